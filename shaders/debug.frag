@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec4 inColor;
+layout(location = 1) in vec3 inNormal;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+	// Just enough shading to make the shape readable
+	vec3 lightDir = normalize(vec3(0.3, 1.0, 0.5));
+	float light = 0.6 + 0.4 * max(dot(normalize(inNormal), lightDir), 0.0);
+	outColor = vec4(inColor.rgb * light, inColor.a);
+}
@@ -0,0 +1,47 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out vec3 outNormal;
+
+layout(buffer_reference, std430) readonly buffer SceneBuffer{
+	mat4 view;
+	mat4 proj;
+	mat4 orthoProj;
+};
+
+struct Vertex {
+	vec3 position;
+	uint color;
+	vec3 normal;
+	float padding;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+	Vertex vertices[];
+};
+
+struct Instance {
+	mat4 model;
+	vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{
+	Instance instances[];
+};
+
+layout(push_constant) uniform constants{
+	SceneBuffer sceneBuffer;
+	VertexBuffer vertexBuffer;
+	InstanceBuffer instanceBuffer;
+} PushConstants;
+
+void main() {
+	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	Instance instance = PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+	SceneBuffer sc = PushConstants.sceneBuffer;
+
+	gl_Position = sc.proj * sc.view * instance.model * vec4(v.position, 1.0);
+	outColor = unpackUnorm4x8(v.color) * instance.color;
+	outNormal = mat3(instance.model) * v.normal;
+}
@@ -0,0 +1,5 @@
+#version 450
+
+// Depth only, nothing is written to color
+void main() {
+}
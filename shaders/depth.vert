@@ -0,0 +1,79 @@
+#version 450
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
+
+// Depth prepass, takes the same push constants as mesh.vert and has to
+// compute gl_Position exactly the way it does
+invariant gl_Position;
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+	uint unused[];
+};
+
+// Same as GPUPositionStreamHeader, followed by the positions
+layout(buffer_reference, std430) readonly buffer PositionBuffer{
+	vec3 boundsMin;
+	uint quantized;
+	vec3 boundsScale;
+	uint padding;
+	uint positions[];
+};
+
+vec3 load_position(PositionBuffer positionBuffer, uint index) {
+	if (positionBuffer.quantized != 0) {
+		uint xy = positionBuffer.positions[index * 2];
+		uint z = positionBuffer.positions[index * 2 + 1];
+		vec3 q = vec3(xy & 0xffffu, xy >> 16, z & 0xffffu);
+		return positionBuffer.boundsMin + q * positionBuffer.boundsScale;
+	}
+	return uintBitsToFloat(uvec3(positionBuffer.positions[index * 3],
+		positionBuffer.positions[index * 3 + 1], positionBuffer.positions[index * 3 + 2]));
+}
+
+layout(buffer_reference, std430) readonly buffer SceneBuffer{
+	mat4 view;
+	mat4 proj;
+	mat4 orthoProj;
+};
+
+struct DrawData {
+	mat4 model;
+	VertexBuffer vertexBuffer;
+	PositionBuffer positionBuffer;
+	uint materialID;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+layout(push_constant) uniform constants{
+	SceneBuffer sceneBuffer;
+	VertexBuffer vertexBuffer;
+	uint64_t materialBuffer;
+	uint64_t lightBuffer;
+	uint lightCount;
+	uint materialID;
+	DrawDataBuffer drawDataBuffer;
+	mat4 model;
+	PositionBuffer positionBuffer;
+} PushConstants;
+
+void main() {
+	PositionBuffer positionBuffer = PushConstants.positionBuffer;
+	mat4 model = PushConstants.model;
+	if (uint64_t(PushConstants.drawDataBuffer) != 0) {
+		DrawData d = PushConstants.drawDataBuffer.draws[gl_InstanceIndex];
+		positionBuffer = d.positionBuffer;
+		model = d.model;
+	}
+
+	vec3 position = load_position(positionBuffer, gl_VertexIndex);
+	SceneBuffer sc = PushConstants.sceneBuffer;
+
+	vec3 fragPos = vec3(model * vec4(position, 1.0));
+	gl_Position = sc.proj * sc.view * vec4(fragPos, 1.0f);
+}
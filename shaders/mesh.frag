@@ -1,14 +1,17 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
 #extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 
 layout (location = 0) in vec2 inUV;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec3 fragPos;
+layout (location = 3) flat in uint inMaterialID;
 
 layout (location = 0) out vec4 outFragColor;
 
-layout (set = 0, binding = 0) uniform sampler2D Textures[];
+layout (set = 0, binding = 0) uniform texture2D Textures[];
+layout (set = 0, binding = 2) uniform sampler Samplers[];
 
 struct Vertex {
 	vec3 position;
@@ -26,15 +29,34 @@ layout(buffer_reference, std430) readonly buffer SceneBuffer{
 	mat4 view;
 	mat4 proj;
 	mat4 orthoProj;
+	// Bindless slots, see GPUSceneData
+	uint shadowMapTexture;
+	uint skyboxTexture;
+	uint linearSampler;
+	uint trilinearSampler;
+	vec3 viewPos;
 };
 
 struct Material {
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	float shininess;
+	vec4 baseColorFactor;
+	vec3 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaCutoff;
+	uint baseColorTexture;
+	uint metallicRoughnessTexture;
+	uint normalTexture;
+	uint occlusionTexture;
+	uint emissiveTexture;
+	uint flags;
 };
 
+// Same as MATERIAL_* in vk_types.h
+#define MATERIAL_NO_TEXTURE			0xffffffffu
+#define MATERIAL_ALPHA_MASK_BIT		1u
+#define MATERIAL_ALPHA_BLEND_BIT	2u
+#define MATERIAL_DOUBLE_SIDED_BIT	4u
+
 layout(buffer_reference, std430) readonly buffer MaterialBuffer{
 	Material materials[];
 };
@@ -64,70 +86,116 @@ layout(push_constant) uniform constants{
 	LightBuffer lightBuffer;
 	uint lightCount;
 	uint materialID;
+	uint64_t drawDataBuffer;
 	mat4 model;
-	vec3 viewPos;
+	uint64_t positionBuffer;
 } PushConstants;
 
+#define PI 3.14159265359
+
+// Surface values after the material's textures have been applied
+struct SurfaceParams {
+	vec3 albedo;
+	float metallic;
+	float roughness;
+	vec3 normal;
+};
+
+vec4 sample_material(uint slot, vec4 fallback) {
+	if (slot == MATERIAL_NO_TEXTURE) {
+		return fallback;
+	}
+	SceneBuffer sc = PushConstants.sceneBuffer;
+	return texture(sampler2D(Textures[nonuniformEXT(slot)],
+		Samplers[sc.trilinearSampler]), inUV);
+}
+
+// There are no vertex tangents, the tangent frame comes from the screen
+// space derivatives of the position and uvs
+vec3 perturb_normal(vec3 normal, vec3 tangentNormal) {
+	vec3 dp1 = dFdx(fragPos);
+	vec3 dp2 = dFdy(fragPos);
+	vec2 duv1 = dFdx(inUV);
+	vec2 duv2 = dFdy(inUV);
+
+	vec3 dp2perp = cross(dp2, normal);
+	vec3 dp1perp = cross(normal, dp1);
+	vec3 T = dp2perp * duv1.x + dp1perp * duv2.x;
+	vec3 B = dp2perp * duv1.y + dp1perp * duv2.y;
+	float invmax = inversesqrt(max(dot(T, T), dot(B, B)));
+	if (isinf(invmax) || isnan(invmax)) {
+		return normal;
+	}
+	return normalize(mat3(T * invmax, B * invmax, normal) * tangentNormal);
+}
+
+float distribution_ggx(float NdotH, float roughness) {
+	float a = roughness * roughness;
+	float a2 = a * a;
+	float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+	return a2 / (PI * d * d);
+}
+
+float geometry_smith(float NdotV, float NdotL, float roughness) {
+	float r = roughness + 1.0;
+	float k = (r * r) / 8.0;
+	float gv = NdotV / (NdotV * (1.0 - k) + k);
+	float gl = NdotL / (NdotL * (1.0 - k) + k);
+	return gv * gl;
+}
+
+vec3 fresnel_schlick(float cosTheta, vec3 F0) {
+	return F0 + (1.0 - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+// Outgoing radiance towards the viewer for light arriving along lightDir
+vec3 brdf(SurfaceParams s, vec3 lightDir, vec3 viewDir, vec3 radiance) {
+	vec3 halfwayDir = normalize(lightDir + viewDir);
+	float NdotL = max(dot(s.normal, lightDir), 0.0);
+	float NdotV = max(dot(s.normal, viewDir), 1e-4);
+	float NdotH = max(dot(s.normal, halfwayDir), 0.0);
+
+	vec3 F0 = mix(vec3(0.04), s.albedo, s.metallic);
+	vec3 F = fresnel_schlick(max(dot(halfwayDir, viewDir), 0.0), F0);
+	float D = distribution_ggx(NdotH, s.roughness);
+	float G = geometry_smith(NdotV, NdotL, s.roughness);
+
+	vec3 specular = D * G * F / (4.0 * NdotV * NdotL + 1e-4);
+	vec3 kD = (vec3(1.0) - F) * (1.0 - s.metallic);
+	return (kD * s.albedo / PI + specular) * radiance * NdotL;
+}
+
 float calc_shadow(vec4 fragPosLightSpace, vec3 normal, vec3 lightDir) {
 	vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
 	projCoords.xy = projCoords.xy * 0.5 + 0.5;
-	float closestDepth = texture(Textures[4], projCoords.xy).r;
+	SceneBuffer sc = PushConstants.sceneBuffer;
+	float closestDepth = texture(sampler2D(Textures[sc.shadowMapTexture],
+		Samplers[sc.linearSampler]), projCoords.xy).r;
 	float currentDepth = projCoords.z;
 	float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
 	float shadow = currentDepth - bias > closestDepth ? 1.0 : 0.0;
 	return shadow;
 }
 
-vec3 calc_directional_light(Light light, vec3 normal, vec3 viewDir) {
-	Material material = PushConstants.materialBuffer.materials[PushConstants.materialID];
-	vec3 lightColor = light.color * light.intensity;
-
+vec3 calc_directional_light(Light light, SurfaceParams s, vec3 viewDir) {
 	vec3 lightDir = normalize(-light.direction);
-	vec3 halfwayDir = normalize(lightDir + viewDir);
-	// diffuse shading
-	float diff = max(dot(normal, lightDir), 0.0);
-	//specular shading
-	float spec = pow(max(dot(viewDir, halfwayDir), 0.0), material.shininess);
-	// combine results
-	vec3 ambient = lightColor;
-	vec3 diffuse = diff * lightColor;
-	vec3 specular = spec * lightColor; 
+	vec3 radiance = light.color * light.intensity;
 	vec4 fragPosLightSpace = light.spaceMatrix * vec4(fragPos, 1.0);
-	float shadow = calc_shadow(fragPosLightSpace, normal, lightDir);
-	return (ambient + (1.0 - shadow) * (diffuse + specular)) * material.diffuse;
+	float shadow = calc_shadow(fragPosLightSpace, s.normal, lightDir);
+	return (1.0 - shadow) * brdf(s, lightDir, viewDir, radiance);
 }
 
-vec3 calc_point_light(Light light, vec3 normal, vec3 fragPos, vec3 viewDir) {
-	Material material = PushConstants.materialBuffer.materials[PushConstants.materialID];
-
+vec3 calc_point_light(Light light, SurfaceParams s, vec3 fragPos, vec3 viewDir) {
 	vec3 lightDir = normalize(light.position - fragPos);
-	vec3 halfwayDir = normalize(lightDir + viewDir);
-	// diffuse shading
-	float diff = max(dot(normal, lightDir), 0.0);
-	//specular shading
-	float spec = pow(max(dot(viewDir, halfwayDir), 0.0), 32);
 	// attenuation
 	float distance = length(light.position - fragPos);
 	float attenuation = 1.0 / (light.constant + light.linear * distance +
 							light.quadratic * (distance * distance));
-	vec3 ambient = light.color * material.ambient;
-	vec3 diffuse = light.color * diff * material.diffuse;
-	vec3 specular = light.color * spec * material.specular;
-	ambient *= attenuation;
-	diffuse *= attenuation;
-	specular *= attenuation;
-	return (ambient + diffuse + specular);
+	return brdf(s, lightDir, viewDir, light.color * attenuation);
 }
 
-vec3 calc_spot_light(Light light, vec3 normal, vec3 fragPos, vec3 viewDir) {
-	Material material = PushConstants.materialBuffer.materials[PushConstants.materialID];
-	
+vec3 calc_spot_light(Light light, SurfaceParams s, vec3 fragPos, vec3 viewDir) {
 	vec3 lightDir = normalize(light.position - fragPos);
-	vec3 halfwayDir = normalize(lightDir + viewDir);
-	// diffuse shading
-	float diff = max(dot(normal, lightDir), 0.0);
-	// specular shading
-	float spec = pow(max(dot(viewDir, halfwayDir), 0.0), material.shininess);	
 	// attenuation
 	float distance = length(light.position - fragPos);
 	float attenuation = 1.0 / (light.constant + light.linear * distance +
@@ -136,34 +204,59 @@ vec3 calc_spot_light(Light light, vec3 normal, vec3 fragPos, vec3 viewDir) {
 	float theta = dot(lightDir, normalize(-light.direction));
 	float epsilon = light.innerAngle - light.outerAngle;
 	float intensity = clamp((theta - light.outerAngle) / epsilon, 0.0, 1.0);
-	// combine results
-	vec3 ambient = light.color * material.ambient;
-	vec3 diffuse = light.color * diff * material.diffuse;
-	vec3 specular = light.color * spec * material.specular;
-	ambient *= attenuation * intensity;
-	diffuse *= attenuation * intensity;
-	specular *= attenuation * intensity;
-	return (ambient + diffuse + specular);
+	return brdf(s, lightDir, viewDir, light.color * attenuation * intensity);
 }
 
 void main()
 {
-	vec3 result = vec3(0.0);
+	Material material = PushConstants.materialBuffer.materials[inMaterialID];
+
+	vec4 baseColor = material.baseColorFactor *
+		sample_material(material.baseColorTexture, vec4(1.0));
+	if ((material.flags & MATERIAL_ALPHA_MASK_BIT) != 0 &&
+		baseColor.a < material.alphaCutoff) {
+		discard;
+	}
+
 	vec3 normal = normalize(inNormal);
-	vec3 viewDir = normalize(PushConstants.viewPos - fragPos);
+	if ((material.flags & MATERIAL_DOUBLE_SIDED_BIT) != 0 && !gl_FrontFacing) {
+		normal = -normal;
+	}
+	if (material.normalTexture != MATERIAL_NO_TEXTURE) {
+		vec3 tangentNormal = sample_material(material.normalTexture, vec4(0.5, 0.5, 1.0, 1.0)).xyz;
+		normal = perturb_normal(normal, tangentNormal * 2.0 - 1.0);
+	}
+
+	vec4 metallicRoughness = sample_material(material.metallicRoughnessTexture, vec4(1.0));
+	SurfaceParams s;
+	s.albedo = baseColor.rgb;
+	s.metallic = clamp(material.metallicFactor * metallicRoughness.b, 0.0, 1.0);
+	s.roughness = clamp(material.roughnessFactor * metallicRoughness.g, 0.04, 1.0);
+	s.normal = normal;
+
+	vec3 viewDir = normalize(PushConstants.sceneBuffer.viewPos - fragPos);
+	vec3 result = vec3(0.0);
 
 	LightBuffer lightBuffer = PushConstants.lightBuffer;
 	for (int i = 0; i < PushConstants.lightCount; i++) {
 		Light light = lightBuffer.lights[i];
 
 		if (light.type == 0) { // Directional light
-			result += calc_directional_light(light, normal, viewDir);
+			result += calc_directional_light(light, s, viewDir);
 		} else if (light.type == 1) { // Point light
-			result += calc_point_light(light, normal, fragPos, viewDir);
+			result += calc_point_light(light, s, fragPos, viewDir);
 		} else if (light.type == 2) { // Spot light 
-			result += calc_spot_light(light, normal, fragPos, viewDir);
+			result += calc_spot_light(light, s, fragPos, viewDir);
 		}
 		
 	}
-	outFragColor = vec4(result, 1.0);
+
+	// Constant ambient until there is image based lighting
+	float occlusion = sample_material(material.occlusionTexture, vec4(1.0)).r;
+	result += 0.03 * s.albedo * occlusion;
+	result += material.emissiveFactor *
+		sample_material(material.emissiveTexture, vec4(1.0)).rgb;
+
+	float alpha = (material.flags & MATERIAL_ALPHA_BLEND_BIT) != 0 ? baseColor.a : 1.0;
+	outFragColor = vec4(result, alpha);
 }
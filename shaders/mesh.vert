@@ -1,10 +1,16 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
 #extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 
 layout (location = 0) out vec2 outUV;
 layout (location = 1) out vec3 outNormal;
 layout (location = 2) out vec3 fragPos;
+layout (location = 3) flat out uint outMaterialID;
+
+// The depth prepass (depth.vert) has to produce the same depth for the
+// EQUAL test to pass
+invariant gl_Position;
 
 
 struct Vertex {
@@ -25,11 +31,38 @@ layout(buffer_reference, std430) readonly buffer SceneBuffer{
 	mat4 orthoProj;
 };
 
+// Same as GPUPositionStreamHeader, followed by the positions
+layout(buffer_reference, std430) readonly buffer PositionBuffer{
+	vec3 boundsMin;
+	uint quantized;
+	vec3 boundsScale;
+	uint padding;
+	uint positions[];
+};
+
+vec3 load_position(PositionBuffer positionBuffer, uint index) {
+	if (positionBuffer.quantized != 0) {
+		uint xy = positionBuffer.positions[index * 2];
+		uint z = positionBuffer.positions[index * 2 + 1];
+		vec3 q = vec3(xy & 0xffffu, xy >> 16, z & 0xffffu);
+		return positionBuffer.boundsMin + q * positionBuffer.boundsScale;
+	}
+	return uintBitsToFloat(uvec3(positionBuffer.positions[index * 3],
+		positionBuffer.positions[index * 3 + 1], positionBuffer.positions[index * 3 + 2]));
+}
+
 struct Material {
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	float shininess;
+	vec4 baseColorFactor;
+	vec3 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaCutoff;
+	uint baseColorTexture;
+	uint metallicRoughnessTexture;
+	uint normalTexture;
+	uint occlusionTexture;
+	uint emissiveTexture;
+	uint flags;
 };
 
 layout(buffer_reference, std430) readonly buffer MaterialBuffer{
@@ -54,6 +87,19 @@ layout(buffer_reference, std430) readonly buffer LightBuffer {
 	Light lights[];
 };
 
+struct DrawData {
+	mat4 model;
+	VertexBuffer vertexBuffer;
+	PositionBuffer positionBuffer;
+	uint materialID;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
 
 layout(push_constant) uniform constants{
 	SceneBuffer sceneBuffer;
@@ -62,20 +108,37 @@ layout(push_constant) uniform constants{
 	LightBuffer lightBuffer;
 	uint lightCount;
 	uint materialID;
+	DrawDataBuffer drawDataBuffer;
 	mat4 model;
-	vec3 viewPos;
+	PositionBuffer positionBuffer;
 } PushConstants;
 
 void main() {
+	// retained objects fetch their per-draw data through the instance index,
+	// immediate draws pass everything in the push constants
+	VertexBuffer vertexBuffer = PushConstants.vertexBuffer;
+	PositionBuffer positionBuffer = PushConstants.positionBuffer;
+	mat4 model = PushConstants.model;
+	uint materialID = PushConstants.materialID;
+	if (uint64_t(PushConstants.drawDataBuffer) != 0) {
+		DrawData d = PushConstants.drawDataBuffer.draws[gl_InstanceIndex];
+		vertexBuffer = d.vertexBuffer;
+		positionBuffer = d.positionBuffer;
+		model = d.model;
+		materialID = d.materialID;
+	}
+
 	// load vertex data from device address
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	Vertex v = vertexBuffer.vertices[gl_VertexIndex];
 	SceneBuffer sc = PushConstants.sceneBuffer;
 
 	// output data
 	outUV.x = v.uv_x;
 	outUV.y = v.uv_y;
-	outNormal = mat3(transpose(inverse(PushConstants.model))) * 
+	outNormal = mat3(transpose(inverse(model))) * 
 		v.normal;
-	fragPos = vec3(PushConstants.model * vec4(v.position, 1.0));
+	// The position comes from the same stream the depth prepass reads
+	fragPos = vec3(model * vec4(load_position(positionBuffer, gl_VertexIndex), 1.0));
+	outMaterialID = materialID;
 	gl_Position = sc.proj * sc.view * vec4(fragPos, 1.0f);
 }
@@ -1,26 +1,62 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 
-struct Vertex {
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+	uint unused[];
 };
 
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-	Vertex vertices[];
+// Same as GPUPositionStreamHeader, followed by the positions
+layout(buffer_reference, std430) readonly buffer PositionBuffer{
+	vec3 boundsMin;
+	uint quantized;
+	vec3 boundsScale;
+	uint padding;
+	uint positions[];
+};
+
+vec3 load_position(PositionBuffer positionBuffer, uint index) {
+	if (positionBuffer.quantized != 0) {
+		uint xy = positionBuffer.positions[index * 2];
+		uint z = positionBuffer.positions[index * 2 + 1];
+		vec3 q = vec3(xy & 0xffffu, xy >> 16, z & 0xffffu);
+		return positionBuffer.boundsMin + q * positionBuffer.boundsScale;
+	}
+	return uintBitsToFloat(uvec3(positionBuffer.positions[index * 3],
+		positionBuffer.positions[index * 3 + 1], positionBuffer.positions[index * 3 + 2]));
+}
+
+struct DrawData {
+	mat4 model;
+	VertexBuffer vertexBuffer;
+	PositionBuffer positionBuffer;
+	uint materialID;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer {
+	DrawData draws[];
 };
 
 layout(push_constant) uniform constants {
 	mat4 model;
 	mat4 lightSpaceMatrix;	
-	VertexBuffer vertexBuffer;
+	PositionBuffer positionBuffer;
+	DrawDataBuffer drawDataBuffer;
 } pc;
 
 void main() {
-	Vertex v = pc.vertexBuffer.vertices[gl_VertexIndex];
-	gl_Position = pc.lightSpaceMatrix * pc.model 
-		* vec4(v.position, 1.0);
+	PositionBuffer positionBuffer = pc.positionBuffer;
+	mat4 model = pc.model;
+	if (uint64_t(pc.drawDataBuffer) != 0) {
+		DrawData d = pc.drawDataBuffer.draws[gl_InstanceIndex];
+		positionBuffer = d.positionBuffer;
+		model = d.model;
+	}
+
+	vec3 position = load_position(positionBuffer, gl_VertexIndex);
+	gl_Position = pc.lightSpaceMatrix * model 
+		* vec4(position, 1.0);
 }
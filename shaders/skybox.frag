@@ -1,11 +1,15 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 texCoords;
+// Texture and sampler slots
+layout(location = 1) flat in uvec2 skybox;
 
 layout(location = 0) out vec4 outColor;
 
-layout (set = 0, binding = 0) uniform samplerCube Textures[];
+layout (set = 0, binding = 0) uniform textureCube Textures[];
+layout (set = 0, binding = 2) uniform sampler Samplers[];
 
 void main() {
-	outColor = texture(Textures[1], texCoords);
+	outColor = texture(samplerCube(Textures[skybox.x], Samplers[skybox.y]), texCoords);
 }
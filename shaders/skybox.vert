@@ -2,6 +2,7 @@
 #extension GL_EXT_buffer_reference : require
 
 layout(location = 0) out vec3 texCoords;
+layout(location = 1) out uvec2 skybox;
 
 struct Vertex {
 	vec3 position;
@@ -19,6 +20,11 @@ layout(buffer_reference, std430) readonly buffer SceneBuffer{
 	mat4 view;
 	mat4 proj;
 	mat4 orthoProj;
+	// Bindless slots, see GPUSceneData
+	uint shadowMapTexture;
+	uint skyboxTexture;
+	uint linearSampler;
+	uint trilinearSampler;
 };
 
 layout(push_constant) uniform constants{
@@ -36,4 +42,5 @@ void main() {
 
 	gl_Position = pos.xyww;
 	texCoords = v.position;
+	skybox = uvec2(sc.skyboxTexture, sc.trilinearSampler);
 }
@@ -2,14 +2,23 @@
 #extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec2 uv;
-layout(location = 1) in vec3 inColor;
+layout(location = 1) in vec4 inColor;
 layout(location = 2) flat in uint fontIndex;
+layout(location = 3) flat in uint samplerIndex;
 
 layout(location = 0) out vec4 outColor;
 
-layout (set = 0, binding = 0) uniform sampler2D Textures[];
+layout (set = 0, binding = 0) uniform texture2D Textures[];
+layout (set = 0, binding = 2) uniform sampler Samplers[];
 
+// Font atlases are R8 signed distance fields with the glyph edge at 0.5
+// (SDF_ON_EDGE). Antialiasing over one screen pixel keeps edges sharp at
+// whatever size the glyph is drawn.
 void main() {
-	vec4 sampledColor = texture(Textures[fontIndex], uv);
-	outColor = vec4(inColor * sampledColor.rgb, sampledColor.a);
+	// Glyphs of one draw can come from different pages
+	float dist = texture(sampler2D(Textures[nonuniformEXT(fontIndex)],
+		Samplers[samplerIndex]), uv).r;
+	float width = max(fwidth(dist), 1e-4);
+	float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+	outColor = vec4(inColor.rgb, inColor.a * alpha);
 }
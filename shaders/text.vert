@@ -2,47 +2,76 @@
 #extension GL_EXT_buffer_reference : require
 
 layout(location = 0) out vec2 outUV;
-layout(location = 1) out vec3 outColor;
+layout(location = 1) out vec4 outColor;
 layout(location = 2) out uint fontIndex;
+layout(location = 3) out uint samplerIndex;
 
-struct Vertex {
-	vec3 position;
-	vec2 uv;
-	vec3 color;
-	uint fontIndex;
+// 16 bytes per glyph, see GPUGlyphInstance
+struct GlyphInstance {
+	vec2 position;
+	uint glyph;
+	uint color;
 };
 
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-	Vertex vertices[];
+// Quad corners relative to the pen position in units of the font's base
+// size and atlas uvs, see GPUGlyph
+struct Glyph {
+	vec4 plane;
+	vec4 uv;
+};
+
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{
+	GlyphInstance instances[];
+};
+
+layout(buffer_reference, std430) readonly buffer GlyphBuffer{
+	Glyph glyphs[];
 };
 
 layout(buffer_reference, std430) readonly buffer SceneBuffer{
 	mat4 view;
 	mat4 proj;
 	mat4 orthoProj;
+	// Bindless slots, see GPUSceneData
+	uint shadowMapTexture;
+	uint skyboxTexture;
+	uint linearSampler;
+	uint trilinearSampler;
 };
 
 layout(push_constant) uniform constants{
 	SceneBuffer sceneBuffer;
-	VertexBuffer vertexBuffer;
-	VertexBuffer DONT_USE;
-	VertexBuffer DONT_USE_LIGHT_BUFFER;
-	uint DONT_USE_EITHER;
-	mat4 model;
-	vec3 viewPos;
+	InstanceBuffer instanceBuffer;
+	GlyphBuffer glyphBuffer;
 } PushConstants;
 
+// Two triangles, (x0, y1) (x0, y0) (x1, y0) and (x0, y1) (x1, y0) (x1, y1)
+const uvec2 corners[6] = uvec2[](
+	uvec2(0, 1), uvec2(0, 0), uvec2(1, 0),
+	uvec2(0, 1), uvec2(1, 0), uvec2(1, 1)
+);
+
 void main() {
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	GlyphInstance inst = PushConstants.instanceBuffer.instances[gl_InstanceIndex];
+	// 12 bits glyph, 10 bits texture, 10 bits pixel size (GLYPH_*_BITS)
+	Glyph g = PushConstants.glyphBuffer.glyphs[inst.glyph & 0xfff];
+	float size = float(inst.glyph >> 22);
 	SceneBuffer sc = PushConstants.sceneBuffer;
-	mat4 view = mat4(1.0);
+
+	// Distance fields scale fine, no snapping to whole pixels
+	vec2 p0 = inst.position + g.plane.xy * size;
+	vec2 p1 = inst.position + g.plane.zw * size;
+
+	uvec2 corner = corners[gl_VertexIndex];
+	vec2 position = vec2(corner.x == 0 ? p0.x : p1.x, corner.y == 0 ? p0.y : p1.y);
+	vec2 uv = vec2(corner.x == 0 ? g.uv.x : g.uv.z, corner.y == 0 ? g.uv.y : g.uv.w);
 
 	// output data
-	vec4 pos = sc.orthoProj * view * 
-		vec4(v.position, 1.0f);
+	vec4 pos = sc.orthoProj * vec4(position, 0.0, 1.0);
 	gl_Position = vec4(pos.x, pos.y, 1, pos.w);
 
-	outUV = v.uv;
-	outColor = v.color;
-	fontIndex = v.fontIndex;
+	outUV = uv;
+	outColor = unpackUnorm4x8(inst.color);
+	fontIndex = (inst.glyph >> 12) & 0x3ff;
+	samplerIndex = sc.linearSampler;
 }
@@ -1,6 +1,7 @@
 #version 450
 #extension GL_EXT_buffer_reference : require
 #extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 
 
 struct Vertex {
@@ -22,10 +23,17 @@ layout(buffer_reference, std430) readonly buffer SceneBuffer{
 };
 
 struct Material {
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
-	float shininess;
+	vec4 baseColorFactor;
+	vec3 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	float alphaCutoff;
+	uint baseColorTexture;
+	uint metallicRoughnessTexture;
+	uint normalTexture;
+	uint occlusionTexture;
+	uint emissiveTexture;
+	uint flags;
 };
 
 layout(buffer_reference, std430) readonly buffer MaterialBuffer{
@@ -96,19 +104,42 @@ layout(buffer_reference, std430) readonly buffer LightBuffer {
 
 //<-----------------------------------------------------------------------------------
 
-layout(push_constant) uniform constants{
-	SceneBuffer sceneBuffer;
+struct DrawData {
+	mat4 model;
 	VertexBuffer vertexBuffer;
-	MaterialBuffer materialBuffer;
-	LightBuffer lightBuffer;
+	uint64_t positionBuffer;
 	uint materialID;
+	uint padding0;
+	uint padding1;
+	uint padding2;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+
+layout(push_constant) uniform constants{
 	mat4 model;
-	vec3 viewPos;
+	vec4 color;
+	SceneBuffer sceneBuffer;
+	VertexBuffer vertexBuffer;
+	DrawDataBuffer drawDataBuffer;
 } PushConstants;
 
+layout(location = 0) out vec4 outColor;
+
 void main() {
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	VertexBuffer vertexBuffer = PushConstants.vertexBuffer;
+	mat4 model = PushConstants.model;
+	if (uint64_t(PushConstants.drawDataBuffer) != 0) {
+		DrawData d = PushConstants.drawDataBuffer.draws[gl_InstanceIndex];
+		vertexBuffer = d.vertexBuffer;
+		model = d.model;
+	}
+
+	Vertex v = vertexBuffer.vertices[gl_VertexIndex];
 	SceneBuffer sc = PushConstants.sceneBuffer;
 
-	gl_Position = sc.proj * sc.view * PushConstants.model * vec4(v.position, 1.0); 
+	gl_Position = sc.proj * sc.view * model * vec4(v.position, 1.0); 
+	outColor = PushConstants.color;
 }
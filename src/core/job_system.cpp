@@ -0,0 +1,266 @@
+#include "job_system.h"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Index of the worker running on this thread, external threads have
+// MAX_JOB_THREADS
+static thread_local uint32_t tWorkerIndex = MAX_JOB_THREADS;
+
+static uint64_t
+now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void
+pin_thread(std::thread* pThread, uint32_t core) {
+#if defined(_WIN32)
+	SetThreadAffinityMask(pThread->native_handle(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(pThread->native_handle(), sizeof(cpu_set_t), &set);
+#else
+	(void)pThread;
+	(void)core;
+#endif
+}
+
+void
+JobScheduler::init(const JobSchedulerInfo* pInfo) {
+	uint32_t cores = std::thread::hardware_concurrency();
+	_workerCount = pInfo->threadCount;
+	if (_workerCount == 0) {
+		_workerCount = cores > 1 ? cores - 1 : 1;
+	}
+	if (_workerCount > MAX_JOB_THREADS) {
+		_workerCount = MAX_JOB_THREADS;
+	}
+
+	_quit = 0;
+	for (uint32_t i = 0; i < _workerCount; i++) {
+		_threads[i] = std::thread(&JobScheduler::worker_main, this, i);
+		if (pInfo->pinThreads && cores > 1) {
+			pin_thread(&_threads[i], (i + 1) % cores);
+		}
+	}
+	_lastSampleNs = now_ns();
+
+	fprintf(stderr, "[JobScheduler] Started %u workers%s.\n", _workerCount,
+		pInfo->pinThreads ? " (pinned)" : "");
+}
+
+void
+JobScheduler::deinit() {
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_quit = 1;
+	}
+	_sleepCondition.notify_all();
+
+	for (uint32_t i = 0; i < _workerCount; i++) {
+		if (_threads[i].joinable()) {
+			_threads[i].join();
+		}
+	}
+	_workerCount = 0;
+}
+
+void
+JobScheduler::submit(JobFn fn, void* pData, JobPriority priority, JobCounter* pCounter) {
+	if (pCounter != nullptr) {
+		pCounter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	uint32_t queueIndex = tWorkerIndex;
+	if (queueIndex >= _workerCount) {
+		queueIndex = _nextQueue.fetch_add(1, std::memory_order_relaxed) % _workerCount;
+	}
+
+	// Counted before the push, under the queue lock, so a worker can't pop
+	// the job and decrement the count before it was incremented
+	{
+		std::lock_guard<std::mutex> lock(_queues[queueIndex].mutex);
+		_queuedJobs.fetch_add(1, std::memory_order_release);
+		_queues[queueIndex].jobs[priority].push_back({ fn, pData, pCounter });
+	}
+
+	// Taking the lock orders this with a worker that is about to sleep,
+	// otherwise the notify could land between its check and its wait
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+	}
+	_sleepCondition.notify_one();
+}
+
+void
+JobScheduler::wait(JobCounter* pCounter) {
+	uint32_t threadIndex = tWorkerIndex < _workerCount ? tWorkerIndex : MAX_JOB_THREADS;
+	while (pCounter->pending.load(std::memory_order_acquire) > 0) {
+		if (!try_run_job(threadIndex)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+struct ParallelForBatch {
+	ParallelForFn	fn;
+	void*			pData;
+	uint32_t		begin;
+	uint32_t		end;
+};
+
+static void
+parallel_for_job(void* pData) {
+	ParallelForBatch* batch = (ParallelForBatch*)pData;
+	batch->fn(batch->begin, batch->end, batch->pData);
+}
+
+void
+JobScheduler::parallel_for(uint32_t count, uint32_t batchSize, ParallelForFn fn,
+	void* pData, JobPriority priority) {
+	if (count == 0) {
+		return;
+	}
+	if (batchSize == 0) {
+		batchSize = 1;
+	}
+
+	uint32_t batchCount = (count + batchSize - 1) / batchSize;
+	if (batchCount == 1) {
+		fn(0, count, pData);
+		return;
+	}
+
+	// The batches outlive the jobs since wait() doesn't return before them
+	std::vector<ParallelForBatch> batches(batchCount);
+	JobCounter counter;
+	for (uint32_t i = 0; i < batchCount; i++) {
+		batches[i].fn = fn;
+		batches[i].pData = pData;
+		batches[i].begin = i * batchSize;
+		batches[i].end = (i + 1) * batchSize < count ? (i + 1) * batchSize : count;
+		submit(parallel_for_job, &batches[i], priority, &counter);
+	}
+	wait(&counter);
+}
+
+void
+JobScheduler::sample_stats(JobThreadStats* pStats) {
+	uint64_t now = now_ns();
+	uint64_t elapsed = now - _lastSampleNs;
+	_lastSampleNs = now;
+
+	for (uint32_t i = 0; i <= _workerCount; i++) {
+		// The external slot is stored last, after the unused worker slots
+		uint32_t slot = i < _workerCount ? i : MAX_JOB_THREADS;
+		ThreadCounters* c = &_counters[slot];
+
+		uint64_t busy = c->busyNs.load(std::memory_order_relaxed);
+		uint64_t executed = c->jobsExecuted.load(std::memory_order_relaxed);
+		uint64_t stolen = c->jobsStolen.load(std::memory_order_relaxed);
+
+		pStats[i].jobsExecuted = executed - _lastJobsExecuted[slot];
+		pStats[i].jobsStolen = stolen - _lastJobsStolen[slot];
+		pStats[i].utilization = elapsed > 0 ?
+			(float)(busy - _lastBusyNs[slot]) / (float)elapsed : 0.f;
+
+		_lastBusyNs[slot] = busy;
+		_lastJobsExecuted[slot] = executed;
+		_lastJobsStolen[slot] = stolen;
+	}
+}
+
+void
+JobScheduler::worker_main(uint32_t index) {
+	tWorkerIndex = index;
+
+	while (!_quit.load(std::memory_order_acquire)) {
+		if (try_run_job(index)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_sleepCondition.wait(lock, [this] {
+			return _queuedJobs.load(std::memory_order_acquire) > 0 ||
+				_quit.load(std::memory_order_acquire);
+		});
+	}
+}
+
+uint32_t
+JobScheduler::pop_job(uint32_t queueIndex, JobPriority priority, uint32_t steal, Job* pJob) {
+	WorkerQueue* queue = &_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	std::deque<Job>& jobs = queue->jobs[priority];
+	if (jobs.empty()) {
+		return 0;
+	}
+
+	// The owner takes the newest job (still hot in cache), thieves take
+	// the oldest one
+	if (steal) {
+		*pJob = jobs.front();
+		jobs.pop_front();
+	} else {
+		*pJob = jobs.back();
+		jobs.pop_back();
+	}
+	return 1;
+}
+
+uint32_t
+JobScheduler::try_run_job(uint32_t threadIndex) {
+	if (_queuedJobs.load(std::memory_order_acquire) == 0) {
+		return 0;
+	}
+
+	Job job;
+	uint32_t found = 0;
+	uint32_t stolen = 0;
+	for (uint32_t p = 0; p < JOB_PRIORITY_COUNT && !found; p++) {
+		JobPriority priority = (JobPriority)p;
+		if (threadIndex < _workerCount) {
+			found = pop_job(threadIndex, priority, 0, &job);
+		}
+		for (uint32_t i = 1; i <= _workerCount && !found; i++) {
+			uint32_t victim = (threadIndex + i) % _workerCount;
+			if (victim == threadIndex) {
+				continue;
+			}
+			found = pop_job(victim, priority, 1, &job);
+			stolen = found;
+		}
+	}
+	if (!found) {
+		return 0;
+	}
+	_queuedJobs.fetch_sub(1, std::memory_order_acq_rel);
+
+	uint64_t start = now_ns();
+	job.fn(job.pData);
+	uint64_t end = now_ns();
+
+	ThreadCounters* c = &_counters[threadIndex < _workerCount ? threadIndex : MAX_JOB_THREADS];
+	c->busyNs.fetch_add(end - start, std::memory_order_relaxed);
+	c->jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+	if (stolen) {
+		c->jobsStolen.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (job.pCounter != nullptr) {
+		job.pCounter->pending.fetch_sub(1, std::memory_order_release);
+	}
+	return 1;
+}
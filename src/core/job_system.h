@@ -0,0 +1,117 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#define MAX_JOB_THREADS		64
+
+enum JobPriority : uint32_t {
+	JOB_PRIORITY_HIGH = 0,
+	JOB_PRIORITY_NORMAL = 1,
+	JOB_PRIORITY_LOW = 2,
+	JOB_PRIORITY_COUNT = 3
+};
+
+typedef void (*JobFn)(void* pData);
+typedef void (*ParallelForFn)(uint32_t begin, uint32_t end, void* pData);
+
+// Counts the outstanding jobs of a group, see JobScheduler::wait()
+struct JobCounter {
+	std::atomic<uint32_t>	pending = 0;
+};
+
+struct JobSchedulerInfo {
+	// 0 uses one worker per core minus the main thread
+	uint32_t				threadCount = 0;
+	// Pins worker i to core i + 1, leaving core 0 to the main thread
+	uint32_t				pinThreads = 0;
+};
+
+struct JobThreadStats {
+	uint64_t				jobsExecuted;
+	uint64_t				jobsStolen;
+	// Fraction of the sample interval spent running jobs
+	float					utilization;
+};
+
+/*
+* Engine-wide work-stealing thread pool. Every worker owns one deque per
+* priority, jobs submitted from a worker go to its own deque (newest first)
+* and idle workers steal the oldest job from the others. Jobs submitted from
+* outside the pool are spread round-robin.
+*
+* Physics runs on this pool through JoltJobSystem (physics/phys_jobs.h),
+* so nothing else should spin up its own worker threads.
+*/
+class JobScheduler {
+public:
+	void					init(const JobSchedulerInfo* pInfo);
+	void					deinit();
+
+	// pCounter (may be nullptr) is incremented now and decremented once the
+	// job has finished
+	void					submit(JobFn fn, void* pData, JobPriority priority,
+								JobCounter* pCounter);
+
+	// Runs queued jobs on the calling thread until pCounter reaches zero
+	void					wait(JobCounter* pCounter);
+
+	// Splits [0, count) into batches of batchSize and waits for all of them
+	void					parallel_for(uint32_t count, uint32_t batchSize,
+								ParallelForFn fn, void* pData, JobPriority priority);
+
+	uint32_t				get_worker_count() { return _workerCount; }
+
+	// Fills pStats[0.._workerCount] with the stats since the last call, the
+	// last entry accounts for non-worker threads helping out in wait()
+	void					sample_stats(JobThreadStats* pStats);
+
+private:
+	struct Job {
+		JobFn				fn;
+		void*				pData;
+		JobCounter*			pCounter;
+	};
+
+	struct alignas(64) WorkerQueue {
+		std::mutex			mutex;
+		std::deque<Job>		jobs[JOB_PRIORITY_COUNT];
+	};
+
+	struct alignas(64) ThreadCounters {
+		std::atomic<uint64_t> busyNs = 0;
+		std::atomic<uint64_t> jobsExecuted = 0;
+		std::atomic<uint64_t> jobsStolen = 0;
+	};
+
+	void					worker_main(uint32_t index);
+	uint32_t				try_run_job(uint32_t threadIndex);
+	uint32_t				pop_job(uint32_t queueIndex, JobPriority priority,
+								uint32_t steal, Job* pJob);
+
+	std::thread				_threads[MAX_JOB_THREADS];
+	WorkerQueue				_queues[MAX_JOB_THREADS];
+	// One extra slot for threads outside the pool
+	ThreadCounters			_counters[MAX_JOB_THREADS + 1];
+	uint32_t				_workerCount = 0;
+
+	std::atomic<uint32_t>	_queuedJobs = 0;
+	std::atomic<uint32_t>	_nextQueue = 0;
+	std::atomic<uint32_t>	_quit = 0;
+
+	std::mutex				_sleepMutex;
+	std::condition_variable	_sleepCondition;
+
+	uint64_t				_lastSampleNs = 0;
+	uint64_t				_lastBusyNs[MAX_JOB_THREADS + 1] = {};
+	uint64_t				_lastJobsExecuted[MAX_JOB_THREADS + 1] = {};
+	uint64_t				_lastJobsStolen[MAX_JOB_THREADS + 1] = {};
+};
+
+#endif /* JOB_SYSTEM_H */
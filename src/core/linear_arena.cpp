@@ -0,0 +1,94 @@
+#include "linear_arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void
+LinearArena::init(size_t capacity) {
+	_blockCount = 0;
+	_capacity = 0;
+	_blockAllocations = 0;
+	add_block(capacity);
+	reset();
+	_highWater = 0;
+}
+
+void
+LinearArena::deinit() {
+	for (uint32_t i = 0; i < _blockCount; i++) {
+		free(_blocks[i].pData);
+		_blocks[i] = {};
+	}
+	_blockCount = 0;
+	_capacity = 0;
+	_offset = 0;
+	_used = 0;
+}
+
+uint32_t
+LinearArena::add_block(size_t size) {
+	if (_blockCount >= MAX_ARENA_BLOCKS) {
+		return 0;
+	}
+	uint8_t* pData = (uint8_t*)malloc(size);
+	if (pData == nullptr) {
+		return 0;
+	}
+	_blocks[_blockCount++] = { pData, size };
+	_capacity += size;
+	_offset = 0;
+	_blockAllocations++;
+	return 1;
+}
+
+void*
+LinearArena::alloc(size_t size, size_t alignment) {
+	Block* block = &_blocks[_blockCount - 1];
+	size_t offset = (_offset + alignment - 1) & ~(alignment - 1);
+	if (offset + size > block->size) {
+		// Chain on a block at least as big as everything so far, the chain
+		// gets merged into one block on the next reset
+		size_t blockSize = _capacity > size + alignment ? _capacity : size + alignment;
+		if (!add_block(blockSize)) {
+			fprintf(stderr, "[LinearArena] Failed to grow arena by %zu bytes.\n", blockSize);
+			return nullptr;
+		}
+		// malloc'd blocks are aligned for any of the types we store
+		block = &_blocks[_blockCount - 1];
+		offset = 0;
+	}
+
+	_offset = offset + size;
+	_used += size;
+	if (_used > _highWater) {
+		_highWater = _used;
+	}
+	return block->pData + offset;
+}
+
+void
+LinearArena::reset() {
+	if (_blockCount > 1) {
+		// One block sized for the worst frame so far replaces the chain
+		size_t capacity = _capacity;
+		for (uint32_t i = 0; i < _blockCount; i++) {
+			free(_blocks[i].pData);
+			_blocks[i] = {};
+		}
+		_blockCount = 0;
+		_capacity = 0;
+		add_block(capacity);
+	}
+	_offset = 0;
+	_used = 0;
+}
+
+LinearArenaStats
+LinearArena::get_stats() const {
+	LinearArenaStats stats;
+	stats.capacity = _capacity;
+	stats.used = _used;
+	stats.highWater = _highWater;
+	stats.blockAllocations = _blockAllocations;
+	return stats;
+}
@@ -0,0 +1,125 @@
+#ifndef LINEAR_ARENA_H
+#define LINEAR_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_ARENA_BLOCKS	16
+
+struct LinearArenaStats {
+	size_t				capacity;
+	size_t				used;
+	// Most bytes ever used between two resets
+	size_t				highWater;
+	// Times a new block had to be allocated, stays flat after warm-up
+	uint32_t			blockAllocations;
+};
+
+/*
+* Bump allocator for data that lives for one frame. Allocations are never
+* freed individually, reset() drops everything at once.
+*
+* If a frame needs more than the arena holds, another block is chained on.
+* The next reset() replaces the chain with a single block big enough for
+* the high-water mark, so after warm-up a frame does no heap allocations.
+*/
+class LinearArena {
+public:
+	void				init(size_t capacity);
+	void				deinit();
+
+	void*				alloc(size_t size, size_t alignment);
+	void				reset();
+
+	size_t				get_used() const { return _used; }
+	size_t				get_high_water() const { return _highWater; }
+	LinearArenaStats	get_stats() const;
+
+private:
+	struct Block {
+		uint8_t*		pData;
+		size_t			size;
+	};
+
+	uint32_t			add_block(size_t size);
+
+	Block				_blocks[MAX_ARENA_BLOCKS] = {};
+	uint32_t			_blockCount = 0;
+	// Bump offset into the last block
+	size_t				_offset = 0;
+
+	size_t				_capacity = 0;
+	size_t				_used = 0;
+	size_t				_highWater = 0;
+	uint32_t			_blockAllocations = 0;
+};
+
+/*
+* Minimal array living in a LinearArena, for the per-frame lists in the
+* DrawContext. It remembers how many elements it held last frame and
+* reserves that much on the first push after a reset, so in steady state
+* it makes one arena allocation per frame and never copies.
+*
+* Only for trivially copyable types, nothing is constructed or destroyed.
+*/
+template <typename T>
+class ArenaArray {
+public:
+	void				set_arena(LinearArena* pArena) { _pArena = pArena; }
+
+	void push_back(const T& value) {
+		if (_size == _capacity) {
+			grow(_size + 1);
+		}
+		_pData[_size++] = value;
+	}
+
+	// Appends 'count' uninitialized elements and returns the first
+	T* push_n(size_t count) {
+		if (_size + count > _capacity) {
+			grow(_size + count);
+		}
+		T* first = _pData + _size;
+		_size += count;
+		return first;
+	}
+
+	// The memory belongs to the arena, this only forgets it. Must be called
+	// whenever the arena is reset.
+	void clear() {
+		_lastSize = _size;
+		_pData = nullptr;
+		_size = 0;
+		_capacity = 0;
+	}
+
+	T*					data() { return _pData; }
+	const T*			data() const { return _pData; }
+	size_t				size() const { return _size; }
+	bool				empty() const { return _size == 0; }
+	T&					operator[](size_t i) { return _pData[i]; }
+	const T&			operator[](size_t i) const { return _pData[i]; }
+
+private:
+	void grow(size_t minCapacity) {
+		size_t capacity = _capacity > 0 ? _capacity * 2 : _lastSize;
+		if (capacity < minCapacity) {
+			capacity = minCapacity < 64 ? 64 : minCapacity;
+		}
+		T* pData = (T*)_pArena->alloc(capacity * sizeof(T), alignof(T));
+		if (_size > 0) {
+			memcpy(pData, _pData, _size * sizeof(T));
+		}
+		_pData = pData;
+		_capacity = capacity;
+	}
+
+	LinearArena*		_pArena = nullptr;
+	T*					_pData = nullptr;
+	size_t				_size = 0;
+	size_t				_capacity = 0;
+	size_t				_lastSize = 0;
+};
+
+#endif /* LINEAR_ARENA_H */
@@ -0,0 +1,690 @@
+#include "texture_compress.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fraction of the second endpoint each index stands for
+static const float BC1_WEIGHTS[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+static const int BC7_WEIGHTS_4[16] = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+static float
+clamp_255(float value) {
+	return value < 0.f ? 0.f : (value > 255.f ? 255.f : value);
+}
+
+// Mean and unit length dominant direction of 'count' points of 'dims'
+// channels. The axis is all zeros when every point is the same.
+static void
+principal_axis(const float* pPoints, uint32_t count, uint32_t dims, float* pMean,
+	float* pAxis) {
+	for (uint32_t d = 0; d < dims; d++) {
+		pMean[d] = 0.f;
+		for (uint32_t i = 0; i < count; i++) {
+			pMean[d] += pPoints[i * dims + d];
+		}
+		pMean[d] /= count;
+	}
+
+	float covariance[4][4] = {};
+	for (uint32_t i = 0; i < count; i++) {
+		for (uint32_t a = 0; a < dims; a++) {
+			float da = pPoints[i * dims + a] - pMean[a];
+			for (uint32_t b = a; b < dims; b++) {
+				covariance[a][b] += da * (pPoints[i * dims + b] - pMean[b]);
+			}
+		}
+	}
+	for (uint32_t a = 0; a < dims; a++) {
+		for (uint32_t b = 0; b < a; b++) {
+			covariance[a][b] = covariance[b][a];
+		}
+	}
+
+	// Power iteration from the row of the channel with the most variance
+	uint32_t start = 0;
+	for (uint32_t d = 1; d < dims; d++) {
+		start = covariance[d][d] > covariance[start][start] ? d : start;
+	}
+	float axis[4] = {};
+	for (uint32_t d = 0; d < dims; d++) {
+		axis[d] = covariance[start][d];
+	}
+	for (uint32_t iteration = 0; iteration < 8; iteration++) {
+		float next[4] = {};
+		float largest = 0.f;
+		for (uint32_t a = 0; a < dims; a++) {
+			for (uint32_t b = 0; b < dims; b++) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			largest = fabsf(next[a]) > largest ? fabsf(next[a]) : largest;
+		}
+		if (largest == 0.f) {
+			break;
+		}
+		for (uint32_t d = 0; d < dims; d++) {
+			axis[d] = next[d] / largest;
+		}
+	}
+
+	float length = 0.f;
+	for (uint32_t d = 0; d < dims; d++) {
+		length += axis[d] * axis[d];
+	}
+	length = sqrtf(length);
+	for (uint32_t d = 0; d < dims; d++) {
+		pAxis[d] = length > 0.f ? axis[d] / length : 0.f;
+	}
+}
+
+// Endpoints at the two extremes of the points along their principal axis
+static void
+axis_endpoints(const float* pPoints, uint32_t dims, float* pE0, float* pE1) {
+	float mean[4], axis[4];
+	principal_axis(pPoints, 16, dims, mean, axis);
+	float tMin = 0.f, tMax = 0.f;
+	for (uint32_t i = 0; i < 16; i++) {
+		float t = 0.f;
+		for (uint32_t d = 0; d < dims; d++) {
+			t += (pPoints[i * dims + d] - mean[d]) * axis[d];
+		}
+		tMin = t < tMin ? t : tMin;
+		tMax = t > tMax ? t : tMax;
+	}
+	for (uint32_t d = 0; d < dims; d++) {
+		pE0[d] = clamp_255(mean[d] + axis[d] * tMax);
+		pE1[d] = clamp_255(mean[d] + axis[d] * tMin);
+	}
+}
+
+// Least squares endpoints for the indices already picked, each point being
+// (1 - w) * e0 + w * e1. Returns 0 when the system is singular (all
+// points use the same index).
+static uint32_t
+refine_endpoints(const float* pPoints, uint32_t dims, const uint8_t* pIndices,
+	const float* pWeights, float* pE0, float* pE1) {
+	float a = 0.f, b = 0.f, c = 0.f;
+	float d0[4] = {}, d1[4] = {};
+	for (uint32_t i = 0; i < 16; i++) {
+		float w = pWeights[pIndices[i]];
+		a += (1.f - w) * (1.f - w);
+		b += (1.f - w) * w;
+		c += w * w;
+		for (uint32_t d = 0; d < dims; d++) {
+			d0[d] += (1.f - w) * pPoints[i * dims + d];
+			d1[d] += w * pPoints[i * dims + d];
+		}
+	}
+	float det = a * c - b * b;
+	if (fabsf(det) < 1e-6f) {
+		return 0;
+	}
+	for (uint32_t d = 0; d < dims; d++) {
+		pE0[d] = clamp_255((c * d0[d] - b * d1[d]) / det);
+		pE1[d] = clamp_255((a * d1[d] - b * d0[d]) / det);
+	}
+	return 1;
+}
+
+/*  ============================================================================
+ *  BC1
+ *  ============================================================================
+ */
+
+static uint16_t
+pack_565(const float* pColor) {
+	uint32_t r = (uint32_t)(pColor[0] * 31.f / 255.f + 0.5f);
+	uint32_t g = (uint32_t)(pColor[1] * 63.f / 255.f + 0.5f);
+	uint32_t b = (uint32_t)(pColor[2] * 31.f / 255.f + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void
+unpack_565(uint16_t value, int* pColor) {
+	int r = (value >> 11) & 31;
+	int g = (value >> 5) & 63;
+	int b = value & 31;
+	pColor[0] = (r << 3) | (r >> 2);
+	pColor[1] = (g << 2) | (g >> 4);
+	pColor[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the closest of the four colors for every point, c0 > c1 is made
+// sure of so the block decodes in four color mode. Returns the error.
+static float
+bc1_fit(uint16_t* pC0, uint16_t* pC1, const float* pPoints, uint8_t* pIndices) {
+	if (*pC0 < *pC1) {
+		uint16_t swap = *pC0;
+		*pC0 = *pC1;
+		*pC1 = swap;
+	}
+
+	int palette[4][3];
+	unpack_565(*pC0, palette[0]);
+	unpack_565(*pC1, palette[1]);
+	for (uint32_t c = 0; c < 3; c++) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+	// Equal endpoints would mean three color mode, index 0 is the color
+	uint32_t paletteSize = *pC0 == *pC1 ? 1 : 4;
+
+	float error = 0.f;
+	for (uint32_t i = 0; i < 16; i++) {
+		float best = 1e30f;
+		for (uint32_t p = 0; p < paletteSize; p++) {
+			float distance = 0.f;
+			for (uint32_t c = 0; c < 3; c++) {
+				float diff = pPoints[i * 3 + c] - palette[p][c];
+				distance += diff * diff;
+			}
+			if (distance < best) {
+				best = distance;
+				pIndices[i] = (uint8_t)p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+static void
+bc1_encode_color(const uint8_t* pRgba, uint8_t* pOut) {
+	float points[16 * 3];
+	for (uint32_t i = 0; i < 16; i++) {
+		for (uint32_t c = 0; c < 3; c++) {
+			points[i * 3 + c] = pRgba[i * 4 + c];
+		}
+	}
+
+	float e0[3], e1[3];
+	axis_endpoints(points, 3, e0, e1);
+	uint16_t c0 = pack_565(e0), c1 = pack_565(e1);
+	uint8_t indices[16];
+	float error = bc1_fit(&c0, &c1, points, indices);
+
+	if (refine_endpoints(points, 3, indices, BC1_WEIGHTS, e0, e1)) {
+		uint16_t r0 = pack_565(e0), r1 = pack_565(e1);
+		uint8_t refined[16];
+		float refinedError = bc1_fit(&r0, &r1, points, refined);
+		if (refinedError < error) {
+			c0 = r0;
+			c1 = r1;
+			memcpy(indices, refined, sizeof(indices));
+		}
+	}
+
+	uint32_t bits = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		bits |= (uint32_t)indices[i] << (2 * i);
+	}
+	pOut[0] = (uint8_t)(c0 & 0xff);
+	pOut[1] = (uint8_t)(c0 >> 8);
+	pOut[2] = (uint8_t)(c1 & 0xff);
+	pOut[3] = (uint8_t)(c1 >> 8);
+	for (uint32_t b = 0; b < 4; b++) {
+		pOut[4 + b] = (uint8_t)(bits >> (8 * b));
+	}
+}
+
+// BC2/BC3 color blocks are always four color, BC1 has a three color +
+// transparent mode when c0 <= c1
+static void
+bc1_decode_color(const uint8_t* pBlock, uint8_t* pRgba, uint32_t alwaysFourColor) {
+	uint16_t c0 = (uint16_t)(pBlock[0] | (pBlock[1] << 8));
+	uint16_t c1 = (uint16_t)(pBlock[2] | (pBlock[3] << 8));
+	int palette[4][4];
+	unpack_565(c0, palette[0]);
+	unpack_565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	for (uint32_t c = 0; c < 3; c++) {
+		if (c0 > c1 || alwaysFourColor) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	if (c0 <= c1 && !alwaysFourColor) {
+		palette[3][3] = 0;
+	}
+
+	uint32_t bits = pBlock[4] | (pBlock[5] << 8) | (pBlock[6] << 16) | ((uint32_t)pBlock[7] << 24);
+	for (uint32_t i = 0; i < 16; i++) {
+		const int* color = palette[(bits >> (2 * i)) & 3];
+		for (uint32_t c = 0; c < 4; c++) {
+			pRgba[i * 4 + c] = (uint8_t)color[c];
+		}
+	}
+}
+
+void
+bc1_encode_block(const uint8_t* pRgba, uint8_t* pOut) {
+	bc1_encode_color(pRgba, pOut);
+}
+
+void
+bc1_decode_block(const uint8_t* pBlock, uint8_t* pRgba) {
+	bc1_decode_color(pBlock, pRgba, 0);
+}
+
+/*  ============================================================================
+ *  BC4 / BC3 / BC5
+ *  ============================================================================
+ */
+
+static void
+bc4_palette(int a0, int a1, int* pPalette) {
+	pPalette[0] = a0;
+	pPalette[1] = a1;
+	if (a0 > a1) {
+		for (int i = 1; i < 7; i++) {
+			pPalette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+		}
+	} else {
+		for (int i = 1; i < 5; i++) {
+			pPalette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		}
+		pPalette[6] = 0;
+		pPalette[7] = 255;
+	}
+}
+
+void
+bc4_encode_block(const uint8_t* pValues, uint8_t* pOut) {
+	int lowest = 255, highest = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		lowest = pValues[i] < lowest ? pValues[i] : lowest;
+		highest = pValues[i] > highest ? pValues[i] : highest;
+	}
+	// highest > lowest selects the eight value mode, equal values decode
+	// to index 0 in either mode
+	pOut[0] = (uint8_t)highest;
+	pOut[1] = (uint8_t)lowest;
+
+	uint64_t bits = 0;
+	if (highest > lowest) {
+		int palette[8];
+		bc4_palette(highest, lowest, palette);
+		for (uint32_t i = 0; i < 16; i++) {
+			uint32_t bestIndex = 0;
+			int best = 256;
+			for (uint32_t p = 0; p < 8; p++) {
+				int distance = abs(pValues[i] - palette[p]);
+				if (distance < best) {
+					best = distance;
+					bestIndex = p;
+				}
+			}
+			bits |= (uint64_t)bestIndex << (3 * i);
+		}
+	}
+	for (uint32_t b = 0; b < 6; b++) {
+		pOut[2 + b] = (uint8_t)(bits >> (8 * b));
+	}
+}
+
+void
+bc4_decode_block(const uint8_t* pBlock, uint8_t* pValues) {
+	int palette[8];
+	bc4_palette(pBlock[0], pBlock[1], palette);
+	uint64_t bits = 0;
+	for (uint32_t b = 0; b < 6; b++) {
+		bits |= (uint64_t)pBlock[2 + b] << (8 * b);
+	}
+	for (uint32_t i = 0; i < 16; i++) {
+		pValues[i] = (uint8_t)palette[(bits >> (3 * i)) & 7];
+	}
+}
+
+static void
+extract_channel(const uint8_t* pRgba, uint32_t channel, uint8_t* pValues) {
+	for (uint32_t i = 0; i < 16; i++) {
+		pValues[i] = pRgba[i * 4 + channel];
+	}
+}
+
+void
+bc3_encode_block(const uint8_t* pRgba, uint8_t* pOut) {
+	uint8_t alpha[16];
+	extract_channel(pRgba, 3, alpha);
+	bc4_encode_block(alpha, pOut);
+	bc1_encode_color(pRgba, pOut + 8);
+}
+
+void
+bc3_decode_block(const uint8_t* pBlock, uint8_t* pRgba) {
+	bc1_decode_color(pBlock + 8, pRgba, 1);
+	uint8_t alpha[16];
+	bc4_decode_block(pBlock, alpha);
+	for (uint32_t i = 0; i < 16; i++) {
+		pRgba[i * 4 + 3] = alpha[i];
+	}
+}
+
+void
+bc5_encode_block(const uint8_t* pRgba, uint8_t* pOut) {
+	uint8_t values[16];
+	extract_channel(pRgba, 0, values);
+	bc4_encode_block(values, pOut);
+	extract_channel(pRgba, 1, values);
+	bc4_encode_block(values, pOut + 8);
+}
+
+void
+bc5_decode_block(const uint8_t* pBlock, uint8_t* pRgba) {
+	uint8_t red[16], green[16];
+	bc4_decode_block(pBlock, red);
+	bc4_decode_block(pBlock + 8, green);
+	for (uint32_t i = 0; i < 16; i++) {
+		pRgba[i * 4 + 0] = red[i];
+		pRgba[i * 4 + 1] = green[i];
+		pRgba[i * 4 + 2] = 0;
+		pRgba[i * 4 + 3] = 255;
+	}
+}
+
+/*  ============================================================================
+ *  BC7 (mode 6)
+ *  ============================================================================
+ */
+
+struct BitStream {
+	uint8_t*		pData;
+	uint32_t		position;
+};
+
+static void
+write_bits(BitStream* pStream, uint32_t value, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++, pStream->position++) {
+		if ((value >> i) & 1) {
+			pStream->pData[pStream->position >> 3] |= (uint8_t)(1 << (pStream->position & 7));
+		}
+	}
+}
+
+static uint32_t
+read_bits(const uint8_t* pData, uint32_t* pPosition, uint32_t count) {
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < count; i++, (*pPosition)++) {
+		value |= (uint32_t)((pData[*pPosition >> 3] >> (*pPosition & 7)) & 1) << i;
+	}
+	return value;
+}
+
+// Mode 6 endpoints are 7 bits per channel plus a p-bit shared by the four
+// channels, picks whichever p-bit gets closer
+static void
+bc7_quantize_endpoint(const float* pEndpoint, uint8_t* pColor, uint8_t* pPBit) {
+	float bestError = 1e30f;
+	for (uint32_t p = 0; p < 2; p++) {
+		uint8_t color[4];
+		float error = 0.f;
+		for (uint32_t c = 0; c < 4; c++) {
+			float value = (pEndpoint[c] - p) * 0.5f + 0.5f;
+			int quantized = (int)(value < 0.f ? 0.f : value);
+			quantized = quantized > 127 ? 127 : quantized;
+			color[c] = (uint8_t)quantized;
+			float diff = (float)((quantized << 1) | p) - pEndpoint[c];
+			error += diff * diff;
+		}
+		if (error < bestError) {
+			bestError = error;
+			memcpy(pColor, color, 4);
+			*pPBit = (uint8_t)p;
+		}
+	}
+}
+
+static void
+bc7_palette(const uint8_t pColors[2][4], const uint8_t* pPBits, int palette[16][4]) {
+	int e0[4], e1[4];
+	for (uint32_t c = 0; c < 4; c++) {
+		e0[c] = (pColors[0][c] << 1) | pPBits[0];
+		e1[c] = (pColors[1][c] << 1) | pPBits[1];
+	}
+	for (uint32_t i = 0; i < 16; i++) {
+		int w = BC7_WEIGHTS_4[i];
+		for (uint32_t c = 0; c < 4; c++) {
+			palette[i][c] = ((64 - w) * e0[c] + w * e1[c] + 32) >> 6;
+		}
+	}
+}
+
+static float
+bc7_fit(const uint8_t pColors[2][4], const uint8_t* pPBits, const float* pPoints,
+	uint8_t* pIndices) {
+	int palette[16][4];
+	bc7_palette(pColors, pPBits, palette);
+	float error = 0.f;
+	for (uint32_t i = 0; i < 16; i++) {
+		float best = 1e30f;
+		for (uint32_t p = 0; p < 16; p++) {
+			float distance = 0.f;
+			for (uint32_t c = 0; c < 4; c++) {
+				float diff = pPoints[i * 4 + c] - palette[p][c];
+				distance += diff * diff;
+			}
+			if (distance < best) {
+				best = distance;
+				pIndices[i] = (uint8_t)p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+void
+bc7_encode_block(const uint8_t* pRgba, uint8_t* pOut) {
+	float points[16 * 4];
+	for (uint32_t i = 0; i < 16 * 4; i++) {
+		points[i] = pRgba[i];
+	}
+
+	float e0[4], e1[4];
+	axis_endpoints(points, 4, e0, e1);
+	uint8_t colors[2][4], pBits[2];
+	bc7_quantize_endpoint(e0, colors[0], &pBits[0]);
+	bc7_quantize_endpoint(e1, colors[1], &pBits[1]);
+	uint8_t indices[16];
+	float error = bc7_fit(colors, pBits, points, indices);
+
+	float weights[16];
+	for (uint32_t i = 0; i < 16; i++) {
+		weights[i] = BC7_WEIGHTS_4[i] / 64.f;
+	}
+	if (refine_endpoints(points, 4, indices, weights, e0, e1)) {
+		uint8_t refinedColors[2][4], refinedPBits[2], refined[16];
+		bc7_quantize_endpoint(e0, refinedColors[0], &refinedPBits[0]);
+		bc7_quantize_endpoint(e1, refinedColors[1], &refinedPBits[1]);
+		float refinedError = bc7_fit(refinedColors, refinedPBits, points, refined);
+		if (refinedError < error) {
+			memcpy(colors, refinedColors, sizeof(colors));
+			memcpy(pBits, refinedPBits, sizeof(pBits));
+			memcpy(indices, refined, sizeof(indices));
+		}
+	}
+
+	// The first index is stored without its top bit, which has to be 0
+	if (indices[0] & 8) {
+		for (uint32_t c = 0; c < 4; c++) {
+			uint8_t swap = colors[0][c];
+			colors[0][c] = colors[1][c];
+			colors[1][c] = swap;
+		}
+		uint8_t swap = pBits[0];
+		pBits[0] = pBits[1];
+		pBits[1] = swap;
+		for (uint32_t i = 0; i < 16; i++) {
+			indices[i] = (uint8_t)(15 - indices[i]);
+		}
+	}
+
+	memset(pOut, 0, 16);
+	BitStream stream = { pOut, 0 };
+	write_bits(&stream, 1 << 6, 7);
+	for (uint32_t c = 0; c < 4; c++) {
+		write_bits(&stream, colors[0][c], 7);
+		write_bits(&stream, colors[1][c], 7);
+	}
+	write_bits(&stream, pBits[0], 1);
+	write_bits(&stream, pBits[1], 1);
+	write_bits(&stream, indices[0], 3);
+	for (uint32_t i = 1; i < 16; i++) {
+		write_bits(&stream, indices[i], 4);
+	}
+}
+
+uint32_t
+bc7_decode_block(const uint8_t* pBlock, uint8_t* pRgba) {
+	if ((pBlock[0] & 0x7f) != 0x40) {
+		for (uint32_t i = 0; i < 16; i++) {
+			pRgba[i * 4 + 0] = 255;
+			pRgba[i * 4 + 1] = 0;
+			pRgba[i * 4 + 2] = 255;
+			pRgba[i * 4 + 3] = 255;
+		}
+		return 0;
+	}
+
+	uint32_t position = 7;
+	uint8_t colors[2][4], pBits[2];
+	for (uint32_t c = 0; c < 4; c++) {
+		colors[0][c] = (uint8_t)read_bits(pBlock, &position, 7);
+		colors[1][c] = (uint8_t)read_bits(pBlock, &position, 7);
+	}
+	pBits[0] = (uint8_t)read_bits(pBlock, &position, 1);
+	pBits[1] = (uint8_t)read_bits(pBlock, &position, 1);
+
+	int palette[16][4];
+	bc7_palette(colors, pBits, palette);
+	for (uint32_t i = 0; i < 16; i++) {
+		uint32_t index = read_bits(pBlock, &position, i == 0 ? 3 : 4);
+		for (uint32_t c = 0; c < 4; c++) {
+			pRgba[i * 4 + c] = (uint8_t)palette[index][c];
+		}
+	}
+	return 1;
+}
+
+/*  ============================================================================
+ *  IMAGES
+ *  ============================================================================
+ */
+
+void
+texture_compress_rows(TextureFileFormat format, const uint8_t* pRgba, uint32_t width,
+	uint32_t height, uint32_t firstRow, uint32_t rowCount, uint8_t* pOut) {
+	if (!texture_format_is_compressed(format)) {
+		// Rows of 4 texels, so callers can split any format the same way
+		uint32_t first = firstRow * 4;
+		uint32_t last = (firstRow + rowCount) * 4 < height ? (firstRow + rowCount) * 4 : height;
+		if (first < last) {
+			memcpy(pOut + (size_t)first * width * 4, pRgba + (size_t)first * width * 4,
+				(size_t)(last - first) * width * 4);
+		}
+		return;
+	}
+
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blockSize = texture_format_block_size(format);
+	uint8_t texels[16 * 4];
+	for (uint32_t by = firstRow; by < firstRow + rowCount; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			for (uint32_t y = 0; y < 4; y++) {
+				uint32_t sy = by * 4 + y < height ? by * 4 + y : height - 1;
+				for (uint32_t x = 0; x < 4; x++) {
+					uint32_t sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+					memcpy(&texels[(y * 4 + x) * 4], &pRgba[((size_t)sy * width + sx) * 4], 4);
+				}
+			}
+
+			uint8_t* block = pOut + ((size_t)by * blocksX + bx) * blockSize;
+			switch (format) {
+				case TEXTURE_FORMAT_BC1:
+					bc1_encode_block(texels, block);
+					break;
+				case TEXTURE_FORMAT_BC3:
+					bc3_encode_block(texels, block);
+					break;
+				case TEXTURE_FORMAT_BC4: {
+					uint8_t values[16];
+					extract_channel(texels, 0, values);
+					bc4_encode_block(values, block);
+					break;
+				}
+				case TEXTURE_FORMAT_BC5:
+					bc5_encode_block(texels, block);
+					break;
+				case TEXTURE_FORMAT_BC7:
+					bc7_encode_block(texels, block);
+					break;
+				default:
+					break;
+			}
+		}
+	}
+}
+
+void
+texture_compress(TextureFileFormat format, const uint8_t* pRgba, uint32_t width,
+	uint32_t height, uint8_t* pOut) {
+	texture_compress_rows(format, pRgba, width, height, 0, (height + 3) / 4, pOut);
+}
+
+void
+texture_decompress(TextureFileFormat format, const uint8_t* pData, uint32_t width,
+	uint32_t height, uint8_t* pRgba) {
+	if (!texture_format_is_compressed(format)) {
+		memcpy(pRgba, pData, (size_t)width * height * 4);
+		return;
+	}
+
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blocksY = (height + 3) / 4;
+	uint32_t blockSize = texture_format_block_size(format);
+	uint8_t texels[16 * 4];
+	for (uint32_t by = 0; by < blocksY; by++) {
+		for (uint32_t bx = 0; bx < blocksX; bx++) {
+			const uint8_t* block = pData + ((size_t)by * blocksX + bx) * blockSize;
+			switch (format) {
+				case TEXTURE_FORMAT_BC1:
+					bc1_decode_block(block, texels);
+					break;
+				case TEXTURE_FORMAT_BC3:
+					bc3_decode_block(block, texels);
+					break;
+				case TEXTURE_FORMAT_BC4: {
+					uint8_t values[16];
+					bc4_decode_block(block, values);
+					for (uint32_t i = 0; i < 16; i++) {
+						texels[i * 4 + 0] = values[i];
+						texels[i * 4 + 1] = 0;
+						texels[i * 4 + 2] = 0;
+						texels[i * 4 + 3] = 255;
+					}
+					break;
+				}
+				case TEXTURE_FORMAT_BC5:
+					bc5_decode_block(block, texels);
+					break;
+				case TEXTURE_FORMAT_BC7:
+					bc7_decode_block(block, texels);
+					break;
+				default:
+					break;
+			}
+
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; y++) {
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; x++) {
+					memcpy(&pRgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4],
+						&texels[(y * 4 + x) * 4], 4);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef TEXTURE_COMPRESS_H
+#define TEXTURE_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "texture_file.h"
+
+/*
+* CPU encoders and decoders for the block compressed TextureFileFormats.
+* Every block is 4x4 texels, passed as 16 RGBA8 texels in row order.
+*
+* The encoders fit endpoints along the principal axis of the block's
+* colors and refine them once with a least squares fit. That is well short
+* of what dedicated compressors do, but cheap enough to cook every texture
+* in the repo in a few seconds. BC7 only uses mode 6 (one subset, RGBA
+* endpoints, 4 bit indices) and the decoder only reads mode 6.
+*/
+
+void	bc1_encode_block(const uint8_t* pRgba, uint8_t* pOut);
+void	bc1_decode_block(const uint8_t* pBlock, uint8_t* pRgba);
+
+// One channel, pValues holds 16 bytes
+void	bc4_encode_block(const uint8_t* pValues, uint8_t* pOut);
+void	bc4_decode_block(const uint8_t* pBlock, uint8_t* pValues);
+
+void	bc3_encode_block(const uint8_t* pRgba, uint8_t* pOut);
+void	bc3_decode_block(const uint8_t* pBlock, uint8_t* pRgba);
+
+// Red and green only
+void	bc5_encode_block(const uint8_t* pRgba, uint8_t* pOut);
+void	bc5_decode_block(const uint8_t* pBlock, uint8_t* pRgba);
+
+void	bc7_encode_block(const uint8_t* pRgba, uint8_t* pOut);
+// Returns 0 for blocks that aren't mode 6, which decode as magenta
+uint32_t bc7_decode_block(const uint8_t* pBlock, uint8_t* pRgba);
+
+// Compresses block rows [firstRow, firstRow + rowCount) of a tightly packed
+// RGBA8 image into pOut (the whole level, texture_level_size() bytes).
+// Blocks past the right or bottom edge repeat the last column / row.
+void	texture_compress_rows(TextureFileFormat format, const uint8_t* pRgba,
+			uint32_t width, uint32_t height, uint32_t firstRow, uint32_t rowCount,
+			uint8_t* pOut);
+void	texture_compress(TextureFileFormat format, const uint8_t* pRgba,
+			uint32_t width, uint32_t height, uint8_t* pOut);
+
+// Back to RGBA8 the way the GPU samples it, channels a format doesn't
+// store come out as 0 (alpha as 255)
+void	texture_decompress(TextureFileFormat format, const uint8_t* pData,
+			uint32_t width, uint32_t height, uint8_t* pRgba);
+
+#endif /* TEXTURE_COMPRESS_H */
@@ -0,0 +1,101 @@
+#include "texture_file.h"
+
+#include <string.h>
+
+uint32_t
+texture_format_is_compressed(TextureFileFormat format) {
+	return format != TEXTURE_FORMAT_RGBA8;
+}
+
+uint32_t
+texture_format_block_size(TextureFileFormat format) {
+	switch (format) {
+		case TEXTURE_FORMAT_RGBA8:
+			return 4;
+		case TEXTURE_FORMAT_BC1:
+		case TEXTURE_FORMAT_BC4:
+			return 8;
+		case TEXTURE_FORMAT_BC3:
+		case TEXTURE_FORMAT_BC5:
+		case TEXTURE_FORMAT_BC7:
+			return 16;
+		default:
+			return 0;
+	}
+}
+
+size_t
+texture_level_size(TextureFileFormat format, uint32_t width, uint32_t height) {
+	if (!texture_format_is_compressed(format)) {
+		return (size_t)width * height * texture_format_block_size(format);
+	}
+	size_t blocksX = (width + 3) / 4;
+	size_t blocksY = (height + 3) / 4;
+	return blocksX * blocksY * texture_format_block_size(format);
+}
+
+uint32_t
+texture_file_read_header(FILE* file, TextureFileHeader* pHeader) {
+	if (fread(pHeader, sizeof(*pHeader), 1, file) != 1) {
+		return 1;
+	}
+	if (pHeader->magic != TEXTURE_FILE_MAGIC || pHeader->version != TEXTURE_FILE_VERSION ||
+		pHeader->format >= TEXTURE_FORMAT_COUNT || pHeader->levelCount == 0 ||
+		pHeader->levelCount > TEXTURE_FILE_MAX_LEVELS || pHeader->layerCount == 0 ||
+		pHeader->layerCount > TEXTURE_FILE_MAX_LAYERS ||
+		pHeader->width == 0 || pHeader->height == 0) {
+		return 1;
+	}
+	// floor(log2(max(width, height))) + 1, vkCreateImage rejects anything more
+	uint32_t maxLevels = 1;
+	for (uint32_t size = pHeader->width > pHeader->height ? pHeader->width : pHeader->height;
+		size > 1; size >>= 1) {
+		maxLevels++;
+	}
+	if (pHeader->levelCount > maxLevels) {
+		return 1;
+	}
+	if ((pHeader->flags & TEXTURE_FILE_CUBE) &&
+		(pHeader->layerCount != 6 || pHeader->width != pHeader->height)) {
+		return 1;
+	}
+	for (uint32_t i = 0; i < pHeader->levelCount; i++) {
+		uint32_t width = pHeader->width >> i ? pHeader->width >> i : 1;
+		uint32_t height = pHeader->height >> i ? pHeader->height >> i : 1;
+		if (pHeader->levels[i].size !=
+			texture_level_size(pHeader->format, width, height) * pHeader->layerCount) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+uint32_t
+texture_file_write(const char* path, TextureFileHeader* pHeader,
+	const uint8_t* const* ppLevels) {
+	pHeader->magic = TEXTURE_FILE_MAGIC;
+	pHeader->version = TEXTURE_FILE_VERSION;
+	memset(pHeader->levels, 0, sizeof(pHeader->levels));
+
+	uint64_t offset = sizeof(TextureFileHeader);
+	for (uint32_t i = 0; i < pHeader->levelCount; i++) {
+		uint32_t width = pHeader->width >> i ? pHeader->width >> i : 1;
+		uint32_t height = pHeader->height >> i ? pHeader->height >> i : 1;
+		pHeader->levels[i].offset = offset;
+		pHeader->levels[i].size =
+			texture_level_size(pHeader->format, width, height) * pHeader->layerCount;
+		offset += pHeader->levels[i].size;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		return 1;
+	}
+	uint32_t failed = fwrite(pHeader, sizeof(*pHeader), 1, file) != 1;
+	for (uint32_t i = 0; i < pHeader->levelCount && !failed; i++) {
+		size_t size = (size_t)pHeader->levels[i].size;
+		failed = fwrite(ppLevels[i], 1, size, file) != size;
+	}
+	fclose(file);
+	return failed;
+}
@@ -0,0 +1,79 @@
+#ifndef TEXTURE_FILE_H
+#define TEXTURE_FILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TEXTURE_FILE_MAGIC		0x58455456 // "VTEX"
+#define TEXTURE_FILE_VERSION	1
+#define TEXTURE_FILE_MAX_LEVELS	16
+// The smallest maxImageArrayLayers Vulkan guarantees, so any file that reads
+// can be created on every device
+#define TEXTURE_FILE_MAX_LAYERS	256
+
+// Pixel formats of cooked textures, see texture_cooker. The renderer maps
+// these to VkFormats (the _SRGB variant when TEXTURE_FILE_SRGB is set).
+enum TextureFileFormat : uint32_t {
+	TEXTURE_FORMAT_RGBA8 = 0,
+	// Opaque RGB, 8 bytes per 4x4 block
+	TEXTURE_FORMAT_BC1 = 1,
+	// RGB + smooth alpha, 16 bytes per block
+	TEXTURE_FORMAT_BC3 = 2,
+	// One channel, 8 bytes per block
+	TEXTURE_FORMAT_BC4 = 3,
+	// Two channels (tangent space normals), 16 bytes per block
+	TEXTURE_FORMAT_BC5 = 4,
+	// RGBA at higher quality than BC1/BC3, 16 bytes per block
+	TEXTURE_FORMAT_BC7 = 5,
+	TEXTURE_FORMAT_COUNT
+};
+
+enum TextureFileFlags : uint32_t {
+	TEXTURE_FILE_SRGB = 1 << 0,
+	// Six layers in +X, -X, +Y, -Y, +Z, -Z order
+	TEXTURE_FILE_CUBE = 1 << 1
+};
+
+struct TextureFileLevel {
+	// From the start of the file. A level holds every layer's data back to
+	// back, layer 0 first.
+	uint64_t				offset;
+	uint64_t				size;
+};
+
+/*
+* Cooked texture container, loosely modelled on KTX2: a fixed header with a
+* level index, then the level data, largest level first. Levels are stored
+* exactly as the GPU wants them (rows of 4x4 blocks for the BC formats), so
+* loading is a read straight into a staging buffer.
+*/
+struct TextureFileHeader {
+	uint32_t				magic;
+	uint32_t				version;
+	TextureFileFormat		format;
+	uint32_t				flags;
+	uint32_t				width;
+	uint32_t				height;
+	uint32_t				layerCount;
+	uint32_t				levelCount;
+	TextureFileLevel		levels[TEXTURE_FILE_MAX_LEVELS];
+};
+
+uint32_t	texture_format_is_compressed(TextureFileFormat format);
+// Bytes per 4x4 block, or per pixel for TEXTURE_FORMAT_RGBA8
+uint32_t	texture_format_block_size(TextureFileFormat format);
+// Bytes of one layer of a width x height level
+size_t		texture_level_size(TextureFileFormat format, uint32_t width, uint32_t height);
+
+// Returns 0 when 'file' starts with a header this version can read and that
+// describes a valid image: no more levels than a full mip chain, six square
+// layers for a cube and level sizes that match the format
+uint32_t	texture_file_read_header(FILE* file, TextureFileHeader* pHeader);
+
+// Fills in the level offsets and sizes of pHeader and writes it followed by
+// ppLevels[i] (all layers of level i) for every level. Returns 0 on success.
+uint32_t	texture_file_write(const char* path, TextureFileHeader* pHeader,
+				const uint8_t* const* ppLevels);
+
+#endif /* TEXTURE_FILE_H */
@@ -1,6 +1,7 @@
 #include "ent_manager.h"
 
 #include <stdio.h>
+#include <math.h>
 
 /*
 * This is the default player input handler, it probably belongs somewhere else
@@ -20,8 +21,13 @@ default_player_input_routine(JPH::Character* pCharacter, const bool* pKeyState,
 }
 
 void
-EntityManager::init(PhysicsContext* pPhysicsContext) {
+EntityManager::init(PhysicsContext* pPhysicsContext, VulkanEngine* pVulkanEngine) {
 	_pPhysicsContext = pPhysicsContext;
+	_pVulkanEngine = pVulkanEngine;
+	for (size_t e = 0; e < MAX_ENTITIES; e++) {
+		_renderObjects[e] = INVALID_RENDER_OBJECT;
+		_characterHandles[e] = INVALID_CHARACTER;
+	}
 }
 
 entity_t 
@@ -37,6 +43,7 @@ EntityManager::create_entity() {
 void
 EntityManager::add_transform(entity_t entity, const Transform* transform) {
 	_transforms[entity] = *transform;
+	_transformsDirty.set(entity);
 	_componentMasks[entity].set(TRANSFORM);
 }
 
@@ -55,6 +62,11 @@ EntityManager::remove_transform(entity_t entity) {
 
 void
 EntityManager::add_mesh(entity_t entity, uint32_t meshID) {
+	// The render object is (re)created on the next render update
+	if (_renderObjects[entity] != INVALID_RENDER_OBJECT) {
+		_pVulkanEngine->destroy_render_object(_renderObjects[entity]);
+		_renderObjects[entity] = INVALID_RENDER_OBJECT;
+	}
 	_meshIDs[entity] = meshID;
 	_componentMasks[entity].set(MESH);
 }
@@ -66,12 +78,17 @@ EntityManager::remove_mesh(entity_t entity) {
 			"[EntityManager] ERROR: Attempting to remove mesh when entity does not have one.\n");
 		return;
 	}
+	if (_renderObjects[entity] != INVALID_RENDER_OBJECT) {
+		_pVulkanEngine->destroy_render_object(_renderObjects[entity]);
+		_renderObjects[entity] = INVALID_RENDER_OBJECT;
+	}
 	_meshIDs[entity] = {};
 	_componentMasks[entity].reset(MESH);
 }
 
 void
-EntityManager::add_physics_body(entity_t entity, glm::vec3 extent) {
+EntityManager::add_physics_body(entity_t entity, glm::vec3 extent,
+	JPH::EMotionType motionType) {
 	if (!has_component(entity, TRANSFORM)) {
 		fprintf(stderr,
 			"[EntityManager] ERROR: Entity must have transform in order to add a physics body.\n");
@@ -83,9 +100,51 @@ EntityManager::add_physics_body(entity_t entity, glm::vec3 extent) {
 		return;
 	}
 	JPH::BodyID bodyID = _pPhysicsContext->add_box(_transforms[entity],
-		JPH::Vec3(extent.x, extent.y, extent.z));
+		JPH::Vec3(extent.x, extent.y, extent.z), motionType,
+		default_layer_for_motion_type(motionType));
 	_bodyIDs[entity] = bodyID;
-	_componentMasks->set(PHYSICS_BODY);
+	// Bodies carry entity + 1 so 0 still means "no entity"
+	_pPhysicsContext->get_physics_system()->GetBodyInterface().SetUserData(bodyID, entity + 1);
+	_currPhysicsStates[entity] = { _transforms[entity].position, _transforms[entity].rotation };
+	_prevPhysicsStates[entity] = _currPhysicsStates[entity];
+	_componentMasks[entity].set(PHYSICS_BODY);
+}
+
+void
+EntityManager::add_physics_bodies(const entity_t* pEntities, const glm::vec3* pExtents,
+	uint32_t count, JPH::EMotionType motionType) {
+	if (_pPhysicsContext == nullptr) {
+		fprintf(stderr,
+			"[EntityManager] ERROR: _pPhysicsSystem is nullptr.\n");
+		return;
+	}
+
+	std::vector<Transform> transforms(count);
+	std::vector<JPH::Vec3> extents(count);
+	std::vector<JPH::BodyID> bodyIDs(count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (!has_component(pEntities[i], TRANSFORM)) {
+			fprintf(stderr,
+				"[EntityManager] ERROR: Entity must have transform in order to add a physics body.\n");
+			return;
+		}
+		transforms[i] = _transforms[pEntities[i]];
+		extents[i] = JPH::Vec3(pExtents[i].x, pExtents[i].y, pExtents[i].z);
+	}
+
+	uint32_t added = _pPhysicsContext->add_boxes(transforms.data(), extents.data(),
+		count, motionType, default_layer_for_motion_type(motionType), bodyIDs.data());
+
+	JPH::BodyInterface& bodyInterface =
+		_pPhysicsContext->get_physics_system()->GetBodyInterface();
+	for (uint32_t i = 0; i < added; i++) {
+		entity_t entity = pEntities[i];
+		_bodyIDs[entity] = bodyIDs[i];
+		bodyInterface.SetUserData(bodyIDs[i], entity + 1);
+		_currPhysicsStates[entity] = { _transforms[entity].position, _transforms[entity].rotation };
+		_prevPhysicsStates[entity] = _currPhysicsStates[entity];
+		_componentMasks[entity].set(PHYSICS_BODY);
+	}
 }
 
 void
@@ -95,8 +154,10 @@ EntityManager::remove_physics_body(entity_t entity) {
 			"[EntityManager] ERROR: Attempting to remove physics body when entity does not have one.\n");
 		return;
 	}
+	_pPhysicsContext->remove_body(_bodyIDs[entity]);
 	_bodyIDs[entity] = {};
-	_componentMasks->reset(PHYSICS_BODY);
+	_physicsMoving.reset(entity);
+	_componentMasks[entity].reset(PHYSICS_BODY);
 }
 
 void
@@ -116,8 +177,12 @@ EntityManager::add_player_controller(entity_t entity, float radius, float height
 	PlayerController p;
 	p.active = 1;
 	p.pPhysicsCharacter = _pPhysicsContext->create_character(position, radius, height);
+	_pPhysicsContext->get_physics_system()->GetBodyInterface().SetUserData(
+		p.pPhysicsCharacter->GetBodyID(), entity + 1);
 	p.camera = Camera{ cameraPos };
 	_playerControllers[entity] = p;
+	_currPhysicsStates[entity] = { transform->position, transform->rotation };
+	_prevPhysicsStates[entity] = _currPhysicsStates[entity];
 	_componentMasks[entity].set(PLAYER_CONTROLLER);
 }
 
@@ -129,9 +194,59 @@ EntityManager::remove_player_controller(entity_t entity) {
 		return;
 	}
 	_playerControllers[entity] = {};
+	_physicsMoving.reset(entity);
 	_componentMasks[entity].reset(PLAYER_CONTROLLER);
 }
 
+void
+EntityManager::add_character(entity_t entity, float radius, float height) {
+	if (!has_component(entity, TRANSFORM)) {
+		fprintf(stderr,
+			"[EntityManager] ERROR: Attempting to add character component to entity that does not have a transform\n");
+		return;
+	}
+	Transform* transform = &_transforms[entity];
+	CharacterHandle handle = _pPhysicsContext->create_virtual_character(
+		JPH::Vec3(transform->position.x, transform->position.y, transform->position.z),
+		radius, height);
+	if (handle == INVALID_CHARACTER) {
+		return;
+	}
+	_characterHandles[entity] = handle;
+	_currPhysicsStates[entity] = { transform->position, transform->rotation };
+	_prevPhysicsStates[entity] = _currPhysicsStates[entity];
+	_componentMasks[entity].set(CHARACTER);
+}
+
+void
+EntityManager::remove_character(entity_t entity) {
+	if (!has_component(entity, CHARACTER)) {
+		fprintf(stderr,
+			"[EntityManager] ERROR: Attempting to remove character when entity does not have one.\n");
+		return;
+	}
+	_pPhysicsContext->destroy_virtual_character(_characterHandles[entity]);
+	_characterHandles[entity] = INVALID_CHARACTER;
+	_physicsMoving.reset(entity);
+	_componentMasks[entity].reset(CHARACTER);
+}
+
+void
+EntityManager::set_character_velocity(entity_t entity, glm::vec3 velocity) {
+	if (!has_component(entity, CHARACTER)) {
+		return;
+	}
+	// Face the direction of travel, keep the old facing when standing still
+	glm::vec2 flat(velocity.x, velocity.z);
+	JPH::Quat rotation = _pPhysicsContext->get_character_pool()->get_rotation(
+		_characterHandles[entity]);
+	if (glm::dot(flat, flat) > 1e-6f) {
+		rotation = JPH::Quat::sRotation(JPH::Vec3::sAxisY(), atan2f(flat.x, flat.y));
+	}
+	_pPhysicsContext->set_virtual_character_input(_characterHandles[entity],
+		JPH::Vec3(velocity.x, velocity.y, velocity.z), rotation);
+}
+
 void
 EntityManager::system_player_controller_update(const bool* pKeyState, float relMouseX) {
 	for (size_t e = 0; e < _entitiesCount; e++) {
@@ -144,68 +259,200 @@ EntityManager::system_player_controller_update(const bool* pKeyState, float relM
 	}
 }
 
-// Holy dear fucking lord this is slow as fuck
+void
+EntityManager::read_physics_state(entity_t entity, JPH::BodyInterface& bodyInterface,
+	PhysicsState* pState) {
+	JPH::Vec3 position;
+	JPH::Quat rotation;
+	if (has_component(entity, PLAYER_CONTROLLER)) {
+		JPH::Character* pCharacter = _playerControllers[entity].pPhysicsCharacter;
+		position = pCharacter->GetPosition();
+		rotation = pCharacter->GetRotation();
+	} else if (has_component(entity, CHARACTER)) {
+		CharacterPool* pPool = _pPhysicsContext->get_character_pool();
+		position = JPH::Vec3(pPool->get_position(_characterHandles[entity]));
+		rotation = pPool->get_rotation(_characterHandles[entity]);
+	} else {
+		position = bodyInterface.GetPosition(_bodyIDs[entity]);
+		rotation = bodyInterface.GetRotation(_bodyIDs[entity]);
+	}
+
+	pState->position = glm::vec3{
+		position.GetX(),
+		position.GetY(),
+		position.GetZ()
+	};
+	pState->rotation = glm::quat{
+		rotation.GetW(),
+		rotation.GetX(),
+		rotation.GetY(),
+		rotation.GetZ()
+	};
+}
+
+uint32_t
+EntityManager::has_physics_state(entity_t entity) {
+	return has_component(entity, TRANSFORM) &&
+		(has_component(entity, PHYSICS_BODY) || has_component(entity, PLAYER_CONTROLLER) ||
+		has_component(entity, CHARACTER));
+}
+
+void
+EntityManager::snapshot_physics_states(void* pData) {
+	EntityManager* pManager = (EntityManager*)pData;
+	JPH::BodyInterface& bodyInterface =
+		pManager->_pPhysicsContext->get_physics_system()->GetBodyInterface();
+
+	for (size_t e = 0; e < pManager->_entitiesCount; e++) {
+		if (!pManager->has_physics_state(e)) {
+			continue;
+		}
+		// A sleeping body is still where it was last read
+		if (pManager->has_component(e, PHYSICS_BODY) &&
+			!bodyInterface.IsActive(pManager->_bodyIDs[e])) {
+			pManager->_prevPhysicsStates[e] = pManager->_currPhysicsStates[e];
+			continue;
+		}
+		pManager->read_physics_state(e, bodyInterface, &pManager->_prevPhysicsStates[e]);
+	}
+}
+
 void
 EntityManager::system_physics_update(float dt) {
-	_pPhysicsContext->update(dt);
+	// The previous states are taken right before the last step so the blend
+	// covers exactly one step, however many were taken this frame
+	uint32_t steps = _pPhysicsContext->update(dt, snapshot_physics_states, this);
+	collect_collision_events();
 
-	JPH::PhysicsSystem* pPhysicsSystem = _pPhysicsContext->get_physics_system();
-	JPH::BodyInterface& bodyInterface = pPhysicsSystem->GetBodyInterface();
+	// Only a new step changes the physics states, in between frames we just
+	// move along the blend between them
+	if (steps > 0) {
+		JPH::PhysicsSystem* pPhysicsSystem = _pPhysicsContext->get_physics_system();
+		JPH::BodyInterface& bodyInterface = pPhysicsSystem->GetBodyInterface();
 
-	// Sync entity's physics bodies with their transform
-	for (size_t e = 0; e < _entitiesCount; e++) {
-		if (has_component(e, TRANSFORM)) {
-			if (has_component(e, PHYSICS_BODY)) {
-				Transform* transform = &_transforms[e];
-				JPH::BodyID bodyID = _bodyIDs[e];;
-
-				JPH::Vec3 position = bodyInterface.GetPosition(bodyID);
-				JPH::Quat rotation = bodyInterface.GetRotation(bodyID);
-
-				transform->position = glm::vec3{
-					position.GetX(),
-					position.GetY(),
-					position.GetZ()
-				};
-				transform->rotation = glm::quat{
-					rotation.GetW(),
-					rotation.GetX(),
-					rotation.GetY(),
-					rotation.GetZ()
-				};
+		for (size_t e = 0; e < _entitiesCount; e++) {
+			if (!has_physics_state(e)) {
+				continue;
+			}
+
+			// Sleeping bodies can't have moved, just settle them on their
+			// final state once. Characters never sleep.
+			if (has_component(e, PHYSICS_BODY) &&
+				!bodyInterface.IsActive(_bodyIDs[e])) {
+				if (_physicsMoving.test(e)) {
+					read_physics_state(e, bodyInterface, &_currPhysicsStates[e]);
+					_prevPhysicsStates[e] = _currPhysicsStates[e];
+					_transforms[e].position = _currPhysicsStates[e].position;
+					_transforms[e].rotation = _currPhysicsStates[e].rotation;
+					_transformsDirty.set(e);
+					_physicsMoving.reset(e);
+				}
+				continue;
 			}
-			if (has_component(e, PLAYER_CONTROLLER)) {
-				Transform* transform = &_transforms[e];
-				PlayerController* controller = &_playerControllers[e];
-
-				JPH::Vec3 position = controller->pPhysicsCharacter->GetPosition();
-				JPH::Quat rotation = controller->pPhysicsCharacter->GetRotation();
-
-				transform->position = glm::vec3{
-					position.GetX(),
-					position.GetY(),
-					position.GetZ()
-				};
-				transform->rotation = glm::quat{
-					rotation.GetW(),
-					rotation.GetX(),
-					rotation.GetY(),
-					rotation.GetZ()
-				};
+
+			read_physics_state(e, bodyInterface, &_currPhysicsStates[e]);
+
+			PhysicsState* prev = &_prevPhysicsStates[e];
+			PhysicsState* curr = &_currPhysicsStates[e];
+			if (prev->position != curr->position || prev->rotation != curr->rotation) {
+				_physicsMoving.set(e);
+			} else if (_physicsMoving.test(e)) {
+				_transforms[e].position = curr->position;
+				_transforms[e].rotation = curr->rotation;
+				_transformsDirty.set(e);
+				_physicsMoving.reset(e);
 			}
 		}
 	}
+
+	smooth_physics_transforms();
+}
+
+void
+EntityManager::collect_collision_events() {
+	_collisionEvents.clear();
+
+	const std::vector<PhysicsEvent>& events = _pPhysicsContext->get_events();
+	JPH::BodyInterface& bodyInterface =
+		_pPhysicsContext->get_physics_system()->GetBodyInterface();
+
+	for (size_t i = 0; i < events.size(); i++) {
+		const PhysicsEvent* event = &events[i];
+		uint64 userData1 = event->userData1;
+		uint64 userData2 = event->userData2;
+
+		switch (event->type) {
+		case PHYSICS_EVENT_CONTACT_REMOVED:
+			// Removed contacts don't carry user data, look it up now. This
+			// is 0 if the body has been destroyed in the meantime.
+			userData1 = bodyInterface.GetUserData(event->body1);
+			userData2 = bodyInterface.GetUserData(event->body2);
+			break;
+		case PHYSICS_EVENT_CONTACT_ADDED:
+		case PHYSICS_EVENT_CONTACT_PERSISTED:
+			break;
+		default:
+			continue;
+		}
+
+		// Contacts with bodies that don't belong to an entity are ignored
+		if (userData1 == 0 || userData2 == 0) {
+			continue;
+		}
+
+		CollisionEvent c;
+		c.type = event->type;
+		c.entity1 = static_cast<entity_t>(userData1 - 1);
+		c.entity2 = static_cast<entity_t>(userData2 - 1);
+		c.point = glm::vec3(event->point.x, event->point.y, event->point.z);
+		c.normal = glm::vec3(event->normal.x, event->normal.y, event->normal.z);
+		_collisionEvents.push_back(c);
+	}
+}
+
+void
+EntityManager::smooth_physics_transforms() {
+	float t;
+	switch (_physicsSmoothing) {
+	case PHYSICS_SMOOTHING_INTERPOLATE:
+		t = _pPhysicsContext->get_alpha();
+		break;
+	case PHYSICS_SMOOTHING_EXTRAPOLATE:
+		t = 1.f + _pPhysicsContext->get_alpha();
+		break;
+	default:
+		t = 1.f;
+		break;
+	}
+
+	for (size_t e = 0; e < _entitiesCount; e++) {
+		if (!_physicsMoving.test(e)) {
+			continue;
+		}
+		PhysicsState* prev = &_prevPhysicsStates[e];
+		PhysicsState* curr = &_currPhysicsStates[e];
+
+		_transforms[e].position = glm::mix(prev->position, curr->position, t);
+		_transforms[e].rotation = glm::slerp(prev->rotation, curr->rotation, t);
+		_transformsDirty.set(e);
+	}
 }
 
+// Mesh entities are retained render objects, so only the ones whose
+// transform changed since the last call cost anything here.
 void 
 EntityManager::system_render_update(VulkanEngine* vk) {
 	for (int e = 0; e < _entitiesCount; e++) {
 		if (has_component(e, TRANSFORM) &&
 			has_component(e, MESH)) {
 			Transform* transform = &_transforms[e];
-			uint32_t meshId = _meshIDs[e];
 
-			vk->draw_mesh(meshId, transform);
+			if (_renderObjects[e] == INVALID_RENDER_OBJECT) {
+				_renderObjects[e] = vk->create_render_object(_meshIDs[e], transform);
+			} else if (_transformsDirty.test(e)) {
+				vk->update_render_object(_renderObjects[e], transform);
+			}
 		}
 	}
-}
\ No newline at end of file
+	_transformsDirty.reset();
+}
@@ -16,17 +16,37 @@
 
 typedef uint32_t entity_t;
 
+// How rendered transforms are derived from the last two physics steps.
+// Interpolation is always correct but lags by up to one step, extrapolation
+// has no lag but can overshoot on impacts.
+enum PhysicsSmoothing : uint32_t {
+	PHYSICS_SMOOTHING_NONE = 0,
+	PHYSICS_SMOOTHING_INTERPOLATE = 1,
+	PHYSICS_SMOOTHING_EXTRAPOLATE = 2
+};
+
 enum ComponentId : uint32_t {
 	TRANSFORM = 0,
 	CAMERA = 1,
 	MESH = 2,
 	PHYSICS_BODY = 3,
-	PLAYER_CONTROLLER = 4
+	PLAYER_CONTROLLER = 4,
+	CHARACTER = 5
+};
+
+// Contact between two entities, filled from the physics events after each
+// physics update. point/normal are zero for CONTACT_REMOVED.
+struct CollisionEvent {
+	PhysicsEventType			type;
+	entity_t					entity1;
+	entity_t					entity2;
+	glm::vec3					point;
+	glm::vec3					normal;
 };
 
 class EntityManager {
 public:
-	void init(PhysicsContext* pPhysicsContext);
+	void init(PhysicsContext* pPhysicsContext, VulkanEngine* pVulkanEngine);
 
 	uint32_t has_component(entity_t entity, uint32_t id) {
 		return _componentMasks[entity].test(id);
@@ -48,19 +68,52 @@ public:
 	void		add_mesh(entity_t entity, uint32_t meshID);
 	void		remove_mesh(entity_t entity);
 
-	void		add_physics_body(entity_t entity, glm::vec3 extent);
+	void		add_physics_body(entity_t entity, glm::vec3 extent,
+					JPH::EMotionType motionType);
+	// Bulk version of add_physics_body() for level loading, every entity
+	// must already have a transform
+	void		add_physics_bodies(const entity_t* pEntities, const glm::vec3* pExtents,
+					uint32_t count, JPH::EMotionType motionType);
 	void		remove_physics_body(entity_t entity);
 
 	void		add_player_controller(entity_t entity, float radius, float height,
 					glm::vec3 cameraPos);
 	void		remove_player_controller(entity_t entity);
 
+	// NPC characters from the physics context's CharacterPool
+	void		add_character(entity_t entity, float radius, float height);
+	void		remove_character(entity_t entity);
+	void		set_character_velocity(entity_t entity, glm::vec3 velocity);
+
 
 	void		system_player_controller_update(const bool* pKeyState, float relMouseX);
 	void		system_physics_update(float dt);
 	void		system_render_update(VulkanEngine* pVulkanEngine);
 
+	// Collisions from the last system_physics_update()
+	const std::vector<CollisionEvent>& get_collision_events() { return _collisionEvents; }
+
+	void		set_physics_smoothing(PhysicsSmoothing smoothing) {
+		_physicsSmoothing = smoothing;
+	}
+
+	// Public for the ImGui combo in the edit state
+	PhysicsSmoothing			_physicsSmoothing = PHYSICS_SMOOTHING_INTERPOLATE;
+
 private:
+	struct PhysicsState {
+		glm::vec3				position;
+		glm::quat				rotation;
+	};
+
+	void		read_physics_state(entity_t entity, JPH::BodyInterface& bodyInterface,
+					PhysicsState* pState);
+	uint32_t	has_physics_state(entity_t entity);
+	// Passed to PhysicsContext::update(), fills _prevPhysicsStates
+	static void	snapshot_physics_states(void* pData);
+	void		smooth_physics_transforms();
+	void		collect_collision_events();
+
 	std::bitset<MAX_COMPONENTS> _componentMasks[MAX_ENTITIES] = {};
 	uint32_t					_entitiesCount = 0;
 
@@ -70,10 +123,24 @@ private:
 
 	Transform					_transforms[MAX_ENTITIES] = {};
 	uint32_t					_meshIDs[MAX_ENTITIES] = {};
+	RenderObjectHandle			_renderObjects[MAX_ENTITIES];
+	// Entities whose transform changed since the last render update
+	std::bitset<MAX_ENTITIES>	_transformsDirty;
 	JPH::BodyID					_bodyIDs[MAX_ENTITIES] = {};
 	PlayerController			_playerControllers[MAX_ENTITIES] = {};
+	CharacterHandle				_characterHandles[MAX_ENTITIES];
+
+	// The physics states before and after the last step, the rendered
+	// transform is blended between these
+	PhysicsState				_prevPhysicsStates[MAX_ENTITIES] = {};
+	PhysicsState				_currPhysicsStates[MAX_ENTITIES] = {};
+	// Entities whose last two states differ, everything else is at rest
+	std::bitset<MAX_ENTITIES>	_physicsMoving;
+
+	std::vector<CollisionEvent>	_collisionEvents;
 
 	PhysicsContext*				_pPhysicsContext = nullptr;
+	VulkanEngine*				_pVulkanEngine = nullptr;
 };
 
 
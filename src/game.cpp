@@ -2,13 +2,26 @@
 
 void
 Game::init() {
+	JobSchedulerInfo jobInfo = {};
+	jobScheduler.init(&jobInfo);
+
+	vulkanEngine.pJobScheduler = &jobScheduler;
 	if (vulkanEngine.init() != ENGINE_SUCCESS) {
 		fprintf(stderr, "[Game] Failed to initialize vulkan engine.\n");
+		_quit = 1;
+		return;
+	}
+
+	PhysicsContextInfo physicsInfo = {};
+	physicsInfo.pJobScheduler = &jobScheduler;
+	physicsInfo.pRecordPath = physicsRecordPath;
+	if (!physicsContext.init(&vulkanEngine, &physicsInfo)) {
+		fprintf(stderr, "[Game] Failed to initialize physics.\n");
+		_quit = 1;
 		return;
 	}
-	physicsContext.init(&vulkanEngine);
 	_physicsInitialized = 1;
-	entityManager.init(&physicsContext);
+	entityManager.init(&physicsContext, &vulkanEngine);
 	transition_state(_currentState);
 }
 
@@ -19,6 +32,7 @@ Game::deinit() {
 	if (_physicsInitialized) {
 		physicsContext.deinit();
 	}
+	jobScheduler.deinit();
 }
 
 glm::vec3 cubePositions[] = {
@@ -38,6 +52,11 @@ void Game::run() {
 	uint32_t prevTime = 0;
 	uint32_t currentTime = 0;
 
+	// init() failed
+	if (_quit) {
+		return;
+	}
+
 	entity_t testCube = entityManager.create_entity();
 	Transform transform = {
 		.position = { 0, 0, 0 },
@@ -46,7 +65,7 @@ void Game::run() {
 	};
 	entityManager.add_transform(testCube, &transform);
 	entityManager.add_mesh(testCube, 0);
-	entityManager.add_physics_body(testCube, { 1, 1, 1 });
+	entityManager.add_physics_body(testCube, { 1, 1, 1 }, JPH::EMotionType::Static);
 
 	entity_t testPlayer = entityManager.create_entity();
 	transform = {
@@ -56,9 +75,12 @@ void Game::run() {
 	};
 	entityManager.add_transform(testPlayer, &transform);
 	entityManager.add_mesh(testPlayer, 0);
-	entityManager.add_player_controller(testPlayer, 1.0f, 1.0f,
+	entityManager.add_player_controller(testPlayer, 1.0f, 2.0f,
 		{ 0.f, 2.f, -1.f });
 
+	// Level is loaded
+	physicsContext.optimize_broadphase();
+
 	while (!_quit) {
 		currentTime = SDL_GetTicks();
 		_deltaTime = (currentTime - prevTime) / 1000.f;
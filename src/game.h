@@ -1,6 +1,7 @@
 #ifndef _GAME_H
 #define _GAME_H
 
+#include "core/job_system.h"
 #include "renderer/vk_engine.h"
 #include "entities/ent_manager.h"
 #include "physics/phys_main.h"
@@ -17,6 +18,12 @@ public:
 
 	float			get_delta_time();
 
+	// Set from the command line (--record-physics <path>) before init()
+	const char*		physicsRecordPath = nullptr;
+
+	// Shared by physics and everything else that wants to go wide
+	JobScheduler	jobScheduler;
+
 	// The three horsemen (these may be directly accessed)
 	VulkanEngine	vulkanEngine;
 	EntityManager	entityManager;
@@ -45,7 +52,7 @@ private:
 
 	float			_deltaTime = 0;
 
-	uint32_t		_physicsInitialized;
+	uint32_t		_physicsInitialized = 0;
 };
 
 #endif /* GAME_H */
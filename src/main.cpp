@@ -1,8 +1,17 @@
 #include "game.h"
 
+#include <string.h>
+
 int main(int argc, char* argv[])
 {
 	Game g;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--record-physics") == 0 && i + 1 < argc) {
+			g.physicsRecordPath = argv[++i];
+		} else if (strcmp(argv[i], "--serial-image-uploads") == 0) {
+			g.vulkanEngine.serialImageUploads = 1;
+		}
+	}
 	// What if init() fails?
 	g.init();
 	g.run();
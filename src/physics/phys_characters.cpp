@@ -0,0 +1,228 @@
+#include "phys_characters.h"
+
+#include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
+
+#include <stdio.h>
+
+#include <chrono>
+#include <new>
+
+#include "phys_layers.h"
+
+void
+CharacterPool::init(PhysicsSystem* pPhysicsSystem, JobScheduler* pScheduler,
+	const ObjectVsBroadPhaseLayerFilter* pBroadPhaseFilter,
+	const ObjectLayerPairFilter* pObjectLayerFilter) {
+	_pPhysicsSystem = pPhysicsSystem;
+	_pScheduler = pScheduler;
+	_pBroadPhaseFilter = pBroadPhaseFilter;
+	_pObjectLayerFilter = pObjectLayerFilter;
+
+	_storage = (uint8_t*)AlignedAllocate(MAX_VIRTUAL_CHARACTERS * sizeof(CharacterVirtual),
+		alignof(CharacterVirtual));
+
+	// Hand out low handles first
+	_freeCount = MAX_VIRTUAL_CHARACTERS;
+	for (uint32_t i = 0; i < MAX_VIRTUAL_CHARACTERS; i++) {
+		_freeList[i] = MAX_VIRTUAL_CHARACTERS - 1 - i;
+	}
+
+	for (uint32_t i = 0; i < MAX_CHARACTER_BATCHES; i++) {
+		_batchAllocators[i] = new TempAllocatorImpl(CHARACTER_TEMP_ALLOC_SIZE);
+	}
+}
+
+void
+CharacterPool::deinit() {
+	while (_activeCount > 0) {
+		destroy(_active[_activeCount - 1]);
+	}
+	for (uint32_t i = 0; i < MAX_CHARACTER_BATCHES; i++) {
+		delete _batchAllocators[i];
+		_batchAllocators[i] = nullptr;
+	}
+	AlignedFree(_storage);
+	_storage = nullptr;
+}
+
+CharacterHandle
+CharacterPool::create(RVec3 position, float radius, float height) {
+	if (_freeCount == 0) {
+		fprintf(stderr, "[CharacterPool] Failed to create character: max reached.\n");
+		return INVALID_CHARACTER;
+	}
+
+	Ref<CharacterVirtualSettings> settings = new CharacterVirtualSettings();
+	settings->mMaxSlopeAngle = DegreesToRadians(45.0f);
+	settings->mEnhancedInternalEdgeRemoval = true;
+	settings->mShape = new CapsuleShape(0.5f * height, radius);
+	// Contacts below the center of the bottom sphere support the character
+	settings->mSupportingVolume = Plane(Vec3::sAxisY(), 0.5f * height);
+	// Pushing bodies would have characters apply impulses to the same body
+	// from several threads, which makes the result order dependent
+	settings->mMaxStrength = 0.f;
+
+	CharacterHandle handle = _freeList[--_freeCount];
+	Slot* slot = &_slots[handle];
+	void* memory = _storage + handle * sizeof(CharacterVirtual);
+	slot->pCharacter = new (memory) CharacterVirtual(settings, position, Quat::sIdentity(),
+		0, _pPhysicsSystem);
+	// The pool owns the memory, Jolt must never try to delete it
+	slot->pCharacter->SetEmbedded();
+	slot->desiredVelocity = Vec3::sZero();
+	slot->activeIndex = _activeCount;
+	_active[_activeCount++] = handle;
+
+	return handle;
+}
+
+void
+CharacterPool::destroy(CharacterHandle handle) {
+	if (handle >= MAX_VIRTUAL_CHARACTERS || _slots[handle].pCharacter == nullptr) {
+		fprintf(stderr, "[CharacterPool] Attempting to destroy an invalid character.\n");
+		return;
+	}
+
+	Slot* slot = &_slots[handle];
+	slot->pCharacter->~CharacterVirtual();
+	slot->pCharacter = nullptr;
+
+	// Swap remove from the dense list
+	CharacterHandle last = _active[--_activeCount];
+	_active[slot->activeIndex] = last;
+	_slots[last].activeIndex = slot->activeIndex;
+
+	_freeList[_freeCount++] = handle;
+}
+
+void
+CharacterPool::set_input(CharacterHandle handle, Vec3 desiredVelocity, Quat rotation) {
+	Slot* slot = &_slots[handle];
+	slot->desiredVelocity = desiredVelocity;
+	slot->pCharacter->SetRotation(rotation);
+}
+
+RVec3
+CharacterPool::get_position(CharacterHandle handle) {
+	return _slots[handle].pCharacter->GetPosition();
+}
+
+Quat
+CharacterPool::get_rotation(CharacterHandle handle) {
+	return _slots[handle].pCharacter->GetRotation();
+}
+
+void
+CharacterPool::update_character(Slot* slot, TempAllocator* pAllocator) {
+	CharacterVirtual* c = slot->pCharacter;
+
+	// Keep the vertical velocity from the last step (falling), or stick to
+	// whatever the character is standing on
+	c->UpdateGroundVelocity();
+	Vec3 groundVelocity = c->GetGroundVelocity();
+	Vec3 linearVelocity = c->GetLinearVelocity();
+	Vec3 currentVertical = Vec3(0, linearVelocity.GetY(), 0);
+
+	Vec3 velocity;
+	if (c->GetGroundState() == CharacterVirtual::EGroundState::OnGround &&
+		(currentVertical.GetY() - groundVelocity.GetY()) < 0.1f) {
+		velocity = groundVelocity;
+	} else {
+		velocity = currentVertical;
+	}
+	velocity += _gravity * _dt;
+	velocity += slot->desiredVelocity;
+	c->SetLinearVelocity(velocity);
+
+	DefaultBroadPhaseLayerFilter broadPhaseFilter(*_pBroadPhaseFilter, Layers::CHARACTER);
+	DefaultObjectLayerFilter objectLayerFilter(*_pObjectLayerFilter, Layers::CHARACTER);
+	CharacterVirtual::ExtendedUpdateSettings settings;
+	c->ExtendedUpdate(_dt, _gravity, settings, broadPhaseFilter, objectLayerFilter,
+		BodyFilter(), ShapeFilter(), *pAllocator);
+}
+
+void
+CharacterPool::update_batch(void* pData) {
+	Batch* batch = (Batch*)pData;
+	CharacterPool* pool = batch->pPool;
+	TempAllocator* allocator = pool->_batchAllocators[batch - pool->_batches];
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint32_t i = batch->begin; i < batch->end; i++) {
+		pool->update_character(&pool->_slots[pool->_active[i]], allocator);
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	batch->ms = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void
+CharacterPool::update(float dt) {
+	_stats.activeCount = _activeCount;
+	if (_activeCount == 0) {
+		_stats.batchCount = 0;
+		_stats.updateMs = 0.f;
+		_stats.slowestBatchMs = 0.f;
+		_stats.perCharacterUs = 0.f;
+		return;
+	}
+
+	_dt = dt;
+	_gravity = _pPhysicsSystem->GetGravity();
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t batchCount = (_activeCount + CHARACTER_BATCH_SIZE - 1) / CHARACTER_BATCH_SIZE;
+	JobCounter counter;
+	for (uint32_t i = 0; i < batchCount; i++) {
+		Batch* batch = &_batches[i];
+		batch->pPool = this;
+		batch->begin = i * CHARACTER_BATCH_SIZE;
+		batch->end = batch->begin + CHARACTER_BATCH_SIZE < _activeCount ?
+			batch->begin + CHARACTER_BATCH_SIZE : _activeCount;
+		batch->ms = 0.f;
+
+		if (_pScheduler != nullptr) {
+			_pScheduler->submit(update_batch, batch, JOB_PRIORITY_HIGH, &counter);
+		} else {
+			update_batch(batch);
+		}
+	}
+	if (_pScheduler != nullptr) {
+		_pScheduler->wait(&counter);
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	float batchTotal = 0.f;
+	float slowest = 0.f;
+	for (uint32_t i = 0; i < batchCount; i++) {
+		batchTotal += _batches[i].ms;
+		slowest = _batches[i].ms > slowest ? _batches[i].ms : slowest;
+	}
+	_stats.batchCount = batchCount;
+	_stats.updateMs = std::chrono::duration<float, std::milli>(end - start).count();
+	_stats.slowestBatchMs = slowest;
+	_stats.perCharacterUs = batchTotal * 1000.f / _activeCount;
+}
+
+uint64_t
+CharacterPool::hash_state(uint64_t hash) {
+	// Handle order rather than active order, the dense list gets shuffled by
+	// destroy() but handles are stable
+	for (uint32_t h = 0; h < MAX_VIRTUAL_CHARACTERS; h++) {
+		CharacterVirtual* c = _slots[h].pCharacter;
+		if (c == nullptr) {
+			continue;
+		}
+		Float3 values[2];
+		RVec3(c->GetPosition()).StoreFloat3(&values[0]);
+		c->GetLinearVelocity().StoreFloat3(&values[1]);
+
+		const uint8_t* bytes = (const uint8_t*)values;
+		for (size_t i = 0; i < sizeof(values); i++) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3ull;
+		}
+	}
+	return hash;
+}
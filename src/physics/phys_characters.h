@@ -0,0 +1,112 @@
+#ifndef PHYS_CHARACTERS_H
+#define PHYS_CHARACTERS_H
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/TempAllocator.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Character/CharacterVirtual.h>
+
+#include <stdint.h>
+
+#include "../core/job_system.h"
+
+using namespace JPH;
+
+#define MAX_VIRTUAL_CHARACTERS		1024
+#define CHARACTER_BATCH_SIZE		32
+#define MAX_CHARACTER_BATCHES		(MAX_VIRTUAL_CHARACTERS / CHARACTER_BATCH_SIZE)
+// Scratch memory for one batch of ExtendedUpdate calls
+#define CHARACTER_TEMP_ALLOC_SIZE	(256 * 1024)
+
+typedef uint32_t CharacterHandle;
+#define INVALID_CHARACTER			UINT32_MAX
+
+struct CharacterPoolStats {
+	uint32_t			activeCount;
+	uint32_t			batchCount;
+	// Wall time of the whole update and of the slowest batch
+	float				updateMs;
+	float				slowestBatchMs;
+	// Summed batch time divided by the number of characters, this is the
+	// number to size NPC counts with
+	float				perCharacterUs;
+};
+
+/*
+* Pool of CharacterVirtuals for NPC crowds. The characters are constructed in
+* place in one preallocated block and updated with ExtendedUpdate in batches
+* of CHARACTER_BATCH_SIZE on the job system, once per physics step before
+* PhysicsSystem::Update.
+*
+* To keep the parallel update deterministic the characters only collide with
+* the world: they have no inner body, don't see each other and don't push
+* dynamic bodies (mMaxStrength = 0).
+*/
+class CharacterPool {
+public:
+	void				init(PhysicsSystem* pPhysicsSystem, JobScheduler* pScheduler,
+							const ObjectVsBroadPhaseLayerFilter* pBroadPhaseFilter,
+							const ObjectLayerPairFilter* pObjectLayerFilter);
+	void				deinit();
+
+	CharacterHandle		create(RVec3 position, float radius, float height);
+	void				destroy(CharacterHandle handle);
+
+	// Horizontal velocity the character tries to move with, gravity and
+	// ground velocity are handled by the pool
+	void				set_input(CharacterHandle handle, Vec3 desiredVelocity, Quat rotation);
+
+	RVec3				get_position(CharacterHandle handle);
+	Quat				get_rotation(CharacterHandle handle);
+	uint32_t			get_active_count() { return _activeCount; }
+
+	void				update(float dt);
+
+	const CharacterPoolStats& get_stats() { return _stats; }
+
+	// Folds every active character's position and velocity into 'hash'
+	uint64_t			hash_state(uint64_t hash);
+
+private:
+	struct Slot {
+		CharacterVirtual*	pCharacter;
+		Vec3				desiredVelocity;
+		uint32_t			activeIndex;
+	};
+
+	struct Batch {
+		CharacterPool*		pPool;
+		uint32_t			begin;
+		uint32_t			end;
+		float				ms;
+	};
+
+	static void			update_batch(void* pData);
+	void				update_character(Slot* slot, TempAllocator* pAllocator);
+
+	PhysicsSystem*		_pPhysicsSystem = nullptr;
+	JobScheduler*		_pScheduler = nullptr;
+	const ObjectVsBroadPhaseLayerFilter* _pBroadPhaseFilter = nullptr;
+	const ObjectLayerPairFilter* _pObjectLayerFilter = nullptr;
+
+	// Backing memory for the characters, never reallocated
+	uint8_t*			_storage = nullptr;
+	Slot				_slots[MAX_VIRTUAL_CHARACTERS] = {};
+	CharacterHandle		_freeList[MAX_VIRTUAL_CHARACTERS];
+	uint32_t			_freeCount = 0;
+
+	// Dense list of live handles so batches don't walk empty slots
+	CharacterHandle		_active[MAX_VIRTUAL_CHARACTERS];
+	uint32_t			_activeCount = 0;
+
+	Batch				_batches[MAX_CHARACTER_BATCHES];
+	TempAllocatorImpl*	_batchAllocators[MAX_CHARACTER_BATCHES] = {};
+
+	// Valid for the duration of update()
+	float				_dt = 0.f;
+	Vec3				_gravity;
+
+	CharacterPoolStats	_stats = {};
+};
+
+#endif /* PHYS_CHARACTERS_H */
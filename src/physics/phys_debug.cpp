@@ -1,58 +1,100 @@
 #include "phys_debug.h"
 
-void DebugRendererSimpleImpl::DrawLine(RVec3Arg inFrom, RVec3Arg inTo, 
-	ColorArg inColor) {
-
-	glm::vec3 from = glm::vec3(
-		inFrom.GetX(),
-		inFrom.GetY(),
-		inFrom.GetZ()
-	);
-	glm::vec3 to = glm::vec3(
-		inTo.GetX(),
-		inTo.GetY(),
-		inTo.GetZ()
-	);
-	glm::vec4 color = glm::vec4(
-		inColor.r,
-		inColor.b,
-		inColor.g,
-		inColor.a
-	);
-
-	_pVulkanEngine->draw_line(from, to, color);
-}
-
-void DebugRendererSimpleImpl::DrawTriangle(RVec3Arg inV1, RVec3Arg inV2, RVec3Arg inV3,
+#include <vector>
+
+static glm::vec4
+to_glm_color(ColorArg color) {
+	return glm::vec4(color.r, color.g, color.b, color.a) / 255.f;
+}
+
+static DebugVertex
+to_debug_vertex(const DebugRenderer::Vertex& v) {
+	DebugVertex out;
+	out.position = glm::vec3(v.mPosition.x, v.mPosition.y, v.mPosition.z);
+	out.color = v.mColor.GetUInt32();
+	out.normal = glm::vec3(v.mNormal.x, v.mNormal.y, v.mNormal.z);
+	out.padding = 0.f;
+	return out;
+}
+
+DebugRendererImpl::DebugRendererImpl(VulkanEngine* pVulkanEngine)
+	: _pVulkanEngine(pVulkanEngine) {
+	// Creates the batches for the primitives (box, sphere, capsule...) that
+	// the Draw* helpers and most shapes use
+	Initialize();
+}
+
+void
+DebugRendererImpl::DrawLine(RVec3Arg inFrom, RVec3Arg inTo, ColorArg inColor) {
+	glm::vec3 from = glm::vec3(inFrom.GetX(), inFrom.GetY(), inFrom.GetZ());
+	glm::vec3 to = glm::vec3(inTo.GetX(), inTo.GetY(), inTo.GetZ());
+	_pVulkanEngine->draw_line(from, to, to_glm_color(inColor));
+}
+
+// Only used for one off triangles, shapes go through DrawGeometry
+void
+DebugRendererImpl::DrawTriangle(RVec3Arg inV1, RVec3Arg inV2, RVec3Arg inV3,
 	ColorArg inColor, ECastShadow inCastShadow) {
+	glm::vec3 vertices[3] = {
+		glm::vec3(inV1.GetX(), inV1.GetY(), inV1.GetZ()),
+		glm::vec3(inV2.GetX(), inV2.GetY(), inV2.GetZ()),
+		glm::vec3(inV3.GetX(), inV3.GetY(), inV3.GetZ())
+	};
+	_pVulkanEngine->draw_triangle(vertices, to_glm_color(inColor));
+}
+
+DebugRenderer::Batch
+DebugRendererImpl::CreateTriangleBatch(const Triangle* inTriangles, int inTriangleCount) {
+	std::vector<DebugVertex> vertices(inTriangleCount * 3);
+	std::vector<uint32_t> indices(inTriangleCount * 3);
+	for (int t = 0; t < inTriangleCount; t++) {
+		for (int v = 0; v < 3; v++) {
+			vertices[t * 3 + v] = to_debug_vertex(inTriangles[t].mV[v]);
+			indices[t * 3 + v] = t * 3 + v;
+		}
+	}
 
-	glm::vec3 v1 = glm::vec3(
-		inV1.GetX(),
-		inV1.GetY(),
-		inV1.GetZ()
-	);
-	glm::vec3 v2 = glm::vec3(
-		inV2.GetX(),
-		inV2.GetY(),
-		inV2.GetZ()
-	);
-	glm::vec3 v3 = glm::vec3(
-		inV3.GetX(),
-		inV3.GetY(),
-		inV3.GetZ()
-	);
-	glm::vec4 color = glm::vec4(
-		inColor.r,
-		inColor.g,
-		inColor.b,
-		inColor.a
-	);
-
-	glm::vec3 vertices[3] = { v1, v2, v3 };
-	_pVulkanEngine->draw_triangle(vertices, color);
-}
-
-void DebugRendererSimpleImpl::DrawText3D(RVec3Arg inPosition, 
-	const string_view& inString, ColorArg inColor, float inHeight) {
+	DebugMeshHandle handle = _pVulkanEngine->create_debug_mesh(vertices.data(),
+		static_cast<uint32_t>(vertices.size()), indices.data(),
+		static_cast<uint32_t>(indices.size()));
+	return new BatchImpl(_pVulkanEngine, handle);
+}
+
+DebugRenderer::Batch
+DebugRendererImpl::CreateTriangleBatch(const Vertex* inVertices, int inVertexCount,
+	const uint32* inIndices, int inIndexCount) {
+	std::vector<DebugVertex> vertices(inVertexCount);
+	for (int i = 0; i < inVertexCount; i++) {
+		vertices[i] = to_debug_vertex(inVertices[i]);
+	}
+
+	DebugMeshHandle handle = _pVulkanEngine->create_debug_mesh(vertices.data(),
+		static_cast<uint32_t>(vertices.size()), inIndices,
+		static_cast<uint32_t>(inIndexCount));
+	return new BatchImpl(_pVulkanEngine, handle);
+}
+
+void
+DebugRendererImpl::DrawGeometry(RMat44Arg inModelMatrix, const AABox& inWorldSpaceBounds,
+	float inLODScaleSq, ColorArg inModelColor, const GeometryRef& inGeometry,
+	ECullMode inCullMode, ECastShadow inCastShadow, EDrawMode inDrawMode) {
+	// Always the most detailed LOD, the renderer has no camera position to
+	// pick one with and the primitives are cheap anyway
+	const BatchImpl* batch =
+		static_cast<const BatchImpl*>(inGeometry->mLODs[0].mTriangleBatch.GetPtr());
+
+	glm::mat4 model;
+	for (int c = 0; c < 4; c++) {
+		Vec4 column = inModelMatrix.GetColumn4(c);
+		model[c] = glm::vec4(column.GetX(), column.GetY(), column.GetZ(), column.GetW());
+	}
+
+	_pVulkanEngine->draw_debug_mesh(batch->_handle, model, to_glm_color(inModelColor),
+		inDrawMode == EDrawMode::Wireframe ? DEBUG_DRAW_WIREFRAME : DEBUG_DRAW_SOLID);
+}
+
+void
+DebugRendererImpl::DrawText3D(RVec3Arg inPosition, const string_view& inString,
+	ColorArg inColor, float inHeight) {
 	return;
-}
\ No newline at end of file
+}
@@ -3,7 +3,8 @@
 
 #include <Jolt/Jolt.h>
 #include <Jolt/Renderer/DebugRenderer.h>
-#include <Jolt/Renderer/DebugRendererSimple.h>
+
+#include <atomic>
 
 #include "../renderer/vk_engine.h"
 
@@ -16,18 +17,52 @@ enum PhysicsDebugFlagBits : uint32_t {
 	PHYSICS_DEBUG_BODY_WIREFRAME_BIT = 1 << 1
 };
 
-class DebugRendererSimpleImpl final : public DebugRendererSimple {
+/*
+* Jolt debug renderer backed by the engine's debug geometry. Jolt turns every
+* shape into a triangle batch once (CreateTriangleBatch) and then only asks
+* for it to be drawn with a transform (DrawGeometry), so a body costs one
+* instance per frame rather than all of its triangles. Lines are written
+* straight into the engine's mapped line buffer.
+*/
+class DebugRendererImpl final : public DebugRenderer {
 public:
-	DebugRendererSimpleImpl(VulkanEngine* pVulkanEngine) : _pVulkanEngine(pVulkanEngine) {};
-
-	virtual void DrawLine(RVec3Arg inFrom, RVec3Arg inTo, ColorArg inColor) override;
-	virtual void DrawTriangle(RVec3Arg inV1, RVec3Arg inV2, RVec3Arg inV3,
-		ColorArg inColor, ECastShadow inCastShadow) override;
-	virtual void DrawText3D(RVec3Arg inPosition,
-		const string_view& inString, ColorArg inColor,
-		float inHeight) override;
+	DebugRendererImpl(VulkanEngine* pVulkanEngine);
+
+	virtual void	DrawLine(RVec3Arg inFrom, RVec3Arg inTo, ColorArg inColor) override;
+	virtual void	DrawTriangle(RVec3Arg inV1, RVec3Arg inV2, RVec3Arg inV3,
+						ColorArg inColor, ECastShadow inCastShadow) override;
+	virtual Batch	CreateTriangleBatch(const Triangle* inTriangles,
+						int inTriangleCount) override;
+	virtual Batch	CreateTriangleBatch(const Vertex* inVertices, int inVertexCount,
+						const uint32* inIndices, int inIndexCount) override;
+	virtual void	DrawGeometry(RMat44Arg inModelMatrix, const AABox& inWorldSpaceBounds,
+						float inLODScaleSq, ColorArg inModelColor,
+						const GeometryRef& inGeometry, ECullMode inCullMode,
+						ECastShadow inCastShadow, EDrawMode inDrawMode) override;
+	virtual void	DrawText3D(RVec3Arg inPosition, const string_view& inString,
+						ColorArg inColor, float inHeight) override;
+
 private:
-	VulkanEngine* _pVulkanEngine;
+	// Owns one debug mesh, destroyed with the last reference to the batch
+	class BatchImpl : public RefTargetVirtual {
+	public:
+		JPH_OVERRIDE_NEW_DELETE
+
+		BatchImpl(VulkanEngine* pVulkanEngine, DebugMeshHandle handle)
+			: _pVulkanEngine(pVulkanEngine), _handle(handle) {}
+		~BatchImpl() { _pVulkanEngine->destroy_debug_mesh(_handle); }
+
+		virtual void	AddRef() override { _refCount++; }
+		virtual void	Release() override { if (--_refCount == 0) delete this; }
+
+		VulkanEngine*	_pVulkanEngine;
+		DebugMeshHandle	_handle;
+
+	private:
+		std::atomic<uint32_t> _refCount = 0;
+	};
+
+	VulkanEngine*	_pVulkanEngine;
 };
 
-#endif /* PHYS_DEBUG_H */
\ No newline at end of file
+#endif /* PHYS_DEBUG_H */
@@ -0,0 +1,69 @@
+#include "phys_events.h"
+
+#include <stdio.h>
+
+// Each thread caches the buffer it claimed along with the id of the queue
+// it belongs to. Ids are never reused, unlike addresses, so a thread that
+// outlives one queue can't mistake a new queue at the same address for it.
+static std::atomic<uint64_t>			gNextQueueId = 1;
+static thread_local uint64_t			tOwnerId = 0;
+static thread_local void*				tBuffer = nullptr;
+
+PhysicsEventQueue::PhysicsEventQueue() :
+	_id(gNextQueueId.fetch_add(1, std::memory_order_relaxed)) {
+}
+
+PhysicsEventQueue::~PhysicsEventQueue() {
+	uint32_t threadCount = _threadCount.load(std::memory_order_acquire);
+	if (threadCount > MAX_EVENT_THREADS) {
+		threadCount = MAX_EVENT_THREADS;
+	}
+	for (uint32_t i = 0; i < threadCount; i++) {
+		delete _buffers[i].load(std::memory_order_relaxed);
+	}
+}
+
+PhysicsEventQueue::ThreadBuffer*
+PhysicsEventQueue::claim_thread_buffer() {
+	uint32_t slot = _threadCount.fetch_add(1, std::memory_order_relaxed);
+	if (slot >= MAX_EVENT_THREADS) {
+		return nullptr;
+	}
+
+	// Only happens once per thread, usually during the first step
+	ThreadBuffer* buffer = new ThreadBuffer();
+	_buffers[slot].store(buffer, std::memory_order_release);
+	return buffer;
+}
+
+void
+PhysicsEventQueue::push(const PhysicsEvent& event) {
+	if (tOwnerId != _id) {
+		tOwnerId = _id;
+		tBuffer = claim_thread_buffer();
+	}
+
+	ThreadBuffer* buffer = (ThreadBuffer*)tBuffer;
+	if (buffer == nullptr || buffer->count >= MAX_EVENTS_PER_THREAD) {
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	buffer->events[buffer->count++] = event;
+}
+
+void
+PhysicsEventQueue::drain(std::vector<PhysicsEvent>* pOut) {
+	uint32_t threadCount = _threadCount.load(std::memory_order_acquire);
+	if (threadCount > MAX_EVENT_THREADS) {
+		threadCount = MAX_EVENT_THREADS;
+	}
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		ThreadBuffer* buffer = _buffers[i].load(std::memory_order_acquire);
+		if (buffer == nullptr || buffer->count == 0) {
+			continue;
+		}
+		pOut->insert(pOut->end(), buffer->events, buffer->events + buffer->count);
+		buffer->count = 0;
+	}
+}
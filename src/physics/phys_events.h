@@ -0,0 +1,163 @@
+#ifndef PHYS_EVENTS_H
+#define PHYS_EVENTS_H
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/Body.h>
+#include <Jolt/Physics/Body/BodyID.h>
+#include <Jolt/Physics/Body/BodyActivationListener.h>
+#include <Jolt/Physics/Collision/ContactListener.h>
+
+#include <atomic>
+#include <vector>
+
+using namespace JPH;
+
+// Jolt's thread pool plus the main thread, anything beyond this drops events
+#define MAX_EVENT_THREADS			64
+#define MAX_EVENTS_PER_THREAD		8192
+
+enum PhysicsEventType : uint32_t {
+	PHYSICS_EVENT_CONTACT_ADDED = 0,
+	PHYSICS_EVENT_CONTACT_PERSISTED = 1,
+	PHYSICS_EVENT_CONTACT_REMOVED = 2,
+	PHYSICS_EVENT_BODY_ACTIVATED = 3,
+	PHYSICS_EVENT_BODY_DEACTIVATED = 4
+};
+
+/*
+* A contact or activation event recorded during a physics step. The user data
+* and contact point/normal are only filled in for added/persisted contacts,
+* removed contacts are reported after the bodies may already be gone.
+*/
+struct PhysicsEvent {
+	PhysicsEventType	type;
+	BodyID				body1;
+	BodyID				body2;
+	uint64				userData1;
+	uint64				userData2;
+	Float3				point;
+	Float3				normal;
+};
+
+/*
+* Collects events from the Jolt listeners. The listeners run on the job
+* system's worker threads, so every thread gets its own buffer (claimed once
+* with an atomic increment) and push() never takes a lock. drain() must only
+* be called from the main thread while no PhysicsSystem::Update is running.
+*/
+class PhysicsEventQueue {
+public:
+	PhysicsEventQueue();
+	~PhysicsEventQueue();
+
+	void				push(const PhysicsEvent& event);
+
+	// Appends every buffered event to pOut and resets the buffers
+	void				drain(std::vector<PhysicsEvent>* pOut);
+
+	// Number of events lost to full buffers since the last call
+	uint32_t			reset_dropped() { return _dropped.exchange(0); }
+
+private:
+	struct alignas(64) ThreadBuffer {
+		uint32_t		count = 0;
+		PhysicsEvent	events[MAX_EVENTS_PER_THREAD];
+	};
+
+	ThreadBuffer*		claim_thread_buffer();
+
+	// Unique per queue, the threads' cached buffers are keyed by it
+	const uint64_t		_id;
+	std::atomic<ThreadBuffer*> _buffers[MAX_EVENT_THREADS] = {};
+	std::atomic<uint32_t> _threadCount = 0;
+	std::atomic<uint32_t> _dropped = 0;
+};
+
+/*
+* The listeners are called from the job system's worker threads in the
+* middle of a step, so they only record events into the PhysicsEventQueue.
+* Anything that wants to react to them reads PhysicsContext::get_events()
+* after update() returns.
+*/
+class ContactListenerImpl : public ContactListener
+{
+public:
+	PhysicsEventQueue*	pEventQueue = nullptr;
+	// Persisted contacts are reported every step for every touching pair,
+	// only record them when something actually needs them
+	uint32_t			recordPersisted = 0;
+
+	virtual void OnContactAdded(
+		const Body& inBody1,
+		const Body& inBody2,
+		const ContactManifold& inManifold,
+		ContactSettings& ioSettings) override
+	{
+		record(PHYSICS_EVENT_CONTACT_ADDED, inBody1, inBody2, inManifold);
+	}
+
+	virtual void OnContactPersisted(
+		const Body& inBody1,
+		const Body& inBody2,
+		const ContactManifold& inManifold,
+		ContactSettings& ioSettings) override
+	{
+		if (recordPersisted) {
+			record(PHYSICS_EVENT_CONTACT_PERSISTED, inBody1, inBody2, inManifold);
+		}
+	}
+
+	virtual void OnContactRemoved(const SubShapeIDPair& inSubShapePair) override
+	{
+		PhysicsEvent event = {};
+		event.type = PHYSICS_EVENT_CONTACT_REMOVED;
+		event.body1 = inSubShapePair.GetBody1ID();
+		event.body2 = inSubShapePair.GetBody2ID();
+		pEventQueue->push(event);
+	}
+
+private:
+	void record(PhysicsEventType type, const Body& inBody1, const Body& inBody2,
+		const ContactManifold& inManifold)
+	{
+		PhysicsEvent event;
+		event.type = type;
+		event.body1 = inBody1.GetID();
+		event.body2 = inBody2.GetID();
+		event.userData1 = inBody1.GetUserData();
+		event.userData2 = inBody2.GetUserData();
+		Vec3(inManifold.GetWorldSpaceContactPointOn1(0)).StoreFloat3(&event.point);
+		inManifold.mWorldSpaceNormal.StoreFloat3(&event.normal);
+		pEventQueue->push(event);
+	}
+};
+
+class BodyActivationListenerImpl : public BodyActivationListener
+{
+public:
+	PhysicsEventQueue*	pEventQueue = nullptr;
+
+	virtual void OnBodyActivated(
+		const BodyID& inBodyID,
+		uint64 inBodyUserData) override
+	{
+		PhysicsEvent event = {};
+		event.type = PHYSICS_EVENT_BODY_ACTIVATED;
+		event.body1 = inBodyID;
+		event.userData1 = inBodyUserData;
+		pEventQueue->push(event);
+	}
+
+	virtual void OnBodyDeactivated(
+		const BodyID& inBodyID,
+		uint64 inBodyUserData) override
+	{
+		PhysicsEvent event = {};
+		event.type = PHYSICS_EVENT_BODY_DEACTIVATED;
+		event.body1 = inBodyID;
+		event.userData1 = inBodyUserData;
+		pEventQueue->push(event);
+	}
+};
+
+#endif /* PHYS_EVENTS_H */
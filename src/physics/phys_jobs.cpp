@@ -0,0 +1,67 @@
+#include "phys_jobs.h"
+
+#include <chrono>
+#include <thread>
+
+JoltJobSystem::JoltJobSystem(JobScheduler* pScheduler, uint inMaxJobs, uint inMaxBarriers)
+	: JobSystemWithBarrier(inMaxBarriers), _pScheduler(pScheduler) {
+	_jobs.Init(inMaxJobs, inMaxJobs);
+}
+
+int
+JoltJobSystem::GetMaxConcurrency() const {
+	// Workers plus the main thread, which executes jobs while it waits on a
+	// barrier
+	return static_cast<int>(_pScheduler->get_worker_count()) + 1;
+}
+
+JobHandle
+JoltJobSystem::CreateJob(const char* inName, ColorArg inColor,
+	const JobFunction& inJobFunction, uint32 inNumDependencies) {
+	uint32 index;
+	for (;;) {
+		index = _jobs.ConstructObject(inName, inColor, this, inJobFunction, inNumDependencies);
+		if (index != AvailableJobs::cInvalidObjectIndex) {
+			break;
+		}
+		// Out of jobs, wait for some to finish. inMaxJobs is too small if
+		// this ever shows up in a profile.
+		JPH_ASSERT(false, "No jobs available!");
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+	Job* job = &_jobs.Get(index);
+
+	// The handle holds a reference so the job can't be freed before this
+	// returns
+	JobHandle handle(job);
+	if (inNumDependencies == 0) {
+		QueueJob(job);
+	}
+	return handle;
+}
+
+void
+JoltJobSystem::run_job(void* pData) {
+	Job* job = (Job*)pData;
+	job->Execute();
+	job->Release();
+}
+
+void
+JoltJobSystem::QueueJob(Job* inJob) {
+	// Released again by run_job()
+	inJob->AddRef();
+	_pScheduler->submit(run_job, inJob, JOB_PRIORITY_HIGH, nullptr);
+}
+
+void
+JoltJobSystem::QueueJobs(Job** inJobs, uint inNumJobs) {
+	for (uint i = 0; i < inNumJobs; i++) {
+		QueueJob(inJobs[i]);
+	}
+}
+
+void
+JoltJobSystem::FreeJob(Job* inJob) {
+	_jobs.DestructObject(inJob);
+}
@@ -0,0 +1,40 @@
+#ifndef PHYS_JOBS_H
+#define PHYS_JOBS_H
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Core/JobSystemWithBarrier.h>
+#include <Jolt/Core/FixedSizeFreeList.h>
+
+#include "../core/job_system.h"
+
+using namespace JPH;
+
+/*
+* Runs Jolt's jobs on the engine's JobScheduler instead of a private thread
+* pool. Jolt jobs go in at high priority since the main thread is usually
+* blocked on the physics step waiting for them.
+*/
+class JoltJobSystem final : public JobSystemWithBarrier {
+public:
+	JoltJobSystem(JobScheduler* pScheduler, uint inMaxJobs, uint inMaxBarriers);
+
+	virtual int			GetMaxConcurrency() const override;
+	virtual JobHandle	CreateJob(const char* inName, ColorArg inColor,
+							const JobFunction& inJobFunction,
+							uint32 inNumDependencies = 0) override;
+
+protected:
+	virtual void		QueueJob(Job* inJob) override;
+	virtual void		QueueJobs(Job** inJobs, uint inNumJobs) override;
+	virtual void		FreeJob(Job* inJob) override;
+
+private:
+	static void			run_job(void* pData);
+
+	using AvailableJobs = FixedSizeFreeList<Job>;
+	AvailableJobs		_jobs;
+
+	JobScheduler*		_pScheduler;
+};
+
+#endif /* PHYS_JOBS_H */
@@ -0,0 +1,154 @@
+#ifndef PHYS_LAYERS_H
+#define PHYS_LAYERS_H
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/Body/MotionType.h>
+#include <Jolt/Physics/Collision/ObjectLayer.h>
+#include <Jolt/Physics/Collision/BroadPhase/BroadPhaseLayer.h>
+
+#include <stdio.h>
+
+using namespace JPH;
+
+namespace Layers
+{
+	static constexpr ObjectLayer STATIC = 0;
+	static constexpr ObjectLayer DYNAMIC = 1;
+	static constexpr ObjectLayer CHARACTER = 2;
+	static constexpr ObjectLayer DEBRIS = 3;
+	static constexpr ObjectLayer SENSOR = 4;
+	static constexpr ObjectLayer NUM_LAYERS = 5;
+};
+
+// Every broadphase layer gets its own tree, static geometry is kept apart
+// from everything that moves so it is never tested against itself
+namespace BroadPhaseLayers
+{
+	static constexpr BroadPhaseLayer STATIC(0);
+	static constexpr BroadPhaseLayer MOVING(1);
+	static constexpr BroadPhaseLayer DEBRIS(2);
+	static constexpr BroadPhaseLayer SENSOR(3);
+	static constexpr uint NUM_LAYERS(4);
+}
+
+#define LAYER_BIT(layer)	(1u << (layer))
+
+struct ObjectLayerDesc {
+	const char*			name;
+	BroadPhaseLayer		broadPhaseLayer;
+	// Mask of LAYER_BIT()s this layer collides with, must be symmetric
+	uint32_t			collidesWith;
+};
+
+/*
+* The collision table, indexed by object layer. Adding a layer only needs an
+* entry here, the filters below are derived from it.
+*/
+static const ObjectLayerDesc LAYER_TABLE[Layers::NUM_LAYERS] = {
+	{ "STATIC", BroadPhaseLayers::STATIC,
+		LAYER_BIT(Layers::DYNAMIC) | LAYER_BIT(Layers::CHARACTER) | LAYER_BIT(Layers::DEBRIS) },
+	{ "DYNAMIC", BroadPhaseLayers::MOVING,
+		LAYER_BIT(Layers::STATIC) | LAYER_BIT(Layers::DYNAMIC) | LAYER_BIT(Layers::CHARACTER) |
+		LAYER_BIT(Layers::SENSOR) },
+	{ "CHARACTER", BroadPhaseLayers::MOVING,
+		LAYER_BIT(Layers::STATIC) | LAYER_BIT(Layers::DYNAMIC) | LAYER_BIT(Layers::CHARACTER) |
+		LAYER_BIT(Layers::SENSOR) },
+	// Debris only lands on the level, it never pushes anything around
+	{ "DEBRIS", BroadPhaseLayers::DEBRIS,
+		LAYER_BIT(Layers::STATIC) },
+	{ "SENSOR", BroadPhaseLayers::SENSOR,
+		LAYER_BIT(Layers::DYNAMIC) | LAYER_BIT(Layers::CHARACTER) },
+};
+
+// Layer a body goes on when the caller doesn't pick one
+inline ObjectLayer
+default_layer_for_motion_type(EMotionType motionType) {
+	return motionType == EMotionType::Static ? Layers::STATIC : Layers::DYNAMIC;
+}
+
+// Class that determines if two object layers can collide
+class ObjectLayerPairFilterImpl : public ObjectLayerPairFilter {
+public:
+	virtual bool ShouldCollide(ObjectLayer inObj1, ObjectLayer inObj2) const override {
+		JPH_ASSERT(inObj1 < Layers::NUM_LAYERS && inObj2 < Layers::NUM_LAYERS);
+		return (LAYER_TABLE[inObj1].collidesWith & LAYER_BIT(inObj2)) != 0;
+	}
+};
+
+class BPLayerInterfaceImpl final : public BroadPhaseLayerInterface
+{
+public:
+	virtual uint GetNumBroadPhaseLayers() const override {
+		return BroadPhaseLayers::NUM_LAYERS;
+	}
+
+	virtual BroadPhaseLayer GetBroadPhaseLayer(ObjectLayer inLayer) const override {
+		JPH_ASSERT(inLayer < Layers::NUM_LAYERS);
+		return LAYER_TABLE[inLayer].broadPhaseLayer;
+	}
+
+#if defined(JPH_EXTERNAL_PROFILE) || defined(JPH_PROFILE_ENABLED)
+	virtual const char* GetBroadPhaseLayerName(BroadPhaseLayer inLayer) const override {
+		switch ((BroadPhaseLayer::Type)inLayer) {
+		case (BroadPhaseLayer::Type)BroadPhaseLayers::STATIC:
+			return "STATIC";
+		case (BroadPhaseLayer::Type)BroadPhaseLayers::MOVING:
+			return "MOVING";
+		case (BroadPhaseLayer::Type)BroadPhaseLayers::DEBRIS:
+			return "DEBRIS";
+		case (BroadPhaseLayer::Type)BroadPhaseLayers::SENSOR:
+			return "SENSOR";
+		default:
+			JPH_ASSERT(false);
+			return "INVALID";
+		}
+	}
+
+#endif /* JPH_EXTERNAL_PROFILE || JPH_PROFILE_ENABLED */
+};
+
+// Class that determines if an object layer can collide with a broadphase layer
+class ObjectVsBroadPhaseLayerFilterImpl : public ObjectVsBroadPhaseLayerFilter
+{
+public:
+	ObjectVsBroadPhaseLayerFilterImpl() {
+		// An object layer has to visit a broadphase layer if it collides
+		// with any object layer stored in it
+		for (ObjectLayer a = 0; a < Layers::NUM_LAYERS; a++) {
+			_broadPhaseMasks[a] = 0;
+			for (ObjectLayer b = 0; b < Layers::NUM_LAYERS; b++) {
+				if (LAYER_TABLE[a].collidesWith & LAYER_BIT(b)) {
+					_broadPhaseMasks[a] |=
+						1u << (BroadPhaseLayer::Type)LAYER_TABLE[b].broadPhaseLayer;
+				}
+			}
+		}
+	}
+
+	virtual bool ShouldCollide(ObjectLayer inLayer1, BroadPhaseLayer inLayer2) const override {
+		JPH_ASSERT(inLayer1 < Layers::NUM_LAYERS);
+		return (_broadPhaseMasks[inLayer1] & (1u << (BroadPhaseLayer::Type)inLayer2)) != 0;
+	}
+
+private:
+	uint32_t _broadPhaseMasks[Layers::NUM_LAYERS];
+};
+
+// Returns 0 and logs the offending pair if the table isn't symmetric
+inline uint32_t
+validate_layer_table() {
+	for (ObjectLayer a = 0; a < Layers::NUM_LAYERS; a++) {
+		for (ObjectLayer b = 0; b < Layers::NUM_LAYERS; b++) {
+			uint32_t ab = (LAYER_TABLE[a].collidesWith & LAYER_BIT(b)) != 0;
+			uint32_t ba = (LAYER_TABLE[b].collidesWith & LAYER_BIT(a)) != 0;
+			if (ab != ba) {
+				fprintf(stderr, "[Physics] Layer table is not symmetric for %s/%s.\n",
+					LAYER_TABLE[a].name, LAYER_TABLE[b].name);
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+#endif /* PHYS_LAYERS_H */
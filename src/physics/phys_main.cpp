@@ -1,7 +1,11 @@
 #include "phys_main.h"
 
 #include <cstdarg>
+#include <cmath>
+#include <chrono>
+#include <cstring>
 #include <thread>
+#include <algorithm>
 
 using namespace JPH::literals;
 
@@ -34,8 +38,19 @@ assert_failed_impl(const char* inExpr, const char* inMsg,
 #endif /* JPH_ENABLE_ASSERTS */
 
 
-void 
-PhysicsContext::init(VulkanEngine* pVulkanEngine) {
+uint32_t
+PhysicsContext::init(VulkanEngine* pVulkanEngine, const PhysicsContextInfo* pInfo) {
+	PhysicsContextInfo info = {};
+	if (pInfo != nullptr) {
+		info = *pInfo;
+	}
+
+	// The filters assume a symmetric table, one-sided pairs would collide
+	// or not depending on which body the broadphase happens to test first
+	if (!validate_layer_table()) {
+		return 0;
+	}
+
 	RegisterDefaultAllocator();
 
 	Trace = trace_impl;
@@ -46,30 +61,55 @@ PhysicsContext::init(VulkanEngine* pVulkanEngine) {
 	RegisterTypes();
 
 	_pTempAllocator = new TempAllocatorImpl(TEMP_ALLOC_SIZE);
-	_pJobSystem = new JobSystemThreadPool(cMaxPhysicsJobs,
-		cMaxPhysicsBarriers, std::thread::hardware_concurrency() - 1);
+	if (info.pJobScheduler != nullptr) {
+		_pJobSystem = new JoltJobSystem(info.pJobScheduler, cMaxPhysicsJobs,
+			cMaxPhysicsBarriers);
+	} else {
+		_pJobSystem = new JobSystemThreadPool(cMaxPhysicsJobs,
+			cMaxPhysicsBarriers, std::thread::hardware_concurrency() - 1);
+	}
 
-	_physicsSystem.Init(MAX_BODIES, MAX_BODY_MUTEXES, MAX_BODY_PAIRS,
-		MAX_CONTACT_CONSTRAINTS, _broadPhaseLayerInterface, 
+	_physicsSystem.Init(info.maxBodies, info.numBodyMutexes, info.maxBodyPairs,
+		info.maxContactConstraints, _broadPhaseLayerInterface, 
 		_objectVsBroadphaseLayerFilter, _objectVsObjectLayerFilter);
+	_bodyIDs.reserve(info.maxBodies);
+
+	_characterPool.init(&_physicsSystem, info.pJobScheduler,
+		&_objectVsBroadphaseLayerFilter, &_objectVsObjectLayerFilter);
+
+	if (info.pRecordPath != nullptr) {
+		PhysicsRecordHeader header = {};
+		header.maxBodies = info.maxBodies;
+		header.numBodyMutexes = info.numBodyMutexes;
+		header.maxBodyPairs = info.maxBodyPairs;
+		header.maxContactConstraints = info.maxContactConstraints;
+		header.collisionSteps = COLLISION_STEPS;
+		_recorder.open(info.pRecordPath, &header);
+	}
 
+	_bodyActivationListener.pEventQueue = &_eventQueue;
+	_contactListener.pEventQueue = &_eventQueue;
 	_physicsSystem.SetBodyActivationListener(&_bodyActivationListener);
-
 	_physicsSystem.SetContactListener(&_contactListener);
 	
-	_pDebugRenderer = new DebugRendererSimpleImpl(pVulkanEngine);
+	_pDebugRenderer = new DebugRendererImpl(pVulkanEngine);
+	return 1;
 }
 
 void 
 PhysicsContext::deinit() {
+	_recorder.close();
+
 	BodyInterface& bodyInterface = _physicsSystem.GetBodyInterface();
 
 	for (size_t i = 0; i < _characters.size(); i++) {
 		_characters[i]->RemoveFromPhysicsSystem();
 	}
+	_characterPool.deinit();
 
 	bodyInterface.RemoveBodies(_bodyIDs.data(), _bodyIDs.size());
 	bodyInterface.DestroyBodies(_bodyIDs.data(), _bodyIDs.size());
+	_boxShapes.clear();
 
 	UnregisterTypes();
 
@@ -83,15 +123,14 @@ PhysicsContext::deinit() {
 
 Character*
 PhysicsContext::create_character(Vec3 position, float radius, float height) {
-	Ref<CharacterSettings> settings = new CharacterSettings();
-	settings->mMaxSlopeAngle = DegreesToRadians(45.0f);
-	settings->mEnhancedInternalEdgeRemoval = Layers::MOVING;
-	settings->mShape = new CapsuleShape(height, radius);
-	settings->mFriction = 0.5f;
-	settings->mSupportingVolume = Plane(Vec3::sAxisY(), 2.f);
-
-	Character* c = new Character(settings, RVec3(0.0f, 5.0f, 0.0f), Quat::sIdentity(),
+	Ref<CharacterSettings> settings = create_character_settings(radius, height);
+
+	Character* c = new Character(settings, RVec3(position), Quat::sIdentity(),
 		0, &_physicsSystem);
+	if (_recorder.is_open()) {
+		_recorder.record_add_character(static_cast<uint32_t>(_characters.size()),
+			RVec3(position), radius, height);
+	}
 	// The ECS also accesses this pointer so we have two places
 	// where this pointer will propogate... seems suspicious
 	_characters.push_back(c);
@@ -99,28 +138,203 @@ PhysicsContext::create_character(Vec3 position, float radius, float height) {
 	return c;
 }
 
+CharacterHandle
+PhysicsContext::create_virtual_character(Vec3 position, float radius, float height) {
+	CharacterHandle handle = _characterPool.create(RVec3(position), radius, height);
+	if (_recorder.is_open() && handle != INVALID_CHARACTER) {
+		_recorder.record_add_virtual_character(handle, RVec3(position), radius, height);
+	}
+	return handle;
+}
+
+void
+PhysicsContext::destroy_virtual_character(CharacterHandle handle) {
+	_characterPool.destroy(handle);
+	if (_recorder.is_open()) {
+		_recorder.record_remove_virtual_character(handle);
+	}
+}
+
+void
+PhysicsContext::set_virtual_character_input(CharacterHandle handle, Vec3 desiredVelocity,
+	Quat rotation) {
+	_characterPool.set_input(handle, desiredVelocity, rotation);
+	if (_recorder.is_open()) {
+		_recorder.record_virtual_character_input(handle, desiredVelocity, rotation);
+	}
+}
+
 BodyID
-PhysicsContext::add_box(Transform transform, Vec3 extent) {
+PhysicsContext::add_box(Transform transform, Vec3 extent, EMotionType motionType,
+	ObjectLayer layer) {
 	BodyInterface& bodyInterface = _physicsSystem.GetBodyInterface();
 
 	// Normalize quats before use in JPH
 	glm::quat q = glm::normalize(transform.rotation);
 
 	BodyCreationSettings boxSettings(
-		new BoxShape(extent),
+		get_box_shape(extent),
 		RVec3(transform.position.x, transform.position.y, transform.position.z),
 		Quat(q.x, q.y, q.z, q.w),
-		EMotionType::Kinematic,
-		Layers::MOVING
+		motionType,
+		layer
 	);
+	if (layer == Layers::SENSOR) {
+		boxSettings.mIsSensor = true;
+	}
 
-	BodyID boxID = bodyInterface.CreateAndAddBody(boxSettings,
-		EActivation::Activate);
+	EActivation activation = motionType == EMotionType::Static ?
+		EActivation::DontActivate : EActivation::Activate;
+	BodyID boxID = bodyInterface.CreateAndAddBody(boxSettings, activation);
+	if (_recorder.is_open() && !boxID.IsInvalid()) {
+		_recorder.record_add_box(boxID, boxSettings, extent, 1);
+		_recorder.record_commit_bodies(1, activation);
+	}
 
 	_bodyIDs.push_back(boxID);
 	return boxID;
 }
 
+uint32_t
+PhysicsContext::add_boxes(const Transform* pTransforms, const Vec3* pExtents,
+	uint32_t count, EMotionType motionType, ObjectLayer layer, BodyID* pOutIDs) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	BodyInterface& bodyInterface = _physicsSystem.GetBodyInterface();
+
+	size_t firstID = _bodyIDs.size();
+	for (uint32_t i = 0; i < count; i++) {
+		glm::quat q = glm::normalize(pTransforms[i].rotation);
+		const glm::vec3& p = pTransforms[i].position;
+
+		BodyCreationSettings boxSettings(
+			get_box_shape(pExtents[i]),
+			RVec3(p.x, p.y, p.z),
+			Quat(q.x, q.y, q.z, q.w),
+			motionType,
+			layer
+		);
+		boxSettings.mIsSensor = layer == Layers::SENSOR;
+
+		Body* body = bodyInterface.CreateBody(boxSettings);
+		if (body == nullptr) {
+			fprintf(stderr, "[Physics] Ran out of bodies after %u of %u, increase maxBodies.\n",
+				i, count);
+			break;
+		}
+		_bodyIDs.push_back(body->GetID());
+		if (_recorder.is_open()) {
+			_recorder.record_add_box(body->GetID(), boxSettings, pExtents[i], 0);
+		}
+	}
+
+	uint32_t added = static_cast<uint32_t>(_bodyIDs.size() - firstID);
+	if (added == 0) {
+		return 0;
+	}
+
+	BodyID* pIDs = _bodyIDs.data() + firstID;
+	EActivation activation = motionType == EMotionType::Static ?
+		EActivation::DontActivate : EActivation::Activate;
+	BroadPhase::AddState state = bodyInterface.AddBodiesPrepare(pIDs, added);
+	bodyInterface.AddBodiesFinalize(pIDs, added, state, activation);
+	if (_recorder.is_open()) {
+		_recorder.record_commit_bodies(added, activation);
+	}
+
+	if (pOutIDs != nullptr) {
+		memcpy(pOutIDs, pIDs, added * sizeof(BodyID));
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	fprintf(stderr, "[Physics] Added %u bodies (%zu unique shapes) in %.2f ms.\n",
+		added, _boxShapes.size(),
+		std::chrono::duration<float, std::milli>(end - start).count());
+	return added;
+}
+
+void
+PhysicsContext::report_layer_stats() {
+	uint64_t bodiesPerLayer[Layers::NUM_LAYERS] = {};
+
+	BodyIDVector bodyIDs;
+	_physicsSystem.GetBodies(bodyIDs);
+	const BodyLockInterfaceNoLock& lockInterface = _physicsSystem.GetBodyLockInterfaceNoLock();
+	for (size_t i = 0; i < bodyIDs.size(); i++) {
+		BodyLockRead lock(lockInterface, bodyIDs[i]);
+		if (lock.Succeeded()) {
+			bodiesPerLayer[lock.GetBody().GetObjectLayer()]++;
+		}
+	}
+
+	// What the old MOVING-collides-with-everything setup would test against
+	// what the table lets through, before the broadphase culls by distance
+	uint64_t totalBodies = bodyIDs.size();
+	uint64_t unfilteredPairs = totalBodies * (totalBodies - (totalBodies > 0)) / 2;
+	uint64_t allowedPairs = 0;
+	for (ObjectLayer a = 0; a < Layers::NUM_LAYERS; a++) {
+		fprintf(stderr, "[Physics] Layer %-10s %llu bodies\n", LAYER_TABLE[a].name,
+			(unsigned long long)bodiesPerLayer[a]);
+		for (ObjectLayer b = a; b < Layers::NUM_LAYERS; b++) {
+			if (!(LAYER_TABLE[a].collidesWith & LAYER_BIT(b))) {
+				continue;
+			}
+			if (a == b) {
+				allowedPairs += bodiesPerLayer[a] * (bodiesPerLayer[a] - (bodiesPerLayer[a] > 0)) / 2;
+			} else {
+				allowedPairs += bodiesPerLayer[a] * bodiesPerLayer[b];
+			}
+		}
+	}
+	fprintf(stderr, "[Physics] Candidate pairs: %llu unfiltered, %llu after layer filtering, "
+		"%lld touching.\n", (unsigned long long)unfilteredPairs,
+		(unsigned long long)allowedPairs, (long long)_activeContacts);
+}
+
+void
+PhysicsContext::remove_body(BodyID bodyID) {
+	auto it = std::find(_bodyIDs.begin(), _bodyIDs.end(), bodyID);
+	if (it == _bodyIDs.end()) {
+		fprintf(stderr, "[Physics] Attempting to remove a body that wasn't added.\n");
+		return;
+	}
+	*it = _bodyIDs.back();
+	_bodyIDs.pop_back();
+
+	BodyInterface& bodyInterface = _physicsSystem.GetBodyInterface();
+	bodyInterface.RemoveBody(bodyID);
+	bodyInterface.DestroyBody(bodyID);
+	if (_recorder.is_open()) {
+		_recorder.record_remove_body(bodyID);
+	}
+}
+
+void
+PhysicsContext::optimize_broadphase() {
+	auto start = std::chrono::high_resolution_clock::now();
+	_physicsSystem.OptimizeBroadPhase();
+	if (_recorder.is_open()) {
+		_recorder.record_optimize_broadphase();
+	}
+	auto end = std::chrono::high_resolution_clock::now();
+	fprintf(stderr, "[Physics] Optimized broadphase in %.2f ms.\n",
+		std::chrono::duration<float, std::milli>(end - start).count());
+	report_layer_stats();
+}
+
+Ref<Shape>
+PhysicsContext::get_box_shape(Vec3 extent) {
+	BoxShapeKey key = { extent.GetX(), extent.GetY(), extent.GetZ() };
+	auto it = _boxShapes.find(key);
+	if (it != _boxShapes.end()) {
+		return it->second;
+	}
+
+	Ref<Shape> shape = new BoxShape(extent);
+	_boxShapes[key] = shape;
+	return shape;
+}
+
 void
 PhysicsContext::set_debug_flags(PhysicsDebugFlags flags) {
 	_debugFlags |= flags;
@@ -131,28 +345,105 @@ PhysicsContext::clear_debug_flags(PhysicsDebugFlags flags) {
 	_debugFlags &= ~flags;
 }
 
-void 
-PhysicsContext::update(float dt) {
-	_accumulator += dt;
-	
-	BodyInterface& bodyInterface = _physicsSystem.GetBodyInterface();
-	uint step = 0;
-	++step;
+void
+PhysicsContext::set_tick_rate(uint32_t hz) {
+	if (hz != 30 && hz != 60 && hz != 120) {
+		fprintf(stderr, "[Physics] Unsupported tick rate %u Hz, keeping %u Hz.\n",
+			hz, _tickRate);
+		return;
+	}
+	// Keep alpha the same so the rendered transforms don't pop
+	float alpha = get_alpha();
+	_tickRate = hz;
+	_timeStep = 1.f / hz;
+	_accumulator = alpha * _timeStep;
+}
+
+static const char*
+event_type_name(PhysicsEventType type) {
+	switch (type) {
+	case PHYSICS_EVENT_CONTACT_ADDED:		return "contact added";
+	case PHYSICS_EVENT_CONTACT_PERSISTED:	return "contact persisted";
+	case PHYSICS_EVENT_CONTACT_REMOVED:		return "contact removed";
+	case PHYSICS_EVENT_BODY_ACTIVATED:		return "body activated";
+	case PHYSICS_EVENT_BODY_DEACTIVATED:	return "body deactivated";
+	default:								return "unknown";
+	}
+}
 
-	const int cCollisionSteps = 1;
+uint32_t
+PhysicsContext::update(float dt, PhysicsStepFn pfnBeforeLastStep, void* pData) {
+	_accumulator += dt;
+	_events.clear();
 
 	if (_debugFlags & PHYSICS_DEBUG_BODY_WIREFRAME_BIT) {
 		BodyManager::DrawSettings drawSettings;
 		drawSettings.mDrawShapeWireframe = true;
 		_physicsSystem.DrawBodies(drawSettings, _pDebugRenderer);
+		// Lets Jolt drop the geometry it cached for shapes that weren't drawn
+		_pDebugRenderer->NextFrame();
 	}
 
-	while (_accumulator >= TIME_STEP) {
-		_physicsSystem.Update(TIME_STEP, cCollisionSteps,
+	uint32_t steps = 0;
+	while (_accumulator >= _timeStep && steps < MAX_STEPS_PER_UPDATE) {
+		uint32_t lastStep = steps + 1 == MAX_STEPS_PER_UPDATE ||
+			_accumulator - _timeStep < _timeStep;
+		if (lastStep && pfnBeforeLastStep != nullptr) {
+			pfnBeforeLastStep(pData);
+		}
+
+		if (_recorder.is_open()) {
+			_recorder.record_characters(_characters.data(),
+				static_cast<uint32_t>(_characters.size()));
+		}
+
+		// Characters move against the world as it was at the end of the last
+		// step, then the bodies are simulated
+		_characterPool.update(_timeStep);
+		_physicsSystem.Update(_timeStep, COLLISION_STEPS,
 			_pTempAllocator, _pJobSystem);
 		for (size_t i = 0; i < _characters.size(); i++) {
 			_characters[i]->PostSimulation(0.05f);
 		}
-		_accumulator -= TIME_STEP;
+
+		if (_recorder.is_open()) {
+			_recorder.record_step(_timeStep,
+				hash_physics_state(&_physicsSystem, &_characterPool));
+		}
+		_accumulator -= _timeStep;
+		steps++;
+
+		// Drain after every step so the per-thread buffers only ever
+		// have to hold one step worth of events
+		_eventQueue.drain(&_events);
+	}
+
+	uint32_t dropped = _eventQueue.reset_dropped();
+	if (dropped > 0) {
+		fprintf(stderr, "[Physics] Dropped %u events, event buffers are full.\n", dropped);
+	}
+
+	if (_eventLogSampleRate > 0) {
+		for (size_t i = 0; i < _events.size(); i++) {
+			if ((_eventsSeen + i) % _eventLogSampleRate == 0) {
+				fprintf(stderr, "[Physics] Event: %s (%u, %u)\n",
+					event_type_name(_events[i].type),
+					_events[i].body1.GetIndexAndSequenceNumber(),
+					_events[i].body2.GetIndexAndSequenceNumber());
+			}
+		}
 	}
+	_eventsSeen += _events.size();
+
+	for (size_t i = 0; i < _events.size(); i++) {
+		if (_events[i].type == PHYSICS_EVENT_CONTACT_ADDED) _activeContacts++;
+		else if (_events[i].type == PHYSICS_EVENT_CONTACT_REMOVED) _activeContacts--;
+	}
+
+	// Drop whatever we couldn't catch up on rather than carrying it over
+	if (steps == MAX_STEPS_PER_UPDATE && _accumulator >= _timeStep) {
+		_accumulator = fmodf(_accumulator, _timeStep);
+	}
+
+	return steps;
 }
\ No newline at end of file
@@ -19,171 +19,127 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
+#include <unordered_map>
+
 #include "phys_debug.h"
+#include "phys_events.h"
+#include "phys_jobs.h"
+#include "phys_record.h"
+#include "phys_characters.h"
+#include "phys_layers.h"
 
 using namespace JPH;
 
 #define TEMP_ALLOC_SIZE				10 * 1024 * 1024
 
-constexpr uint MAX_BODIES = 1024;
-constexpr uint MAX_BODY_MUTEXES = 0;
-constexpr uint MAX_BODY_PAIRS = 1024;
-constexpr uint MAX_CONTACT_CONSTRAINTS = 1024;
-
-constexpr float		TIME_STEP = 1.f / 60.f;
-
-// An example contact listener
-class ContactListenerImpl : public ContactListener
-{
-public:
-	// See: ContactListener
-	virtual ValidateResult	OnContactValidate(
-		const Body& inBody1,
-		const Body& inBody2, RVec3Arg inBaseOffset,
-		const CollideShapeResult& inCollisionResult) override
-	{
-		fprintf(stderr, "[Physics] Contact validate callback\n");
-
-		// Allows you to ignore a contact before it is created (using layers to not make objects collide is cheaper!)
-		return ValidateResult::AcceptAllContactsForThisBodyPair;
-	}
-
-	virtual void OnContactAdded(
-		const Body& inBody1,
-		const Body& inBody2,
-		const ContactManifold& inManifold,
-		ContactSettings& ioSettings) override
-	{
-		fprintf(stderr, "[Physics] A contact was added\n");
-	}
-
-	virtual void OnContactPersisted(
-		const Body& inBody1,
-		const Body& inBody2,
-		const ContactManifold& inManifold,
-		ContactSettings& ioSettings) override
-	{
-		fprintf(stderr, "[Physics] A contact was persisted\n");
-	}
-
-	virtual void OnContactRemoved(const SubShapeIDPair& inSubShapePair) override
-	{
-		fprintf(stderr, "[Physics] A contact was removed\n");
-	}
+// Defaults for PhysicsContextInfo
+constexpr uint DEFAULT_MAX_BODIES = 1024;
+constexpr uint DEFAULT_MAX_BODY_MUTEXES = 0;
+constexpr uint DEFAULT_MAX_BODY_PAIRS = 1024;
+constexpr uint DEFAULT_MAX_CONTACT_CONSTRAINTS = 1024;
+
+// Fixed simulation rate, independent of the frame rate. Anything that is
+// rendered should be interpolated using get_alpha().
+constexpr uint		DEFAULT_TICK_RATE = 60;
+// Caps the number of steps a single update() may take so a long frame
+// doesn't snowball into even longer ones
+constexpr uint		MAX_STEPS_PER_UPDATE = 8;
+constexpr int		COLLISION_STEPS = 1;
+
+typedef void (*PhysicsStepFn)(void* pData);
+
+/*
+* Capacities of the physics system, these are fixed once init() is called.
+* Size them for the biggest level that will be loaded (e.g. 65536 bodies for
+* a level with 50k static colliders).
+*/
+struct PhysicsContextInfo {
+	uint32_t							maxBodies = DEFAULT_MAX_BODIES;
+	// 0 lets Jolt pick a default
+	uint32_t							numBodyMutexes = DEFAULT_MAX_BODY_MUTEXES;
+	uint32_t							maxBodyPairs = DEFAULT_MAX_BODY_PAIRS;
+	uint32_t							maxContactConstraints = DEFAULT_MAX_CONTACT_CONSTRAINTS;
+	// Shared engine job system, nullptr falls back to a private Jolt
+	// thread pool (for tools that don't run the rest of the engine)
+	JobScheduler*						pJobScheduler = nullptr;
+	// When set every step and its inputs are written here for physics_replay.
+	// Recording starts at init so the log contains the whole scene.
+	const char*							pRecordPath = nullptr;
 };
 
-// An example activation listener
-class BodyActivationListenerImpl : public BodyActivationListener
-{
-public:
-	virtual void OnBodyActivated(
-		const BodyID& inBodyID,
-		uint64 inBodyUserData) override
-	{
-		fprintf(stderr, "[Physics] A body got activated\n");
-	}
+// Bit exact key for the box shape cache
+struct BoxShapeKey {
+	float								x, y, z;
 
-	virtual void OnBodyDeactivated(
-		const BodyID& inBodyID,
-		uint64 inBodyUserData) override
-	{
-		fprintf(stderr, "[Physics] A body went to sleep\n");
+	bool operator==(const BoxShapeKey& other) const {
+		return x == other.x && y == other.y && z == other.z;
 	}
 };
 
-namespace Layers
-{
-	static constexpr ObjectLayer NON_MOVING = 0;
-	static constexpr ObjectLayer MOVING = 1;
-	static constexpr ObjectLayer NUM_LAYERS = 2;
-};
-
-// Class that determines if two object layers can collide
-class ObjectLayerPairFilterImpl : public ObjectLayerPairFilter {
-public:
-	virtual bool ShouldCollide(ObjectLayer inObj1, ObjectLayer inObj2) const override {
-		switch (inObj1) {
-		case Layers::NON_MOVING:
-			return inObj2 == Layers::MOVING;
-		case Layers::MOVING:
-			return true;
-		default:
-			JPH_ASSERT(false);
-			return false;
-		}
+struct BoxShapeKeyHash {
+	size_t operator()(const BoxShapeKey& key) const {
+		size_t h = std::hash<float>()(key.x);
+		h ^= std::hash<float>()(key.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		h ^= std::hash<float>()(key.z) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		return h;
 	}
 };
 
-// Broadphase layers definitions and mappings
-namespace BroadPhaseLayers
-{
-	static constexpr BroadPhaseLayer NON_MOVING(0);
-	static constexpr BroadPhaseLayer MOVING(1);
-	static constexpr uint NUM_LAYERS(2);
-}
-
-class BPLayerInterfaceImpl final : public BroadPhaseLayerInterface
-{
+class PhysicsContext {
 public:
-	BPLayerInterfaceImpl() {
-		_objectToBroadPhase[Layers::NON_MOVING] = BroadPhaseLayers::NON_MOVING;
-		_objectToBroadPhase[Layers::MOVING] = BroadPhaseLayers::MOVING;
-	}
+	// pInfo may be nullptr to use the default capacities. Returns 0 if the
+	// layer table is inconsistent, nothing is set up in that case.
+	uint32_t							init(VulkanEngine* pVulkanEngine,
+											const PhysicsContextInfo* pInfo = nullptr);
+	void								deinit();
 
-	virtual uint GetNumBroadPhaseLayers() const override {
-		return BroadPhaseLayers::NUM_LAYERS;
-	}
+	// For all characters height is the length of the capsule's cylinder,
+	// the distance between the centers of its two spheres
+	Character*							create_character(Vec3 position, float radius, float height);
 
-	virtual BroadPhaseLayer GetBroadPhaseLayer(ObjectLayer inLayer) const override {
-		JPH_ASSERT(inLayer < Layers::NUM_LAYERS);
-		return _objectToBroadPhase[inLayer];
+	// Pooled CharacterVirtuals for NPCs, see CharacterPool
+	CharacterHandle						create_virtual_character(Vec3 position,
+											float radius, float height);
+	void								destroy_virtual_character(CharacterHandle handle);
+	void								set_virtual_character_input(CharacterHandle handle,
+											Vec3 desiredVelocity, Quat rotation);
+	CharacterPool*						get_character_pool() { return &_characterPool; }
+
+	BodyID								add_box(Transform transform, Vec3 extent,
+											EMotionType motionType, ObjectLayer layer);
+
+	void								remove_body(BodyID bodyID);
+
+	// Bulk version of add_box() for level loading. Bodies are created
+	// without touching the broadphase and then inserted in one batch.
+	// Returns the number of bodies that were added, pOutIDs (may be nullptr)
+	// receives their ids.
+	uint32_t							add_boxes(const Transform* pTransforms,
+											const Vec3* pExtents, uint32_t count,
+											EMotionType motionType, ObjectLayer layer,
+											BodyID* pOutIDs);
+
+	// Events recorded during the steps of the last update()
+	const std::vector<PhysicsEvent>& get_events() { return _events; }
+
+	// Logs every n'th event to stderr, 0 turns logging off
+	void								set_event_log_sample_rate(uint32_t n) {
+		_eventLogSampleRate = n;
 	}
-
-#if defined(JPH_EXTERNAL_PROFILE) || defined(JPH_PROFILE_ENABLED)
-	virtual const char* GetBroadPhaseLayerName(BroadPhaseLayer inLayer) const override {
-		switch ((BroadPhaseLayer::Type)inLayer) {
-		case (BroadPhaseLayer::Type)BroadPhaseLayers::NON_MOVING:
-			return "NON_MOVING";
-		case (BroadPhaseLayer::Type)BroadPhaseLayers::MOVING:
-			return "MOVING";
-		default:
-			JPH_ASSERT(false);
-			return "INVALID";
-		}
+	void								set_record_persisted_contacts(uint32_t record) {
+		_contactListener.recordPersisted = record;
 	}
 
-#endif /* JPH_EXTERNAL_PROFILE || JPH_PROFILE_ENABLED */
-
-private:
-	BroadPhaseLayer _objectToBroadPhase[Layers::NUM_LAYERS];
-};
+	// Logs the number of bodies per layer and how many body pairs the layer
+	// table allows to be tested, along with the currently touching pairs
+	void								report_layer_stats();
 
-// Class that determines if an object layer can collide with a broadphase layer
-class ObjectVsBroadPhaseLayerFilterImpl : public ObjectVsBroadPhaseLayerFilter
-{
-public:
-	virtual bool ShouldCollide(ObjectLayer inLayer1, BroadPhaseLayer inLayer2) const override {
-		switch (inLayer1) {
-		case Layers::NON_MOVING:
-			return inLayer2 == BroadPhaseLayers::MOVING;
-		case Layers::MOVING:
-			return true;
-		default:
-			JPH_ASSERT(false);
-			return false;
-		}
-	}
-};
+	// Rebuilds the broadphase trees. Call this once after a level has been
+	// loaded, it is too expensive to run every frame.
+	void								optimize_broadphase();
 
-
-class PhysicsContext {
-public:
-	void								init(VulkanEngine* pVulkanEngine);
-	void								deinit();
-
-	Character*							create_character(Vec3 position, float radius, float height);
-
-	BodyID								add_box(Transform transform, Vec3 extent);
+	// Box shapes are shared between all bodies with the same extent
+	Ref<Shape>							get_box_shape(Vec3 extent);
 
 	PhysicsSystem* get_physics_system() {
 		return &_physicsSystem;
@@ -192,7 +148,21 @@ public:
 	void								set_debug_flags(PhysicsDebugFlags flags);
 	void								clear_debug_flags(PhysicsDebugFlags flags);
 
-	void								update(float dt);
+	// Returns the number of fixed steps that were simulated.
+	// pfnBeforeLastStep (may be nullptr) is called right before the last
+	// of those steps, so whatever is interpolated with get_alpha() can
+	// snapshot the state that step starts from.
+	uint32_t							update(float dt,
+											PhysicsStepFn pfnBeforeLastStep = nullptr,
+											void* pData = nullptr);
+
+	// Valid rates are 30, 60 and 120 Hz
+	void								set_tick_rate(uint32_t hz);
+	uint32_t							get_tick_rate() { return _tickRate; }
+	float								get_time_step() { return _timeStep; }
+
+	// How far the leftover time is into the next step, in [0, 1)
+	float								get_alpha() { return _accumulator / _timeStep; }
 	
 	// This should also probably be private but need direct access for ImGui
 	// drawing in the edit game state
@@ -200,20 +170,33 @@ public:
 private:
 	BodyActivationListenerImpl			_bodyActivationListener;
 	ContactListenerImpl					_contactListener;
+	PhysicsEventQueue					_eventQueue;
+	std::vector<PhysicsEvent>			_events;
+	uint32_t							_eventLogSampleRate = 0;
+	uint64_t							_eventsSeen = 0;
+	// Running count of added minus removed contacts
+	int64_t								_activeContacts = 0;
 
 	BPLayerInterfaceImpl				_broadPhaseLayerInterface;
 	ObjectVsBroadPhaseLayerFilterImpl	_objectVsBroadphaseLayerFilter;
 	ObjectLayerPairFilterImpl			_objectVsObjectLayerFilter;
 
 	TempAllocatorImpl*					_pTempAllocator;
-	JobSystemThreadPool*				_pJobSystem;
-	DebugRendererSimpleImpl*			_pDebugRenderer;
+	JobSystem*							_pJobSystem;
+	DebugRendererImpl*					_pDebugRenderer;
+
+	PhysicsRecorder						_recorder;
 
 	PhysicsSystem						_physicsSystem;
 	BodyIDVector						_bodyIDs;
 	std::vector<Character*>				_characters;
+	CharacterPool						_characterPool;
+
+	std::unordered_map<BoxShapeKey, Ref<Shape>, BoxShapeKeyHash> _boxShapes;
 
 	float								_accumulator = 0.f;
+	uint32_t							_tickRate = DEFAULT_TICK_RATE;
+	float								_timeStep = 1.f / DEFAULT_TICK_RATE;
 };
 
 
@@ -0,0 +1,208 @@
+#include "phys_record.h"
+
+#include <Jolt/Physics/Collision/Shape/CapsuleShape.h>
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "phys_layers.h"
+
+Ref<CharacterSettings>
+create_character_settings(float radius, float height) {
+	Ref<CharacterSettings> settings = new CharacterSettings();
+	settings->mMaxSlopeAngle = DegreesToRadians(45.0f);
+	settings->mEnhancedInternalEdgeRemoval = true;
+	settings->mLayer = Layers::CHARACTER;
+	settings->mShape = new CapsuleShape(0.5f * height, radius);
+	settings->mFriction = 0.5f;
+	settings->mSupportingVolume = Plane(Vec3::sAxisY(), 2.f);
+	return settings;
+}
+
+static uint64_t
+fnv1a(uint64_t hash, const void* pData, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)pData;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+uint64_t
+hash_physics_state(PhysicsSystem* pPhysicsSystem, CharacterPool* pCharacterPool) {
+	BodyIDVector bodyIDs;
+	pPhysicsSystem->GetBodies(bodyIDs);
+	std::sort(bodyIDs.begin(), bodyIDs.end());
+
+	const BodyLockInterfaceNoLock& lockInterface = pPhysicsSystem->GetBodyLockInterfaceNoLock();
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < bodyIDs.size(); i++) {
+		BodyLockRead lock(lockInterface, bodyIDs[i]);
+		if (!lock.Succeeded() || lock.GetBody().IsStatic()) {
+			continue;
+		}
+		const Body& body = lock.GetBody();
+
+		Float3 values[3];
+		RVec3(body.GetPosition()).StoreFloat3(&values[0]);
+		body.GetLinearVelocity().StoreFloat3(&values[1]);
+		body.GetAngularVelocity().StoreFloat3(&values[2]);
+		Quat rotation = body.GetRotation();
+		Float4 q;
+		rotation.GetXYZW().StoreFloat4(&q);
+
+		uint32_t id = bodyIDs[i].GetIndexAndSequenceNumber();
+		hash = fnv1a(hash, &id, sizeof(id));
+		hash = fnv1a(hash, values, sizeof(values));
+		hash = fnv1a(hash, &q, sizeof(q));
+	}
+
+	if (pCharacterPool != nullptr) {
+		hash = pCharacterPool->hash_state(hash);
+	}
+	return hash;
+}
+
+uint32_t
+PhysicsRecorder::open(const char* path, const PhysicsRecordHeader* pHeader) {
+	_file = fopen(path, "wb");
+	if (_file == nullptr) {
+		fprintf(stderr, "[PhysicsRecorder] Failed to open %s for writing.\n", path);
+		return 0;
+	}
+
+	PhysicsRecordHeader header = *pHeader;
+	header.magic = PHYSICS_RECORD_MAGIC;
+	header.version = PHYSICS_RECORD_VERSION;
+	fwrite(&header, sizeof(header), 1, _file);
+
+	_stepIndex = 0;
+	_lastCharacterStates.clear();
+	fprintf(stderr, "[PhysicsRecorder] Recording to %s.\n", path);
+	return 1;
+}
+
+void
+PhysicsRecorder::close() {
+	if (_file != nullptr) {
+		fclose(_file);
+		_file = nullptr;
+		fprintf(stderr, "[PhysicsRecorder] Recorded %u steps.\n", _stepIndex);
+	}
+}
+
+void
+PhysicsRecorder::write(PhysicsRecordType type, const void* pData, size_t size) {
+	fwrite(&type, sizeof(type), 1, _file);
+	if (size > 0) {
+		fwrite(pData, size, 1, _file);
+	}
+}
+
+void
+PhysicsRecorder::record_add_box(BodyID bodyID, const BodyCreationSettings& settings,
+	Vec3 extent, uint32_t addNow) {
+	PhysicsRecordAddBox r = {};
+	r.bodyID = bodyID.GetIndexAndSequenceNumber();
+	RVec3(settings.mPosition).StoreFloat3((Float3*)r.position);
+	settings.mRotation.GetXYZW().StoreFloat4((Float4*)r.rotation);
+	extent.StoreFloat3((Float3*)r.extent);
+	r.motionType = (uint8_t)settings.mMotionType;
+	r.layer = (uint8_t)settings.mObjectLayer;
+	r.isSensor = settings.mIsSensor;
+	r.addNow = (uint8_t)addNow;
+	write(PHYSICS_RECORD_ADD_BOX, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_commit_bodies(uint32_t count, EActivation activation) {
+	PhysicsRecordCommitBodies r = {};
+	r.count = count;
+	r.activate = activation == EActivation::Activate;
+	write(PHYSICS_RECORD_COMMIT_BODIES, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_remove_body(BodyID bodyID) {
+	PhysicsRecordRemoveBody r = {};
+	r.bodyID = bodyID.GetIndexAndSequenceNumber();
+	write(PHYSICS_RECORD_REMOVE_BODY, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_add_character(uint32_t characterIndex, RVec3 position,
+	float radius, float height) {
+	PhysicsRecordAddCharacter r = {};
+	r.characterIndex = characterIndex;
+	position.StoreFloat3((Float3*)r.position);
+	r.radius = radius;
+	r.height = height;
+	write(PHYSICS_RECORD_ADD_CHARACTER, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_characters(Character* const* ppCharacters, uint32_t count) {
+	if (_lastCharacterStates.size() < count) {
+		// New characters always get written once, 'characterIndex' of the
+		// blank entry can never match
+		PhysicsRecordCharacterState blank = {};
+		blank.characterIndex = UINT32_MAX;
+		_lastCharacterStates.resize(count, blank);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		PhysicsRecordCharacterState r = {};
+		r.characterIndex = i;
+		ppCharacters[i]->GetLinearVelocity().StoreFloat3((Float3*)r.velocity);
+		ppCharacters[i]->GetRotation().GetXYZW().StoreFloat4((Float4*)r.rotation);
+
+		if (memcmp(&r, &_lastCharacterStates[i], sizeof(r)) != 0) {
+			write(PHYSICS_RECORD_CHARACTER_STATE, &r, sizeof(r));
+			_lastCharacterStates[i] = r;
+		}
+	}
+}
+
+void
+PhysicsRecorder::record_add_virtual_character(CharacterHandle handle, RVec3 position,
+	float radius, float height) {
+	PhysicsRecordAddVirtualCharacter r = {};
+	r.handle = handle;
+	position.StoreFloat3((Float3*)r.position);
+	r.radius = radius;
+	r.height = height;
+	write(PHYSICS_RECORD_ADD_VIRTUAL_CHARACTER, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_remove_virtual_character(CharacterHandle handle) {
+	PhysicsRecordRemoveVirtualCharacter r = {};
+	r.handle = handle;
+	write(PHYSICS_RECORD_REMOVE_VIRTUAL_CHARACTER, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_virtual_character_input(CharacterHandle handle,
+	Vec3 desiredVelocity, Quat rotation) {
+	PhysicsRecordVirtualCharacterInput r = {};
+	r.handle = handle;
+	desiredVelocity.StoreFloat3((Float3*)r.desiredVelocity);
+	rotation.GetXYZW().StoreFloat4((Float4*)r.rotation);
+	write(PHYSICS_RECORD_VIRTUAL_CHARACTER_INPUT, &r, sizeof(r));
+}
+
+void
+PhysicsRecorder::record_optimize_broadphase() {
+	write(PHYSICS_RECORD_OPTIMIZE_BROADPHASE, nullptr, 0);
+}
+
+void
+PhysicsRecorder::record_step(float dt, uint64_t stateHash) {
+	PhysicsRecordStep r = {};
+	r.stepIndex = _stepIndex++;
+	r.dt = dt;
+	r.stateHash = stateHash;
+	write(PHYSICS_RECORD_STEP, &r, sizeof(r));
+}
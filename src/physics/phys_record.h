@@ -0,0 +1,151 @@
+#ifndef PHYS_RECORD_H
+#define PHYS_RECORD_H
+
+#include <Jolt/Jolt.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Character/Character.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "phys_characters.h"
+
+using namespace JPH;
+
+#define PHYSICS_RECORD_MAGIC		0x52594850	// "PHYR"
+#define PHYSICS_RECORD_VERSION		2
+
+/*
+* Layout of a physics recording: a PhysicsRecordHeader followed by records,
+* each one a PhysicsRecordType byte and the matching payload struct. The
+* records are in the order the calls happened, replaying them in the same
+* order on the same build gives bit identical results (see physics_replay).
+*/
+enum PhysicsRecordType : uint8_t {
+	PHYSICS_RECORD_ADD_BOX = 0,
+	PHYSICS_RECORD_COMMIT_BODIES = 1,
+	PHYSICS_RECORD_REMOVE_BODY = 2,
+	PHYSICS_RECORD_ADD_CHARACTER = 3,
+	PHYSICS_RECORD_CHARACTER_STATE = 4,
+	PHYSICS_RECORD_OPTIMIZE_BROADPHASE = 5,
+	PHYSICS_RECORD_STEP = 6,
+	PHYSICS_RECORD_ADD_VIRTUAL_CHARACTER = 7,
+	PHYSICS_RECORD_REMOVE_VIRTUAL_CHARACTER = 8,
+	PHYSICS_RECORD_VIRTUAL_CHARACTER_INPUT = 9
+};
+
+#pragma pack(push, 1)
+
+struct PhysicsRecordHeader {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	maxBodies;
+	uint32_t	numBodyMutexes;
+	uint32_t	maxBodyPairs;
+	uint32_t	maxContactConstraints;
+	uint32_t	collisionSteps;
+};
+
+struct PhysicsRecordAddBox {
+	uint32_t	bodyID;
+	float		position[3];
+	float		rotation[4];
+	float		extent[3];
+	uint8_t		motionType;
+	uint8_t		layer;
+	uint8_t		isSensor;
+	// Added on its own (1) or created as part of the next COMMIT_BODIES (0)
+	uint8_t		addNow;
+};
+
+// Adds every box recorded since the last commit in one batch
+struct PhysicsRecordCommitBodies {
+	uint32_t	count;
+	uint8_t		activate;
+};
+
+struct PhysicsRecordRemoveBody {
+	uint32_t	bodyID;
+};
+
+struct PhysicsRecordAddCharacter {
+	uint32_t	characterIndex;
+	float		position[3];
+	float		radius;
+	float		height;
+};
+
+// Only written when the character's velocity or rotation changed
+struct PhysicsRecordCharacterState {
+	uint32_t	characterIndex;
+	float		velocity[3];
+	float		rotation[4];
+};
+
+struct PhysicsRecordAddVirtualCharacter {
+	uint32_t	handle;
+	float		position[3];
+	float		radius;
+	float		height;
+};
+
+struct PhysicsRecordRemoveVirtualCharacter {
+	uint32_t	handle;
+};
+
+struct PhysicsRecordVirtualCharacterInput {
+	uint32_t	handle;
+	float		desiredVelocity[3];
+	float		rotation[4];
+};
+
+struct PhysicsRecordStep {
+	uint32_t	stepIndex;
+	float		dt;
+	uint64_t	stateHash;
+};
+
+#pragma pack(pop)
+
+// Characters have to be built the same way in the game and in the replay
+Ref<CharacterSettings>	create_character_settings(float radius, float height);
+
+// FNV-1a over the id, position, rotation and velocities of every non static
+// body, in body id order, followed by the pooled characters if given
+uint64_t				hash_physics_state(PhysicsSystem* pPhysicsSystem,
+							CharacterPool* pCharacterPool);
+
+class PhysicsRecorder {
+public:
+	uint32_t			open(const char* path, const PhysicsRecordHeader* pHeader);
+	void				close();
+	uint32_t			is_open() { return _file != nullptr; }
+
+	void				record_add_box(BodyID bodyID, const BodyCreationSettings& settings,
+							Vec3 extent, uint32_t addNow);
+	void				record_commit_bodies(uint32_t count, EActivation activation);
+	void				record_remove_body(BodyID bodyID);
+	void				record_add_character(uint32_t characterIndex, RVec3 position,
+							float radius, float height);
+	// Call before every step, writes the characters whose input changed
+	void				record_characters(Character* const* ppCharacters, uint32_t count);
+	void				record_add_virtual_character(CharacterHandle handle, RVec3 position,
+							float radius, float height);
+	void				record_remove_virtual_character(CharacterHandle handle);
+	void				record_virtual_character_input(CharacterHandle handle,
+							Vec3 desiredVelocity, Quat rotation);
+	void				record_optimize_broadphase();
+	void				record_step(float dt, uint64_t stateHash);
+
+private:
+	void				write(PhysicsRecordType type, const void* pData, size_t size);
+
+	FILE*				_file = nullptr;
+	uint32_t			_stepIndex = 0;
+	std::vector<PhysicsRecordCharacterState> _lastCharacterStates;
+};
+
+#endif /* PHYS_RECORD_H */
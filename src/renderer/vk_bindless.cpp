@@ -0,0 +1,349 @@
+#include "vk_bindless.h"
+
+#include "vk_types.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static const char* bindingNames[BINDLESS_BINDING_COUNT] = {
+	"texture", "storage image", "sampler"
+};
+
+static VkDescriptorType
+descriptor_type(BindlessBinding binding) {
+	switch (binding) {
+	case BINDLESS_BINDING_TEXTURES:			return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	case BINDLESS_BINDING_STORAGE_IMAGES:	return VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	default:								return VK_DESCRIPTOR_TYPE_SAMPLER;
+	}
+}
+
+void
+BindlessRegistry::init(VkDevice device, VmaAllocator allocator, DeviceDispatch* pDeviceDispatch,
+	const VkPhysicalDeviceDescriptorBufferPropertiesEXT* pDescriptorBufferProps) {
+	_device = device;
+	_vmaAllocator = allocator;
+	_pDeviceDispatch = pDeviceDispatch;
+	_descriptorBuffer = pDescriptorBufferProps != nullptr;
+
+	// Descriptor buffer layouts can't be UPDATE_AFTER_BIND, they don't need
+	// it either since the buffer is ours to write whenever
+	VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+	VkDescriptorSetLayoutCreateFlags layoutFlags =
+		VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+	if (!_descriptorBuffer) {
+		flags |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+		layoutFlags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	}
+
+	DescriptorLayoutBuilder b;
+	b.add_binding(BINDLESS_BINDING_TEXTURES, descriptor_type(BINDLESS_BINDING_TEXTURES),
+		BINDLESS_MAX_TEXTURES, flags);
+	b.add_binding(BINDLESS_BINDING_STORAGE_IMAGES, descriptor_type(BINDLESS_BINDING_STORAGE_IMAGES),
+		BINDLESS_MAX_STORAGE_IMAGES, flags);
+	b.add_binding(BINDLESS_BINDING_SAMPLERS, descriptor_type(BINDLESS_BINDING_SAMPLERS),
+		BINDLESS_MAX_SAMPLERS, flags);
+	_layout = b.build(device, VK_SHADER_STAGE_ALL, pDeviceDispatch, layoutFlags);
+
+	_slots[BINDLESS_BINDING_TEXTURES].capacity = BINDLESS_MAX_TEXTURES;
+	_slots[BINDLESS_BINDING_STORAGE_IMAGES].capacity = BINDLESS_MAX_STORAGE_IMAGES;
+	_slots[BINDLESS_BINDING_SAMPLERS].capacity = BINDLESS_MAX_SAMPLERS;
+
+	if (_descriptorBuffer) {
+		if (init_descriptor_buffer(pDescriptorBufferProps) == 0) {
+			fprintf(stderr, "[Bindless] Using a %.1f KB descriptor buffer.\n",
+				_buffer.info.size / 1024.f);
+			return;
+		}
+		fprintf(stderr, "[Bindless] Falling back to a descriptor pool.\n");
+		pDeviceDispatch->vkDestroyDescriptorSetLayout(device, _layout, nullptr);
+		init(device, allocator, pDeviceDispatch, nullptr);
+		return;
+	}
+
+	// A single set, the ratios are the descriptor counts
+	std::vector<DescriptorAllocator::PoolSizeRatio> sizes = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, BINDLESS_MAX_TEXTURES },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, BINDLESS_MAX_STORAGE_IMAGES },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, BINDLESS_MAX_SAMPLERS },
+	};
+	_allocator.init(device, 1, sizes, pDeviceDispatch);
+	_set = _allocator.alloc(device, _layout, pDeviceDispatch);
+}
+
+uint32_t
+BindlessRegistry::init_descriptor_buffer(const VkPhysicalDeviceDescriptorBufferPropertiesEXT* pProps) {
+	_descriptorSizes[BINDLESS_BINDING_TEXTURES] = pProps->sampledImageDescriptorSize;
+	_descriptorSizes[BINDLESS_BINDING_STORAGE_IMAGES] = pProps->storageImageDescriptorSize;
+	_descriptorSizes[BINDLESS_BINDING_SAMPLERS] = pProps->samplerDescriptorSize;
+
+	VkDeviceSize size = 0;
+	_pDeviceDispatch->vkGetDescriptorSetLayoutSizeEXT(_device, _layout, &size);
+	for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+		_pDeviceDispatch->vkGetDescriptorSetLayoutBindingOffsetEXT(_device, _layout, i,
+			&_bindingOffsets[i]);
+	}
+
+	// Samplers and images share the buffer, it has to fit both ranges
+	if (size > pProps->maxResourceDescriptorBufferRange ||
+		size > pProps->maxSamplerDescriptorBufferRange) {
+		fprintf(stderr, "[Bindless] The %llu byte descriptor buffer is over the device's range.\n",
+			static_cast<unsigned long long>(size));
+		return 1;
+	}
+
+	_bufferUsage = VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT |
+		VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+	// The GPU reads descriptors from wherever this lands, host visible
+	// device memory when there is some
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = _vmaAllocator;
+	bufferInfo.pBuffer = &_buffer;
+	bufferInfo.allocSize = size;
+	bufferInfo.usage = _bufferUsage;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	create_buffer(&bufferInfo);
+	if (_buffer.buffer == VK_NULL_HANDLE || _buffer.info.pMappedData == nullptr) {
+		fprintf(stderr, "[Bindless] Could not create the descriptor buffer.\n");
+		if (_buffer.buffer != VK_NULL_HANDLE) {
+			destroy_buffer(&_buffer);
+		}
+		_buffer = {};
+		return 1;
+	}
+
+	VkBufferDeviceAddressInfo addrInfo = { .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO };
+	addrInfo.buffer = _buffer.buffer;
+	_bufferAddress = _pDeviceDispatch->vkGetBufferDeviceAddress(_device, &addrInfo);
+
+	// Partially bound, slots nobody wrote are never read
+	memset(_buffer.info.pMappedData, 0, size);
+	return 0;
+}
+
+void
+BindlessRegistry::destroy() {
+	_pDeviceDispatch->vkDestroyDescriptorSetLayout(_device, _layout, nullptr);
+	if (_descriptorBuffer) {
+		destroy_buffer(&_buffer);
+		_buffer = {};
+		_bufferAddress = 0;
+	} else {
+		_allocator.destroy_pool(_device, _pDeviceDispatch);
+	}
+	_layout = VK_NULL_HANDLE;
+	_set = VK_NULL_HANDLE;
+
+	for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+		_slots[i].freeSlots.clear();
+		_slots[i].next = 0;
+		_slots[i].used = 0;
+	}
+	_pendingWrites.clear();
+	_pendingFrees.clear();
+}
+
+uint32_t
+BindlessRegistry::allocate(BindlessBinding binding, const VkDescriptorImageInfo* pInfo) {
+	SlotList* slots = &_slots[binding];
+
+	uint32_t index;
+	if (!slots->freeSlots.empty()) {
+		index = slots->freeSlots.back();
+		slots->freeSlots.pop_back();
+	} else if (slots->next < slots->capacity) {
+		index = slots->next++;
+	} else {
+		fprintf(stderr, "[Bindless] All %u %s slots are in use.\n", slots->capacity,
+			bindingNames[binding]);
+		return BINDLESS_INVALID_INDEX;
+	}
+	slots->used++;
+
+	_pendingWrites.push_back({ binding, index, *pInfo });
+	return index;
+}
+
+void
+BindlessRegistry::release(BindlessBinding binding, uint32_t index) {
+	if (index == BINDLESS_INVALID_INDEX) {
+		return;
+	}
+	_pendingFrees.push_back({ binding, index, _frame });
+}
+
+BindlessTexture
+BindlessRegistry::add_texture(VkImageView view) {
+	VkDescriptorImageInfo info = {};
+	info.imageView = view;
+	info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	return BindlessTexture{ allocate(BINDLESS_BINDING_TEXTURES, &info) };
+}
+
+BindlessStorageImage
+BindlessRegistry::add_storage_image(VkImageView view) {
+	VkDescriptorImageInfo info = {};
+	info.imageView = view;
+	info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	return BindlessStorageImage{ allocate(BINDLESS_BINDING_STORAGE_IMAGES, &info) };
+}
+
+BindlessSampler
+BindlessRegistry::add_sampler(VkSampler sampler) {
+	VkDescriptorImageInfo info = {};
+	info.sampler = sampler;
+	return BindlessSampler{ allocate(BINDLESS_BINDING_SAMPLERS, &info) };
+}
+
+BindlessTexture
+BindlessRegistry::replace_texture(BindlessTexture texture, VkImageView view) {
+	BindlessTexture replacement = add_texture(view);
+	if (replacement.index == BINDLESS_INVALID_INDEX) {
+		return texture;
+	}
+	free_texture(texture);
+	return replacement;
+}
+
+void
+BindlessRegistry::free_texture(BindlessTexture texture) {
+	release(BINDLESS_BINDING_TEXTURES, texture.index);
+}
+
+void
+BindlessRegistry::free_storage_image(BindlessStorageImage image) {
+	release(BINDLESS_BINDING_STORAGE_IMAGES, image.index);
+}
+
+void
+BindlessRegistry::free_sampler(BindlessSampler sampler) {
+	release(BINDLESS_BINDING_SAMPLERS, sampler.index);
+}
+
+void
+BindlessRegistry::flush() {
+	// A slot freed while recording frame N may be referenced by N and the
+	// frames before it, all of which are done once N's fence was waited on
+	size_t kept = 0;
+	for (size_t i = 0; i < _pendingFrees.size(); i++) {
+		const PendingFree* pending = &_pendingFrees[i];
+		if (pending->frame + FRAME_OVERLAP > _frame) {
+			_pendingFrees[kept++] = *pending;
+			continue;
+		}
+		_slots[pending->binding].freeSlots.push_back(pending->index);
+		_slots[pending->binding].used--;
+	}
+	_pendingFrees.resize(kept);
+
+	_stats.writtenSlots = static_cast<uint32_t>(_pendingWrites.size());
+	_stats.writeCount = 0;
+	if (!_pendingWrites.empty()) {
+		if (_descriptorBuffer) {
+			write_descriptor_buffer();
+		} else {
+			write_sets();
+		}
+		_pendingWrites.clear();
+	}
+
+	for (uint32_t i = 0; i < BINDLESS_BINDING_COUNT; i++) {
+		_stats.used[i] = _slots[i].used;
+	}
+	_stats.pendingFrees = static_cast<uint32_t>(_pendingFrees.size());
+}
+
+void
+BindlessRegistry::write_sets() {
+	// Slots next to each other go in one write
+	std::sort(_pendingWrites.begin(), _pendingWrites.end(),
+		[](const PendingWrite& a, const PendingWrite& b) {
+			return a.binding != b.binding ? a.binding < b.binding : a.index < b.index;
+		});
+
+	// Sized up front, the writes point into it
+	_imageInfos.resize(_pendingWrites.size());
+	_writes.clear();
+	for (size_t i = 0; i < _pendingWrites.size(); i++) {
+		const PendingWrite* pending = &_pendingWrites[i];
+		_imageInfos[i] = pending->info;
+
+		if (!_writes.empty()) {
+			VkWriteDescriptorSet* last = &_writes.back();
+			if (last->dstBinding == pending->binding &&
+				last->dstArrayElement + last->descriptorCount == pending->index) {
+				last->descriptorCount++;
+				continue;
+			}
+		}
+
+		VkWriteDescriptorSet write = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		write.dstSet = _set;
+		write.dstBinding = pending->binding;
+		write.dstArrayElement = pending->index;
+		write.descriptorCount = 1;
+		write.descriptorType = descriptor_type(pending->binding);
+		write.pImageInfo = &_imageInfos[i];
+		_writes.push_back(write);
+	}
+
+	_pDeviceDispatch->vkUpdateDescriptorSets(_device, static_cast<uint32_t>(_writes.size()),
+		_writes.data(), 0, nullptr);
+	_stats.writeCount = static_cast<uint32_t>(_writes.size());
+}
+
+void
+BindlessRegistry::write_descriptor_buffer() {
+	uint8_t* pDescriptors = static_cast<uint8_t*>(_buffer.info.pMappedData);
+	for (size_t i = 0; i < _pendingWrites.size(); i++) {
+		const PendingWrite* pending = &_pendingWrites[i];
+
+		VkDescriptorGetInfoEXT info = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT };
+		info.type = descriptor_type(pending->binding);
+		if (pending->binding == BINDLESS_BINDING_TEXTURES) {
+			info.data.pSampledImage = &pending->info;
+		} else if (pending->binding == BINDLESS_BINDING_STORAGE_IMAGES) {
+			info.data.pStorageImage = &pending->info;
+		} else {
+			info.data.pSampler = &pending->info.sampler;
+		}
+
+		size_t size = _descriptorSizes[pending->binding];
+		_pDeviceDispatch->vkGetDescriptorEXT(_device, &info, size,
+			pDescriptors + _bindingOffsets[pending->binding] + pending->index * size);
+	}
+	// No-op on coherent memory
+	vmaFlushAllocation(_vmaAllocator, _buffer.allocation, 0, VK_WHOLE_SIZE);
+	_stats.writeCount = static_cast<uint32_t>(_pendingWrites.size());
+}
+
+void
+BindlessRegistry::bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint,
+	VkPipelineLayout layout) const {
+	if (!_descriptorBuffer) {
+		_pDeviceDispatch->vkCmdBindDescriptorSets(cmd, bindPoint, layout, 0, 1, &_set,
+			0, nullptr);
+		return;
+	}
+
+	VkDescriptorBufferBindingInfoEXT bindingInfo = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT };
+	bindingInfo.address = _bufferAddress;
+	bindingInfo.usage = _bufferUsage;
+	_pDeviceDispatch->vkCmdBindDescriptorBuffersEXT(cmd, 1, &bindingInfo);
+
+	uint32_t bufferIndex = 0;
+	VkDeviceSize offset = 0;
+	_pDeviceDispatch->vkCmdSetDescriptorBufferOffsetsEXT(cmd, bindPoint, layout, 0, 1,
+		&bufferIndex, &offset);
+}
+
+void
+BindlessRegistry::next_frame() {
+	_frame++;
+}
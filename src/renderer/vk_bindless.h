@@ -0,0 +1,169 @@
+#ifndef VK_BINDLESS_H
+#define VK_BINDLESS_H
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "vk_buffers.h"
+#include "vk_descriptors.h"
+#include "vk_dispatch.h"
+
+// Glyph instances pack a texture index in 10 bits, see GLYPH_TEXTURE_BITS
+#define BINDLESS_MAX_TEXTURES		1024
+#define BINDLESS_MAX_STORAGE_IMAGES	64
+#define BINDLESS_MAX_SAMPLERS		32
+
+#define BINDLESS_INVALID_INDEX		0xffffffffu
+
+// Bindings of the bindless set, the shaders declare them as
+//		0: texture2D / textureCube Textures[]
+//		1: image2D StorageImages[]
+//		2: sampler Samplers[]
+enum BindlessBinding : uint32_t {
+	BINDLESS_BINDING_TEXTURES = 0,
+	BINDLESS_BINDING_STORAGE_IMAGES = 1,
+	BINDLESS_BINDING_SAMPLERS = 2,
+	BINDLESS_BINDING_COUNT = 3
+};
+
+// Distinct types so a sampler index can't end up where a texture is read
+struct BindlessTexture {
+	uint32_t				index = BINDLESS_INVALID_INDEX;
+};
+
+struct BindlessStorageImage {
+	uint32_t				index = BINDLESS_INVALID_INDEX;
+};
+
+struct BindlessSampler {
+	uint32_t				index = BINDLESS_INVALID_INDEX;
+};
+
+struct BindlessRegistryStats {
+	uint32_t				used[BINDLESS_BINDING_COUNT];
+	// Freed slots waiting for the frames that may use them
+	uint32_t				pendingFrees;
+	// Descriptors written in the last flush() and the calls that took,
+	// VkWriteDescriptorSets or vkGetDescriptorEXT
+	uint32_t				writtenSlots;
+	uint32_t				writeCount;
+};
+
+/*
+* Owns the bindless descriptor set every pipeline binds at set 0. Slots are
+* handed out from a free list per binding and written on the next flush(),
+* which only touches the slots that changed since the last one. Freed slots
+* aren't reused until the frames that may still reference them are done,
+* so a slot is never rewritten under a pending submit.
+*
+* The set has two backends. With pDescriptorBufferProps the descriptors live
+* in a host visible VK_EXT_descriptor_buffer buffer and flush() writes them
+* with vkGetDescriptorEXT straight into the mapping, there's no pool and no
+* vkUpdateDescriptorSets. Otherwise it is a regular set with UPDATE_AFTER_BIND
+* and UPDATE_UNUSED_WHILE_PENDING bindings. Either way new slots can be
+* written while earlier frames that don't use them execute.
+*
+* Pipelines using the layout must be created with get_pipeline_flags() and
+* bound through bind(), which picks the matching commands.
+*/
+class BindlessRegistry {
+public:
+	// pDescriptorBufferProps is nullptr when the device has no
+	// descriptorBuffer feature, the pool backend is used then and when the
+	// descriptor buffer can't be created
+	void					init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch,
+								const VkPhysicalDeviceDescriptorBufferPropertiesEXT* pDescriptorBufferProps);
+	void					destroy();
+
+	// Invalid handles when the binding is full
+	BindlessTexture			add_texture(VkImageView view);
+	BindlessStorageImage	add_storage_image(VkImageView view);
+	BindlessSampler			add_sampler(VkSampler sampler);
+
+	// Points at 'view' through a new slot and frees the old one, frames in
+	// flight keep sampling what they were recorded with
+	BindlessTexture			replace_texture(BindlessTexture texture, VkImageView view);
+
+	void					free_texture(BindlessTexture texture);
+	void					free_storage_image(BindlessStorageImage image);
+	void					free_sampler(BindlessSampler sampler);
+
+	// Recycles the slots whose frames finished and writes the new ones.
+	// Call once the frame's fence has been waited on, before it's submitted.
+	void					flush();
+
+	// Call once per submitted frame
+	void					next_frame();
+
+	// Binds the set at set 0 of 'layout'
+	void					bind(VkCommandBuffer cmd, VkPipelineBindPoint bindPoint,
+								VkPipelineLayout layout) const;
+
+	VkDescriptorSetLayout	get_layout() const { return _layout; }
+	VkPipelineCreateFlags	get_pipeline_flags() const {
+		return _descriptorBuffer ? VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT : 0;
+	}
+	uint32_t				uses_descriptor_buffer() const { return _descriptorBuffer; }
+	const BindlessRegistryStats& get_stats() const { return _stats; }
+
+private:
+	struct SlotList {
+		std::vector<uint32_t> freeSlots;
+		// Slots past this one were never handed out
+		uint32_t			next = 0;
+		uint32_t			capacity = 0;
+		uint32_t			used = 0;
+	};
+
+	struct PendingWrite {
+		BindlessBinding		binding;
+		uint32_t			index;
+		VkDescriptorImageInfo info;
+	};
+
+	struct PendingFree {
+		BindlessBinding		binding;
+		uint32_t			index;
+		uint64_t			frame;
+	};
+
+	uint32_t				allocate(BindlessBinding binding, const VkDescriptorImageInfo* pInfo);
+	void					release(BindlessBinding binding, uint32_t index);
+	uint32_t				init_descriptor_buffer(
+								const VkPhysicalDeviceDescriptorBufferPropertiesEXT* pProps);
+	void					write_sets();
+	void					write_descriptor_buffer();
+
+	VkDevice				_device;
+	VmaAllocator			_vmaAllocator;
+	DeviceDispatch*			_pDeviceDispatch;
+
+	VkDescriptorSetLayout	_layout = VK_NULL_HANDLE;
+
+	// Pool backend
+	DescriptorAllocator		_allocator{};
+	VkDescriptorSet			_set = VK_NULL_HANDLE;
+
+	// Descriptor buffer backend
+	uint32_t				_descriptorBuffer = 0;
+	AllocatedBuffer			_buffer = {};
+	VkDeviceAddress			_bufferAddress = 0;
+	VkBufferUsageFlags		_bufferUsage = 0;
+	VkDeviceSize			_bindingOffsets[BINDLESS_BINDING_COUNT];
+	size_t					_descriptorSizes[BINDLESS_BINDING_COUNT];
+
+	SlotList				_slots[BINDLESS_BINDING_COUNT];
+	std::vector<PendingWrite> _pendingWrites;
+	std::vector<PendingFree> _pendingFrees;
+
+	// Scratch for flush()
+	std::vector<VkDescriptorImageInfo> _imageInfos;
+	std::vector<VkWriteDescriptorSet> _writes;
+
+	uint64_t				_frame = 0;
+	BindlessRegistryStats	_stats = {};
+};
+
+#endif /* VK_BINDLESS_H */
@@ -9,7 +9,7 @@ void create_buffer(BufferCreateInfo* createInfo) {
 	bufferInfo.usage = createInfo->usage;
 
 	VmaAllocationCreateInfo vmaallocInfo = {};
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+	vmaallocInfo.usage = createInfo->memoryUsage;
 	vmaallocInfo.flags = createInfo->flags;
 
 	createInfo->pBuffer->allocator = createInfo->allocator;
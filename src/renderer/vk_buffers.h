@@ -17,6 +17,7 @@ struct BufferCreateInfo {
 	size_t						allocSize;
 	VkBufferUsageFlags			usage;
 	VmaAllocationCreateFlags	flags;
+	VmaMemoryUsage				memoryUsage = VMA_MEMORY_USAGE_AUTO;
 };
 
 void create_buffer(BufferCreateInfo* create_info);
@@ -1,11 +1,16 @@
 #include "vk_context.h"
 
+#include <algorithm>
+#include <string.h>
 #include <vector>
 
 #include "vk_text.h"
 
 void
-DrawContext::init(uint32_t shadowAtlasExtent, uint32_t numSupportedLights) {
+DrawContext::init(uint32_t shadowAtlasExtent, uint32_t numSupportedLights,
+	const MaterialRegistry* pMaterials) {
+	_pMaterials = pMaterials;
+
 	uint32_t shadowMapsPerRow = static_cast<uint32_t>(std::sqrt(numSupportedLights));
 	uint32_t shadowMapGridSize = shadowAtlasExtent / shadowMapsPerRow;
 	_numSupportedLights = numSupportedLights;
@@ -21,29 +26,31 @@ DrawContext::init(uint32_t shadowAtlasExtent, uint32_t numSupportedLights) {
 		) / glm::vec2(shadowAtlasExtent);
 		_shadowAtlasRegions[i].scale = glm::vec2(shadowMapGridSize) / glm::vec2(shadowAtlasExtent);
 	}
+
+	for (size_t i = 0; i < FRAME_OVERLAP; i++) {
+		_arenas[i].init(DRAW_CONTEXT_ARENA_SIZE);
+	}
+	_arenaIndex = 0;
+	set_arena(&_arenas[_arenaIndex]);
 }
 
 void
-DrawContext::add_line(glm::vec3 from, glm::vec3 to, glm::vec4 color) {
-	_lineData.push_back(LineVertex{
-		.color = color,
-		.position = from
-	});
-	_lineData.push_back(LineVertex{
-		.color = color,
-		.position = to
-	});
+DrawContext::destroy() {
+	for (size_t i = 0; i < FRAME_OVERLAP; i++) {
+		_arenas[i].deinit();
+	}
 }
 
-void 
-DrawContext::add_triangle(glm::vec3 vertices[3], glm::vec4 color) {
-	for (size_t i = 0; i < 3; i++) {
-		_triangleData.push_back(TriangleVertex{
-			.color = color,
-			.position = vertices[i]
-		});
-	}
- }
+void
+DrawContext::set_arena(LinearArena* pArena) {
+	_surfaceData.set_arena(pArena);
+	_opaqueQueue.set_arena(pArena);
+	_transparentQueue.set_arena(pArena);
+	_sortItems.set_arena(pArena);
+	_sortScratch.set_arena(pArena);
+	_wireframeData.set_arena(pArena);
+	_lights.set_arena(pArena);
+}
 
 void
 DrawContext::add_mesh(const Mesh* mesh, const Transform* transform) {
@@ -58,60 +65,43 @@ DrawContext::add_mesh(const Mesh* mesh, const Transform* transform) {
 		data.firstIndex = surface->startIndex;
 		data.indexBufferAddr = mesh->indexOffset;
 		data.materialID = surface->materialID;
+		data.pass = _pMaterials->get_pass(surface->materialID);
+		data.cullMode = _pMaterials->get_cull_mode(surface->materialID);
 		data.vertexBufferAddr = mesh->vertexOffset;
+		data.positionBufferAddr = mesh->positionOffset;
 		data.transform = modelMatrix;
+		data.boundsCenter = glm::vec3(modelMatrix * glm::vec4(surface->boundsCenter, 1.f));
 
 		_surfaceData.push_back(data);
 	}
 }
 
 void
-DrawContext::add_text(const char* text, glm::vec3 position, FontAtlas* pAtlas) {
-	uint32_t vertexOffset = _textData.vertices.size();
-	float offsetX = position.x, offsetY = position.y;
-	for (size_t i = 0; text[i] != '\0'; i++) {
-		char c = text[i];
-		if (c < FIRST_CHAR || c > LAST_CHAR) {
-			continue;
-		}
-
-		GlyphInfo info = pAtlas->get_glyph_info(c, offsetX, offsetY);
-		for (size_t i = 0; i < 4; i++) {
-			_textData.vertices.push_back(TextVertex{
-				.position = info.positions[i],
-				.uv = info.uvs[i],
-				// make all text white temporarily
-				.color = { 1.f, 1.f, 1.f },
-				.fontDescriptorIndex = pAtlas->descriptorIndex
-			});
-		}
-
-		_textData.indices.push_back(vertexOffset + 0);
-		_textData.indices.push_back(vertexOffset + 1);
-		_textData.indices.push_back(vertexOffset + 2);
-		_textData.indices.push_back(vertexOffset + 0);
-		_textData.indices.push_back(vertexOffset + 2);
-		_textData.indices.push_back(vertexOffset + 3);
-
-		vertexOffset += 4;
-		offsetX = info.offsetX;
-	}
+DrawContext::add_wireframe(const WireframeDrawData* pData) {
+	_wireframeData.push_back(*pData);
 }
 
-// This function is a bit iffy because there is no check or enforcment
-// of the structure of data in vertices... but we assume that they come
-// in as a list of triangles.
-// TODO -> THIS FUNCTION IS NOT IMPLEMENTED DO NOT USE
+// Wireframe overlay of a mesh that is already uploaded, the surfaces are
+// drawn straight from 'indexBuffer' at the mesh's offsets
 void
-DrawContext::add_wireframe(std::vector<glm::vec3>& vertices) {
-	uint32_t vertexCount = 0, vertexOffset = _wireframeData.vertices.size();
-	uint32_t triangleIndices[6] = { 0, 1, 2, 0 ,2, 3 };
-	for (size_t i = 0; i < vertices.size(); i++) {
-		_wireframeData.vertices.push_back(Vertex{
-			.position = vertices[i],
-			.color = glm::vec4(1, 0, 1, 1)
-		});
-		vertexCount++;
+DrawContext::add_mesh_wireframe(const Mesh* mesh, VkBuffer indexBuffer,
+	VkDeviceAddress vertexBufferAddr, const Transform* transform, glm::vec4 color) {
+	glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), transform->position);
+	modelMatrix *= glm::mat4_cast(transform->rotation);
+	modelMatrix = glm::scale(modelMatrix, transform->scale);
+
+	for (size_t i = 0; i < mesh->surfaces.size(); i++) {
+		const Surface* surface = &mesh->surfaces[i];
+		WireframeDrawData data;
+		data.indexBuffer = indexBuffer;
+		data.indexOffset = mesh->indexOffset;
+		data.firstIndex = surface->startIndex;
+		data.indexCount = surface->count;
+		data.vertexBufferAddr = vertexBufferAddr + mesh->vertexOffset;
+		data.transform = modelMatrix;
+		data.color = color;
+
+		_wireframeData.push_back(data);
 	}
 }
 
@@ -145,14 +135,182 @@ DrawContext::add_light(const Light* light) {
 	_lights.push_back(newLight);
 }
 
+/*
+* Sort key layout, most significant bits first:
+*
+*   opaque, masked:  pass:2 | state:6  | material:20 | depth:20 | mesh:16
+*   transparent:     pass:2 | ~depth:20 | state:6    | material:20 | mesh:16
+*
+* The state is the pipeline with the cull mode below it, see state_bits().
+* Opaque surfaces are grouped by state and drawn front to back within a
+* material so early-Z rejects what is behind them. Blended surfaces have to
+* be drawn back to front, state only breaks ties. The mesh bits keep draws
+* of the same mesh next to each other.
+*/
+#define SORT_KEY_DEPTH_BITS			20
+#define SORT_KEY_MATERIAL_BITS		20
+#define SORT_KEY_PIPELINE_BITS		6
+#define SORT_KEY_MESH_BITS			16
+#define SORT_KEY_FIELD_MASK(BITS)	((1ull << (BITS)) - 1)
+
+// Positive floats order the same as their bits, the top 20 bits below the
+// sign are a logarithmic depth bucket. Surfaces behind the eye land in 0.
+static uint64_t
+depth_bucket(float depth) {
+	if (!(depth > 0.f)) {
+		return 0;
+	}
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> (31 - SORT_KEY_DEPTH_BITS);
+}
+
+// Surfaces with the same pipeline and cull mode, MAX_PIPELINES times two
+// fits in SORT_KEY_PIPELINE_BITS
+static uint32_t
+state_bits(uint32_t pipeline, VkCullModeFlags cullMode) {
+	return pipeline << 1 | (cullMode == VK_CULL_MODE_NONE);
+}
+
+static uint64_t
+make_sort_key(uint32_t pass, uint32_t state, uint32_t material, float depth,
+	VkDeviceSize indexOffset) {
+	uint64_t p = state & SORT_KEY_FIELD_MASK(SORT_KEY_PIPELINE_BITS);
+	uint64_t m = std::min<uint64_t>(material, SORT_KEY_FIELD_MASK(SORT_KEY_MATERIAL_BITS));
+	uint64_t d = depth_bucket(depth);
+	uint64_t mesh = (indexOffset ^ (indexOffset >> 16) ^ (indexOffset >> 32)) &
+		SORT_KEY_FIELD_MASK(SORT_KEY_MESH_BITS);
+
+	uint64_t key = static_cast<uint64_t>(pass) << 62;
+	if (pass == MATERIAL_PASS_TRANSPARENT) {
+		d = SORT_KEY_FIELD_MASK(SORT_KEY_DEPTH_BITS) - d;
+		key |= d << 42 | p << 36 | m << 16 | mesh;
+	} else {
+		key |= p << 56 | m << 36 | d << 16 | mesh;
+	}
+	return key;
+}
+
+/*
+* LSD radix sort on 8 bit digits, stable, sorts 'pItems' using 'pScratch'
+* as the second buffer and returns the one holding the result. All eight
+* histograms are built in one read of the keys, a digit every key has the
+* same value in needs no pass, which with few materials and pipelines is
+* most of the high ones. Every pass is a histogram, a prefix sum and a
+* scatter, none of which compare keys.
+*/
+static DrawSortItem*
+radix_sort(DrawSortItem* pItems, DrawSortItem* pScratch, size_t count,
+	uint32_t* pPasses) {
+	uint32_t histograms[8][256] = {};
+	for (size_t i = 0; i < count; i++) {
+		uint64_t key = pItems[i].key;
+		for (uint32_t digit = 0; digit < 8; digit++) {
+			histograms[digit][(key >> (digit * 8)) & 0xff]++;
+		}
+	}
+
+	DrawSortItem* pSrc = pItems;
+	DrawSortItem* pDst = pScratch;
+	*pPasses = 0;
+	for (uint32_t digit = 0; digit < 8; digit++) {
+		uint32_t* histogram = histograms[digit];
+		if (histogram[(pSrc[0].key >> (digit * 8)) & 0xff] == count) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < 256; bucket++) {
+			uint32_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+		for (size_t i = 0; i < count; i++) {
+			pDst[histogram[(pSrc[i].key >> (digit * 8)) & 0xff]++] = pSrc[i];
+		}
+
+		DrawSortItem* pTmp = pSrc;
+		pSrc = pDst;
+		pDst = pTmp;
+		(*pPasses)++;
+	}
+	return pSrc;
+}
+
+void
+DrawContext::sort_surfaces(const glm::mat4& view,
+	const uint32_t passPipelines[MATERIAL_PASS_COUNT]) {
+	_opaqueQueue.clear();
+	_transparentQueue.clear();
+	_sortItems.clear();
+	_sortScratch.clear();
+	_sortStats = {};
+
+	size_t count = _surfaceData.size();
+	if (count == 0) {
+		return;
+	}
+
+	// The view looks down -z, depth is the distance in front of the eye
+	// of the surface's bounds center. The primitives of a mesh share its
+	// origin, that would put them all in the same bucket.
+	DrawSortItem* pItems = _sortItems.push_n(count);
+	DrawSortItem* pScratch = _sortScratch.push_n(count);
+	uint32_t lastPipeline = UINT32_MAX;
+	uint32_t lastMaterial = MATERIAL_INVALID;
+	for (size_t i = 0; i < count; i++) {
+		const SurfaceDrawData* surface = &_surfaceData[i];
+		uint32_t pipeline = passPipelines[surface->pass];
+		float depth = -(view * glm::vec4(surface->boundsCenter, 1.f)).z;
+
+		pItems[i].key = make_sort_key(surface->pass,
+			state_bits(pipeline, surface->cullMode), surface->materialID,
+			depth, surface->indexBufferAddr);
+		pItems[i].surface = static_cast<uint32_t>(i);
+		pItems[i].padding = 0;
+
+		_sortStats.unsortedPipelineChanges += pipeline != lastPipeline;
+		_sortStats.unsortedMaterialChanges += surface->materialID != lastMaterial;
+		lastPipeline = pipeline;
+		lastMaterial = surface->materialID;
+	}
+
+	const DrawSortItem* pSorted = radix_sort(pItems, pScratch, count,
+		&_sortStats.radixPasses);
+
+	lastPipeline = UINT32_MAX;
+	lastMaterial = MATERIAL_INVALID;
+	for (size_t i = 0; i < count; i++) {
+		const SurfaceDrawData* surface = &_surfaceData[pSorted[i].surface];
+		uint32_t pipeline = passPipelines[surface->pass];
+		if (surface->pass == MATERIAL_PASS_TRANSPARENT) {
+			_transparentQueue.push_back(pSorted[i].surface);
+		} else {
+			_opaqueQueue.push_back(pSorted[i].surface);
+		}
+
+		_sortStats.pipelineChanges += pipeline != lastPipeline;
+		_sortStats.materialChanges += surface->materialID != lastMaterial;
+		lastPipeline = pipeline;
+		lastMaterial = surface->materialID;
+	}
+	_sortStats.opaqueCount = static_cast<uint32_t>(_opaqueQueue.size());
+	_sortStats.transparentCount = static_cast<uint32_t>(_transparentQueue.size());
+}
+
 void
 DrawContext::clear() {
-	_lineData.clear();
-	_triangleData.clear();
 	_surfaceData.clear();
-	_textData.vertices.clear();
-	_textData.indices.clear();
-	_wireframeData.vertices.clear();
-	_wireframeData.indices.clear();
+	_opaqueQueue.clear();
+	_transparentQueue.clear();
+	_sortItems.clear();
+	_sortScratch.clear();
+	_wireframeData.clear();
 	_lights.clear();
+
+	// The next frame records into the next arena, whatever pointed into the
+	// one being reset belongs to a frame that has already been submitted
+	_arenaIndex = (_arenaIndex + 1) % FRAME_OVERLAP;
+	_arenas[_arenaIndex].reset();
+	set_arena(&_arenas[_arenaIndex]);
 }
\ No newline at end of file
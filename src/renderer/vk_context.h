@@ -1,9 +1,36 @@
 #ifndef VK_CONTEXT_H
 #define VK_CONTEXT_H
 
+#include "../core/linear_arena.h"
+
 #include "vk_types.h"
 #include "vk_buffers.h"
-#include "vk_text.h"
+#include "vk_materials.h"
+
+// Starting size of each frame's arena, it grows to the high-water mark
+#define DRAW_CONTEXT_ARENA_SIZE		4 * 1024 * 1024
+
+// One surface in draw order, 'key' is built by make_sort_key() in
+// vk_context.cpp and 'surface' indexes DrawContext::_surfaceData
+struct DrawSortItem {
+	uint64_t						key;
+	uint32_t						surface;
+	uint32_t						padding;
+};
+
+struct DrawSortStats {
+	uint32_t						opaqueCount;
+	uint32_t						transparentCount;
+	// 8 bit digits the radix sort moved the keys on, digits every key
+	// shares are skipped
+	uint32_t						radixPasses;
+	// Pipeline binds and material switches drawing the queues takes, and
+	// what drawing the surfaces in submission order would have taken
+	uint32_t						pipelineChanges;
+	uint32_t						materialChanges;
+	uint32_t						unsortedPipelineChanges;
+	uint32_t						unsortedMaterialChanges;
+};
 
 // These are normalized coordinates (i.e 0 to 1)
 struct ShadowAtlasRegion {
@@ -14,6 +41,10 @@ struct ShadowAtlasRegion {
 /*
 * This class is the main data structure that provides a "global" view
 * of a scene in a frame.
+*
+* The per-frame lists live in a linear arena (one per frame in flight) that
+* is reset in clear(), so recording a frame does no heap allocations once
+* the arenas have grown to fit the busiest frame.
 */
 
 class DrawContext {
@@ -26,29 +57,58 @@ public:
 		WIREFRAME
 	};
 
-	void							init(uint32_t shadowAtlasExtent, uint32_t numSupportedLights);
+	// pMaterials decides which pass the surfaces go in
+	void							init(uint32_t shadowAtlasExtent, uint32_t numSupportedLights,
+										const MaterialRegistry* pMaterials);
+	void							destroy();
 
-	void							add_line(glm::vec3 from, glm::vec3 to, glm::vec4 color);
-	void							add_triangle(glm::vec3 vertices[3], glm::vec4 color);
 	void							add_mesh(const Mesh* mesh, const Transform* transform);
-	void							add_text(const char* text, glm::vec3 position, FontAtlas* pAtlas);
-	void							add_wireframe(std::vector<glm::vec3>& vertices);
+	void							add_wireframe(const WireframeDrawData* pData);
+	void							add_mesh_wireframe(const Mesh* mesh, VkBuffer indexBuffer,
+										VkDeviceAddress vertexBufferAddr,
+										const Transform* transform, glm::vec4 color);
 
 	void							add_light(const Light* light);
 
+	// Fills _opaqueQueue and _transparentQueue from _surfaceData. Opaque
+	// surfaces are grouped by pipeline and material, then drawn front to
+	// back, masked ones come after them in the same queue. Transparent
+	// ones are drawn back to front. 'view' gives the
+	// depth, 'passPipelines' the pipeline each MaterialPass is drawn with.
+	void							sort_surfaces(const glm::mat4& view,
+										const uint32_t passPipelines[MATERIAL_PASS_COUNT]);
+	const DrawSortStats&			get_sort_stats() const { return _sortStats; }
+
 	void							clear();
 
+	// Stats of the arena the current frame is recorded into
+	LinearArenaStats				get_arena_stats() const {
+		return _arenas[_arenaIndex].get_stats();
+	}
+
 //private: the data below SHOULD be private but I want to access it directly until
 	// the rest of the rendering logic is moved here
-	std::vector<LineVertex>			_lineData = {};
-	std::vector<TriangleVertex>		_triangleData = {};
-	std::vector<SurfaceDrawData>	_surfaceData = {};
-	TextDrawDataS					_textData = {};
-	WireframeDrawDataS				_wireframeData = {};
+	ArenaArray<SurfaceDrawData>		_surfaceData = {};
+	// Indices into _surfaceData in draw order, valid after sort_surfaces()
+	ArenaArray<uint32_t>			_opaqueQueue = {};
+	ArenaArray<uint32_t>			_transparentQueue = {};
+	ArenaArray<WireframeDrawData>	_wireframeData = {};
 
 	uint32_t						_numSupportedLights;
-	std::vector<Light>				_lights = {};
+	ArenaArray<Light>				_lights = {};
 	std::vector<ShadowAtlasRegion>	_shadowAtlasRegions = {};
+
+private:
+	void							set_arena(LinearArena* pArena);
+
+	const MaterialRegistry*			_pMaterials = nullptr;
+
+	ArenaArray<DrawSortItem>		_sortItems = {};
+	ArenaArray<DrawSortItem>		_sortScratch = {};
+	DrawSortStats					_sortStats = {};
+
+	LinearArena						_arenas[FRAME_OVERLAP];
+	uint32_t						_arenaIndex = 0;
 };
 
 #endif /* VK_CONTEXT_H */
\ No newline at end of file
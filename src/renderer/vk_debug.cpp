@@ -0,0 +1,202 @@
+#include "vk_debug.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+void
+DebugGeometry::init(VkDevice device, VmaAllocator allocator,
+	DeviceDispatch* pDeviceDispatch) {
+	_allocator = allocator;
+
+	// Host visible so meshes can be written without a transfer, this is only
+	// debug geometry and with resizable BAR it ends up in VRAM anyway
+	_geometry.create_buffer(device, allocator, DEBUG_GEOMETRY_SIZE,
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT,
+		pDeviceDispatch);
+
+	_instances.reserve(MAX_DEBUG_INSTANCES);
+	_batches.reserve(MAX_DEBUG_MESHES);
+
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = allocator;
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+	VkBufferDeviceAddressInfo addrInfo = {};
+	addrInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	addrInfo.pNext = nullptr;
+
+	for (size_t i = 0; i < TRANSIENT_FRAME_COUNT; i++) {
+		bufferInfo.pBuffer = &_instanceBuffers[i];
+		bufferInfo.allocSize = MAX_DEBUG_INSTANCES * sizeof(GPUDebugInstance);
+		create_buffer(&bufferInfo);
+		addrInfo.buffer = _instanceBuffers[i].buffer;
+		_instanceAddrs[i] = pDeviceDispatch->vkGetBufferDeviceAddress(device, &addrInfo);
+	}
+}
+
+void
+DebugGeometry::destroy() {
+	for (size_t i = 0; i < TRANSIENT_FRAME_COUNT; i++) {
+		destroy_buffer(&_instanceBuffers[i]);
+	}
+	_geometry.destroy_buffer(_allocator);
+}
+
+DebugMeshHandle
+DebugGeometry::create_mesh(const DebugVertex* pVertices, uint32_t vertexCount,
+	const uint32_t* pIndices, uint32_t indexCount) {
+	DebugMeshHandle handle;
+	if (_freeCount > 0) {
+		handle = _freeList[--_freeCount];
+	} else if (_meshCount < MAX_DEBUG_MESHES) {
+		handle = _meshCount++;
+	} else {
+		fprintf(stderr, "[DebugGeometry] Failed to create mesh: max meshes reached.\n");
+		return INVALID_DEBUG_MESH;
+	}
+
+	size_t vertexSize = vertexCount * sizeof(DebugVertex);
+	size_t indexSize = indexCount * sizeof(uint32_t);
+	// Padded so every block starts vertex aligned
+	VkDeviceSize blockSize = (vertexSize + indexSize + sizeof(DebugVertex) - 1) &
+		~(VkDeviceSize)(sizeof(DebugVertex) - 1);
+	VkDeviceSize vertexOffset = allocate_block(blockSize);
+	VkDeviceSize indexOffset = vertexOffset + vertexSize;
+	if (vertexOffset == VK_WHOLE_SIZE) {
+		fprintf(stderr, "[DebugGeometry] Failed to create mesh: out of geometry memory.\n");
+		_freeList[_freeCount++] = handle;
+		return INVALID_DEBUG_MESH;
+	}
+
+	uint8_t* data = (uint8_t*)_geometry.info.pMappedData;
+	memcpy(data + vertexOffset, pVertices, vertexSize);
+	memcpy(data + indexOffset, pIndices, indexSize);
+
+	DebugMesh* mesh = &_meshes[handle];
+	mesh->vertexOffset = vertexOffset;
+	mesh->indexOffset = indexOffset;
+	mesh->indexCount = indexCount;
+	mesh->alive = 1;
+	mesh->blockSize = blockSize;
+	return handle;
+}
+
+// First fit from the reusable blocks, otherwise from the end of the buffer
+VkDeviceSize
+DebugGeometry::allocate_block(VkDeviceSize size) {
+	for (size_t i = 0; i < _freeBlocks.size(); i++) {
+		FreeBlock* block = &_freeBlocks[i];
+		if (block->size < size) {
+			continue;
+		}
+		VkDeviceSize offset = block->offset;
+		block->offset += size;
+		block->size -= size;
+		if (block->size == 0) {
+			_freeBlocks[i] = _freeBlocks.back();
+			_freeBlocks.pop_back();
+		}
+		return offset;
+	}
+	return _geometry.suballocate(size, sizeof(DebugVertex));
+}
+
+void
+DebugGeometry::destroy_mesh(DebugMeshHandle handle) {
+	if (handle >= _meshCount || !_meshes[handle].alive) {
+		return;
+	}
+	DebugMesh* mesh = &_meshes[handle];
+	mesh->alive = 0;
+	_pendingBlocks.push_back({ mesh->vertexOffset, mesh->blockSize, _frame });
+	_freeList[_freeCount++] = handle;
+}
+
+void
+DebugGeometry::add_instance(DebugMeshHandle handle, const glm::mat4& model,
+	glm::vec4 color, DebugDrawMode mode) {
+	if (handle >= _meshCount || !_meshes[handle].alive) {
+		return;
+	}
+	if (_instances.size() >= MAX_DEBUG_INSTANCES) {
+		_droppedInstances++;
+		return;
+	}
+	DebugInstance instance;
+	instance.key = (handle << 1) | mode;
+	instance.data.model = model;
+	instance.data.color = color;
+	_instances.push_back(instance);
+}
+
+const std::vector<DebugDrawBatch>&
+DebugGeometry::prepare() {
+	_batches.clear();
+	if (_instances.empty()) {
+		return _batches;
+	}
+
+	// Stable so instances of one mesh keep their submission order
+	std::stable_sort(_instances.begin(), _instances.end(),
+		[](const DebugInstance& a, const DebugInstance& b) {
+			return a.key < b.key;
+		});
+
+	GPUDebugInstance* data = (GPUDebugInstance*)_instanceBuffers[_slot].info.pMappedData;
+	uint32_t count = static_cast<uint32_t>(_instances.size());
+	for (uint32_t i = 0; i < count; i++) {
+		data[i] = _instances[i].data;
+
+		uint32_t key = _instances[i].key;
+		if (i > 0 && key == _instances[i - 1].key) {
+			_batches.back().instanceCount++;
+			continue;
+		}
+
+		const DebugMesh* mesh = &_meshes[key >> 1];
+		DebugDrawBatch batch;
+		batch.vertexBuffer = _geometry.addr + mesh->vertexOffset;
+		batch.indexOffset = mesh->indexOffset;
+		batch.indexCount = mesh->indexCount;
+		batch.firstInstance = i;
+		batch.instanceCount = 1;
+		batch.mode = (DebugDrawMode)(key & 1);
+		_batches.push_back(batch);
+	}
+
+	return _batches;
+}
+
+void
+DebugGeometry::next_frame() {
+	_stats.meshCount = _meshCount - _freeCount;
+	_stats.instanceCount = static_cast<uint32_t>(_instances.size());
+	_stats.batchCount = static_cast<uint32_t>(_batches.size());
+	_stats.droppedInstances = _droppedInstances;
+
+	_instances.clear();
+	_batches.clear();
+	_droppedInstances = 0;
+	_slot = (_slot + 1) % TRANSIENT_FRAME_COUNT;
+	_frame++;
+
+	// A frame can draw a mesh that is destroyed while it is being recorded,
+	// after TRANSIENT_FRAME_COUNT more frames that frame has completed for sure
+	for (size_t i = 0; i < _pendingBlocks.size();) {
+		if (_frame - _pendingBlocks[i].frame > TRANSIENT_FRAME_COUNT) {
+			_freeBlocks.push_back(_pendingBlocks[i]);
+			_pendingBlocks[i] = _pendingBlocks.back();
+			_pendingBlocks.pop_back();
+		} else {
+			i++;
+		}
+	}
+}
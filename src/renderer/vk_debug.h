@@ -0,0 +1,124 @@
+#ifndef VK_DEBUG_H
+#define VK_DEBUG_H
+
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_buffers.h"
+#include "vk_suballocator.h"
+
+#define MAX_DEBUG_MESHES		4096
+#define MAX_DEBUG_INSTANCES		65536
+#define DEBUG_GEOMETRY_SIZE		32 * 1024 * 1024
+
+typedef uint32_t			DebugMeshHandle;
+#define INVALID_DEBUG_MESH	UINT32_MAX
+
+enum DebugDrawMode : uint32_t {
+	DEBUG_DRAW_SOLID = 0,
+	DEBUG_DRAW_WIREFRAME = 1
+};
+
+// Consecutive instances of one mesh, drawn with a single instanced call
+struct DebugDrawBatch {
+	VkDeviceAddress		vertexBuffer;
+	VkDeviceSize		indexOffset;
+	uint32_t			indexCount;
+	uint32_t			firstInstance;
+	uint32_t			instanceCount;
+	DebugDrawMode		mode;
+};
+
+struct DebugGeometryStats {
+	uint32_t			meshCount;
+	uint32_t			instanceCount;
+	uint32_t			batchCount;
+	// Instances that did not fit into this frame's buffer
+	uint32_t			droppedInstances;
+};
+
+/*
+* Geometry for debug overlays (mainly the Jolt debug renderer). Meshes are
+* uploaded once into a mapped geometry buffer and drawn as instances, the
+* instances are written into a mapped per-frame buffer. Debug lines go
+* through VulkanEngine::draw_line().
+*/
+class DebugGeometry {
+public:
+	void					init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch);
+	void					destroy();
+
+	DebugMeshHandle			create_mesh(const DebugVertex* pVertices, uint32_t vertexCount,
+								const uint32_t* pIndices, uint32_t indexCount);
+	// The mesh's memory is reused once the frames that may still draw it
+	// have completed
+	void					destroy_mesh(DebugMeshHandle handle);
+
+	void					add_instance(DebugMeshHandle handle, const glm::mat4& model,
+								glm::vec4 color, DebugDrawMode mode);
+
+	// Sorts this frame's instances by mesh and writes them out, returns the
+	// batches to draw. Call once while recording the frame.
+	const std::vector<DebugDrawBatch>& prepare();
+	// Moves on to the next set of per-frame buffers
+	void					next_frame();
+
+	VkBuffer				get_geometry_buffer() const { return _geometry.buffer; }
+	VkDeviceAddress			get_instance_addr() const { return _instanceAddrs[_slot]; }
+
+	// Numbers for the last completed frame
+	const DebugGeometryStats& get_stats() const { return _stats; }
+
+private:
+	struct DebugMesh {
+		VkDeviceSize		vertexOffset;
+		VkDeviceSize		indexOffset;
+		uint32_t			indexCount;
+		uint32_t			alive;
+		// The vertices and indices are one block starting at vertexOffset
+		VkDeviceSize		blockSize;
+	};
+
+	struct FreeBlock {
+		VkDeviceSize		offset;
+		VkDeviceSize		size;
+		// Frame the block was freed in, see next_frame()
+		uint64_t			frame;
+	};
+
+	VkDeviceSize			allocate_block(VkDeviceSize size);
+
+	struct DebugInstance {
+		// (mesh << 1) | mode, instances are sorted on this
+		uint32_t			key;
+		GPUDebugInstance	data;
+	};
+
+	VmaAllocator			_allocator;
+	VkBufferSuballocator	_geometry;
+
+	DebugMesh				_meshes[MAX_DEBUG_MESHES] = {};
+	uint32_t				_freeList[MAX_DEBUG_MESHES];
+	uint32_t				_freeCount = 0;
+	uint32_t				_meshCount = 0;
+
+	// Blocks of destroyed meshes, the pending ones may still be in use by
+	// the GPU
+	std::vector<FreeBlock>	_pendingBlocks;
+	std::vector<FreeBlock>	_freeBlocks;
+	uint64_t				_frame = 0;
+
+	std::vector<DebugInstance> _instances;
+	std::vector<DebugDrawBatch> _batches;
+
+	uint32_t				_slot = 0;
+	AllocatedBuffer			_instanceBuffers[TRANSIENT_FRAME_COUNT];
+	VkDeviceAddress			_instanceAddrs[TRANSIENT_FRAME_COUNT];
+
+	// Counter for the frame being recorded, copied to _stats in next_frame()
+	uint32_t				_droppedInstances = 0;
+	DebugGeometryStats		_stats = {};
+};
+
+#endif /* VK_DEBUG_H */
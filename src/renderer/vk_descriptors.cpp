@@ -18,7 +18,7 @@ void DescriptorLayoutBuilder::clear()
 }
 
 VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderStageFlags shaderStages,
-	DeviceDispatch* deviceDispatch) {
+	DeviceDispatch* deviceDispatch, VkDescriptorSetLayoutCreateFlags layoutFlags) {
 	for (auto& b : bindings) {
 		b.stageFlags |= shaderStages;
 	}
@@ -35,7 +35,7 @@ VkDescriptorSetLayout DescriptorLayoutBuilder::build(VkDevice device, VkShaderSt
 	ci.pNext = &flags;
 	ci.pBindings = bindings.data();
 	ci.bindingCount = (uint32_t)bindings.size();
-	ci.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	ci.flags = layoutFlags;
 
 	VkDescriptorSetLayout set;
 	if (deviceDispatch->vkCreateDescriptorSetLayout(device, &ci, NULL, &set) != VK_SUCCESS) {
@@ -1,3 +1,6 @@
+#ifndef VK_DESCRIPTORS_H
+#define VK_DESCRIPTORS_H
+
 #include <vector>
 #include <span>
 #include <deque>
@@ -18,7 +21,8 @@ struct DescriptorLayoutBuilder {
 		VkDescriptorBindingFlags flags);
 	void clear();
 	VkDescriptorSetLayout build(VkDevice device, VkShaderStageFlags shaderStages,
-		DeviceDispatch *deviceDispatch);
+		DeviceDispatch *deviceDispatch,
+		VkDescriptorSetLayoutCreateFlags layoutFlags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
 };
 
 struct DescriptorAllocator {
@@ -54,4 +58,6 @@ public:
 private:
 	uint32_t imgIndex = 0;
 	uint32_t bufIndex = 0;
-};
\ No newline at end of file
+};
+
+#endif /* VK_DESCRIPTORS_H */
@@ -106,16 +106,33 @@ void load_device_dispatch_table(DeviceDispatch *disp, PFN_vkGetInstanceProcAddr
 	disp->vkCmdSetScissor = (PFN_vkCmdSetScissor)disp->vkGetDeviceProcAddr(dev, "vkCmdSetScissor");
 	disp->vkCmdSetLineWidth = (PFN_vkCmdSetLineWidth)disp->vkGetDeviceProcAddr(dev, "vkCmdSetLineWidth");
 	disp->vkCmdSetDepthTestEnable = (PFN_vkCmdSetDepthTestEnable)disp->vkGetDeviceProcAddr(dev, "vkCmdSetDepthTestEnable");
+	disp->vkCmdSetCullMode = (PFN_vkCmdSetCullMode)disp->vkGetDeviceProcAddr(dev, "vkCmdSetCullMode");
 
 	disp->vkCmdClearAttachments = (PFN_vkCmdClearAttachments)disp->vkGetDeviceProcAddr(dev, "vkCmdClearAttachments");
 
 	disp->vkCmdDraw = (PFN_vkCmdDraw)disp->vkGetDeviceProcAddr(dev, "vkCmdDraw");
 	disp->vkCmdDrawIndexed = (PFN_vkCmdDrawIndexed)disp->vkGetDeviceProcAddr(dev, "vkCmdDrawIndexed");
+	disp->vkCmdDrawIndexedIndirect = (PFN_vkCmdDrawIndexedIndirect)disp->vkGetDeviceProcAddr(dev, "vkCmdDrawIndexedIndirect");
+
+	disp->vkCreateQueryPool = (PFN_vkCreateQueryPool)disp->vkGetDeviceProcAddr(dev, "vkCreateQueryPool");
+	disp->vkDestroyQueryPool = (PFN_vkDestroyQueryPool)disp->vkGetDeviceProcAddr(dev, "vkDestroyQueryPool");
+	disp->vkCmdResetQueryPool = (PFN_vkCmdResetQueryPool)disp->vkGetDeviceProcAddr(dev, "vkCmdResetQueryPool");
+	disp->vkCmdBeginQuery = (PFN_vkCmdBeginQuery)disp->vkGetDeviceProcAddr(dev, "vkCmdBeginQuery");
+	disp->vkCmdEndQuery = (PFN_vkCmdEndQuery)disp->vkGetDeviceProcAddr(dev, "vkCmdEndQuery");
+	disp->vkGetQueryPoolResults = (PFN_vkGetQueryPoolResults)disp->vkGetDeviceProcAddr(dev, "vkGetQueryPoolResults");
+	disp->vkCmdWriteTimestamp2 = (PFN_vkCmdWriteTimestamp2)disp->vkGetDeviceProcAddr(dev, "vkCmdWriteTimestamp2");
 
 	disp->vkCmdCopyBuffer = (PFN_vkCmdCopyBuffer)disp->vkGetDeviceProcAddr(dev, "vkCmdCopyBuffer");
 	disp->vkCmdCopyBufferToImage = (PFN_vkCmdCopyBufferToImage)disp->vkGetDeviceProcAddr(dev, "vkCmdCopyBufferToImage");
+	disp->vkCmdCopyImage2 = (PFN_vkCmdCopyImage2)disp->vkGetDeviceProcAddr(dev, "vkCmdCopyImage2");
 	disp->vkGetBufferDeviceAddress = (PFN_vkGetBufferDeviceAddress)disp->vkGetDeviceProcAddr(dev, "vkGetBufferDeviceAddress");
 
+	disp->vkGetDescriptorSetLayoutSizeEXT = (PFN_vkGetDescriptorSetLayoutSizeEXT)disp->vkGetDeviceProcAddr(dev, "vkGetDescriptorSetLayoutSizeEXT");
+	disp->vkGetDescriptorSetLayoutBindingOffsetEXT = (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT)disp->vkGetDeviceProcAddr(dev, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+	disp->vkGetDescriptorEXT = (PFN_vkGetDescriptorEXT)disp->vkGetDeviceProcAddr(dev, "vkGetDescriptorEXT");
+	disp->vkCmdBindDescriptorBuffersEXT = (PFN_vkCmdBindDescriptorBuffersEXT)disp->vkGetDeviceProcAddr(dev, "vkCmdBindDescriptorBuffersEXT");
+	disp->vkCmdSetDescriptorBufferOffsetsEXT = (PFN_vkCmdSetDescriptorBufferOffsetsEXT)disp->vkGetDeviceProcAddr(dev, "vkCmdSetDescriptorBufferOffsetsEXT");
+
 	disp->vkCreateSampler = (PFN_vkCreateSampler)disp->vkGetDeviceProcAddr(dev, "vkCreateSampler");
 	disp->vkDestroySampler = (PFN_vkDestroySampler)disp->vkGetDeviceProcAddr(dev, "vkDestroySampler");
 }
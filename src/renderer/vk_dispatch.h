@@ -105,16 +105,34 @@ struct DeviceDispatch {
 	PFN_vkCmdSetScissor vkCmdSetScissor;
 	PFN_vkCmdSetLineWidth vkCmdSetLineWidth;
 	PFN_vkCmdSetDepthTestEnable vkCmdSetDepthTestEnable;
+	PFN_vkCmdSetCullMode vkCmdSetCullMode;
 
 	PFN_vkCmdClearAttachments vkCmdClearAttachments;
 
 	PFN_vkCmdDraw vkCmdDraw;
 	PFN_vkCmdDrawIndexed vkCmdDrawIndexed;
+	PFN_vkCmdDrawIndexedIndirect vkCmdDrawIndexedIndirect;
+
+	PFN_vkCreateQueryPool vkCreateQueryPool;
+	PFN_vkDestroyQueryPool vkDestroyQueryPool;
+	PFN_vkCmdResetQueryPool vkCmdResetQueryPool;
+	PFN_vkCmdBeginQuery vkCmdBeginQuery;
+	PFN_vkCmdEndQuery vkCmdEndQuery;
+	PFN_vkGetQueryPoolResults vkGetQueryPoolResults;
+	PFN_vkCmdWriteTimestamp2 vkCmdWriteTimestamp2;
 
 	PFN_vkCmdCopyBuffer vkCmdCopyBuffer;
 	PFN_vkCmdCopyBufferToImage vkCmdCopyBufferToImage;
+	PFN_vkCmdCopyImage2 vkCmdCopyImage2;
 	PFN_vkGetBufferDeviceAddress vkGetBufferDeviceAddress;
 
+	// VK_EXT_descriptor_buffer, null when the device doesn't have it
+	PFN_vkGetDescriptorSetLayoutSizeEXT vkGetDescriptorSetLayoutSizeEXT;
+	PFN_vkGetDescriptorSetLayoutBindingOffsetEXT vkGetDescriptorSetLayoutBindingOffsetEXT;
+	PFN_vkGetDescriptorEXT vkGetDescriptorEXT;
+	PFN_vkCmdBindDescriptorBuffersEXT vkCmdBindDescriptorBuffersEXT;
+	PFN_vkCmdSetDescriptorBufferOffsetsEXT vkCmdSetDescriptorBufferOffsetsEXT;
+
 	PFN_vkCreateSampler vkCreateSampler;
 	PFN_vkDestroySampler vkDestroySampler;
 };
@@ -12,6 +12,8 @@
 
 #include <stb_image.h>
 
+#include <stdlib.h>
+
 #if defined(VK_USE_PLATFORM_WIN32_KHR)
 	#define load_proc_addr GetProcAddress
 #elif defined(VK_USE_PLATFORM_XCB_KHR)
@@ -85,7 +87,7 @@ VulkanEngine::init() {
 
 	// Begin the shader monitor thread (passing 'this' seems suspect)
 	shaderMonitorThread = std::thread(&VulkanEngine::shader_monitor_thread, this);
-	_mainDrawContext.init(shadowMapAtlas.imageExtent.width, 4);
+	_mainDrawContext.init(shadowMapAtlas.imageExtent.width, 4, &materialRegistry);
 
 	return ENGINE_SUCCESS;
 }
@@ -144,6 +146,7 @@ VulkanEngine::deinit() {
 	}
 
 	mainDeletionQueue.flush();
+	_mainDrawContext.destroy();
 
 	if (swapchain != NULL) {
 		ENGINE_MESSAGE("Destroying swapchain image views.");
@@ -356,10 +359,16 @@ VulkanEngine::device_suitable(VkPhysicalDevice device) {
 
 	return devprops.properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &
 		devfeats.features.geometryShader &
+		devfeats.features.multiDrawIndirect &
+		devfeats.features.drawIndirectFirstInstance &
 		devfeats.features.wideLines &
 		devfeats.features.fillModeNonSolid &
 		indexingfeats.shaderSampledImageArrayNonUniformIndexing &
 		indexingfeats.descriptorBindingSampledImageUpdateAfterBind &
+		indexingfeats.descriptorBindingStorageImageUpdateAfterBind &
+		indexingfeats.descriptorBindingUpdateUnusedWhilePending &
+		indexingfeats.descriptorBindingPartiallyBound &
+		indexingfeats.runtimeDescriptorArray &
 		indexingfeats.shaderUniformBufferArrayNonUniformIndexing &
 		indexingfeats.descriptorBindingUniformBufferUpdateAfterBind &
 		indexingfeats.shaderStorageBufferArrayNonUniformIndexing &
@@ -460,6 +469,23 @@ VulkanEngine::find_queue_families(VkPhysicalDevice physicalDevice, QueueFamilyIn
 	return ENGINE_SUCCESS;
 }
 
+uint32_t
+VulkanEngine::device_has_extension(VkPhysicalDevice dev, const char* name) {
+	uint32_t extensionCount = 0;
+	instanceDispatch.vkEnumerateDeviceExtensionProperties(dev, NULL, &extensionCount, NULL);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	if (instanceDispatch.vkEnumerateDeviceExtensionProperties(dev, NULL, &extensionCount,
+		extensions.data()) != VK_SUCCESS) {
+		return 0;
+	}
+	for (uint32_t i = 0; i < extensionCount; i++) {
+		if (!strcmp(name, extensions[i].extensionName)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 EngineResult
 VulkanEngine::create_device() {
 	if (find_queue_families(physicalDevice, &queueFamilies) != ENGINE_SUCCESS) {
@@ -491,12 +517,85 @@ VulkanEngine::create_device() {
 	feats12.bufferDeviceAddress = VK_TRUE;
 	feats12.descriptorIndexing = VK_TRUE;
 	feats12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	feats12.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE;
+	// The bindless registry writes new slots while earlier frames execute
+	feats12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 	feats12.descriptorBindingPartiallyBound = VK_TRUE;
+	feats12.runtimeDescriptorArray = VK_TRUE;
+	feats12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
 	feats12.pNext = &feats13;
 
 	VkPhysicalDeviceFeatures feats10 = {};
 	feats10.wideLines = VK_TRUE;
 	feats10.fillModeNonSolid = VK_TRUE;
+	// The retained render scene is drawn with a single indirect call
+	// that indexes per-draw data through firstInstance
+	feats10.multiDrawIndirect = VK_TRUE;
+	feats10.drawIndirectFirstInstance = VK_TRUE;
+	// Bindless textures and samplers are indexed with values from buffers
+	feats10.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+	// Optional, mipmapped textures are sampled anisotropically when it's there
+	VkPhysicalDeviceFeatures supportedFeats = {};
+	instanceDispatch.vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeats);
+	feats10.samplerAnisotropy = supportedFeats.samplerAnisotropy;
+	if (supportedFeats.samplerAnisotropy) {
+		VkPhysicalDeviceProperties2 devprops = {};
+		devprops.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		instanceDispatch.vkGetPhysicalDeviceProperties2(physicalDevice, &devprops);
+		maxSamplerAnisotropy = devprops.properties.limits.maxSamplerAnisotropy;
+	}
+	// Cooked .vtex textures are BCn, the PNG paths are used without it
+	feats10.textureCompressionBC = supportedFeats.textureCompressionBC;
+	textureCompressionBC = supportedFeats.textureCompressionBC;
+	feats10.pipelineStatisticsQuery = supportedFeats.pipelineStatisticsQuery;
+	pipelineStatisticsQuery = supportedFeats.pipelineStatisticsQuery;
+	// Optional, GPU pass timings are shown when the queue can write them
+	VkPhysicalDeviceProperties2 timestampProps = {};
+	timestampProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	instanceDispatch.vkGetPhysicalDeviceProperties2(physicalDevice, &timestampProps);
+	if (timestampProps.properties.limits.timestampComputeAndGraphics) {
+		timestampPeriod = timestampProps.properties.limits.timestampPeriod;
+	}
+
+	std::vector<const char*> extensions(vkDeviceExtensions.begin(), vkDeviceExtensions.end());
+
+	// Optional and opt-in, BindlessRegistry falls back to a descriptor pool
+	// without it. The environment wins over the build default so both
+	// backends can be run from the same binary.
+	uint32_t useDescriptorBuffer = USE_DESCRIPTOR_BUFFER;
+	const char* descriptorBufferEnv = getenv(DESCRIPTOR_BUFFER_ENV);
+	if (descriptorBufferEnv != nullptr) {
+		useDescriptorBuffer = atoi(descriptorBufferEnv) != 0;
+	}
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptorBufferFeats = {};
+	descriptorBufferFeats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+	if (useDescriptorBuffer && device_has_extension(physicalDevice, VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME)) {
+		VkPhysicalDeviceFeatures2 devfeats = {};
+		devfeats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		devfeats.pNext = &descriptorBufferFeats;
+		instanceDispatch.vkGetPhysicalDeviceFeatures2(physicalDevice, &devfeats);
+		descriptorBuffer = descriptorBufferFeats.descriptorBuffer;
+	}
+	if (useDescriptorBuffer && !descriptorBuffer) {
+		fprintf(stderr, "[VulkanEngine] Descriptor buffers were requested but the device "
+			"has no descriptorBuffer feature, using a descriptor pool.\n");
+	}
+	if (descriptorBuffer) {
+		descriptorBufferProps.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 devprops = {};
+		devprops.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		devprops.pNext = &descriptorBufferProps;
+		instanceDispatch.vkGetPhysicalDeviceProperties2(physicalDevice, &devprops);
+
+		// Only the feature itself, capture replay and the rest stay off
+		descriptorBufferFeats = {};
+		descriptorBufferFeats.sType =
+			VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+		descriptorBufferFeats.descriptorBuffer = VK_TRUE;
+		feats13.pNext = &descriptorBufferFeats;
+		extensions.push_back(VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME);
+	}
 
 	VkDeviceCreateInfo ci = {};
 	ci.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -505,8 +604,8 @@ VulkanEngine::create_device() {
 	ci.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	ci.pQueueCreateInfos = queueCreateInfos.data();
 	ci.enabledLayerCount = 0;
-	ci.enabledExtensionCount = vkDeviceExtensions.size();
-	ci.ppEnabledExtensionNames = vkDeviceExtensions.data();
+	ci.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	ci.ppEnabledExtensionNames = extensions.data();
 	ci.pEnabledFeatures = &feats10;
 
 	if (instanceDispatch.vkCreateDevice(physicalDevice, &ci, NULL, &device) != VK_SUCCESS) {
@@ -823,6 +922,37 @@ VulkanEngine::init_commands() {
 		}
 	}
 
+	if (pipelineStatisticsQuery) {
+		VkQueryPoolCreateInfo queryCi = {};
+		queryCi.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryCi.pNext = NULL;
+		queryCi.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		queryCi.queryCount = FRAME_OVERLAP;
+		queryCi.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+		if (deviceDispatch.vkCreateQueryPool(device, &queryCi, NULL, &geometryQueryPool) != VK_SUCCESS) {
+			ENGINE_ERROR("Failed to create the geometry query pool.");
+			return ENGINE_FAILURE;
+		}
+		mainDeletionQueue.push_function("vkDestroyQueryPool", [=]() {
+			deviceDispatch.vkDestroyQueryPool(device, geometryQueryPool, NULL);
+		});
+	}
+
+	if (timestampPeriod > 0.f) {
+		VkQueryPoolCreateInfo queryCi = {};
+		queryCi.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		queryCi.pNext = NULL;
+		queryCi.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		queryCi.queryCount = FRAME_OVERLAP * 3;
+		if (deviceDispatch.vkCreateQueryPool(device, &queryCi, NULL, &timestampQueryPool) != VK_SUCCESS) {
+			ENGINE_ERROR("Failed to create the timestamp query pool.");
+			return ENGINE_FAILURE;
+		}
+		mainDeletionQueue.push_function("vkDestroyQueryPool (timestamps)", [=]() {
+			deviceDispatch.vkDestroyQueryPool(device, timestampQueryPool, NULL);
+		});
+	}
+
 	// immediate submits
 	if (deviceDispatch.vkCreateCommandPool(device, &ci, NULL, &immCmdPool) != VK_SUCCESS) {
 		ENGINE_ERROR("Failed to create immediate submit command pool.");
@@ -919,28 +1049,12 @@ VulkanEngine::init_descriptors() {
 		descriptorAllocator.destroy_pool(device, &deviceDispatch);
 		});
 
-	// Set up bindless descriptor sets
-	// Bindless layout:
-	//		0: COMBINED IMAGE SAMPLERS
-	{
-		DescriptorLayoutBuilder b;
-		b.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000,
-			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
-			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT);
-		bindlessDescriptorLayout = b.build(device, VK_SHADER_STAGE_ALL,
-			&deviceDispatch);
-	}
-
-	std::vector<DescriptorAllocator::PoolSizeRatio> descriptorSizes = {
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
-	};
-	bindlessDescriptorAllocator.init(device, 1000, descriptorSizes, &deviceDispatch);
-	bindlessDescriptorSet = bindlessDescriptorAllocator.alloc(device, 
-		bindlessDescriptorLayout, &deviceDispatch);
+	// Set up the bindless set, see BindlessRegistry for its layout
+	bindlessRegistry.init(device, allocator, &deviceDispatch,
+		descriptorBuffer ? &descriptorBufferProps : nullptr);
 
-	mainDeletionQueue.push_function("vkDestroyDescriptorSetLayout & destroy_pool", [&] {
-		deviceDispatch.vkDestroyDescriptorSetLayout(device, bindlessDescriptorLayout, NULL);
-		bindlessDescriptorAllocator.destroy_pool(device, &deviceDispatch);
+	mainDeletionQueue.push_function("bindlessRegistry.destroy", [&] {
+		bindlessRegistry.destroy();
 	});
 
 	return ENGINE_SUCCESS;
@@ -970,6 +1084,9 @@ VulkanEngine::init_pipelines() {
 	if (init_wireframe_pipeline() != ENGINE_SUCCESS) {
 		return ENGINE_FAILURE;
 	}
+	if (init_debug_geometry_pipelines() != ENGINE_SUCCESS) {
+		return ENGINE_FAILURE;
+	}
 	return ENGINE_SUCCESS;
 }
 
@@ -1226,52 +1343,18 @@ VulkanEngine::init_buffers() {
 	/*---------------------------
 	 |  VERTEX BUFFERS
 	 ---------------------------*/
-	bufferInfo.allocator = allocator;
-	bufferInfo.allocSize = 1 * 1024 * 1024;
-	bufferInfo.flags = 0;
-	bufferInfo.pBuffer = &textVertexBuffer;
-	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	create_buffer(&bufferInfo);
-	addrInfo.buffer = textVertexBuffer.buffer;
-	textVertexBufferAddr =
-		deviceDispatch.vkGetBufferDeviceAddress(device, &addrInfo);
-
-	// Create wireframe vertex buffer
-	bufferInfo.pBuffer = &wireframeVertexBuffer;
-	create_buffer(&bufferInfo);
-	addrInfo.buffer = wireframeVertexBuffer.buffer;
-	wireframeVertexBufferAddr =
-		deviceDispatch.vkGetBufferDeviceAddress(device, &addrInfo);
-
-	// Create line vertex buffer
-	bufferInfo.pBuffer = &lineVertexBuffer;
-	create_buffer(&bufferInfo);
-	addrInfo.buffer = lineVertexBuffer.buffer;
-	lineVertexBufferAddr =
-		deviceDispatch.vkGetBufferDeviceAddress(device, &addrInfo);
-
-	// Create triangle vertex buffer
-	bufferInfo.pBuffer = &triangleVertexBuffer;
-	create_buffer(&bufferInfo);
-	addrInfo.buffer = triangleVertexBuffer.buffer;
-	triangleVertexBufferAddr =
-		deviceDispatch.vkGetBufferDeviceAddress(device, &addrInfo);
+	// Line and triangle vertices are written straight into these rings
+	_lineRing.init(device, allocator, &deviceDispatch, TRANSIENT_RING_BLOCK_SIZE,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	_triangleRing.init(device, allocator, &deviceDispatch, TRANSIENT_RING_BLOCK_SIZE,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	_wireframeRing.init(device, allocator, &deviceDispatch, TRANSIENT_RING_BLOCK_SIZE,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
 
 	/*---------------------------
-	 |  INDEX BUFFERS
+	 |  STORAGE BUFFERS
 	 ---------------------------*/
-	// Create text index buffer
-	bufferInfo.pBuffer = &textIndexBuffer;
-	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	create_buffer(&bufferInfo);
-
-	// Create wireframe index buffer
-	bufferInfo.pBuffer = &wireframeIndexBuffer;
-	create_buffer(&bufferInfo);
-
+	bufferInfo.allocator = allocator;
 	bufferInfo.pBuffer = &lightBuffer;
 	bufferInfo.allocSize = 65536;
 	bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
@@ -1298,25 +1381,31 @@ VulkanEngine::init_buffers() {
 	uSceneDataAddr =
 		deviceDispatch.vkGetBufferDeviceAddress(device, &addrInfo);
 
-	bufferInfo.pBuffer = &uMaterialBuffer;
-	bufferInfo.allocSize = MAX_MATERIALS * sizeof(Material);
-	create_buffer(&bufferInfo);
-	addrInfo.buffer = uMaterialBuffer.buffer;
-	uMaterialBufferAddr =
-		deviceDispatch.vkGetBufferDeviceAddress(device, &addrInfo);
+	if (materialRegistry.init(device, allocator, &deviceDispatch,
+		MATERIAL_INITIAL_CAPACITY) != 0) {
+		ENGINE_ERROR("Failed to create the material buffer.");
+		return ENGINE_FAILURE;
+	}
+
+	_renderScene.init(device, allocator, &deviceDispatch, &materialRegistry);
+	_debugGeometry.init(device, allocator, &deviceDispatch);
+	_textCache.init(device, allocator, &deviceDispatch, pJobScheduler);
+	_textureStreamer.init(device, allocator, &deviceDispatch, pJobScheduler,
+		textureStreamingBudget);
 
 	mainDeletionQueue.push_function("destroying base buffers",
 		[&]() {
+			_renderScene.destroy();
+			_debugGeometry.destroy();
 			geometryBuffer.destroy_buffer(allocator);
 			destroy_buffer(&lightBuffer);
-			destroy_buffer(&triangleVertexBuffer);
-			destroy_buffer(&lineVertexBuffer);
-			destroy_buffer(&textVertexBuffer);
-			destroy_buffer(&textIndexBuffer);
-			destroy_buffer(&wireframeVertexBuffer);
-			destroy_buffer(&wireframeIndexBuffer);
+			_triangleRing.destroy();
+			_lineRing.destroy();
+			_wireframeRing.destroy();
+			_textCache.destroy();
+			_textureStreamer.destroy();
 			destroy_buffer(&uSceneData);
-			destroy_buffer(&uMaterialBuffer);
+			materialRegistry.destroy();
 		});
 
 	return ENGINE_SUCCESS;
@@ -1337,7 +1426,8 @@ VulkanEngine::init_mesh_pipelines() {
 	layoutCi.pPushConstantRanges = &bufferRange;
 	layoutCi.pushConstantRangeCount = 1;
 	// Use bindless layout
-	layoutCi.pSetLayouts = &bindlessDescriptorLayout;
+	VkDescriptorSetLayout bindlessLayout = bindlessRegistry.get_layout();
+	layoutCi.pSetLayouts = &bindlessLayout;
 	layoutCi.setLayoutCount = 1;
 
 	VkPipelineLayout layout;
@@ -1358,9 +1448,13 @@ VulkanEngine::init_mesh_pipelines() {
 	PipelineBuilder builder;
 
 	builder.set_layout(layout);
+	builder.set_create_flags(bindlessRegistry.get_pipeline_flags());
 	builder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 	builder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	// Set per surface, single sided materials cull back faces, see
+	// MaterialRegistry::get_cull_mode()
 	builder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	builder.add_dynamic_state(VK_DYNAMIC_STATE_CULL_MODE);
 	builder.set_multisampling_none();
 	builder.disable_blending();
 	builder.enable_depthtest(true, VK_COMPARE_OP_LESS);
@@ -1370,11 +1464,46 @@ VulkanEngine::init_mesh_pipelines() {
 
 	create_pipeline(&builder, vtxShader, fragShader, &opaquePipeline);
 
-	builder.enable_depthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
-	builder.enable_blending_additive();
+	// MATERIAL_PASS_TRANSPARENT, tested against the opaque depth
+	builder.enable_depthtest(false, VK_COMPARE_OP_LESS);
+	builder.enable_blending_alphablend();
 
 	create_pipeline(&builder, vtxShader, fragShader, &transparentPipeline);
 
+	// Depth prepass mode, the main pass only shades what the prepass left
+	// in the depth buffer
+	builder.disable_blending();
+	builder.enable_depthtest(false, VK_COMPARE_OP_EQUAL);
+
+	create_pipeline(&builder, vtxShader, fragShader, &opaqueEqualPipeline);
+
+	uint32_t depthVtxShader, depthFragShader;
+	if (create_shader("../../shaders/depth.vert",
+		EShLangVertex, &depthVtxShader) != ENGINE_SUCCESS) {
+		return ENGINE_FAILURE;
+	}
+	if (create_shader("../../shaders/depth.frag",
+		EShLangFragment, &depthFragShader) != ENGINE_SUCCESS) {
+		return ENGINE_FAILURE;
+	}
+
+	// Same layout and push constants as the mesh pipelines, no color
+	// attachment
+	PipelineBuilder depthBuilder;
+
+	depthBuilder.set_layout(layout);
+	depthBuilder.set_create_flags(bindlessRegistry.get_pipeline_flags());
+	depthBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	depthBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	depthBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	depthBuilder.add_dynamic_state(VK_DYNAMIC_STATE_CULL_MODE);
+	depthBuilder.set_multisampling_none();
+	depthBuilder.disable_blending();
+	depthBuilder.enable_depthtest(true, VK_COMPARE_OP_LESS);
+	depthBuilder.set_depth_format(depthImage.imageFormat);
+
+	create_pipeline(&depthBuilder, depthVtxShader, depthFragShader, &depthPrepassPipeline);
+
 	return ENGINE_SUCCESS;
 }
 
@@ -1480,7 +1609,7 @@ EngineResult
 VulkanEngine::init_wireframe_pipeline() {
 	VkPushConstantRange pcRange = {};
 	pcRange.offset = 0;
-	pcRange.size = sizeof(GPUDrawPushConstants);
+	pcRange.size = sizeof(GPUWireframePushConstants);
 	pcRange.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
 
 	VkPipelineLayoutCreateInfo layoutCi = {};
@@ -1490,8 +1619,8 @@ VulkanEngine::init_wireframe_pipeline() {
 	layoutCi.pPushConstantRanges = &pcRange;
 	layoutCi.pushConstantRangeCount = 1;
 
-	layoutCi.pSetLayouts = &bindlessDescriptorLayout;
-	layoutCi.setLayoutCount = 1;
+	layoutCi.pSetLayouts = nullptr;
+	layoutCi.setLayoutCount = 0;
 
 	VkPipelineLayout layout;
 	if (deviceDispatch.vkCreatePipelineLayout(device, &layoutCi, nullptr,
@@ -1531,6 +1660,59 @@ VulkanEngine::init_wireframe_pipeline() {
 	return ENGINE_SUCCESS;
 }
 
+// Solid and wireframe pipelines for the cached debug meshes, they share
+// the shaders and the layout
+EngineResult
+VulkanEngine::init_debug_geometry_pipelines() {
+	VkPushConstantRange pcRange = {};
+	pcRange.offset = 0;
+	pcRange.size = sizeof(GPUDebugPushConstants);
+	pcRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo layoutCi = {};
+	layoutCi.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	layoutCi.pNext = nullptr;
+	layoutCi.pPushConstantRanges = &pcRange;
+	layoutCi.pushConstantRangeCount = 1;
+	layoutCi.pSetLayouts = nullptr;
+	layoutCi.setLayoutCount = 0;
+
+	VkPipelineLayout layout;
+	VK_RUN_FN(deviceDispatch.vkCreatePipelineLayout(device, &layoutCi, nullptr, &layout),
+		"Failed to create debug geometry pipeline layout.");
+
+	uint32_t vtxShader, fragShader;
+	if (create_shader("../../shaders/debug.vert", EShLangVertex,
+		&vtxShader) != ENGINE_SUCCESS) {
+		return ENGINE_FAILURE;
+	}
+	if (create_shader("../../shaders/debug.frag", EShLangFragment,
+		&fragShader) != ENGINE_SUCCESS) {
+		return ENGINE_FAILURE;
+	}
+
+	PipelineBuilder builder;
+	builder.set_layout(layout);
+	builder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	builder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+	builder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+	builder.set_multisampling_none();
+	builder.disable_blending();
+	builder.enable_depthtest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
+	builder.set_color_attachment_format(drawImage.imageFormat);
+	builder.set_depth_format(depthImage.imageFormat);
+
+	ENGINE_RUN_FN(create_pipeline(&builder, vtxShader, fragShader, &debugSolidPipeline));
+
+	builder.set_polygon_mode(VK_POLYGON_MODE_LINE);
+	builder.enable_depthtest(false, VK_COMPARE_OP_LESS_OR_EQUAL);
+	builder.add_dynamic_state(VK_DYNAMIC_STATE_LINE_WIDTH);
+
+	ENGINE_RUN_FN(create_pipeline(&builder, vtxShader, fragShader, &debugWireframePipeline));
+
+	return ENGINE_SUCCESS;
+}
+
 EngineResult
 VulkanEngine::init_skybox_pipeline() {
 	// Skybox shaders only need to know vertex buffer (for the cube)
@@ -1547,7 +1729,8 @@ VulkanEngine::init_skybox_pipeline() {
 	layoutCi.pPushConstantRanges = &bufferRange;
 	layoutCi.pushConstantRangeCount = 1;
 	// Use bindless layout
-	layoutCi.pSetLayouts = &bindlessDescriptorLayout;
+	VkDescriptorSetLayout bindlessLayout = bindlessRegistry.get_layout();
+	layoutCi.pSetLayouts = &bindlessLayout;
 	layoutCi.setLayoutCount = 1;
 
 	VkPipelineLayout layout;
@@ -1567,6 +1750,7 @@ VulkanEngine::init_skybox_pipeline() {
 	PipelineBuilder builder;
 
 	builder.set_layout(layout);
+	builder.set_create_flags(bindlessRegistry.get_pipeline_flags());
 	builder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 	builder.set_polygon_mode(VK_POLYGON_MODE_FILL);
 	builder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
@@ -1587,7 +1771,7 @@ VulkanEngine::init_text_pipeline() {
 	// Declare push constant buffer range
 	VkPushConstantRange bufferRange{};
 	bufferRange.offset = 0;
-	bufferRange.size = sizeof(GPUDrawPushConstants);
+	bufferRange.size = sizeof(GPUTextPushConstants);
 	bufferRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
 	// Create pipeline layout
@@ -1597,7 +1781,8 @@ VulkanEngine::init_text_pipeline() {
 	layoutCi.pPushConstantRanges = &bufferRange;
 	layoutCi.pushConstantRangeCount = 1;
 	// Use bindless layout
-	layoutCi.pSetLayouts = &bindlessDescriptorLayout;
+	VkDescriptorSetLayout bindlessLayout = bindlessRegistry.get_layout();
+	layoutCi.pSetLayouts = &bindlessLayout;
 	layoutCi.setLayoutCount = 1;
 
 	VkPipelineLayout layout;
@@ -1617,6 +1802,7 @@ VulkanEngine::init_text_pipeline() {
 	PipelineBuilder builder;
 
 	builder.set_layout(layout);
+	builder.set_create_flags(bindlessRegistry.get_pipeline_flags());
 	builder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 	builder.set_polygon_mode(VK_POLYGON_MODE_FILL);
 	builder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
@@ -1624,8 +1810,9 @@ VulkanEngine::init_text_pipeline() {
 	builder.enable_blending_alphablend();
 	builder.disable_depthtest();
 
+	// Drawn at the end of the main pass, which has a depth attachment
 	builder.set_color_attachment_format(drawImage.imageFormat);
-
+	builder.set_depth_format(depthImage.imageFormat);
 
 	create_pipeline(&builder, vtxShader, fragShader, &textPipeline);
 
@@ -1709,91 +1896,115 @@ VulkanEngine::init_default_data() {
 	sampl.minFilter = VK_FILTER_LINEAR;
 	deviceDispatch.vkCreateSampler(device, &sampl, nullptr, &defaultSamplerLinear);
 
-	errorHandle = bindlessDescriptorWriter.write_image(
-		0,
-		errorCheckerboardImage.imageView,
-		defaultSamplerNearest,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
-	);
+	// The two above stop at mip 0 (maxLod 0)
+	sampl.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	sampl.minLod = 0.f;
+	sampl.maxLod = VK_LOD_CLAMP_NONE;
+	sampl.anisotropyEnable = maxSamplerAnisotropy > 1.f ? VK_TRUE : VK_FALSE;
+	sampl.maxAnisotropy = std::min(maxSamplerAnisotropy, MAX_TEXTURE_ANISOTROPY);
+	deviceDispatch.vkCreateSampler(device, &sampl, nullptr, &defaultSamplerTrilinear);
 
-	// load space cube map texture
+	// Shaders pick the sampler, textures are just images in the bindless set
+	nearestSamplerHandle = bindlessRegistry.add_sampler(defaultSamplerNearest);
+	linearSamplerHandle = bindlessRegistry.add_sampler(defaultSamplerLinear);
+	trilinearSamplerHandle = bindlessRegistry.add_sampler(defaultSamplerTrilinear);
 
-	imgInfo.pImg = &spaceCubeMap;
-	create_image_cube_map(&imgInfo, "../../assets/space_cube/", immCmdBuf,
-		immFence, graphicsQueue);
+	errorHandle = bindlessRegistry.add_texture(errorCheckerboardImage.imageView);
 
-	errorHandle = bindlessDescriptorWriter.write_image(
-		0,
-		spaceCubeMap.imageView,
-		defaultSamplerNearest,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
-	);
+	auto texturesStart = std::chrono::high_resolution_clock::now();
 
-	int width, height, channels;
-	stbi_uc* data = stbi_load("../../assets/cubemap.png", &width, &height,
-		&channels, STBI_rgb_alpha);
+	// PNG fallbacks of the textures below, decoded on the job scheduler and
+	// uploaded together
+	ImageFileDesc pngDescs[2];
+	uint32_t pngCount = 0;
 
+	// load space cube map texture
+	// The cooked BC7 version (see texture_cooker) is streamed when it has
+	// been built, the PNGs are decoded and mipmapped at load otherwise
+	VkImageView skyboxView = VK_NULL_HANDLE;
+	if (textureCompressionBC && _textureStreamer.register_texture(
+		"../../assets/space_cube/space_cube.vtex", &_skyboxStream) == 0) {
+		skyboxView = _textureStreamer.get_image_view(_skyboxStream);
+	} else {
+		ImageFileDesc* desc = &pngDescs[pngCount++];
+		desc->pImg = &spaceCubeMap;
+		desc->paths[0] = "../../assets/space_cube/right.png";
+		desc->paths[1] = "../../assets/space_cube/left.png";
+		desc->paths[2] = "../../assets/space_cube/top.png";
+		desc->paths[3] = "../../assets/space_cube/bottom.png";
+		desc->paths[4] = "../../assets/space_cube/front.png";
+		desc->paths[5] = "../../assets/space_cube/back.png";
+		desc->layerCount = 6;
+		desc->cube = 1;
+		desc->format = VK_FORMAT_R8G8B8A8_SRGB;
+		desc->mipmapped = 1;
+	}
+
+	// Cooked with --linear, the PNG is sampled as UNORM too
 	imgInfo.pImg = &containerTexture;
-	imgInfo.size = { 500, 500, 1 };
-	create_image_with_data(&imgInfo, data, immCmdBuf, immFence, graphicsQueue);
-	bindlessDescriptorWriter.write_image(
-		0,
-		containerTexture.imageView,
-		defaultSamplerNearest,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
-	);
-
-	FontCreateInfo fontInfo;
-	fontInfo.allocator = allocator;
-	fontInfo.device = device;
-	fontInfo.cmd = immCmdBuf;
-	fontInfo.fence = immFence;
-	fontInfo.queue = graphicsQueue;
-	fontInfo.pDeviceDispatch = &deviceDispatch;
-	fontInfo.ttfPath = "../../assets/fonts/Roboto-Regular.ttf";
-	fontInfo.size = 32;
-	defaultFont.create(&fontInfo);
-
-	uint32_t idx = 0;
-	idx = bindlessDescriptorWriter.write_image(0, defaultFont.texture.imageView,
-		defaultSamplerLinear, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-	defaultFont.descriptorIndex = idx;
-
-
-	bindlessDescriptorWriter.write_image(
-		0,
-		shadowMapAtlas.imageView,
-		defaultSamplerLinear,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
-	);
+	imgInfo.mipmapped = 1;
+	if (!textureCompressionBC || create_image_from_file(&imgInfo,
+		"../../assets/cubemap.vtex", immCmdBuf, immFence, graphicsQueue)) {
+		ImageFileDesc* desc = &pngDescs[pngCount++];
+		desc->pImg = &containerTexture;
+		desc->paths[0] = "../../assets/cubemap.png";
+		desc->format = VK_FORMAT_R8G8B8A8_UNORM;
+		desc->mipmapped = 1;
+	}
+
+	if (pngCount > 0) {
+		ImageBatchInfo batchInfo;
+		batchInfo.allocator = allocator;
+		batchInfo.device = device;
+		batchInfo.pDeviceDispatch = &deviceDispatch;
+		batchInfo.pScheduler = pJobScheduler;
+		batchInfo.cmd = immCmdBuf;
+		batchInfo.fence = immFence;
+		batchInfo.queue = graphicsQueue;
+		batchInfo.serial = serialImageUploads ? 1 : 0;
+		if (create_images_from_files(&batchInfo, pngDescs, pngCount)) {
+			ENGINE_ERROR("Failed to load the default textures.");
+			return ENGINE_FAILURE;
+		}
+	}
+	if (skyboxView == VK_NULL_HANDLE) {
+		skyboxView = spaceCubeMap.imageView;
+	}
+	ENGINE_MESSAGE_ARGS("Loaded the default textures%s in %.2f ms.",
+		serialImageUploads ? " (serial uploads)" : "",
+		std::chrono::duration<float, std::milli>(
+			std::chrono::high_resolution_clock::now() - texturesStart).count());
 
+	skyboxHandle = bindlessRegistry.add_texture(skyboxView);
+	containerHandle = bindlessRegistry.add_texture(containerTexture.imageView);
+	shadowMapHandle = bindlessRegistry.add_texture(shadowMapAtlas.imageView);
 
-	bindlessDescriptorWriter.update_set(device, bindlessDescriptorSet,
-		&deviceDispatch);
+	ENGINE_RUN_FN(create_font("../../assets/fonts/Roboto-Regular.ttf", 48,
+		"../../assets/fonts/Roboto-Regular.sdfa", &defaultFont));
 
-	Material copper{
-		.ambient = glm::vec3{ 0.19125, 0.0735, 0.0225 },
-		.diffuse = glm::vec3{ 0.7038, 0.27048, 0.0828 },
-		.specular = glm::vec3{ 	0.256777, 0.137622, 0.086014 },
-		.shininess = 8
-	};
+	GPUMaterial copper = *materialRegistry.get(MATERIAL_DEFAULT);
+	copper.baseColorFactor = glm::vec4(0.955f, 0.637f, 0.538f, 1.f);
+	copper.metallicFactor = 1.f;
+	copper.roughnessFactor = 0.35f;
 	uint32_t copperIdx;
 	create_material(&copper, &copperIdx);
 
 	mainDeletionQueue.push_function("Default textures and samplers deletion", [&]() {
 		deviceDispatch.vkDestroySampler(device, defaultSamplerLinear, nullptr);
 		deviceDispatch.vkDestroySampler(device, defaultSamplerNearest, nullptr);
+		deviceDispatch.vkDestroySampler(device, defaultSamplerTrilinear, nullptr);
 
 		destroy_image(device, &deviceDispatch, allocator, &errorCheckerboardImage);
-		destroy_image(device, &deviceDispatch, allocator, &spaceCubeMap);
+		if (_skyboxStream == STREAM_INVALID_HANDLE) {
+			destroy_image(device, &deviceDispatch, allocator, &spaceCubeMap);
+		}
 		destroy_image(device, &deviceDispatch, allocator, &containerTexture);
-		defaultFont.destroy(device, &deviceDispatch, allocator);
+		destroy_font(&defaultFont);
+
+		for (size_t i = 0; i < loadedTextures.size(); i++) {
+			destroy_image(device, &deviceDispatch, allocator, &loadedTextures[i]);
+		}
+		loadedTextures.clear();
 		});
 
 	return ENGINE_SUCCESS;
@@ -1823,6 +2034,33 @@ VulkanEngine::draw() {
 	}
 	get_current_frame().deletionQueue.flush();
 
+	uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+	if (geometryQueryPending[frameIndex]) {
+		uint64_t invocations = 0;
+		if (deviceDispatch.vkGetQueryPoolResults(device, geometryQueryPool, frameIndex, 1,
+			sizeof(invocations), &invocations, sizeof(invocations),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS && drawExtent.width * drawExtent.height > 0) {
+			geometryOverdraw = static_cast<float>(invocations) /
+				(drawExtent.width * drawExtent.height);
+		}
+		geometryQueryPending[frameIndex] = 0;
+	}
+	if (timestampPending[frameIndex]) {
+		uint64_t timestamps[3] = {};
+		if (deviceDispatch.vkGetQueryPoolResults(device, timestampQueryPool, frameIndex * 3, 3,
+			sizeof(timestamps), timestamps, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			uint32_t prepass = timestampPrepass[frameIndex];
+			prepassTimeMs[prepass] = (timestamps[1] - timestamps[0]) * timestampPeriod / 1e6f;
+			mainPassTimeMs[prepass] = (timestamps[2] - timestamps[1]) * timestampPeriod / 1e6f;
+		}
+		timestampPending[frameIndex] = 0;
+	}
+
+	// The GPU is done with this frame's copy of the scene buffers so the
+	// pending object changes can be written into them
+	_renderScene.flush(frameNumber % FRAME_OVERLAP);
+
 	for (size_t i = 0; i < shaderCount; i++) {
 		if (shaders[i].recompile.load()) {
 			recompile_shader(i);
@@ -1863,12 +2101,32 @@ VulkanEngine::draw() {
 		return ENGINE_FAILURE;
 	}
 
+	// Queries can't be reset inside the main pass
+	if (geometryQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdResetQueryPool(cmd, geometryQueryPool, frameIndex, 1);
+	}
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdResetQueryPool(cmd, timestampQueryPool, frameIndex * 3, 3);
+	}
+
 	transition_image(cmd, drawImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, &deviceDispatch);
 
 	transition_image(cmd, depthImage.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, &deviceDispatch);
 
 	transition_image(cmd, shadowMapAtlas.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, &deviceDispatch);
 
+	// Glyphs rasterized since last frame, before anything samples the pages
+	_textCache.record_uploads(cmd);
+
+	// A cube face spans the screen height over tan(fov / 2) pixels
+	_textureStreamer.request(_skyboxStream,
+		drawExtent.height / tanf(glm::radians(45.f) * 0.5f));
+	_textureStreamer.record_uploads(cmd);
+	apply_texture_swaps();
+
+	// Slots added since last frame, this frame's fence was waited on above
+	bindlessRegistry.flush();
+
 	// Write to scene data
 	GPUSceneData* data = (GPUSceneData*)uSceneData.info.pMappedData;
 	sceneData.view = _activeCamera.calcViewMat();
@@ -1882,6 +2140,12 @@ VulkanEngine::draw() {
 		0.0f, (float)drawExtent.width / renderScale, 0.0f,
 		(float)drawExtent.height / renderScale, -1.0f, 1.0f
 	);
+	sceneData.shadowMapTexture = shadowMapHandle.index;
+	sceneData.skyboxTexture = skyboxHandle.index;
+	sceneData.linearSampler = linearSamplerHandle.index;
+	sceneData.trilinearSampler = trilinearSamplerHandle.index;
+	sceneData.viewPos = _activeCamera.position;
+	sceneData.padding = 0.f;
 	*data = sceneData;
 
 	// Write to lights buffer
@@ -1889,8 +2153,36 @@ VulkanEngine::draw() {
 	memcpy(lightsData, _mainDrawContext._lights.data(),
 		sizeof(Light) * _mainDrawContext._lights.size());
 
+	// The prepass and the main pass draw the same queues
+	uint32_t passPipelines[MATERIAL_PASS_COUNT];
+	get_geometry_pipelines(passPipelines);
+	_mainDrawContext.sort_surfaces(sceneData.view, passPipelines);
+
 	render_shadow_pass(cmd);
+
+	// Timestamps 0-1 bracket the prepass (empty when it's off), 1-2 the
+	// main pass
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			timestampQueryPool, frameIndex * 3);
+	}
+	if (depthPrepass) {
+		render_depth_prepass(cmd);
+		// The main pass tests against and loads what the prepass wrote
+		transition_image(cmd, depthImage.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, &deviceDispatch);
+	}
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			timestampQueryPool, frameIndex * 3 + 1);
+	}
 	render_main_pass(cmd);
+	if (timestampQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			timestampQueryPool, frameIndex * 3 + 2);
+		timestampPending[frameIndex] = 1;
+		timestampPrepass[frameIndex] = depthPrepass;
+	}
 	if (_debugFlags & RENDER_DEBUG_ENABLE_BIT) {
 		render_debug_pass(cmd);
 	}
@@ -1974,6 +2266,14 @@ VulkanEngine::draw() {
 
 	frameNumber++;
 	_mainDrawContext.clear();
+	_debugGeometry.next_frame();
+	_lineRing.next_frame();
+	_triangleRing.next_frame();
+	_wireframeRing.next_frame();
+	_textCache.next_frame();
+	_textureStreamer.next_frame();
+	bindlessRegistry.next_frame();
+	materialRegistry.next_frame();
 	return ENGINE_SUCCESS;
 }
 
@@ -2133,7 +2433,8 @@ VulkanEngine::render_shadow_pass(VkCommandBuffer cmd) {
 				VK_INDEX_TYPE_UINT32);
 
 			GPUShadowPushConstants pc;
-			pc.vertexBuffer = geometryBuffer.addr + surface->vertexBufferAddr;
+			pc.positionBuffer = geometryBuffer.addr + surface->positionBufferAddr;
+			pc.drawDataBuffer = 0;
 			pc.model = surface->transform;
 			pc.lightSpaceMatrix = _mainDrawContext._lights[i].spaceMatrix;
 			deviceDispatch.vkCmdPushConstants(cmd, pipelines[shadowPipeline].layout,
@@ -2141,6 +2442,23 @@ VulkanEngine::render_shadow_pass(VkCommandBuffer cmd) {
 
 			deviceDispatch.vkCmdDrawIndexed(cmd, surface->indexCount, 1, surface->firstIndex, 0, 0);
 		}
+
+		if (_renderScene.get_draw_count() > 0) {
+			uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+			deviceDispatch.vkCmdBindIndexBuffer(cmd, geometryBuffer.buffer, 0,
+				VK_INDEX_TYPE_UINT32);
+
+			GPUShadowPushConstants pc;
+			pc.positionBuffer = 0;
+			pc.drawDataBuffer = _renderScene.get_draw_data_addr(frameIndex);
+			pc.model = glm::mat4(1.f);
+			pc.lightSpaceMatrix = _mainDrawContext._lights[i].spaceMatrix;
+			deviceDispatch.vkCmdPushConstants(cmd, pipelines[shadowPipeline].layout,
+				VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUShadowPushConstants), &pc);
+
+			deviceDispatch.vkCmdDrawIndexedIndirect(cmd, _renderScene.get_indirect_buffer(frameIndex),
+				0, _renderScene.get_draw_count(), sizeof(VkDrawIndexedIndirectCommand));
+		}
 	}
 	deviceDispatch.vkCmdEndRendering(cmd);
 
@@ -2164,7 +2482,9 @@ VulkanEngine::render_main_pass(VkCommandBuffer cmd) {
 
 	depthAttachment.imageView = depthImage.imageView;
 	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	// Cleared by the prepass when it runs
+	depthAttachment.loadOp = depthPrepass ? VK_ATTACHMENT_LOAD_OP_LOAD :
+		VK_ATTACHMENT_LOAD_OP_CLEAR;
 	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 	depthAttachment.clearValue.depthStencil.depth = 1.f;
 
@@ -2205,6 +2525,7 @@ VulkanEngine::render_main_pass(VkCommandBuffer cmd) {
 	render_wireframes(cmd);
 	render_lines(cmd);
 	render_triangles(cmd);
+	render_debug_geometry(cmd);
 	render_text_geometry(cmd);
 
 	deviceDispatch.vkCmdEndRendering(cmd);
@@ -2212,48 +2533,224 @@ VulkanEngine::render_main_pass(VkCommandBuffer cmd) {
 	return ENGINE_SUCCESS;
 }
 
+// Depth only pass over the opaque surfaces, masked ones need their
+// textures to discard and are left to the main pass
 EngineResult
-VulkanEngine::render_geometry(VkCommandBuffer cmd) {
-	Pipeline p = pipelines[opaquePipeline];
+VulkanEngine::render_depth_prepass(VkCommandBuffer cmd) {
+	VkRenderingAttachmentInfo depthAttachment = {};
+	depthAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depthAttachment.pNext = NULL;
 
-	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, 
-		p.pipeline);
+	depthAttachment.imageView = depthImage.imageView;
+	depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.clearValue.depthStencil.depth = 1.f;
 
-	deviceDispatch.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		p.layout, 0, 1, &bindlessDescriptorSet, 0, nullptr);
-	
+	VkRenderingInfo renderInfo = {};
+	renderInfo.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	renderInfo.pNext = NULL;
 
-	for (size_t i = 0; i < _mainDrawContext._surfaceData.size(); i++) {
-		const SurfaceDrawData* surface = &_mainDrawContext._surfaceData[i];
+	renderInfo.renderArea = VkRect2D{ VkOffset2D { 0, 0 }, drawExtent };
+	renderInfo.layerCount = 1;
+	renderInfo.colorAttachmentCount = 0;
+	renderInfo.pColorAttachments = NULL;
+	renderInfo.pDepthAttachment = &depthAttachment;
+	renderInfo.pStencilAttachment = NULL;
 
-		deviceDispatch.vkCmdBindIndexBuffer(cmd, geometryBuffer.buffer, surface->indexBufferAddr, 
-			VK_INDEX_TYPE_UINT32);
+	deviceDispatch.vkCmdBeginRendering(cmd, &renderInfo);
 
-		GPUDrawPushConstants pc;
-		pc.vertexBuffer = geometryBuffer.addr + surface->vertexBufferAddr;
-		pc.sceneBuffer = uSceneDataAddr;
-		pc.materialBuffer = uMaterialBufferAddr;
-		pc.lightBuffer = lightBufferAddr;
-		pc.lightCount = _mainDrawContext._lights.size();
-		pc.materialID = surface->materialID;
-		pc.model = surface->transform;
-		pc.viewPos = _activeCamera.position;
-		deviceDispatch.vkCmdPushConstants(cmd, pipelines[opaquePipeline].layout,
-			VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(GPUDrawPushConstants), &pc);
+	VkViewport viewport = {};
+	viewport.x = 0;
+	viewport.y = 0;
+	viewport.width = drawExtent.width;
+	viewport.height = drawExtent.height;
+	viewport.minDepth = 0.f;
+	viewport.maxDepth = 1.f;
+
+	deviceDispatch.vkCmdSetViewport(cmd, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset.x = 0;
+	scissor.offset.y = 0;
+	scissor.extent.width = drawExtent.width;
+	scissor.extent.height = drawExtent.height;
+
+	deviceDispatch.vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-		deviceDispatch.vkCmdDrawIndexed(cmd, surface->indexCount, 1, surface->firstIndex, 0, 0);
+	const Pipeline* p = &pipelines[depthPrepassPipeline];
+	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p->pipeline);
+	bindlessRegistry.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p->layout);
+
+	// Opaque surfaces are at the front of the queue, front to back
+	VkCullModeFlags boundCullMode = VK_CULL_MODE_FLAG_BITS_MAX_ENUM;
+	const ArenaArray<uint32_t>* queue = &_mainDrawContext._opaqueQueue;
+	for (size_t i = 0; i < queue->size(); i++) {
+		const SurfaceDrawData* surface = &_mainDrawContext._surfaceData[(*queue)[i]];
+		if (surface->pass != MATERIAL_PASS_OPAQUE) {
+			break;
+		}
+		draw_surface(cmd, p->layout, surface, &boundCullMode);
 	}
 
+	// Alpha tested retained surfaces would write solid depth here that the
+	// main pass then discards under EQUAL, they go in the main pass instead
+	render_retained_geometry(cmd, depthPrepassPipeline, UINT32_MAX);
+
+	deviceDispatch.vkCmdEndRendering(cmd);
+
 	return ENGINE_SUCCESS;
 }
 
+void
+VulkanEngine::get_geometry_pipelines(uint32_t passPipelines[MATERIAL_PASS_COUNT]) {
+	passPipelines[MATERIAL_PASS_OPAQUE] = depthPrepass ? opaqueEqualPipeline : opaquePipeline;
+	passPipelines[MATERIAL_PASS_MASKED] = opaquePipeline;
+	passPipelines[MATERIAL_PASS_TRANSPARENT] = transparentPipeline;
+}
+
+void
+VulkanEngine::draw_surface(VkCommandBuffer cmd, VkPipelineLayout layout,
+	const SurfaceDrawData* surface, VkCullModeFlags* pBoundCullMode) {
+	if (surface->cullMode != *pBoundCullMode) {
+		deviceDispatch.vkCmdSetCullMode(cmd, surface->cullMode);
+		*pBoundCullMode = surface->cullMode;
+	}
+
+	deviceDispatch.vkCmdBindIndexBuffer(cmd, geometryBuffer.buffer, surface->indexBufferAddr, 
+		VK_INDEX_TYPE_UINT32);
+
+	GPUDrawPushConstants pc;
+	pc.vertexBuffer = geometryBuffer.addr + surface->vertexBufferAddr;
+	pc.sceneBuffer = uSceneDataAddr;
+	pc.materialBuffer = materialRegistry.get_address();
+	pc.lightBuffer = lightBufferAddr;
+	pc.lightCount = _mainDrawContext._lights.size();
+	pc.materialID = surface->materialID;
+	pc.drawDataBuffer = 0;
+	pc.model = surface->transform;
+	pc.positionBuffer = geometryBuffer.addr + surface->positionBufferAddr;
+	deviceDispatch.vkCmdPushConstants(cmd, layout,
+		VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(GPUDrawPushConstants), &pc);
+
+	deviceDispatch.vkCmdDrawIndexed(cmd, surface->indexCount, 1, surface->firstIndex, 0, 0);
+}
+
+// Draws the queues sort_surfaces() built in draw()
+EngineResult
+VulkanEngine::render_geometry(VkCommandBuffer cmd) {
+	uint32_t passPipelines[MATERIAL_PASS_COUNT];
+	get_geometry_pipelines(passPipelines);
+	uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+
+	if (geometryQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdBeginQuery(cmd, geometryQueryPool, frameIndex, 0);
+	}
+
+	// Every mesh pipeline takes the cull mode as dynamic state, so it stays
+	// set across their binds
+	uint32_t boundPipeline = UINT32_MAX;
+	VkCullModeFlags boundCullMode = VK_CULL_MODE_FLAG_BITS_MAX_ENUM;
+	const ArenaArray<uint32_t>* queue = &_mainDrawContext._opaqueQueue;
+	for (size_t i = 0; i < queue->size(); i++) {
+		const SurfaceDrawData* surface = &_mainDrawContext._surfaceData[(*queue)[i]];
+		const Pipeline* p = &pipelines[passPipelines[surface->pass]];
+		if (passPipelines[surface->pass] != boundPipeline) {
+			boundPipeline = passPipelines[surface->pass];
+			deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				p->pipeline);
+			bindlessRegistry.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p->layout);
+		}
+		draw_surface(cmd, p->layout, surface, &boundCullMode);
+	}
+
+	// Retained objects are drawn as opaque, they have to be in before
+	// anything is blended over them. Masked ones weren't in the prepass so
+	// they are tested with LESS. They set the cull mode themselves.
+	render_retained_geometry(cmd, passPipelines[MATERIAL_PASS_OPAQUE],
+		passPipelines[MATERIAL_PASS_MASKED]);
+	boundCullMode = VK_CULL_MODE_FLAG_BITS_MAX_ENUM;
+
+	queue = &_mainDrawContext._transparentQueue;
+	if (!queue->empty()) {
+		const Pipeline* p = &pipelines[passPipelines[MATERIAL_PASS_TRANSPARENT]];
+		deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+			p->pipeline);
+		bindlessRegistry.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p->layout);
+		for (size_t i = 0; i < queue->size(); i++) {
+			draw_surface(cmd, p->layout, &_mainDrawContext._surfaceData[(*queue)[i]],
+				&boundCullMode);
+		}
+	}
+
+	if (geometryQueryPool != VK_NULL_HANDLE) {
+		deviceDispatch.vkCmdEndQuery(cmd, geometryQueryPool, frameIndex);
+		geometryQueryPending[frameIndex] = 1;
+	}
+
+	return ENGINE_SUCCESS;
+}
+
+// Retained objects are already resident, one indirect call per bucket draws
+// them all. Surfaces with opaque materials are drawn with 'opaquePipeline',
+// the rest with 'maskedPipeline' (UINT32_MAX leaves them out). Blended ones
+// are drawn as opaque too, they can't be sorted. Both pipelines take
+// GPUDrawPushConstants and a dynamic cull mode.
+void
+VulkanEngine::render_retained_geometry(VkCommandBuffer cmd, uint32_t opaquePipeline,
+	uint32_t maskedPipeline) {
+	if (_renderScene.get_draw_count() == 0) {
+		return;
+	}
+
+	uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+	deviceDispatch.vkCmdBindIndexBuffer(cmd, geometryBuffer.buffer, 0,
+		VK_INDEX_TYPE_UINT32);
+
+	GPUDrawPushConstants pc;
+	pc.vertexBuffer = 0;
+	pc.sceneBuffer = uSceneDataAddr;
+	pc.materialBuffer = materialRegistry.get_address();
+	pc.lightBuffer = lightBufferAddr;
+	pc.lightCount = _mainDrawContext._lights.size();
+	pc.materialID = 0;
+	pc.drawDataBuffer = _renderScene.get_draw_data_addr(frameIndex);
+	pc.model = glm::mat4(1.f);
+	pc.positionBuffer = 0;
+
+	uint32_t boundPipeline = UINT32_MAX;
+	for (uint32_t bucket = 0; bucket < RENDER_BUCKET_COUNT; bucket++) {
+		const RenderDrawRange& range = _renderScene.get_draw_range(bucket);
+		uint32_t pipeline = (bucket & RENDER_BUCKET_NOT_OPAQUE_BIT) ?
+			maskedPipeline : opaquePipeline;
+		if (range.count == 0 || pipeline == UINT32_MAX) {
+			continue;
+		}
+
+		if (pipeline != boundPipeline) {
+			boundPipeline = pipeline;
+			const Pipeline* p = &pipelines[pipeline];
+			deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p->pipeline);
+			bindlessRegistry.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p->layout);
+			deviceDispatch.vkCmdPushConstants(cmd, p->layout,
+				VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(GPUDrawPushConstants), &pc);
+		}
+
+		deviceDispatch.vkCmdSetCullMode(cmd, (bucket & RENDER_BUCKET_DOUBLE_SIDED_BIT) ?
+			VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT);
+		deviceDispatch.vkCmdDrawIndexedIndirect(cmd, _renderScene.get_indirect_buffer(frameIndex),
+			range.first * sizeof(VkDrawIndexedIndirectCommand), range.count,
+			sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
+
 EngineResult
 VulkanEngine::render_skybox(VkCommandBuffer cmd) {
 
 	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		pipelines[skyboxPipeline].pipeline);
-	deviceDispatch.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		pipelines[skyboxPipeline].layout, 0, 1, &bindlessDescriptorSet, 0, nullptr);
+	bindlessRegistry.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+		pipelines[skyboxPipeline].layout);
 
 	glm::mat4 view = _activeCamera.calcViewMat();
 	glm::mat4 proj = glm::perspective(
@@ -2311,14 +2808,33 @@ VulkanEngine::render_debug_pass(VkCommandBuffer cmd) {
 			deviceDispatch.vkCmdBindIndexBuffer(cmd, geometryBuffer.buffer, surface->indexBufferAddr,
 				VK_INDEX_TYPE_UINT32);
 
-			GPUDrawPushConstants pc;
+			GPUWireframePushConstants pc;
 			pc.vertexBuffer = geometryBuffer.addr + surface->vertexBufferAddr;
 			pc.sceneBuffer = uSceneDataAddr;
+			pc.drawDataBuffer = 0;
 			pc.model = surface->transform;
+			pc.color = GEOMETRY_WIREFRAME_COLOR;
 			deviceDispatch.vkCmdPushConstants(cmd, p.layout, VK_SHADER_STAGE_ALL_GRAPHICS,
-				0, sizeof(GPUDrawPushConstants), &pc);
+				0, sizeof(GPUWireframePushConstants), &pc);
 			deviceDispatch.vkCmdDrawIndexed(cmd, surface->indexCount, 1, surface->firstIndex, 0, 0);
 		}
+
+		if (_renderScene.get_draw_count() > 0) {
+			uint32_t frameIndex = frameNumber % FRAME_OVERLAP;
+			deviceDispatch.vkCmdBindIndexBuffer(cmd, geometryBuffer.buffer, 0,
+				VK_INDEX_TYPE_UINT32);
+
+			GPUWireframePushConstants pc;
+			pc.vertexBuffer = 0;
+			pc.sceneBuffer = uSceneDataAddr;
+			pc.drawDataBuffer = _renderScene.get_draw_data_addr(frameIndex);
+			pc.model = glm::mat4(1.f);
+			pc.color = GEOMETRY_WIREFRAME_COLOR;
+			deviceDispatch.vkCmdPushConstants(cmd, p.layout, VK_SHADER_STAGE_ALL_GRAPHICS,
+				0, sizeof(GPUWireframePushConstants), &pc);
+			deviceDispatch.vkCmdDrawIndexedIndirect(cmd, _renderScene.get_indirect_buffer(frameIndex),
+				0, _renderScene.get_draw_count(), sizeof(VkDrawIndexedIndirectCommand));
+		}
 	}
 	if (_debugFlags & RENDER_DEBUG_LIGHTS_BIT) {
 
@@ -2330,6 +2846,71 @@ VulkanEngine::render_debug_pass(VkCommandBuffer cmd) {
 	if (ImGui::Begin("Renderer Debugging")) {
 		ImGui::SliderFloat("Render Scale", &renderScale, 0.3f, 1.0);
 		ImGui::CheckboxFlags("Geometry Wireframe", &_debugFlags, RENDER_DEBUG_GEOMETRY_WIREFRAME_BIT);
+		bool prepass = depthPrepass;
+		if (ImGui::Checkbox("Depth Prepass", &prepass)) {
+			depthPrepass = prepass;
+		}
+		if (timestampQueryPool != VK_NULL_HANDLE) {
+			ImGui::Text("GPU without prepass: main %.3f ms", mainPassTimeMs[0]);
+			ImGui::Text("GPU with prepass: prepass %.3f ms, main %.3f ms, total %.3f ms",
+				prepassTimeMs[1], mainPassTimeMs[1], prepassTimeMs[1] + mainPassTimeMs[1]);
+		}
+		LinearArenaStats arenaStats = _mainDrawContext.get_arena_stats();
+		ImGui::Text("Frame arena: %.1f / %.1f KB (high-water %.1f KB, %u block allocations)",
+			arenaStats.used / 1024.f, arenaStats.capacity / 1024.f,
+			arenaStats.highWater / 1024.f, arenaStats.blockAllocations);
+
+		TransientRingStats lineStats = _lineRing.get_stats();
+		TransientRingStats triangleStats = _triangleRing.get_stats();
+		ImGui::Text("Line ring: %.1f / %.1f KB in %u blocks (high-water %.1f KB)",
+			lineStats.used / 1024.f, lineStats.capacity / 1024.f,
+			lineStats.blockCount, lineStats.highWater / 1024.f);
+		ImGui::Text("Triangle ring: %.1f / %.1f KB in %u blocks (high-water %.1f KB)",
+			triangleStats.used / 1024.f, triangleStats.capacity / 1024.f,
+			triangleStats.blockCount, triangleStats.highWater / 1024.f);
+		TransientRingStats wireframeStats = _wireframeRing.get_stats();
+		ImGui::Text("Wireframe ring: %.1f / %.1f KB in %u blocks (high-water %.1f KB)",
+			wireframeStats.used / 1024.f, wireframeStats.capacity / 1024.f,
+			wireframeStats.blockCount, wireframeStats.highWater / 1024.f);
+
+		const TextCacheStats& textStats = _textCache.get_stats();
+		ImGui::Text("Text: %u glyphs, %u runs cached (%u hits, %u misses)",
+			textStats.glyphCount, textStats.runCount, textStats.hits, textStats.misses);
+		ImGui::Text("Glyph pages: %u uploaded, %u pending, %u pages evicted",
+			textStats.uploadedGlyphs, textStats.pendingGlyphs, textStats.evictedPages);
+
+		const TextureStreamerStats& streamStats = _textureStreamer.get_stats();
+		ImGui::Text("Streaming: %u textures, %.1f / %.1f MB, %u loads in flight",
+			streamStats.textureCount, streamStats.residentBytes / (1024.f * 1024.f),
+			streamStats.budgetBytes / (1024.f * 1024.f), streamStats.loadsInFlight);
+		ImGui::Text("Streamed levels: %u loaded, %u evicted",
+			streamStats.loadedLevels, streamStats.evictedLevels);
+		const BindlessRegistryStats& bindlessStats = bindlessRegistry.get_stats();
+		ImGui::Text("Bindless: %u textures, %u storage images, %u samplers, %u frees pending",
+			bindlessStats.used[BINDLESS_BINDING_TEXTURES],
+			bindlessStats.used[BINDLESS_BINDING_STORAGE_IMAGES],
+			bindlessStats.used[BINDLESS_BINDING_SAMPLERS], bindlessStats.pendingFrees);
+		ImGui::Text("Bindless updates: %u slots in %u writes (%s)",
+			bindlessStats.writtenSlots, bindlessStats.writeCount,
+			bindlessRegistry.uses_descriptor_buffer() ? "descriptor buffer" : "descriptor pool");
+		const MaterialRegistryStats& materialStats = materialRegistry.get_stats();
+		ImGui::Text("Materials: %u / %u, %u deduplicated",
+			materialStats.materialCount, materialStats.capacity, materialStats.dedupHits);
+		const DrawSortStats& sortStats = _mainDrawContext.get_sort_stats();
+		ImGui::Text("Geometry: %u opaque, %u transparent, %u radix passes",
+			sortStats.opaqueCount, sortStats.transparentCount, sortStats.radixPasses);
+		ImGui::Text("State changes: %u pipeline, %u material (unsorted %u, %u)",
+			sortStats.pipelineChanges, sortStats.materialChanges,
+			sortStats.unsortedPipelineChanges, sortStats.unsortedMaterialChanges);
+		if (geometryQueryPool != VK_NULL_HANDLE) {
+			ImGui::Text("Geometry overdraw: %.2f fragments per screen pixel", geometryOverdraw);
+		}
+
+		int budgetMb = static_cast<int>(textureStreamingBudget / (1024 * 1024));
+		if (ImGui::SliderInt("Streaming budget (MB)", &budgetMb, 1, 1024)) {
+			textureStreamingBudget = static_cast<size_t>(budgetMb) * 1024 * 1024;
+			_textureStreamer.set_budget(textureStreamingBudget);
+		}
 	}
 	ImGui::End();
 
@@ -2337,221 +2918,182 @@ VulkanEngine::render_debug_pass(VkCommandBuffer cmd) {
 }
 
 
+// Lines and triangles are already in the mapped rings, each block of the
+// current slot is one draw
 EngineResult
 VulkanEngine::render_lines(VkCommandBuffer cmd) {
-	// Nothing to draw if no vertices recorded in lineCtx
-	if (_mainDrawContext._lineData.size() <= 0) {
+	if (_lineRing.get_stats().used == 0) {
 		return ENGINE_SUCCESS;
 	}
 
-	LineVertex* lineData = _mainDrawContext._lineData.data();
-	size_t vtxSize = _mainDrawContext._lineData.size() * sizeof(LineVertex);
-
-	void* data = (void*)lineData;
-
-	CopyDataToBufferInfo copyInfo;
-	copyInfo.buffer = lineVertexBuffer.buffer;
-	copyInfo.allocator = allocator;
-	copyInfo.pData = data;
-	copyInfo.size = vtxSize;
-	copyInfo.device = device;
-	copyInfo.pDeviceDispatch = &deviceDispatch;
-	copyInfo.cmdBuf = immCmdBuf;
-	copyInfo.cmdFence = immFence;
-	copyInfo.queue = graphicsQueue;
-	copy_data_to_buffer(&copyInfo);
-
 	Pipeline p = pipelines[linePipeline];
 
 	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		p.pipeline);
 	deviceDispatch.vkCmdSetLineWidth(cmd, 1);
 
-	GPUDrawPushConstants pc;
-	pc.sceneBuffer = uSceneDataAddr;
-	pc.vertexBuffer = lineVertexBufferAddr;
+	for (uint32_t i = 0; i < _lineRing.get_block_count(); i++) {
+		GPUDrawPushConstants pc;
+		pc.sceneBuffer = uSceneDataAddr;
+		pc.vertexBuffer = _lineRing.get_block_addr(i);
 
-	deviceDispatch.vkCmdPushConstants(cmd, p.layout,
-		VK_SHADER_STAGE_VERTEX_BIT, 0, 
-		2 * sizeof(VkDeviceAddress), &pc);
-	deviceDispatch.vkCmdDraw(cmd, _mainDrawContext._lineData.size(), 1, 0, 0);
+		deviceDispatch.vkCmdPushConstants(cmd, p.layout,
+			VK_SHADER_STAGE_VERTEX_BIT, 0,
+			2 * sizeof(VkDeviceAddress), &pc);
+		deviceDispatch.vkCmdDraw(cmd,
+			_lineRing.get_block_used(i) / sizeof(LineVertex), 1, 0, 0);
+	}
+
+	return ENGINE_SUCCESS;
 }
 
 EngineResult
 VulkanEngine::render_triangles(VkCommandBuffer cmd) {
-	if (_mainDrawContext._triangleData.size() <= 0) {
+	if (_triangleRing.get_stats().used == 0) {
 		return ENGINE_SUCCESS;
 	}
 
-	void* data = (void*)_mainDrawContext._triangleData.data();
-	size_t vtxSize = _mainDrawContext._triangleData.size() * sizeof(TriangleVertex);
-
-	CopyDataToBufferInfo copyInfo;
-	copyInfo.buffer = triangleVertexBuffer.buffer;
-	copyInfo.allocator = allocator;
-	copyInfo.pData = data;
-	copyInfo.size = vtxSize;
-	copyInfo.device = device;
-	copyInfo.pDeviceDispatch = &deviceDispatch;
-	copyInfo.cmdBuf = immCmdBuf;
-	copyInfo.cmdFence = immFence;
-	copyInfo.queue = graphicsQueue;
-	copy_data_to_buffer(&copyInfo);
-
 	Pipeline p = pipelines[trianglePipeline];
 
 	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		p.pipeline);
 
-	GPUDrawPushConstants pc;
-	pc.sceneBuffer = uSceneDataAddr;
-	pc.vertexBuffer = triangleVertexBufferAddr;
+	for (uint32_t i = 0; i < _triangleRing.get_block_count(); i++) {
+		GPUDrawPushConstants pc;
+		pc.sceneBuffer = uSceneDataAddr;
+		pc.vertexBuffer = _triangleRing.get_block_addr(i);
 
-	deviceDispatch.vkCmdPushConstants(cmd, p.layout,
-		VK_SHADER_STAGE_VERTEX_BIT, 0,
-		2 * sizeof(VkDeviceAddress), &pc);
-	deviceDispatch.vkCmdDraw(cmd, _mainDrawContext._triangleData.size(), 1, 0, 0);
+		deviceDispatch.vkCmdPushConstants(cmd, p.layout,
+			VK_SHADER_STAGE_VERTEX_BIT, 0,
+			2 * sizeof(VkDeviceAddress), &pc);
+		deviceDispatch.vkCmdDraw(cmd,
+			_triangleRing.get_block_used(i) / sizeof(TriangleVertex), 1, 0, 0);
+	}
+
+	return ENGINE_SUCCESS;
 }
 
+// Everything drawn here is already on the GPU (geometry buffer or the
+// mapped wireframe ring), so this only records draws
 EngineResult
 VulkanEngine::render_wireframes(VkCommandBuffer cmd) {
+	const ArenaArray<WireframeDrawData>& wireframes = _mainDrawContext._wireframeData;
+	if (wireframes.empty()) {
+		return ENGINE_SUCCESS;
+	}
+
 	Pipeline p = pipelines[wireframePipeline];
 
 	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		p.pipeline);
-	deviceDispatch.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		p.layout, 0, 1, &bindlessDescriptorSet, 0, nullptr);
+	deviceDispatch.vkCmdSetDepthTestEnable(cmd, VK_TRUE);
 	deviceDispatch.vkCmdSetLineWidth(cmd, 2.0);
 
-	if (_mainDrawContext._wireframeData.indices.size() > 0) {
-		size_t vtxSize = _mainDrawContext._wireframeData.vertices.size() * sizeof(Vertex);
-		size_t idxSize = _mainDrawContext._wireframeData.indices.size() * sizeof(uint32_t);
-		AllocatedBuffer uploadBuffer;
-		BufferCreateInfo bufferInfo;
-		bufferInfo.allocator = allocator;
-		bufferInfo.allocSize = vtxSize + idxSize;
-		bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
-			VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-		bufferInfo.pBuffer = &uploadBuffer;
-		create_buffer(&bufferInfo);
-
-		void* data = uploadBuffer.info.pMappedData;
-		memcpy(data, _mainDrawContext._wireframeData.vertices.data(), vtxSize);
-		memcpy((char*)data + vtxSize, _mainDrawContext._wireframeData.indices.data(), idxSize);
-
-
-		immediate_submit([&](VkCommandBuffer cmd) {
-			VkBufferCopy vertexCopy{ 0 };
-			vertexCopy.dstOffset = 0;
-			vertexCopy.srcOffset = 0;
-			vertexCopy.size = vtxSize;
-
-			deviceDispatch.vkCmdCopyBuffer(cmd, uploadBuffer.buffer,
-				wireframeVertexBuffer.buffer, 1, &vertexCopy);
-
-			VkBufferCopy indexCopy{ 0 };
-			indexCopy.dstOffset = 0;
-			indexCopy.srcOffset = vtxSize;
-			indexCopy.size = idxSize;
-
-			deviceDispatch.vkCmdCopyBuffer(cmd, uploadBuffer.buffer,
-				wireframeIndexBuffer.buffer, 1, &indexCopy);
-			});
-
-		destroy_buffer(&uploadBuffer);
-
-		deviceDispatch.vkCmdBindIndexBuffer(cmd, wireframeIndexBuffer.buffer,
-			0, VK_INDEX_TYPE_UINT32);
-		GPUDrawPushConstants pc;
-		pc.vertexBuffer = wireframeVertexBufferAddr;
+	VkBuffer boundBuffer = VK_NULL_HANDLE;
+	VkDeviceSize boundOffset = 0;
+	for (size_t i = 0; i < wireframes.size(); i++) {
+		const WireframeDrawData* wireframe = &wireframes[i];
+		// Surfaces of the same mesh share the index buffer binding
+		if (wireframe->indexBuffer != boundBuffer || wireframe->indexOffset != boundOffset) {
+			deviceDispatch.vkCmdBindIndexBuffer(cmd, wireframe->indexBuffer,
+				wireframe->indexOffset, VK_INDEX_TYPE_UINT32);
+			boundBuffer = wireframe->indexBuffer;
+			boundOffset = wireframe->indexOffset;
+		}
+
+		GPUWireframePushConstants pc;
+		pc.vertexBuffer = wireframe->vertexBufferAddr;
 		pc.sceneBuffer = uSceneDataAddr;
-		pc.model = glm::mat4(1.f);
+		pc.drawDataBuffer = 0;
+		pc.model = wireframe->transform;
+		pc.color = wireframe->color;
 
 		deviceDispatch.vkCmdPushConstants(cmd, p.layout,
-			VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(GPUDrawPushConstants), &pc);
+			VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(GPUWireframePushConstants), &pc);
 
-		deviceDispatch.vkCmdDrawIndexed(cmd, _mainDrawContext._wireframeData.indices.size(),
-			1, 0, 0, 0);
+		deviceDispatch.vkCmdDrawIndexed(cmd, wireframe->indexCount, 1,
+			wireframe->firstIndex, 0, 0);
 	}
 
 	return ENGINE_SUCCESS;
 }
 
+// Draws the debug mesh instances recorded this frame. They already live in
+// a mapped buffer so nothing is copied here.
 EngineResult
-VulkanEngine::render_text_geometry(VkCommandBuffer cmd) {
-	// Write text data to buffer
-	if (_mainDrawContext._textData.vertices.size() <= 0) {
+VulkanEngine::render_debug_geometry(VkCommandBuffer cmd) {
+	const std::vector<DebugDrawBatch>& batches = _debugGeometry.prepare();
+	if (batches.empty()) {
 		return ENGINE_SUCCESS;
 	}
-	void* data = (void*)_mainDrawContext._textData.vertices.data();
-	size_t size = sizeof(TextVertex) * _mainDrawContext._textData.vertices.size();
-
-	CopyDataToBufferInfo copyInfo;
-	copyInfo.buffer = textVertexBuffer.buffer;
-	copyInfo.allocator = allocator;
-	copyInfo.pData = data;
-	copyInfo.size = size;
-	copyInfo.device = device;
-	copyInfo.pDeviceDispatch = &deviceDispatch;
-	copyInfo.cmdBuf = immCmdBuf;
-	copyInfo.cmdFence = immFence;
-	copyInfo.queue = graphicsQueue;
-	copy_data_to_buffer(&copyInfo);
 
-	data = (void*)_mainDrawContext._textData.indices.data();
-	size = sizeof(uint32_t) * _mainDrawContext._textData.indices.size();
-
-	copyInfo.buffer = textIndexBuffer.buffer;
-	copyInfo.pData = data;
-	copyInfo.size = size;
-	copy_data_to_buffer(&copyInfo);
+	deviceDispatch.vkCmdBindIndexBuffer(cmd, _debugGeometry.get_geometry_buffer(), 0,
+		VK_INDEX_TYPE_UINT32);
 
-	VkRenderingAttachmentInfo colorAttachment = {};
-	colorAttachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-	colorAttachment.pNext = NULL;
+	GPUDebugPushConstants pc;
+	pc.sceneBuffer = uSceneDataAddr;
+	pc.instanceBuffer = _debugGeometry.get_instance_addr();
+
+	// Batches are sorted by mesh and then mode, so the pipeline changes at
+	// most once per mesh
+	int32_t boundMode = -1;
+	for (size_t i = 0; i < batches.size(); i++) {
+		const DebugDrawBatch* batch = &batches[i];
+		Pipeline p = pipelines[batch->mode == DEBUG_DRAW_WIREFRAME ?
+			debugWireframePipeline : debugSolidPipeline];
+		if (boundMode != (int32_t)batch->mode) {
+			deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+				p.pipeline);
+			if (batch->mode == DEBUG_DRAW_WIREFRAME) {
+				deviceDispatch.vkCmdSetLineWidth(cmd, 1.f);
+			}
+			boundMode = batch->mode;
+		}
 
-	colorAttachment.imageView = drawImage.imageView;
-	colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		pc.vertexBuffer = batch->vertexBuffer;
+		deviceDispatch.vkCmdPushConstants(cmd, p.layout, VK_SHADER_STAGE_VERTEX_BIT,
+			0, sizeof(GPUDebugPushConstants), &pc);
+		deviceDispatch.vkCmdDrawIndexed(cmd, batch->indexCount, batch->instanceCount,
+			static_cast<uint32_t>(batch->indexOffset / sizeof(uint32_t)), 0,
+			batch->firstInstance);
+	}
 
-	VkRenderingInfo renderInfo = { .sType = VK_STRUCTURE_TYPE_RENDERING_INFO };
-	renderInfo.pNext = nullptr;
+	return ENGINE_SUCCESS;
+}
 
-	renderInfo.renderArea = VkRect2D{ VkOffset2D {0, 0}, drawExtent };
-	renderInfo.layerCount = 1;
-	renderInfo.colorAttachmentCount = 1;
-	renderInfo.pColorAttachments = &colorAttachment;
-	renderInfo.pDepthAttachment = nullptr;
-	renderInfo.pStencilAttachment = nullptr;
+// Glyph instances are already in the text cache's mapped ring, one
+// instanced draw of 6 vertices per glyph and ring block
+EngineResult
+VulkanEngine::render_text_geometry(VkCommandBuffer cmd) {
+	const TransientRing& instances = _textCache.get_instances();
+	if (instances.get_stats().used == 0) {
+		return ENGINE_SUCCESS;
+	}
 
 	Pipeline p = pipelines[textPipeline];
-	deviceDispatch.vkCmdBeginRendering(cmd, &renderInfo);
 
 	deviceDispatch.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
 		p.pipeline);
 
-	deviceDispatch.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		p.layout, 0, 1, &bindlessDescriptorSet, 0, nullptr);
-
-	glm::mat4 view = glm::mat4(1.0f);
-	glm::mat4 proj = glm::ortho(0.0f, (float)drawExtent.width / renderScale, 0.0f,
-		(float)drawExtent.height / renderScale, -1.0f, 1.0f);
+	bindlessRegistry.bind(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, p.layout);
 
-	GPUDrawPushConstants pc;
-	pc.model = glm::mat4(0.0f);
-	pc.vertexBuffer = textVertexBufferAddr;
-	pc.sceneBuffer = uSceneDataAddr;
+	for (uint32_t i = 0; i < instances.get_block_count(); i++) {
+		uint32_t glyphCount = static_cast<uint32_t>(
+			instances.get_block_used(i) / sizeof(GPUGlyphInstance));
+		if (glyphCount == 0) {
+			continue;
+		}
 
-	deviceDispatch.vkCmdBindIndexBuffer(cmd, textIndexBuffer.buffer, 0,
-		VK_INDEX_TYPE_UINT32);
+		GPUTextPushConstants pc;
+		pc.sceneBuffer = uSceneDataAddr;
+		pc.instanceBuffer = instances.get_block_addr(i);
+		pc.glyphBuffer = _textCache.get_glyph_table_addr();
 
-	deviceDispatch.vkCmdPushConstants(cmd, pipelines[textPipeline].layout,
-		VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUDrawPushConstants), &pc);
+		deviceDispatch.vkCmdPushConstants(cmd, p.layout,
+			VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(GPUTextPushConstants), &pc);
 
-	deviceDispatch.vkCmdDrawIndexed(cmd, _mainDrawContext._textData.indices.size(),
-		1, 0, 0, 0);
+		deviceDispatch.vkCmdDraw(cmd, 6, glyphCount, 0, 0);
+	}
 
 	return ENGINE_SUCCESS;
 }
@@ -2583,6 +3125,66 @@ VulkanEngine::clear_debug_flags(RenderDebugFlags flags) {
 	_debugFlags &= ~flags;
 }
 
+// Lays out the position stream of a mesh, GPUPositionStreamHeader followed
+// by the positions
+static void
+build_position_stream(const Vertex* pVertices, uint32_t vertexCount, uint32_t quantize,
+	std::vector<uint8_t>* pStream) {
+	GPUPositionStreamHeader header = {};
+	header.quantized = quantize;
+
+	glm::vec3 boundsMax(0.f);
+	if (vertexCount > 0) {
+		header.boundsMin = boundsMax = pVertices[0].position;
+	}
+	for (uint32_t i = 1; i < vertexCount; i++) {
+		header.boundsMin = glm::min(header.boundsMin, pVertices[i].position);
+		boundsMax = glm::max(boundsMax, pVertices[i].position);
+	}
+	if (!quantize) {
+		header.boundsMin = glm::vec3(0.f);
+	}
+	header.boundsScale = quantize ? (boundsMax - header.boundsMin) / 65535.f : glm::vec3(1.f);
+
+	size_t positionSize = quantize ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+	pStream->resize(sizeof(header) + vertexCount * positionSize);
+	memcpy(pStream->data(), &header, sizeof(header));
+
+	uint8_t* pPositions = pStream->data() + sizeof(header);
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		const glm::vec3& position = pVertices[i].position;
+		if (!quantize) {
+			memcpy(pPositions + i * positionSize, &position, positionSize);
+			continue;
+		}
+
+		// Flat axes have a scale of 0 and quantize to 0
+		uint16_t q[4] = {};
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = boundsMax[axis] - header.boundsMin[axis];
+			float t = extent > 0.f ? (position[axis] - header.boundsMin[axis]) / extent : 0.f;
+			q[axis] = static_cast<uint16_t>(glm::clamp(t, 0.f, 1.f) * 65535.f + 0.5f);
+		}
+		memcpy(pPositions + i * positionSize, q, positionSize);
+	}
+}
+
+static glm::vec3
+surface_bounds_center(const Vertex* pVertices, const uint32_t* pIndices,
+	const Surface* pSurface) {
+	if (pSurface->count == 0) {
+		return glm::vec3(0.f);
+	}
+	glm::vec3 boundsMin = pVertices[pIndices[pSurface->startIndex]].position;
+	glm::vec3 boundsMax = boundsMin;
+	for (uint32_t i = 1; i < pSurface->count; i++) {
+		const glm::vec3& position = pVertices[pIndices[pSurface->startIndex + i]].position;
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+	}
+	return 0.5f * (boundsMin + boundsMax);
+}
+
 // Takes a partly constructed mesh and uploades it to the geometry buffer
 void 
 VulkanEngine::upload_mesh(UploadMeshInfo *pUploadInfo) {
@@ -2593,12 +3195,23 @@ VulkanEngine::upload_mesh(UploadMeshInfo *pUploadInfo) {
 
 	for (size_t i = 0; i < pUploadInfo->surfaceCount; i++) {
 		Surface adjustedSurface = pUploadInfo->pSurfaces[i];
-		adjustedSurface.materialID = 0;
+		if (adjustedSurface.materialID >= materialRegistry.get_count()) {
+			adjustedSurface.materialID = MATERIAL_DEFAULT;
+		}
+		adjustedSurface.boundsCenter = surface_bounds_center(pUploadInfo->pVertices,
+			pUploadInfo->pIndices, &adjustedSurface);
 		newMesh.surfaces.push_back(adjustedSurface);
 	}
 
+	// Shadows, the depth prepass and gl_Position of the main pass read this
+	// instead of the vertices
+	std::vector<uint8_t> positionStream;
+	build_position_stream(pUploadInfo->pVertices, pUploadInfo->vertexCount,
+		QUANTIZE_MESH_POSITIONS, &positionStream);
+
 	newMesh.vertexOffset = geometryBuffer.suballocate(vertexBufferSize, 8);
 	newMesh.indexOffset = geometryBuffer.suballocate(indexBufferSize, 8);
+	newMesh.positionOffset = geometryBuffer.suballocate(positionStream.size(), 16);
 
 	CopyDataToBufferInfo copyInfo = {};
 	copyInfo.allocator = allocator;
@@ -2619,20 +3232,65 @@ VulkanEngine::upload_mesh(UploadMeshInfo *pUploadInfo) {
 	copyInfo.dstOffset = newMesh.indexOffset;
 	copy_data_to_buffer(&copyInfo);
 
+	copyInfo.pData = positionStream.data();
+	copyInfo.size = positionStream.size();
+	copyInfo.dstOffset = newMesh.positionOffset;
+	copy_data_to_buffer(&copyInfo);
+
 	meshes[meshCount++] = newMesh;
 }
 
-// Adds the line to the main draw context
+// Writes the line straight into this frame's line ring
 void
 VulkanEngine::draw_line(glm::vec3 from, glm::vec3 to, glm::vec4 color) {
-	_mainDrawContext.add_line(from, to, color);
+	LineVertex* vertices = (LineVertex*)_lineRing.alloc(2 * sizeof(LineVertex),
+		sizeof(LineVertex));
+	if (vertices == nullptr) {
+		return;
+	}
+	vertices[0] = LineVertex{
+		.color = color,
+		.position = from
+	};
+	vertices[1] = LineVertex{
+		.color = color,
+		.position = to
+	};
+}
+
+DebugMeshHandle
+VulkanEngine::create_debug_mesh(const DebugVertex* pVertices, uint32_t vertexCount,
+	const uint32_t* pIndices, uint32_t indexCount) {
+	return _debugGeometry.create_mesh(pVertices, vertexCount, pIndices, indexCount);
+}
+
+void
+VulkanEngine::destroy_debug_mesh(DebugMeshHandle handle) {
+	_debugGeometry.destroy_mesh(handle);
 }
 
-// Adds trianlge vertices to the main draw context (does not support indexed drawing rn)
+void
+VulkanEngine::draw_debug_mesh(DebugMeshHandle handle, const glm::mat4& model,
+	glm::vec4 color, DebugDrawMode mode) {
+	_debugGeometry.add_instance(handle, model, color, mode);
+}
+
+// Writes the triangle straight into this frame's triangle ring (does not
+// support indexed drawing rn)
 // @TODO ->	Indexed drawing please
 void
 VulkanEngine::draw_triangle(glm::vec3 vertices[3], glm::vec4 color) {
-	_mainDrawContext.add_triangle(vertices, color);
+	TriangleVertex* triangle = (TriangleVertex*)_triangleRing.alloc(
+		3 * sizeof(TriangleVertex), sizeof(TriangleVertex));
+	if (triangle == nullptr) {
+		return;
+	}
+	for (size_t i = 0; i < 3; i++) {
+		triangle[i] = TriangleVertex{
+			.color = color,
+			.position = vertices[i]
+		};
+	}
 }
 
 // Adds the mesh with 'id' and transform data 'transform' to the
@@ -2642,18 +3300,140 @@ VulkanEngine::draw_mesh(uint32_t id, const Transform* transform) {
 	_mainDrawContext.add_mesh(&meshes[id], transform);
 }
 
+// Creates a persistent render object for mesh 'meshID'. Unlike draw_mesh()
+// the object does not have to be resubmitted every frame.
+RenderObjectHandle
+VulkanEngine::create_render_object(uint32_t meshID, const Transform* transform) {
+	if (meshID >= meshCount) {
+		ENGINE_ERROR("Attempting to create render object with invalid mesh.");
+		return INVALID_RENDER_OBJECT;
+	}
+	const Mesh* mesh = &meshes[meshID];
+	return _renderScene.create_object(mesh, geometryBuffer.addr + mesh->vertexOffset,
+		geometryBuffer.addr + mesh->positionOffset, mesh->indexOffset, transform);
+}
+
+// Only call this when the transform actually changed, every call costs an
+// upload for each frame in flight.
+void
+VulkanEngine::update_render_object(RenderObjectHandle handle, const Transform* transform) {
+	_renderScene.update_object(handle, transform);
+}
+
+void
+VulkanEngine::destroy_render_object(RenderObjectHandle handle) {
+	_renderScene.destroy_object(handle);
+}
+
+// Writes the vertices and indices into this frame's wireframe ring and
+// records one indexed draw. 'indices' index into 'vertices' and are read
+// as a triangle list.
+void
+VulkanEngine::draw_wireframe(const std::vector<glm::vec3>& vertices,
+	const std::vector<uint32_t>& indices, glm::vec4 color) {
+	if (vertices.empty() || indices.empty()) {
+		return;
+	}
+
+	// Vertices first, the indices follow in the same allocation so both
+	// end up in the same ring block
+	size_t vtxSize = vertices.size() * sizeof(Vertex);
+	size_t idxSize = indices.size() * sizeof(uint32_t);
+	TransientAllocation allocation;
+	// 16 is the default buffer_reference alignment in the shaders
+	uint8_t* data = (uint8_t*)_wireframeRing.alloc(vtxSize + idxSize, 16, &allocation);
+	if (data == nullptr) {
+		return;
+	}
+
+	Vertex* pVertices = (Vertex*)data;
+	for (size_t i = 0; i < vertices.size(); i++) {
+		pVertices[i] = Vertex{
+			.position = vertices[i],
+			.color = color
+		};
+	}
+	memcpy(data + vtxSize, indices.data(), idxSize);
+
+	WireframeDrawData wireframe;
+	wireframe.indexBuffer = allocation.buffer;
+	wireframe.indexOffset = allocation.offset + vtxSize;
+	wireframe.firstIndex = 0;
+	wireframe.indexCount = static_cast<uint32_t>(indices.size());
+	wireframe.vertexBufferAddr = allocation.addr;
+	wireframe.transform = glm::mat4(1.f);
+	wireframe.color = color;
+	_mainDrawContext.add_wireframe(&wireframe);
+}
+
+// Wireframe overlay of mesh 'id', drawn from the geometry buffer so nothing
+// gets uploaded again.
+void
+VulkanEngine::draw_mesh_wireframe(uint32_t id, const Transform* transform, glm::vec4 color) {
+	if (id >= meshCount) {
+		ENGINE_ERROR("Attempting to draw wireframe of invalid mesh.");
+		return;
+	}
+	_mainDrawContext.add_mesh_wireframe(&meshes[id], geometryBuffer.buffer,
+		geometryBuffer.addr, transform, color);
+}
+
+// Draws UTF-8 'text' at position 'x', 'y' with a height of 'size' (all in
+// screen pixels) this frame, in pAtlas or defaultFont when it is nullptr.
+// Unchanged strings reuse their cached glyph run.
+void
+VulkanEngine::draw_text(const char* text, float x, float y, float size,
+	FontAtlas* pAtlas) {
+	_textCache.add_text(text, { x, y }, size,
+		pAtlas != nullptr ? pAtlas : &defaultFont, TEXT_DEFAULT_COLOR);
+}
+
+EngineResult
+VulkanEngine::create_font(const char* ttfPath, int size, const char* cachePath,
+	FontAtlas* pAtlas) {
+	FontCreateInfo fontInfo;
+	fontInfo.allocator = allocator;
+	fontInfo.device = device;
+	fontInfo.pDeviceDispatch = &deviceDispatch;
+	fontInfo.ttfPath = ttfPath;
+	fontInfo.cachePath = cachePath;
+	fontInfo.size = size;
+	if (pAtlas->create(&fontInfo) != 0) {
+		ENGINE_ERROR("Failed to create font.");
+		return ENGINE_FAILURE;
+	}
+
+	// Sampled with linearSampler, see text.frag
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		pAtlas->pages[i].descriptorIndex = bindlessRegistry.add_texture(
+			pAtlas->pages[i].texture.imageView).index;
+	}
+
+	_textCache.register_font(pAtlas);
+	return ENGINE_SUCCESS;
+}
+
 void
-VulkanEngine::draw_wireframe(std::vector<glm::vec3>& vertices,
-	std::vector<uint32_t>& indices) {
-	// NOT IMPLEMENTED IN VK_CONTEXT.CPP
+VulkanEngine::apply_texture_swaps() {
+	// The old slots are only reused once the frames sampling them are done,
+	// nothing in flight has to be waited on
+	const std::vector<TextureSwap>& swaps = _textureStreamer.get_swaps();
+	for (size_t i = 0; i < swaps.size(); i++) {
+		if (swaps[i].texture == _skyboxStream) {
+			skyboxHandle = bindlessRegistry.replace_texture(skyboxHandle, swaps[i].imageView);
+		}
+	}
 }
 
-// Adds 'text' at position 'x', 'y' to the main draw context.
-// @TODO -> Right now, only renders with defaultFont... allow
-//			passing a fontAtlas id for custom fonts.
 void
-VulkanEngine::draw_text(const char* text, float x, float y, FontAtlas* pAtlas) {
-	_mainDrawContext.add_text(text, { x, y, 1 }, &defaultFont);
+VulkanEngine::destroy_font(FontAtlas* pAtlas) {
+	// Frames in flight may still sample the pages
+	deviceDispatch.vkDeviceWaitIdle(device);
+	_textCache.unregister_font(pAtlas);
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		bindlessRegistry.free_texture(BindlessTexture{ pAtlas->pages[i].descriptorIndex });
+	}
+	pAtlas->destroy(device, &deviceDispatch, allocator);
 }
 
 void
@@ -2691,14 +3471,45 @@ VulkanEngine::create_shader(const char* path, EShLanguage stage, uint32_t* idx)
 // Creates a material to be owned by the VulkanEngine, passing the material
 // index via 'idx'.
 EngineResult
-VulkanEngine::create_material(const Material* material,
+VulkanEngine::create_material(const GPUMaterial* material,
 	uint32_t* idx) {
-	if (materialCount >= MAX_MATERIALS) {
-		ENGINE_ERROR("Failed to create material... max materials reached.");
+	uint32_t id = materialRegistry.add(material);
+	if (id == MATERIAL_INVALID) {
+		ENGINE_ERROR("Failed to create material... the material buffer can't grow.");
+		return ENGINE_FAILURE;
+	}
+	*idx = id;
+
+	return ENGINE_SUCCESS;
+}
+
+EngineResult
+VulkanEngine::create_texture(const void* pPixels, uint32_t width, uint32_t height,
+	VkFormat format, BindlessTexture* pTexture) {
+	AllocatedImage image = {};
+
+	ImageCreateInfo imgInfo = {};
+	imgInfo.allocator = allocator;
+	imgInfo.device = device;
+	imgInfo.pDeviceDispatch = &deviceDispatch;
+	imgInfo.pImg = &image;
+	imgInfo.size = VkExtent3D{ width, height, 1 };
+	imgInfo.format = format;
+	imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	imgInfo.mipmapped = format_supports_mip_blit(format);
+	create_image_with_data(&imgInfo, const_cast<void*>(pPixels), immCmdBuf, immFence,
+		graphicsQueue);
+	if (image.image == VK_NULL_HANDLE) {
+		ENGINE_ERROR("Failed to create texture.");
+		return ENGINE_FAILURE;
+	}
+
+	*pTexture = bindlessRegistry.add_texture(image.imageView);
+	if (pTexture->index == BINDLESS_INVALID_INDEX) {
+		destroy_image(device, &deviceDispatch, allocator, &image);
 		return ENGINE_FAILURE;
 	}
-	memcpy((Material*)uMaterialBuffer.info.pMappedData + materialCount++,
-		material, sizeof(Material));
+	loadedTextures.push_back(image);
 
 	return ENGINE_SUCCESS;
 }
\ No newline at end of file
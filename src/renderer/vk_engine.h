@@ -26,10 +26,16 @@
 
 #include "../os.h"
 #include "camera.h"
+#include "vk_bindless.h"
+#include "vk_debug.h"
 #include "vk_descriptors.h"
 #include "vk_dispatch.h"
 #include "vk_loader.h"
+#include "vk_materials.h"
 #include "vk_pipelines.h"
+#include "vk_ring.h"
+#include "vk_scene.h"
+#include "vk_streaming.h"
 #include "vk_suballocator.h"
 #include "vk_text.h"
 #include "vk_types.h"
@@ -49,10 +55,28 @@
 #define MAX_SHADERS			64
 #define MAX_PIPELINES		32
 #define MAX_MESHES			128
-#define MAX_MATERIALS		64
+// Lets the bindless set live in a descriptor buffer on devices with
+// VK_EXT_descriptor_buffer, the descriptor pool is used otherwise. Off by
+// default until that path has been run on real hardware. Setting
+// DESCRIPTOR_BUFFER_ENV to 1 or 0 overrides it without a rebuild.
+#define USE_DESCRIPTOR_BUFFER	0
+#define DESCRIPTOR_BUFFER_ENV	"ENGINE_DESCRIPTOR_BUFFER"
+// Mesh position streams hold 16 bit positions over the mesh's bounds
+// rather than floats, see GPUPositionStreamHeader. Off by default: every
+// mesh gets its own grid, so edges shared between meshes can crack (about
+// 1.5 cm on a 1 km mesh) now that the main pass positions come from it.
+#define QUANTIZE_MESH_POSITIONS	0
 
 #define GLOBAL_BUFFER_SIZE	128 * 1024 * 1024
 #define UNIFORM_BUFFER_SIZE	16384
+#define TRANSIENT_RING_BLOCK_SIZE	1 * 1024 * 1024
+// Upper bound for mipmapped textures, lowered to the device limit
+#define MAX_TEXTURE_ANISOTROPY	16.f
+
+// Color of the RENDER_DEBUG_GEOMETRY_WIREFRAME_BIT overlay
+#define GEOMETRY_WIREFRAME_COLOR	glm::vec4(0.5f, 1.f, 0.5f, 1.f)
+// RGBA8, all text is white for now
+#define TEXT_DEFAULT_COLOR			0xffffffff
 
 #define ENGINE_MESSAGE(MSG) \
 	fprintf(stderr, "[VulkanEngine] INFO: " MSG "\n");
@@ -149,8 +173,6 @@ struct UploadMeshInfo {
 	uint32_t	surfaceCount;
 };
 
-constexpr unsigned int FRAME_OVERLAP = 2;
-
 /*---------------------------
  | VULKANENGINE CLASS
  ---------------------------*/
@@ -159,6 +181,14 @@ class VulkanEngine {
 public:
 	// TEMPORARY PLEASE MAKE PRIVATE LATER
 	FontAtlas				defaultFont;
+	// Set before init(), glyphs are rasterized on it. May stay nullptr.
+	JobScheduler*			pJobScheduler = nullptr;
+	// VRAM streamed texture mips may use, set before init() (or through
+	// the debug window)
+	size_t					textureStreamingBudget = STREAM_DEFAULT_BUDGET;
+	// Load the PNG textures one layer at a time rather than as one batch,
+	// set before init() (--serial-image-uploads) to compare load times
+	uint32_t				serialImageUploads = 0;
 	EngineResult 			init();
 	void 					deinit();
 
@@ -188,8 +218,13 @@ public:
 	 ---------------------------*/
 	EngineResult			create_shader(const char* path,
 								EShLanguage stage, uint32_t* idx);
-	EngineResult			create_material(const Material* material,
+	// Deduplicated, 'idx' is the ID of an identical material if there is one
+	EngineResult			create_material(const GPUMaterial* material,
 								uint32_t* idx);
+	// A mipmapped texture owned by the engine until deinit(), sampled
+	// through the bindless slot in 'pTexture'
+	EngineResult			create_texture(const void* pPixels, uint32_t width,
+								uint32_t height, VkFormat format, BindlessTexture* pTexture);
 
 	void		 			upload_mesh(UploadMeshInfo* pInfo);
 
@@ -208,10 +243,36 @@ public:
 	void					draw_triangle(glm::vec3 vertices[3], glm::vec4 color);
 
 	void					draw_mesh(uint32_t id, const Transform* transform);
-	void					draw_wireframe(std::vector<glm::vec3>& vertices,
-								std::vector<uint32_t>& indices);
-	void					draw_text(const char* text, float x, float y,
+
+	// Debug meshes are uploaded once and then drawn as instances (used by
+	// the Jolt debug renderer)
+	DebugMeshHandle			create_debug_mesh(const DebugVertex* pVertices,
+								uint32_t vertexCount, const uint32_t* pIndices,
+								uint32_t indexCount);
+	void					destroy_debug_mesh(DebugMeshHandle handle);
+	void					draw_debug_mesh(DebugMeshHandle handle, const glm::mat4& model,
+								glm::vec4 color, DebugDrawMode mode);
+	const DebugGeometryStats& get_debug_geometry_stats() {
+		return _debugGeometry.get_stats();
+	}
+
+	// Retained mode objects, these persist across frames until destroyed
+	RenderObjectHandle		create_render_object(uint32_t meshID,
+								const Transform* transform);
+	void					update_render_object(RenderObjectHandle handle,
+								const Transform* transform);
+	void					destroy_render_object(RenderObjectHandle handle);
+	void					draw_wireframe(const std::vector<glm::vec3>& vertices,
+								const std::vector<uint32_t>& indices, glm::vec4 color);
+	void					draw_mesh_wireframe(uint32_t id, const Transform* transform,
+								glm::vec4 color);
+	void					draw_text(const char* text, float x, float y, float size,
 								FontAtlas* pAtlas);
+	// 'size' is the pixel size glyphs are rasterized at, 'cachePath' may be
+	// nullptr (see FontCreateInfo)
+	EngineResult			create_font(const char* ttfPath, int size,
+								const char* cachePath, FontAtlas* pAtlas);
+	void					destroy_font(FontAtlas* pAtlas);
 
 	void					add_light(const Light* light);
 	
@@ -245,10 +306,23 @@ private:
 	EngineResult 			create_surface();
 
 	VkPhysicalDevice 		physicalDevice = NULL;
+	// 0 when the device has no samplerAnisotropy
+	float					maxSamplerAnisotropy = 0.f;
+	uint32_t				textureCompressionBC = 0;
+	// Optional, overdraw is measured with fragment shader invocation counts
+	uint32_t				pipelineStatisticsQuery = 0;
+	// Nanoseconds per timestamp tick, 0 when the graphics queue has no
+	// timestamps
+	float					timestampPeriod = 0.f;
+	// Optional, the bindless set lives in a descriptor buffer when it's there
+	// and enabled, see USE_DESCRIPTOR_BUFFER
+	uint32_t				descriptorBuffer = 0;
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProps = {};
 	QueueFamilyIndices 		queueFamilies;
 	EngineResult 			find_queue_families(VkPhysicalDevice physdev,
 								QueueFamilyIndices *qfi);
 	uint32_t 				device_suitable(VkPhysicalDevice dev);
+	uint32_t				device_has_extension(VkPhysicalDevice dev, const char* name);
 	EngineResult 			select_physical_device();
 
 	VkDevice 				device = NULL;
@@ -300,8 +374,37 @@ private:
 	EngineResult			render_shadow_pass(VkCommandBuffer cmd);
 
 	// Main pass and its subpasses
+	EngineResult			render_depth_prepass(VkCommandBuffer cmd);
 	EngineResult			render_main_pass(VkCommandBuffer cmd);
 	EngineResult 			render_geometry(VkCommandBuffer cmd);
+	void					render_retained_geometry(VkCommandBuffer cmd, uint32_t opaquePipeline,
+								uint32_t maskedPipeline);
+	// pBoundCullMode is the cull mode last set in 'cmd', updated when the
+	// surface needs another one
+	void					draw_surface(VkCommandBuffer cmd, VkPipelineLayout layout,
+								const SurfaceDrawData* surface, VkCullModeFlags* pBoundCullMode);
+	// Pipeline each MaterialPass is drawn with in the main pass
+	void					get_geometry_pipelines(uint32_t passPipelines[MATERIAL_PASS_COUNT]);
+
+	// Opaque surfaces are laid down depth only first, the main pass then
+	// shades each pixel once with an EQUAL test. Toggled from the debug panel.
+	uint32_t				depthPrepass = 0;
+	// Timestamps around the prepass and the main pass, three per frame in
+	// flight, read back like the geometry query
+	VkQueryPool				timestampQueryPool = VK_NULL_HANDLE;
+	uint32_t				timestampPending[FRAME_OVERLAP] = {};
+	uint32_t				timestampPrepass[FRAME_OVERLAP] = {};
+	// Last GPU times in ms, indexed by whether the prepass was on so both
+	// configurations can be compared
+	float					prepassTimeMs[2] = {};
+	float					mainPassTimeMs[2] = {};
+	// Fragment shader invocations of render_geometry(), one query per frame
+	// in flight, read back once that frame's fence has been waited on
+	VkQueryPool				geometryQueryPool = VK_NULL_HANDLE;
+	uint32_t				geometryQueryPending[FRAME_OVERLAP] = {};
+	// Invocations over every pixel of the draw extent (not only the covered
+	// ones) of the last frame read back
+	float					geometryOverdraw = 0.f;
 	EngineResult			render_skybox(VkCommandBuffer cmd);
 
 	// Debug pass and its subpasses
@@ -311,6 +414,7 @@ private:
 	EngineResult			render_lines(VkCommandBuffer cmd);
 	EngineResult			render_triangles(VkCommandBuffer cmd);
 	EngineResult			render_wireframes(VkCommandBuffer cmd);
+	EngineResult			render_debug_geometry(VkCommandBuffer cmd);
 	
 	EngineResult			render_text_geometry(VkCommandBuffer cmd);
 
@@ -334,10 +438,8 @@ private:
 	/*---------------------------
 	 |  DESCRIPTORS
 	 ---------------------------*/
-	VkDescriptorSetLayout	bindlessDescriptorLayout = VK_NULL_HANDLE;
-	VkDescriptorSet			bindlessDescriptorSet = VK_NULL_HANDLE;
-	DescriptorAllocator		bindlessDescriptorAllocator{};
-	DescriptorWriter		bindlessDescriptorWriter{};
+	// Set 0 of every pipeline
+	BindlessRegistry		bindlessRegistry{};
 
 	/*---------------------------
 	 |  RESOUCE ARRAYS & BUFFERS
@@ -367,33 +469,31 @@ private:
 	AllocatedBuffer			lightBuffer;
 	VkDeviceAddress			lightBufferAddr;
 
-	// Buffers for text rendering
-	AllocatedBuffer			textVertexBuffer;
-	VkDeviceAddress			textVertexBufferAddr;
-	AllocatedBuffer			textIndexBuffer;
+	// Cached glyph runs and the per-frame glyph instances of draw_text()
+	TextCache				_textCache;
 
-	// Buffer for line rendering
-	AllocatedBuffer			lineVertexBuffer;
-	VkDeviceAddress			lineVertexBufferAddr;
+	// Mips of cooked textures, loaded as the screen needs them
+	TextureStreamer			_textureStreamer;
+	// STREAM_INVALID_HANDLE when the skybox came from the PNGs
+	StreamedTextureHandle	_skyboxStream = STREAM_INVALID_HANDLE;
+	// Moves the bindless handles of textures the streamer replaced to the
+	// new images
+	void					apply_texture_swaps();
 
-	// Buffer for debug trianlge rendering (mainly used by JoltPhysics debug renderer)
-	AllocatedBuffer			triangleVertexBuffer;
-	VkDeviceAddress			triangleVertexBufferAddr;
+	// Mapped per-frame rings draw_line/draw_triangle write vertices into
+	TransientRing			_lineRing;
+	TransientRing			_triangleRing;
 
-	// Buffers for wireframe rendering
-	AllocatedBuffer			wireframeVertexBuffer;
-	VkDeviceAddress			wireframeVertexBufferAddr;
-	AllocatedBuffer			wireframeIndexBuffer;
+	// Vertices and indices of draw_wireframe() calls
+	TransientRing			_wireframeRing;
 	
 	// Renderer owns all meshes loaded/uploaded and are accessed
 	// through index
 	Mesh					meshes[MAX_MESHES] = {};
 	uint32_t				meshCount = 0;
 
-	// 
-	AllocatedBuffer			uMaterialBuffer;
-	VkDeviceAddress			uMaterialBufferAddr;
-	uint32_t				materialCount = 0;
+	MaterialRegistry		materialRegistry{};
+	std::vector<AllocatedImage> loadedTextures;
 
 	EngineResult			init_buffers();
 
@@ -403,6 +503,9 @@ private:
 	 ---------------------------*/
 	uint32_t				opaquePipeline;
 	uint32_t				transparentPipeline;
+	// Depth prepass mode, see depthPrepass
+	uint32_t				depthPrepassPipeline;
+	uint32_t				opaqueEqualPipeline;
 	EngineResult			init_mesh_pipelines();
 
 	uint32_t				linePipeline;
@@ -414,6 +517,10 @@ private:
 	uint32_t				wireframePipeline;
 	EngineResult			init_wireframe_pipeline();
 
+	uint32_t				debugSolidPipeline;
+	uint32_t				debugWireframePipeline;
+	EngineResult			init_debug_geometry_pipelines();
+
 	uint32_t				skyboxPipeline;
 	EngineResult			init_skybox_pipeline();
 	
@@ -427,6 +534,8 @@ private:
 	 |  DRAW CONTEXTS
 	 ---------------------------*/
 	DrawContext				_mainDrawContext;
+	RenderScene				_renderScene;
+	DebugGeometry			_debugGeometry;
 
 	EngineResult 			init_default_data();
 
@@ -434,12 +543,20 @@ private:
 	// for textured images
 	AllocatedImage 			errorCheckerboardImage;
 	AllocatedImage			spaceCubeMap;
-	uint32_t				errorHandle;
+	BindlessTexture			errorHandle;
+	BindlessTexture			skyboxHandle;
 
 	AllocatedImage			containerTexture;
+	BindlessTexture			containerHandle;
+	BindlessTexture			shadowMapHandle;
 
 	VkSampler 				defaultSamplerLinear;
 	VkSampler 				defaultSamplerNearest;
+	// For mipmapped textures, trilinear + anisotropic
+	VkSampler 				defaultSamplerTrilinear;
+	BindlessSampler			linearSamplerHandle;
+	BindlessSampler			nearestSamplerHandle;
+	BindlessSampler			trilinearSamplerHandle;
 
 	AllocatedBuffer			sceneUBO;
 
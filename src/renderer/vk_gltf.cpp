@@ -7,6 +7,123 @@
 #define TINYGLTF_IMPLEMENTATION
 #include <tiny_gltf.h>
 
+#include <unordered_map>
+
+// Bindless slot of a glTF texture, MATERIAL_NO_TEXTURE if it has none or it
+// can't be uploaded. tinygltf has already decoded the images, each one is
+// uploaded once per color space it is sampled in.
+static uint32_t
+load_gltf_texture(VulkanEngine* pVulkanEngine, const tinygltf::Model* pModel,
+	int textureIndex, uint32_t srgb, std::unordered_map<int, uint32_t>* pCache) {
+	if (textureIndex < 0 || textureIndex >= static_cast<int>(pModel->textures.size())) {
+		return MATERIAL_NO_TEXTURE;
+	}
+	int source = pModel->textures[textureIndex].source;
+	if (source < 0 || source >= static_cast<int>(pModel->images.size())) {
+		return MATERIAL_NO_TEXTURE;
+	}
+
+	int key = source * 2 + (srgb ? 1 : 0);
+	auto cached = pCache->find(key);
+	if (cached != pCache->end()) {
+		return cached->second;
+	}
+
+	const tinygltf::Image* image = &pModel->images[source];
+	if (image->bits != 8 || image->component < 1 || image->component > 4 ||
+		image->image.empty()) {
+		fprintf(stderr, "[gLTF Loader] Skipping image %s, only 8 bit images are supported.\n",
+			image->name.c_str());
+		(*pCache)[key] = MATERIAL_NO_TEXTURE;
+		return MATERIAL_NO_TEXTURE;
+	}
+
+	// Expanded to RGBA, grey replicated and alpha opaque when missing
+	const unsigned char* pPixels = image->image.data();
+	std::vector<unsigned char> rgba;
+	if (image->component != 4) {
+		size_t pixelCount = static_cast<size_t>(image->width) * image->height;
+		rgba.resize(pixelCount * 4);
+		for (size_t i = 0; i < pixelCount; i++) {
+			const unsigned char* src = &pPixels[i * image->component];
+			unsigned char* dst = &rgba[i * 4];
+			if (image->component <= 2) {
+				dst[0] = dst[1] = dst[2] = src[0];
+				dst[3] = image->component == 2 ? src[1] : 255;
+			} else {
+				dst[0] = src[0];
+				dst[1] = src[1];
+				dst[2] = src[2];
+				dst[3] = 255;
+			}
+		}
+		pPixels = rgba.data();
+	}
+
+	BindlessTexture texture;
+	uint32_t slot = MATERIAL_NO_TEXTURE;
+	if (pVulkanEngine->create_texture(pPixels, image->width, image->height,
+		srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM, &texture) == ENGINE_SUCCESS) {
+		slot = texture.index;
+	}
+	(*pCache)[key] = slot;
+	return slot;
+}
+
+// Material ID of every glTF material, MATERIAL_DEFAULT where one couldn't be
+// created. Materials identical to existing ones are shared.
+static void
+load_gltf_materials(VulkanEngine* pVulkanEngine, const tinygltf::Model* pModel,
+	std::vector<uint32_t>* pMaterialIDs) {
+	std::unordered_map<int, uint32_t> textures;
+
+	pMaterialIDs->resize(pModel->materials.size());
+	for (size_t i = 0; i < pModel->materials.size(); i++) {
+		const tinygltf::Material* m = &pModel->materials[i];
+		const tinygltf::PbrMetallicRoughness* pbr = &m->pbrMetallicRoughness;
+
+		GPUMaterial material = {};
+		material.baseColorFactor = glm::vec4(
+			static_cast<float>(pbr->baseColorFactor[0]), static_cast<float>(pbr->baseColorFactor[1]),
+			static_cast<float>(pbr->baseColorFactor[2]), static_cast<float>(pbr->baseColorFactor[3]));
+		material.emissiveFactor = glm::vec3(
+			static_cast<float>(m->emissiveFactor[0]), static_cast<float>(m->emissiveFactor[1]),
+			static_cast<float>(m->emissiveFactor[2]));
+		material.metallicFactor = static_cast<float>(pbr->metallicFactor);
+		material.roughnessFactor = static_cast<float>(pbr->roughnessFactor);
+		material.alphaCutoff = static_cast<float>(m->alphaCutoff);
+
+		// Colors are sRGB, the rest is data
+		material.baseColorTexture = load_gltf_texture(pVulkanEngine, pModel,
+			pbr->baseColorTexture.index, 1, &textures);
+		material.metallicRoughnessTexture = load_gltf_texture(pVulkanEngine, pModel,
+			pbr->metallicRoughnessTexture.index, 0, &textures);
+		material.normalTexture = load_gltf_texture(pVulkanEngine, pModel,
+			m->normalTexture.index, 0, &textures);
+		material.occlusionTexture = load_gltf_texture(pVulkanEngine, pModel,
+			m->occlusionTexture.index, 0, &textures);
+		material.emissiveTexture = load_gltf_texture(pVulkanEngine, pModel,
+			m->emissiveTexture.index, 1, &textures);
+
+		material.flags = 0;
+		if (m->alphaMode == "MASK") {
+			material.flags |= MATERIAL_ALPHA_MASK_BIT;
+		} else if (m->alphaMode == "BLEND") {
+			material.flags |= MATERIAL_ALPHA_BLEND_BIT;
+		}
+		if (m->doubleSided) {
+			material.flags |= MATERIAL_DOUBLE_SIDED_BIT;
+		}
+
+		if (pVulkanEngine->create_material(&material, &(*pMaterialIDs)[i]) != ENGINE_SUCCESS) {
+			(*pMaterialIDs)[i] = MATERIAL_DEFAULT;
+		}
+	}
+
+	fprintf(stderr, "[gLTF Loader] Loaded %zu material(s), %zu texture(s)\n",
+		pModel->materials.size(), textures.size());
+}
+
 void load_gltf_meshes(VulkanEngine* pVulkanEngine, const char* filename) {
 	// Only assumes one node in the gLTF file, let's enforce this
 	tinygltf::TinyGLTF context;
@@ -31,6 +148,9 @@ void load_gltf_meshes(VulkanEngine* pVulkanEngine, const char* filename) {
 		fprintf(stderr, "[gLTF Loader] Loaded gLTF file: %s\n", filename);
 	}
 
+	std::vector<uint32_t> materialIDs;
+	load_gltf_materials(pVulkanEngine, &model, &materialIDs);
+
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
 
@@ -49,6 +169,8 @@ void load_gltf_meshes(VulkanEngine* pVulkanEngine, const char* filename) {
 			Surface newSurface;
 			newSurface.startIndex = static_cast<uint32_t>(indices.size());
 			newSurface.count = static_cast<uint32_t>(model.accessors[p->indices].count);
+			newSurface.materialID = p->material >= 0 ?
+				materialIDs[p->material] : MATERIAL_DEFAULT;
 			uint32_t vertexStart = static_cast<uint32_t>(vertices.size());
 			uint32_t indexCount = 0;
 
@@ -4,8 +4,28 @@
 
 #include <stb_image.h>
 
+#include <chrono>
+#include <vector>
+
 void transition_image(VkCommandBuffer cmdBuf, VkImage image, VkImageLayout currentLayout,
 	VkImageLayout newLayout, DeviceDispatch *deviceDispatch) {
+	VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ?
+		VK_IMAGE_ASPECT_DEPTH_BIT :
+		VK_IMAGE_ASPECT_COLOR_BIT;
+	VkImageSubresourceRange subresourceRange = {};
+	subresourceRange.aspectMask = aspectMask;
+	subresourceRange.baseMipLevel = 0;
+	subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+	subresourceRange.baseArrayLayer = 0;
+	subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+
+	transition_image_range(cmdBuf, image, currentLayout, newLayout, &subresourceRange,
+		deviceDispatch);
+}
+
+void transition_image_range(VkCommandBuffer cmdBuf, VkImage image,
+	VkImageLayout currentLayout, VkImageLayout newLayout,
+	const VkImageSubresourceRange* pRange, DeviceDispatch* deviceDispatch) {
 	VkImageMemoryBarrier2 imageBarrier = {};
 	imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
 	imageBarrier.pNext = NULL;
@@ -18,17 +38,7 @@ void transition_image(VkCommandBuffer cmdBuf, VkImage image, VkImageLayout curre
 	imageBarrier.oldLayout = currentLayout;
 	imageBarrier.newLayout = newLayout;
 
-	VkImageAspectFlags aspectMask = (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ?
-		VK_IMAGE_ASPECT_DEPTH_BIT :
-		VK_IMAGE_ASPECT_COLOR_BIT;
-	VkImageSubresourceRange subresourceRange = {};
-	subresourceRange.aspectMask = aspectMask;
-	subresourceRange.baseMipLevel = 0;
-	subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
-	subresourceRange.baseArrayLayer = 0;
-	subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
-
-	imageBarrier.subresourceRange = subresourceRange;
+	imageBarrier.subresourceRange = *pRange;
 	imageBarrier.image = image;
 
 	VkDependencyInfo di = {};
@@ -41,6 +51,79 @@ void transition_image(VkCommandBuffer cmdBuf, VkImage image, VkImageLayout curre
 	deviceDispatch->vkCmdPipelineBarrier2(cmdBuf, &di);
 }
 
+// Formats the spec requires to support BLIT_SRC, BLIT_DST and linear
+// filtering with optimal tiling, so there is nothing to query per device
+uint32_t format_supports_mip_blit(VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_R8_UNORM:
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+		case VK_FORMAT_B8G8R8A8_UNORM:
+		case VK_FORMAT_B8G8R8A8_SRGB:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+void generate_mipmaps(VkCommandBuffer cmdBuf, VkImage image, VkExtent3D extent,
+	uint32_t mipLevels, uint32_t baseLayer, uint32_t layerCount,
+	DeviceDispatch* deviceDispatch) {
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.levelCount = 1;
+	range.baseArrayLayer = baseLayer;
+	range.layerCount = layerCount;
+
+	int32_t width = static_cast<int32_t>(extent.width);
+	int32_t height = static_cast<int32_t>(extent.height);
+	for (uint32_t level = 1; level < mipLevels; level++) {
+		int32_t mipWidth = width > 1 ? width / 2 : 1;
+		int32_t mipHeight = height > 1 ? height / 2 : 1;
+
+		// The level above becomes the source once its writes are done
+		range.baseMipLevel = level - 1;
+		transition_image_range(cmdBuf, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, &range, deviceDispatch);
+
+		VkImageBlit2 blitRegion{ .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2, .pNext = nullptr };
+		blitRegion.srcOffsets[1] = { width, height, 1 };
+		blitRegion.dstOffsets[1] = { mipWidth, mipHeight, 1 };
+
+		blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blitRegion.srcSubresource.baseArrayLayer = baseLayer;
+		blitRegion.srcSubresource.layerCount = layerCount;
+		blitRegion.srcSubresource.mipLevel = level - 1;
+
+		blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blitRegion.dstSubresource.baseArrayLayer = baseLayer;
+		blitRegion.dstSubresource.layerCount = layerCount;
+		blitRegion.dstSubresource.mipLevel = level;
+
+		VkBlitImageInfo2 blitInfo{ .sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2, .pNext = nullptr };
+		blitInfo.dstImage = image;
+		blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		blitInfo.srcImage = image;
+		blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		blitInfo.filter = VK_FILTER_LINEAR;
+		blitInfo.regionCount = 1;
+		blitInfo.pRegions = &blitRegion;
+
+		deviceDispatch->vkCmdBlitImage2(cmdBuf, &blitInfo);
+
+		transition_image_range(cmdBuf, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &range, deviceDispatch);
+
+		width = mipWidth;
+		height = mipHeight;
+	}
+
+	range.baseMipLevel = mipLevels - 1;
+	transition_image_range(cmdBuf, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &range, deviceDispatch);
+}
+
 void copy_image_to_image(VkCommandBuffer cmdBuf, VkImage srcImg, VkImage dstImg, 
 	VkExtent2D srcSize, VkExtent2D dstSize, DeviceDispatch* deviceDispatch) {
 	VkImageBlit2 blitRegion{ .sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2, .pNext = nullptr };
@@ -75,29 +158,16 @@ void copy_image_to_image(VkCommandBuffer cmdBuf, VkImage srcImg, VkImage dstImg,
 	deviceDispatch->vkCmdBlitImage2(cmdBuf, &blitInfo);
 }
 
-void copy_data_to_image(CopyDataToImageInfo* copyInfo) {
-	VkResult res = {};
-
-	AllocatedBuffer uploadBuffer;
-	BufferCreateInfo bufferInfo;
-	bufferInfo.allocator = copyInfo->allocator;
-	bufferInfo.pBuffer = &uploadBuffer;
-	bufferInfo.allocSize = copyInfo->data_size;
-	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
-		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-	create_buffer(&bufferInfo);
-
-	memcpy(uploadBuffer.info.pMappedData, copyInfo->pData, copyInfo->data_size);
-
-	res = copyInfo->pDeviceDispatch->vkResetFences(copyInfo->device, 1, 
-		&copyInfo->cmdFence);
+// Resets and begins the immediate command buffer of an upload
+static void begin_upload(VkDevice device, VkCommandBuffer cmdBuf, VkFence fence,
+	DeviceDispatch* deviceDispatch) {
+	VkResult res = deviceDispatch->vkResetFences(device, 1, &fence);
 	if (res != VK_SUCCESS) {
-		fprintf(stderr, "[copy_data_to_image] Failed to reset command fence.\n");
+		fprintf(stderr, "[Images] Failed to reset command fence.\n");
 	}
-	res = copyInfo->pDeviceDispatch->vkResetCommandBuffer(copyInfo->cmdBuf, 0);
+	res = deviceDispatch->vkResetCommandBuffer(cmdBuf, 0);
 	if (res != VK_SUCCESS) {
-		fprintf(stderr, "[copy_data_to_image] Failed to reset command buffer.\n");
+		fprintf(stderr, "[Images] Failed to reset command buffer.\n");
 	}
 
 	VkCommandBufferBeginInfo cmdBi = {};
@@ -106,43 +176,24 @@ void copy_data_to_image(CopyDataToImageInfo* copyInfo) {
 	cmdBi.pInheritanceInfo = NULL;
 	cmdBi.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	res = copyInfo->pDeviceDispatch->vkBeginCommandBuffer(copyInfo->cmdBuf, &cmdBi);
+	res = deviceDispatch->vkBeginCommandBuffer(cmdBuf, &cmdBi);
 	if (res != VK_SUCCESS) {
-		fprintf(stderr, "[copy_data_to_image] Failed to begin command buffer.\n");
+		fprintf(stderr, "[Images] Failed to begin command buffer.\n");
 	}
+}
 
-	transition_image(copyInfo->cmdBuf, copyInfo->dstImg, VK_IMAGE_LAYOUT_UNDEFINED,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyInfo->pDeviceDispatch);
-
-	VkBufferImageCopy copyRegion = {};
-	copyRegion.bufferOffset = 0;
-	copyRegion.bufferRowLength = 0;
-	copyRegion.bufferImageHeight = 0;
-
-	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	copyRegion.imageSubresource.mipLevel = 0;
-	copyRegion.imageSubresource.baseArrayLayer = copyInfo->arrayIndex;
-	copyRegion.imageSubresource.layerCount = 1;
-	copyRegion.imageExtent = copyInfo->extent;
-
-	copyInfo->pDeviceDispatch->vkCmdCopyBufferToImage(
-		copyInfo->cmdBuf, uploadBuffer.buffer, copyInfo->dstImg,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion
-	);
-
-	transition_image(copyInfo->cmdBuf, copyInfo->dstImg,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, copyInfo->pDeviceDispatch);
-
-	res = copyInfo->pDeviceDispatch->vkEndCommandBuffer(copyInfo->cmdBuf);
+// Ends, submits and waits for the command buffer begun by begin_upload()
+static void submit_upload(VkDevice device, VkCommandBuffer cmdBuf, VkFence fence,
+	VkQueue queue, DeviceDispatch* deviceDispatch) {
+	VkResult res = deviceDispatch->vkEndCommandBuffer(cmdBuf);
 	if (res != VK_SUCCESS) {
-		fprintf(stderr, "[copy_data_to_image] Failed to end command buffer.\n");
+		fprintf(stderr, "[Images] Failed to end command buffer.\n");
 	}
 
 	VkCommandBufferSubmitInfo cmdSi = {};
 	cmdSi.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
 	cmdSi.pNext = NULL;
-	cmdSi.commandBuffer = copyInfo->cmdBuf;
+	cmdSi.commandBuffer = cmdBuf;
 	cmdSi.deviceMask = 0;
 
 	VkSubmitInfo2 submitInfo = {};
@@ -155,17 +206,70 @@ void copy_data_to_image(CopyDataToImageInfo* copyInfo) {
 	submitInfo.commandBufferInfoCount = 1;
 	submitInfo.pCommandBufferInfos = &cmdSi;
 
-	res = copyInfo->pDeviceDispatch->vkQueueSubmit2(copyInfo->queue, 1,
-		&submitInfo, copyInfo->cmdFence);
+	res = deviceDispatch->vkQueueSubmit2(queue, 1, &submitInfo, fence);
 	if (res != VK_SUCCESS) {
-		fprintf(stderr, "[copy_data_to_image] Failed to submit command buffer.\n");
+		fprintf(stderr, "[Images] Failed to submit command buffer.\n");
 	}
 
-	res = copyInfo->pDeviceDispatch->vkWaitForFences(copyInfo->device, 1,
-		&copyInfo->cmdFence, true, 9999999999);
+	res = deviceDispatch->vkWaitForFences(device, 1, &fence, true, 9999999999);
 	if (res != VK_SUCCESS) {
-		fprintf(stderr, "[copy_data_to_image] Failed to wait for command fence.\n");
+		fprintf(stderr, "[Images] Failed to wait for command fence.\n");
 	}
+}
+
+void copy_data_to_image(CopyDataToImageInfo* copyInfo) {
+	AllocatedBuffer uploadBuffer;
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = copyInfo->allocator;
+	bufferInfo.pBuffer = &uploadBuffer;
+	bufferInfo.allocSize = copyInfo->data_size;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	create_buffer(&bufferInfo);
+
+	memcpy(uploadBuffer.info.pMappedData, copyInfo->pData, copyInfo->data_size);
+
+	begin_upload(copyInfo->device, copyInfo->cmdBuf, copyInfo->cmdFence,
+		copyInfo->pDeviceDispatch);
+
+	// Only this layer, the other faces of a cube map may already be written
+	VkImageSubresourceRange range = {};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.baseMipLevel = 0;
+	range.levelCount = copyInfo->mipLevels;
+	range.baseArrayLayer = copyInfo->arrayIndex;
+	range.layerCount = 1;
+	transition_image_range(copyInfo->cmdBuf, copyInfo->dstImg, VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &range, copyInfo->pDeviceDispatch);
+
+	VkBufferImageCopy copyRegion = {};
+	copyRegion.bufferOffset = 0;
+	copyRegion.bufferRowLength = 0;
+	copyRegion.bufferImageHeight = 0;
+
+	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copyRegion.imageSubresource.mipLevel = 0;
+	copyRegion.imageSubresource.baseArrayLayer = copyInfo->arrayIndex;
+	copyRegion.imageSubresource.layerCount = 1;
+	copyRegion.imageExtent = copyInfo->extent;
+
+	copyInfo->pDeviceDispatch->vkCmdCopyBufferToImage(
+		copyInfo->cmdBuf, uploadBuffer.buffer, copyInfo->dstImg,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion
+	);
+
+	if (copyInfo->mipLevels > 1) {
+		generate_mipmaps(copyInfo->cmdBuf, copyInfo->dstImg, copyInfo->extent,
+			copyInfo->mipLevels, copyInfo->arrayIndex, 1, copyInfo->pDeviceDispatch);
+	} else {
+		transition_image_range(copyInfo->cmdBuf, copyInfo->dstImg,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &range, copyInfo->pDeviceDispatch);
+	}
+
+	submit_upload(copyInfo->device, copyInfo->cmdBuf, copyInfo->cmdFence, copyInfo->queue,
+		copyInfo->pDeviceDispatch);
 
 	destroy_buffer(&uploadBuffer);
 }
@@ -187,11 +291,15 @@ void create_image(ImageCreateInfo* createInfo) {
 	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
 	imgInfo.usage = createInfo->usage;
 
-	if (createInfo->mipmapped) {
+	if (createInfo->mipmapped && format_supports_mip_blit(createInfo->format)) {
 		imgInfo.mipLevels = static_cast<uint32_t>(std::floor(
 			std::log2(std::max(createInfo->size.width, createInfo->size.height))
 		)) + 1;
+	} else if (createInfo->mipmapped) {
+		fprintf(stderr, "[Images] Format %d can't be blitted, creating a single mip.\n",
+			createInfo->format);
 	}
+	createInfo->pImg->mipLevels = imgInfo.mipLevels;
 
 	VmaAllocationCreateInfo allocInfo = {};
 	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -218,9 +326,9 @@ void create_image(ImageCreateInfo* createInfo) {
 	viewInfo.image = createInfo->pImg->image;
 	viewInfo.format = createInfo->format;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = imgInfo.mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
-	viewInfo.subresourceRange.layerCount = imgInfo.mipLevels;
+	viewInfo.subresourceRange.layerCount = 1;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
 
 	createInfo->pDeviceDispatch->vkCreateImageView(
@@ -240,6 +348,7 @@ void create_image_with_data(ImageCreateInfo* createInfo, void* data,
 			stride = 1;
 			break;
 		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
 			stride = 4;
 			break;
 		default:
@@ -249,20 +358,12 @@ void create_image_with_data(ImageCreateInfo* createInfo, void* data,
 	uint32_t data_size = createInfo->size.depth * createInfo->size.width 
 		* createInfo->size.height * stride;
 
-	AllocatedBuffer uploadBuffer;
-	BufferCreateInfo bufferInfo;
-	bufferInfo.allocator = createInfo->allocator;
-	bufferInfo.pBuffer = &uploadBuffer;
-	bufferInfo.allocSize = data_size;
-	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
-		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
-	create_buffer(&bufferInfo);
-
-	memcpy(uploadBuffer.info.pMappedData, data, data_size);
-
 	ImageCreateInfo imageInfo = *createInfo;
 	imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	if (createInfo->mipmapped) {
+		// Each level is blitted from the one above it
+		imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	}
 	create_image(&imageInfo);
 
 	// Record the provided command buffer the copy instructions
@@ -277,101 +378,458 @@ void create_image_with_data(ImageCreateInfo* createInfo, void* data,
 	copyInfo.pDeviceDispatch = createInfo->pDeviceDispatch;
 	copyInfo.device = createInfo->device;
 	copyInfo.queue = queue;
+	copyInfo.mipLevels = createInfo->pImg->mipLevels;
 	copy_data_to_image(&copyInfo);
+}
+
+// A layer of a create_images_from_files() batch
+struct DecodedLayer {
+	const char*		path;
+	stbi_uc*		pData;
+	int				width;
+	int				height;
+	VkDeviceSize	offset;
+	uint8_t*		pStaging;
+	// stbi_failure_reason() of the worker that decoded the layer, the
+	// reason is thread local
+	const char*		pFailureReason;
+};
+
+static void decode_layers(uint32_t begin, uint32_t end, void* pData) {
+	DecodedLayer* layers = static_cast<DecodedLayer*>(pData);
+	for (uint32_t i = begin; i < end; i++) {
+		int channels;
+		layers[i].pData = stbi_load(layers[i].path, &layers[i].width, &layers[i].height,
+			&channels, STBI_rgb_alpha);
+		if (layers[i].pData == nullptr) {
+			layers[i].pFailureReason = stbi_failure_reason();
+		}
+	}
+}
+
+static void pack_layers(uint32_t begin, uint32_t end, void* pData) {
+	DecodedLayer* layers = static_cast<DecodedLayer*>(pData);
+	for (uint32_t i = begin; i < end; i++) {
+		memcpy(layers[i].pStaging + layers[i].offset, layers[i].pData,
+			static_cast<size_t>(layers[i].width) * layers[i].height * 4);
+		stbi_image_free(layers[i].pData);
+		layers[i].pData = nullptr;
+	}
+}
+
+static uint32_t create_layered_image(ImageBatchInfo* pBatchInfo, const ImageFileDesc* pDesc,
+	VkExtent3D extent) {
+	VkImageCreateInfo imgInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	imgInfo.pNext = nullptr;
+	imgInfo.imageType = VK_IMAGE_TYPE_2D;
+	imgInfo.format = pDesc->format;
+	imgInfo.extent = extent;
+	imgInfo.mipLevels = 1;
+	imgInfo.arrayLayers = pDesc->layerCount;
+	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imgInfo.usage = pDesc->usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imgInfo.flags = pDesc->cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+	if (pDesc->mipmapped && format_supports_mip_blit(pDesc->format)) {
+		imgInfo.mipLevels = static_cast<uint32_t>(std::floor(
+			std::log2(std::max(extent.width, extent.height))
+		)) + 1;
+		// Each level is blitted from the one above it
+		imgInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	} else if (pDesc->mipmapped) {
+		fprintf(stderr, "[Images] Format %d can't be blitted, creating a single mip.\n",
+			pDesc->format);
+	}
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	AllocatedImage* pImg = pDesc->pImg;
+	if (vmaCreateImage(pBatchInfo->allocator, &imgInfo, &allocInfo, &pImg->image,
+		&pImg->allocation, nullptr) != VK_SUCCESS) {
+		fprintf(stderr, "[Images] VMA failed to create %s.\n", pDesc->paths[0]);
+		return 1;
+	}
+	pImg->imageFormat = imgInfo.format;
+	pImg->imageExtent = imgInfo.extent;
+	pImg->mipLevels = imgInfo.mipLevels;
 
+	VkImageViewCreateInfo viewInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+	viewInfo.pNext = nullptr;
+	viewInfo.viewType = pDesc->cube ? VK_IMAGE_VIEW_TYPE_CUBE :
+		(pDesc->layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D);
+	viewInfo.image = pImg->image;
+	viewInfo.format = imgInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = imgInfo.mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = pDesc->layerCount;
+
+	pBatchInfo->pDeviceDispatch->vkCreateImageView(pBatchInfo->device, &viewInfo,
+		nullptr, &pImg->imageView);
+	return 0;
+}
+
+// The path images took before batching: every layer is decoded on the
+// calling thread and uploaded with its own staging buffer and fence wait.
+// Kept to compare load times against, see ImageBatchInfo::serial.
+static uint32_t create_images_serially(ImageBatchInfo* pBatchInfo, ImageFileDesc* pDescs,
+	uint32_t descCount) {
+	auto start = std::chrono::high_resolution_clock::now();
+	float decodeMs = 0.f;
+	uint32_t layerCount = 0;
+
+	for (uint32_t i = 0; i < descCount; i++) {
+		stbi_uc* layerData[6] = {};
+		VkExtent3D extent = {};
+		uint32_t failed = 0;
+
+		auto decodeStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t l = 0; l < pDescs[i].layerCount && !failed; l++) {
+			int width, height, channels;
+			layerData[l] = stbi_load(pDescs[i].paths[l], &width, &height, &channels,
+				STBI_rgb_alpha);
+			if (layerData[l] == nullptr) {
+				fprintf(stderr, "[Images] Failed to load %s: %s\n", pDescs[i].paths[l],
+					stbi_failure_reason());
+				failed = 1;
+			} else if (l == 0) {
+				extent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1 };
+			} else if (static_cast<uint32_t>(width) != extent.width ||
+				static_cast<uint32_t>(height) != extent.height) {
+				fprintf(stderr, "[Images] %s is %dx%d, the other layers are %ux%u.\n",
+					pDescs[i].paths[l], width, height, extent.width, extent.height);
+				failed = 1;
+			}
+		}
+		decodeMs += std::chrono::duration<float, std::milli>(
+			std::chrono::high_resolution_clock::now() - decodeStart).count();
+
+		if (failed || create_layered_image(pBatchInfo, &pDescs[i], extent)) {
+			for (uint32_t l = 0; l < pDescs[i].layerCount; l++) {
+				stbi_image_free(layerData[l]);
+			}
+			for (uint32_t j = 0; j < i; j++) {
+				destroy_image(pBatchInfo->device, pBatchInfo->pDeviceDispatch,
+					pBatchInfo->allocator, pDescs[j].pImg);
+			}
+			return 1;
+		}
+
+		for (uint32_t l = 0; l < pDescs[i].layerCount; l++) {
+			CopyDataToImageInfo copyInfo;
+			copyInfo.allocator = pBatchInfo->allocator;
+			copyInfo.cmdBuf = pBatchInfo->cmd;
+			copyInfo.cmdFence = pBatchInfo->fence;
+			copyInfo.queue = pBatchInfo->queue;
+			copyInfo.pData = layerData[l];
+			copyInfo.data_size = static_cast<size_t>(extent.width) * extent.height * 4;
+			copyInfo.dstImg = pDescs[i].pImg->image;
+			copyInfo.extent = extent;
+			copyInfo.device = pBatchInfo->device;
+			copyInfo.pDeviceDispatch = pBatchInfo->pDeviceDispatch;
+			copyInfo.arrayIndex = l;
+			copyInfo.mipLevels = pDescs[i].pImg->mipLevels;
+			copy_data_to_image(&copyInfo);
+			stbi_image_free(layerData[l]);
+		}
+		layerCount += pDescs[i].layerCount;
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	fprintf(stderr, "[Images] Loaded %u image(s), %u layer(s) serially in %.2f ms "
+		"(decode %.2f ms).\n", descCount, layerCount,
+		std::chrono::duration<float, std::milli>(end - start).count(), decodeMs);
+	return 0;
+}
+
+uint32_t create_images_from_files(ImageBatchInfo* pBatchInfo, ImageFileDesc* pDescs,
+	uint32_t descCount) {
+	if (pBatchInfo->serial) {
+		return create_images_serially(pBatchInfo, pDescs, descCount);
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::vector<DecodedLayer> layers;
+	for (uint32_t i = 0; i < descCount; i++) {
+		for (uint32_t l = 0; l < pDescs[i].layerCount; l++) {
+			layers.push_back({ .path = pDescs[i].paths[l] });
+		}
+	}
+	uint32_t layerCount = static_cast<uint32_t>(layers.size());
+
+	// stb_image keeps no state between calls apart from the thread local
+	// failure reason, one file per job
+	if (pBatchInfo->pScheduler != nullptr) {
+		pBatchInfo->pScheduler->parallel_for(layerCount, 1, decode_layers, layers.data(),
+			JOB_PRIORITY_HIGH);
+	} else {
+		decode_layers(0, layerCount, layers.data());
+	}
+	auto decoded = std::chrono::high_resolution_clock::now();
+
+	uint32_t failed = 0;
+	for (uint32_t i = 0, layer = 0; i < descCount; i++) {
+		const DecodedLayer* first = &layers[layer];
+		for (uint32_t l = 0; l < pDescs[i].layerCount; l++, layer++) {
+			if (layers[layer].pData == nullptr) {
+				fprintf(stderr, "[Images] Failed to load %s: %s\n", layers[layer].path,
+					layers[layer].pFailureReason != nullptr ?
+					layers[layer].pFailureReason : "unknown reason");
+				failed = 1;
+			} else if (first->pData != nullptr && (layers[layer].width != first->width ||
+				layers[layer].height != first->height)) {
+				fprintf(stderr, "[Images] %s is %dx%d, the other layers are %dx%d.\n",
+					layers[layer].path, layers[layer].width, layers[layer].height,
+					first->width, first->height);
+				failed = 1;
+			}
+		}
+	}
+	if (failed) {
+		for (uint32_t i = 0; i < layerCount; i++) {
+			stbi_image_free(layers[i].pData);
+		}
+		return 1;
+	}
+
+	// Every layer in one staging buffer, 16 byte aligned so block formats
+	// could share it
+	VkDeviceSize stagingSize = 0;
+	for (uint32_t i = 0; i < layerCount; i++) {
+		layers[i].offset = stagingSize;
+		stagingSize += (static_cast<VkDeviceSize>(layers[i].width) * layers[i].height * 4 + 15) &
+			~VkDeviceSize(15);
+	}
+
+	AllocatedBuffer uploadBuffer;
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = pBatchInfo->allocator;
+	bufferInfo.pBuffer = &uploadBuffer;
+	bufferInfo.allocSize = stagingSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	create_buffer(&bufferInfo);
+
+	for (uint32_t i = 0; i < layerCount; i++) {
+		layers[i].pStaging = static_cast<uint8_t*>(uploadBuffer.info.pMappedData);
+	}
+	if (pBatchInfo->pScheduler != nullptr) {
+		pBatchInfo->pScheduler->parallel_for(layerCount, 1, pack_layers, layers.data(),
+			JOB_PRIORITY_HIGH);
+	} else {
+		pack_layers(0, layerCount, layers.data());
+	}
+
+	for (uint32_t i = 0, layer = 0; i < descCount; i++) {
+		VkExtent3D extent = {
+			static_cast<uint32_t>(layers[layer].width),
+			static_cast<uint32_t>(layers[layer].height), 1
+		};
+		if (create_layered_image(pBatchInfo, &pDescs[i], extent)) {
+			for (uint32_t j = 0; j < i; j++) {
+				destroy_image(pBatchInfo->device, pBatchInfo->pDeviceDispatch,
+					pBatchInfo->allocator, pDescs[j].pImg);
+			}
+			destroy_buffer(&uploadBuffer);
+			return 1;
+		}
+		layer += pDescs[i].layerCount;
+	}
+
+	DeviceDispatch* deviceDispatch = pBatchInfo->pDeviceDispatch;
+	VkCommandBuffer cmd = pBatchInfo->cmd;
+	begin_upload(pBatchInfo->device, cmd, pBatchInfo->fence, deviceDispatch);
+
+	std::vector<VkBufferImageCopy> regions;
+	for (uint32_t i = 0, layer = 0; i < descCount; i++) {
+		const AllocatedImage* pImg = pDescs[i].pImg;
+
+		VkImageSubresourceRange range = {};
+		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		range.baseMipLevel = 0;
+		range.levelCount = pImg->mipLevels;
+		range.baseArrayLayer = 0;
+		range.layerCount = pDescs[i].layerCount;
+		transition_image_range(cmd, pImg->image, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &range, deviceDispatch);
+
+		// One region per layer, they don't have to be contiguous in the buffer
+		regions.clear();
+		for (uint32_t l = 0; l < pDescs[i].layerCount; l++, layer++) {
+			VkBufferImageCopy region = {};
+			region.bufferOffset = layers[layer].offset;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = 0;
+			region.imageSubresource.baseArrayLayer = l;
+			region.imageSubresource.layerCount = 1;
+			region.imageExtent = pImg->imageExtent;
+			regions.push_back(region);
+		}
+		deviceDispatch->vkCmdCopyBufferToImage(cmd, uploadBuffer.buffer, pImg->image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()),
+			regions.data());
+
+		if (pImg->mipLevels > 1) {
+			generate_mipmaps(cmd, pImg->image, pImg->imageExtent, pImg->mipLevels, 0,
+				pDescs[i].layerCount, deviceDispatch);
+		} else {
+			transition_image_range(cmd, pImg->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &range, deviceDispatch);
+		}
+	}
+
+	submit_upload(pBatchInfo->device, cmd, pBatchInfo->fence, pBatchInfo->queue,
+		deviceDispatch);
 	destroy_buffer(&uploadBuffer);
+
+	auto end = std::chrono::high_resolution_clock::now();
+	fprintf(stderr, "[Images] Loaded %u image(s), %u layer(s) in %.2f ms "
+		"(decode %.2f ms, %.1f MB staged).\n", descCount, layerCount,
+		std::chrono::duration<float, std::milli>(end - start).count(),
+		std::chrono::duration<float, std::milli>(decoded - start).count(),
+		stagingSize / (1024.f * 1024.f));
+	return 0;
 }
 
-void create_image_cube_map(ImageCreateInfo* createInfo, const char* texturePrefix,
+VkFormat texture_file_vk_format(TextureFileFormat format, uint32_t srgb) {
+	switch (format) {
+		case TEXTURE_FORMAT_RGBA8:
+			return srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+		case TEXTURE_FORMAT_BC1:
+			return srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+		case TEXTURE_FORMAT_BC3:
+			return srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK;
+		case TEXTURE_FORMAT_BC4:
+			return VK_FORMAT_BC4_UNORM_BLOCK;
+		case TEXTURE_FORMAT_BC5:
+			return VK_FORMAT_BC5_UNORM_BLOCK;
+		case TEXTURE_FORMAT_BC7:
+			return srgb ? VK_FORMAT_BC7_SRGB_BLOCK : VK_FORMAT_BC7_UNORM_BLOCK;
+		default:
+			return VK_FORMAT_UNDEFINED;
+	}
+}
+
+uint32_t create_image_from_file(ImageCreateInfo* createInfo, const char* path,
 	VkCommandBuffer cmd, VkFence fence, VkQueue queue) {
-	const char* files[] = {
-		"right.png",
-		"left.png",
-		"top.png",
-		"bottom.png",
-		"front.png",
-		"back.png"
-	};
-
-	stbi_uc* faceData[6];
-	VkExtent3D faceExtents[6];
-
-	int width, height, channels;
-	for (size_t i = 0; i < 6; i++) {
-		char full_path[256];
-		strcpy(full_path, texturePrefix);
-		strcat(full_path, files[i]);
-		fprintf(stderr, "[Cubemap] Loading %s\n", full_path);
-		stbi_uc* data = stbi_load(full_path, &width, &height, &channels,
-			STBI_rgb_alpha);
-		if (!data) {
-			fprintf(stderr, "Failed to load cubemap image.");
-		}
-		faceData[i] = data;
-		faceExtents[i] = VkExtent3D{
-			.width = static_cast<uint32_t>(width),
-			.height = static_cast<uint32_t>(height),
-			.depth = 1
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr) {
+		return 1;
+	}
+	TextureFileHeader header;
+	if (texture_file_read_header(file, &header)) {
+		fprintf(stderr, "[Images] %s is not a texture file this version can read.\n", path);
+		fclose(file);
+		return 1;
+	}
+
+	// Block copies want offsets that are a multiple of the block size
+	VkBufferImageCopy regions[TEXTURE_FILE_MAX_LEVELS] = {};
+	VkDeviceSize stagingSize = 0;
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		regions[i].bufferOffset = stagingSize;
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.baseArrayLayer = 0;
+		regions[i].imageSubresource.layerCount = header.layerCount;
+		regions[i].imageExtent = {
+			std::max(header.width >> i, 1u), std::max(header.height >> i, 1u), 1
 		};
+		stagingSize += (header.levels[i].size + 15) & ~VkDeviceSize(15);
+	}
+
+	AllocatedBuffer uploadBuffer;
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = createInfo->allocator;
+	bufferInfo.pBuffer = &uploadBuffer;
+	bufferInfo.allocSize = stagingSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	create_buffer(&bufferInfo);
+
+	uint8_t* staging = static_cast<uint8_t*>(uploadBuffer.info.pMappedData);
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < header.levelCount && !failed; i++) {
+		size_t size = static_cast<size_t>(header.levels[i].size);
+		failed = fseek(file, static_cast<long>(header.levels[i].offset), SEEK_SET) != 0 ||
+			fread(staging + regions[i].bufferOffset, 1, size, file) != size;
+	}
+	fclose(file);
+	if (failed) {
+		fprintf(stderr, "[Images] %s is truncated.\n", path);
+		destroy_buffer(&uploadBuffer);
+		return 1;
 	}
 
+	VkFormat format = texture_file_vk_format(header.format, header.flags & TEXTURE_FILE_SRGB);
+	uint32_t cube = (header.flags & TEXTURE_FILE_CUBE) && header.layerCount == 6;
+
 	VkImageCreateInfo imgInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
 	imgInfo.pNext = nullptr;
 	imgInfo.imageType = VK_IMAGE_TYPE_2D;
-	imgInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
-	// assuming all faces have the same extent which should be the case
-	// for a cube map
-	imgInfo.extent = faceExtents[0];
-	imgInfo.mipLevels = 1;
-	imgInfo.arrayLayers = 6;
+	imgInfo.format = format;
+	imgInfo.extent = { header.width, header.height, 1 };
+	imgInfo.mipLevels = header.levelCount;
+	imgInfo.arrayLayers = header.layerCount;
 	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
 	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-	imgInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-		VK_IMAGE_USAGE_SAMPLED_BIT;
-	imgInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+	imgInfo.usage = createInfo->usage | VK_IMAGE_USAGE_SAMPLED_BIT |
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	imgInfo.flags = cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+
+	createInfo->pImg->imageFormat = format;
+	createInfo->pImg->imageExtent = imgInfo.extent;
+	createInfo->pImg->mipLevels = header.levelCount;
 
 	VmaAllocationCreateInfo allocInfo = {};
 	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
 	allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	// allocate and create the image
-	vmaCreateImage(createInfo->allocator, &imgInfo, &allocInfo,
-		&createInfo->pImg->image, &createInfo->pImg->allocation, nullptr);
+	if (vmaCreateImage(createInfo->allocator, &imgInfo, &allocInfo,
+		&createInfo->pImg->image, &createInfo->pImg->allocation, nullptr) != VK_SUCCESS) {
+		fprintf(stderr, "[Images] VMA failed to create image for %s.\n", path);
+		destroy_buffer(&uploadBuffer);
+		return 1;
+	}
 
-	// build an image-view for the image
 	VkImageViewCreateInfo viewInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
 	viewInfo.pNext = nullptr;
-	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+	viewInfo.viewType = cube ? VK_IMAGE_VIEW_TYPE_CUBE :
+		(header.layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D);
 	viewInfo.image = createInfo->pImg->image;
-	viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+	viewInfo.format = format;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = header.levelCount;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
-	viewInfo.subresourceRange.layerCount = 6;
+	viewInfo.subresourceRange.layerCount = header.layerCount;
 	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-	createInfo->pDeviceDispatch->vkCreateImageView(createInfo->device, &viewInfo, 
+	createInfo->pDeviceDispatch->vkCreateImageView(createInfo->device, &viewInfo,
 		nullptr, &createInfo->pImg->imageView);
 
-	for (size_t i = 0; i < 6; i++) {
-		size_t faceSize = faceExtents[i].width * faceExtents[i].height * 4;
-
-		CopyDataToImageInfo copyInfo;
-		copyInfo.device = createInfo->device;
-		copyInfo.allocator = createInfo->allocator;
-		copyInfo.cmdBuf = cmd;
-		copyInfo.cmdFence = fence;
-		copyInfo.queue = queue;
-		copyInfo.pData = faceData[i];
-		copyInfo.data_size = faceSize;
-		copyInfo.dstImg = createInfo->pImg->image;
-		copyInfo.extent = faceExtents[i];
-		copyInfo.pDeviceDispatch = createInfo->pDeviceDispatch;
-		copyInfo.arrayIndex = i;
-		copy_data_to_image(&copyInfo);
-
-		stbi_image_free(faceData[i]);
-	}
+	begin_upload(createInfo->device, cmd, fence, createInfo->pDeviceDispatch);
+
+	transition_image(cmd, createInfo->pImg->image, VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, createInfo->pDeviceDispatch);
+	createInfo->pDeviceDispatch->vkCmdCopyBufferToImage(cmd, uploadBuffer.buffer,
+		createInfo->pImg->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, header.levelCount,
+		regions);
+	transition_image(cmd, createInfo->pImg->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, createInfo->pDeviceDispatch);
+
+	submit_upload(createInfo->device, cmd, fence, queue, createInfo->pDeviceDispatch);
+
+	destroy_buffer(&uploadBuffer);
+
+	fprintf(stderr, "[Images] Loaded %s (%ux%u, %u layers, %u levels, %.1f KB)\n", path,
+		header.width, header.height, header.layerCount, header.levelCount,
+		stagingSize / 1024.0);
+	return 0;
 }
 
 void destroy_image(VkDevice device, DeviceDispatch* deviceDispatch,
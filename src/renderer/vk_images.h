@@ -5,10 +5,24 @@
 
 #include "vk_dispatch.h"
 #include "vk_types.h"
+#include "../core/job_system.h"
+#include "../core/texture_file.h"
 
 void transition_image(VkCommandBuffer cmdBuf, VkImage image, VkImageLayout currentLayout,
 	VkImageLayout newLayout, DeviceDispatch *deviceDispatch);
 
+// transition_image() for part of the image (some mips / array layers)
+void transition_image_range(VkCommandBuffer cmdBuf, VkImage image,
+	VkImageLayout currentLayout, VkImageLayout newLayout,
+	const VkImageSubresourceRange* pRange, DeviceDispatch* deviceDispatch);
+
+// Fills mips 1..mipLevels-1 of the given layers by blitting each level down
+// from the previous one. Expects every level in TRANSFER_DST_OPTIMAL with
+// level 0 written, leaves them all in SHADER_READ_ONLY_OPTIMAL.
+void generate_mipmaps(VkCommandBuffer cmdBuf, VkImage image, VkExtent3D extent,
+	uint32_t mipLevels, uint32_t baseLayer, uint32_t layerCount,
+	DeviceDispatch* deviceDispatch);
+
 void copy_image_to_image(VkCommandBuffer cmdBuf, VkImage srcImg, VkImage dstImg, VkExtent2D srcSize, 
 	VkExtent2D dstSize, DeviceDispatch *deviceDispatch);
 
@@ -28,6 +42,8 @@ struct CopyDataToImageInfo {
 	DeviceDispatch* pDeviceDispatch;
 
 	uint32_t		arrayIndex = 0;
+	// Mips below level 0 are generated from the uploaded data
+	uint32_t		mipLevels = 1;
 };
 
 void copy_data_to_image(CopyDataToImageInfo* copyInfo);
@@ -41,17 +57,64 @@ struct ImageCreateInfo {
 	VkExtent3D			size;
 	VkFormat			format;
 	VkImageUsageFlags	usage;
+	// Full mip chain, generated on upload by create_image_with_data().
+	// Needs a format blits can filter, see
+	// format_supports_mip_blit().
 	uint8_t				mipmapped = 0;
 };
 
+uint32_t format_supports_mip_blit(VkFormat format);
+
 void create_image(ImageCreateInfo* createInfo);
 
 void create_image_with_data(ImageCreateInfo* createInfo, void* data,
 	VkCommandBuffer cmd, VkFence fence, VkQueue queue);
 
-void create_image_cube_map(ImageCreateInfo* createInfo, 
-	const char* texturePrefix, VkCommandBuffer cmd, VkFence fence,
-	VkQueue queue);
+// One image of a create_images_from_files() batch, every path is a layer
+struct ImageFileDesc {
+	AllocatedImage*		pImg;
+	const char*			paths[6];
+	uint32_t			layerCount = 1;
+	// Needs 6 layers
+	uint8_t				cube = 0;
+	VkFormat			format = VK_FORMAT_R8G8B8A8_UNORM;
+	VkImageUsageFlags	usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+	uint8_t				mipmapped = 0;
+};
+
+struct ImageBatchInfo {
+	VmaAllocator		allocator;
+	VkDevice			device;
+	DeviceDispatch*		pDeviceDispatch;
+	// May be nullptr, the files are then decoded on the calling thread
+	JobScheduler*		pScheduler;
+
+	VkCommandBuffer		cmd;
+	VkFence				fence;
+	VkQueue				queue;
+
+	// Decode on the calling thread and upload every layer with its own
+	// staging buffer and fence wait, the way images were loaded before
+	// batching. Only there to compare load times against.
+	uint8_t				serial = 0;
+};
+
+// Decodes every layer of every image in parallel, packs them into one
+// staging buffer and uploads them all in a single submit, one copy per
+// image. Files are decoded to RGBA8. Returns 0 on success, nothing is
+// created if any file fails to load or the layers of an image differ in size.
+uint32_t create_images_from_files(ImageBatchInfo* pBatchInfo, ImageFileDesc* pDescs,
+	uint32_t descCount);
+
+// The VkFormat levels of a .vtex file are uploaded as
+VkFormat texture_file_vk_format(TextureFileFormat format, uint32_t srgb);
+
+// Loads a .vtex file written by texture_cooker. Every level is read
+// straight into one staging buffer and copied in a single command, nothing
+// is decoded or generated. size, format and mipmapped of createInfo are
+// ignored, they come from the file. Returns 0 on success.
+uint32_t create_image_from_file(ImageCreateInfo* createInfo, const char* path,
+	VkCommandBuffer cmd, VkFence fence, VkQueue queue);
 
 void destroy_image(VkDevice device, DeviceDispatch* deviceDisptach,
 	VmaAllocator allocator, const AllocatedImage* img);
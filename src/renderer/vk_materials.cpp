@@ -0,0 +1,163 @@
+#include "vk_materials.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// FNV-1a, GPUMaterial has no padding so equal materials hash the same
+static uint64_t
+hash_material(const GPUMaterial* pMaterial) {
+	const uint8_t* pBytes = reinterpret_cast<const uint8_t*>(pMaterial);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < sizeof(GPUMaterial); i++) {
+		hash = (hash ^ pBytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+uint32_t
+MaterialRegistry::init(VkDevice device, VmaAllocator allocator,
+	DeviceDispatch* pDeviceDispatch, uint32_t initialCapacity) {
+	_device = device;
+	_allocator = allocator;
+	_pDeviceDispatch = pDeviceDispatch;
+
+	if (create_material_buffer(initialCapacity, &_buffer, &_address) != 0) {
+		return 1;
+	}
+	_capacity = initialCapacity;
+	_materials.reserve(initialCapacity);
+
+	// White, fully rough dielectric
+	GPUMaterial defaultMaterial = {};
+	defaultMaterial.baseColorFactor = glm::vec4(1.f);
+	defaultMaterial.emissiveFactor = glm::vec3(0.f);
+	defaultMaterial.metallicFactor = 0.f;
+	defaultMaterial.roughnessFactor = 1.f;
+	defaultMaterial.alphaCutoff = 0.5f;
+	defaultMaterial.baseColorTexture = MATERIAL_NO_TEXTURE;
+	defaultMaterial.metallicRoughnessTexture = MATERIAL_NO_TEXTURE;
+	defaultMaterial.normalTexture = MATERIAL_NO_TEXTURE;
+	defaultMaterial.occlusionTexture = MATERIAL_NO_TEXTURE;
+	defaultMaterial.emissiveTexture = MATERIAL_NO_TEXTURE;
+	defaultMaterial.flags = 0;
+	add(&defaultMaterial);
+
+	return 0;
+}
+
+void
+MaterialRegistry::destroy() {
+	for (size_t i = 0; i < _retired.size(); i++) {
+		destroy_buffer(&_retired[i].buffer);
+	}
+	_retired.clear();
+	if (_buffer.buffer != VK_NULL_HANDLE) {
+		destroy_buffer(&_buffer);
+	}
+	_buffer = {};
+	_address = 0;
+	_capacity = 0;
+	_materials.clear();
+	_lookup.clear();
+}
+
+uint32_t
+MaterialRegistry::create_material_buffer(uint32_t capacity, AllocatedBuffer* pBuffer,
+	VkDeviceAddress* pAddress) {
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = _allocator;
+	bufferInfo.pBuffer = pBuffer;
+	bufferInfo.allocSize = capacity * sizeof(GPUMaterial);
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	bufferInfo.memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	create_buffer(&bufferInfo);
+	if (pBuffer->info.pMappedData == nullptr) {
+		fprintf(stderr, "[Materials] Failed to create a buffer for %u materials.\n", capacity);
+		return 1;
+	}
+
+	VkBufferDeviceAddressInfo addrInfo = {};
+	addrInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	addrInfo.pNext = nullptr;
+	addrInfo.buffer = pBuffer->buffer;
+	*pAddress = _pDeviceDispatch->vkGetBufferDeviceAddress(_device, &addrInfo);
+	return 0;
+}
+
+uint32_t
+MaterialRegistry::grow(uint32_t minCapacity) {
+	uint32_t capacity = _capacity > 0 ? _capacity * 2 : MATERIAL_INITIAL_CAPACITY;
+	while (capacity < minCapacity) {
+		capacity *= 2;
+	}
+
+	AllocatedBuffer buffer = {};
+	VkDeviceAddress address = 0;
+	if (create_material_buffer(capacity, &buffer, &address) != 0) {
+		return 1;
+	}
+	memcpy(buffer.info.pMappedData, _materials.data(),
+		_materials.size() * sizeof(GPUMaterial));
+
+	// Frames recorded up to now read the old one
+	_retired.push_back({ _buffer, _frame });
+	_buffer = buffer;
+	_address = address;
+	_capacity = capacity;
+	_stats.growCount++;
+	return 0;
+}
+
+uint32_t
+MaterialRegistry::add(const GPUMaterial* pMaterial) {
+	uint64_t hash = hash_material(pMaterial);
+	auto range = _lookup.equal_range(hash);
+	for (auto it = range.first; it != range.second; it++) {
+		if (!memcmp(&_materials[it->second], pMaterial, sizeof(GPUMaterial))) {
+			_stats.dedupHits++;
+			return it->second;
+		}
+	}
+
+	uint32_t material = static_cast<uint32_t>(_materials.size());
+	if (material >= _capacity && grow(material + 1) != 0) {
+		return MATERIAL_INVALID;
+	}
+	memcpy(static_cast<GPUMaterial*>(_buffer.info.pMappedData) + material, pMaterial,
+		sizeof(GPUMaterial));
+	_materials.push_back(*pMaterial);
+	_lookup.emplace(hash, material);
+
+	_stats.materialCount = static_cast<uint32_t>(_materials.size());
+	_stats.capacity = _capacity;
+	return material;
+}
+
+MaterialPass
+MaterialRegistry::get_pass(uint32_t material) const {
+	uint32_t flags = _materials[material].flags;
+	if (flags & MATERIAL_ALPHA_BLEND_BIT) {
+		return MATERIAL_PASS_TRANSPARENT;
+	}
+	return (flags & MATERIAL_ALPHA_MASK_BIT) ? MATERIAL_PASS_MASKED : MATERIAL_PASS_OPAQUE;
+}
+
+void
+MaterialRegistry::next_frame() {
+	_frame++;
+
+	// A buffer retired while recording frame N is read by N at most, whose
+	// fence has been waited on once N + FRAME_OVERLAP is being recorded
+	size_t kept = 0;
+	for (size_t i = 0; i < _retired.size(); i++) {
+		if (_retired[i].frame + TRANSIENT_FRAME_COUNT > _frame) {
+			_retired[kept++] = _retired[i];
+			continue;
+		}
+		destroy_buffer(&_retired[i].buffer);
+	}
+	_retired.resize(kept);
+}
@@ -0,0 +1,95 @@
+#ifndef VK_MATERIALS_H
+#define VK_MATERIALS_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_buffers.h"
+
+#define MATERIAL_INITIAL_CAPACITY	64
+// Created by init(), what surfaces without a material use
+#define MATERIAL_DEFAULT			0
+#define MATERIAL_INVALID			0xffffffffu
+
+// Pipelines materials are drawn with, in the order they are drawn
+enum MaterialPass : uint32_t {
+	MATERIAL_PASS_OPAQUE = 0,
+	// Opaque but alpha tested, the depth prepass can't discard so these
+	// are left out of it
+	MATERIAL_PASS_MASKED = 1,
+	MATERIAL_PASS_TRANSPARENT = 2,
+	MATERIAL_PASS_COUNT = 3
+};
+
+struct MaterialRegistryStats {
+	uint32_t				materialCount;
+	uint32_t				capacity;
+	// add() calls that returned an existing material
+	uint32_t				dedupHits;
+	uint32_t				growCount;
+};
+
+/*
+* Owns every GPUMaterial, the shaders index them by material ID through the
+* buffer at get_address(). Materials are immutable and live until destroy(),
+* add() hands back the ID of an identical material when there is one, so
+* glTF files sharing materials don't grow the buffer.
+*
+* The buffer is host visible and written in place, a new material lands in
+* a slot no submitted frame reads. When it is full it is reallocated at twice
+* the size and the old one is freed once the frames that may read it are
+* done, so get_address() has to be read again every frame.
+*/
+class MaterialRegistry {
+public:
+	// Returns 0 on success
+	uint32_t				init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch, uint32_t initialCapacity);
+	void					destroy();
+
+	// MATERIAL_INVALID when the buffer can't grow
+	uint32_t				add(const GPUMaterial* pMaterial);
+
+	const GPUMaterial*		get(uint32_t material) const { return &_materials[material]; }
+	MaterialPass			get_pass(uint32_t material) const;
+	// Back faces are culled unless the material is double sided
+	VkCullModeFlags			get_cull_mode(uint32_t material) const {
+		return (_materials[material].flags & MATERIAL_DOUBLE_SIDED_BIT) ?
+			VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+	}
+	uint32_t				get_count() const { return static_cast<uint32_t>(_materials.size()); }
+	VkDeviceAddress			get_address() const { return _address; }
+	const MaterialRegistryStats& get_stats() const { return _stats; }
+
+	// Call once per submitted frame
+	void					next_frame();
+
+private:
+	struct Retired {
+		AllocatedBuffer		buffer;
+		uint64_t			frame;
+	};
+
+	uint32_t				create_material_buffer(uint32_t capacity, AllocatedBuffer* pBuffer,
+								VkDeviceAddress* pAddress);
+	uint32_t				grow(uint32_t minCapacity);
+
+	VkDevice				_device;
+	VmaAllocator			_allocator;
+	DeviceDispatch*			_pDeviceDispatch;
+
+	std::vector<GPUMaterial> _materials;
+	// Content hash -> material, collisions are told apart with memcmp
+	std::unordered_multimap<uint64_t, uint32_t> _lookup;
+
+	AllocatedBuffer			_buffer = {};
+	VkDeviceAddress			_address = 0;
+	uint32_t				_capacity = 0;
+	std::vector<Retired>	_retired;
+
+	uint64_t				_frame = 0;
+	MaterialRegistryStats	_stats = {};
+};
+
+#endif /* VK_MATERIALS_H */
@@ -12,6 +12,7 @@ void PipelineBuilder::clear() {
 	pipelineLayout = {};
 	depthStencil = { .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO };
 	renderInfo = { .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO };
+	flags = 0;
 }
 
 VkPipeline PipelineBuilder::build_pipeline(VkDevice device, DeviceDispatch* deviceDispatch) {
@@ -51,6 +52,7 @@ VkPipeline PipelineBuilder::build_pipeline(VkDevice device, DeviceDispatch* devi
 	VkGraphicsPipelineCreateInfo pipelineInfo = { .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO };
 	// connect the renderInfo the the pNext extension mechanism
 	pipelineInfo.pNext = &renderInfo;
+	pipelineInfo.flags = flags;
 
 	pipelineInfo.stageCount = 2;
 	pipelineInfo.pStages = shaderStages;
@@ -81,6 +83,10 @@ void PipelineBuilder::set_layout(VkPipelineLayout layout) {
 	pipelineLayout = layout;
 }
 
+void PipelineBuilder::set_create_flags(VkPipelineCreateFlags createFlags) {
+	flags = createFlags;
+}
+
 void PipelineBuilder::set_vtx_shader(VkShaderModule shader) {
 	VkPipelineShaderStageCreateInfo shaderInfo{};
 	shaderInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -31,6 +31,7 @@ public:
 	VkPipelineDepthStencilStateCreateInfo	depthStencil;
 	VkPipelineRenderingCreateInfo			renderInfo;
 	VkFormat								colorAttachmentFormat;
+	VkPipelineCreateFlags					flags;
 
 	VkDynamicState							dynamicStates[16] = {
 		VK_DYNAMIC_STATE_VIEWPORT,
@@ -44,6 +45,7 @@ public:
 
 	VkPipeline build_pipeline(VkDevice device, DeviceDispatch* deviceDispatch);
 	void set_layout(VkPipelineLayout layout);
+	void set_create_flags(VkPipelineCreateFlags createFlags);
 	void set_vtx_shader(VkShaderModule shader);
 	void set_frag_shader(VkShaderModule shader);
 	void set_input_topology(VkPrimitiveTopology topology);
@@ -0,0 +1,131 @@
+#include "vk_ring.h"
+
+#include <stdio.h>
+
+void
+TransientRing::init(VkDevice device, VmaAllocator allocator,
+	DeviceDispatch* pDeviceDispatch, size_t blockSize, VkBufferUsageFlags usage) {
+	_device = device;
+	_allocator = allocator;
+	_pDeviceDispatch = pDeviceDispatch;
+	_usage = usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+	for (uint32_t i = 0; i < TRANSIENT_FRAME_COUNT; i++) {
+		add_block(i, blockSize);
+	}
+	_slot = 0;
+}
+
+void
+TransientRing::destroy() {
+	for (uint32_t i = 0; i < TRANSIENT_FRAME_COUNT; i++) {
+		for (size_t b = 0; b < _slots[i].size(); b++) {
+			destroy_block(&_slots[i][b]);
+		}
+		_slots[i].clear();
+	}
+}
+
+uint32_t
+TransientRing::add_block(uint32_t slot, size_t size) {
+	Block block = {};
+	block.size = size;
+
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = _allocator;
+	bufferInfo.pBuffer = &block.buffer;
+	bufferInfo.allocSize = size;
+	bufferInfo.usage = _usage;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	// Picks device local + host visible memory (resizable BAR) when there is
+	// any, plain host memory otherwise
+	bufferInfo.memoryUsage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	create_buffer(&bufferInfo);
+	if (block.buffer.info.pMappedData == nullptr) {
+		fprintf(stderr, "[TransientRing] Failed to create a %zu byte block.\n", size);
+		return 0;
+	}
+
+	VkBufferDeviceAddressInfo addrInfo = {};
+	addrInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	addrInfo.pNext = nullptr;
+	addrInfo.buffer = block.buffer.buffer;
+	block.addr = _pDeviceDispatch->vkGetBufferDeviceAddress(_device, &addrInfo);
+
+	_slots[slot].push_back(block);
+	_blockAllocations++;
+	return 1;
+}
+
+void
+TransientRing::destroy_block(Block* block) {
+	destroy_buffer(&block->buffer);
+}
+
+void*
+TransientRing::alloc(size_t size, size_t alignment, TransientAllocation* pAllocation) {
+	std::vector<Block>& blocks = _slots[_slot];
+	size_t offset = 0;
+	if (!blocks.empty()) {
+		offset = (blocks.back().used + alignment - 1) & ~(alignment - 1);
+	}
+	if (blocks.empty() || offset + size > blocks.back().size) {
+		size_t blockSize = blocks.empty() ? size : blocks.back().size * 2;
+		if (!add_block(_slot, blockSize > size ? blockSize : size)) {
+			return nullptr;
+		}
+		offset = 0;
+	}
+	Block* block = &blocks.back();
+	block->used = offset + size;
+	if (pAllocation != nullptr) {
+		pAllocation->buffer = block->buffer.buffer;
+		pAllocation->offset = offset;
+		pAllocation->addr = block->addr + offset;
+	}
+	return (uint8_t*)block->buffer.info.pMappedData + offset;
+}
+
+void
+TransientRing::next_frame() {
+	size_t used = 0;
+	for (size_t b = 0; b < _slots[_slot].size(); b++) {
+		used += _slots[_slot][b].used;
+	}
+	if (used > _highWater) {
+		_highWater = used;
+	}
+
+	_slot = (_slot + 1) % TRANSIENT_FRAME_COUNT;
+
+	// The GPU is done with this slot (see TRANSIENT_FRAME_COUNT), so a
+	// chain left over from a big frame can be merged now
+	std::vector<Block>& blocks = _slots[_slot];
+	if (blocks.size() > 1) {
+		size_t size = 0;
+		for (size_t b = 0; b < blocks.size(); b++) {
+			size += blocks[b].size;
+			destroy_block(&blocks[b]);
+		}
+		blocks.clear();
+		add_block(_slot, size);
+	}
+	for (size_t b = 0; b < blocks.size(); b++) {
+		blocks[b].used = 0;
+	}
+}
+
+TransientRingStats
+TransientRing::get_stats() const {
+	TransientRingStats stats = {};
+	const std::vector<Block>& blocks = _slots[_slot];
+	for (size_t b = 0; b < blocks.size(); b++) {
+		stats.capacity += blocks[b].size;
+		stats.used += blocks[b].used;
+	}
+	stats.highWater = _highWater;
+	stats.blockCount = static_cast<uint32_t>(blocks.size());
+	stats.blockAllocations = _blockAllocations;
+	return stats;
+}
@@ -0,0 +1,85 @@
+#ifndef VK_RING_H
+#define VK_RING_H
+
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_buffers.h"
+
+struct TransientRingStats {
+	size_t					capacity;
+	size_t					used;
+	size_t					highWater;
+	uint32_t				blockCount;
+	// Blocks created since init, stays flat after warm-up
+	uint32_t				blockAllocations;
+};
+
+// Where an allocation ended up, for data that is bound by buffer + offset
+// (index buffers) rather than by device address
+struct TransientAllocation {
+	VkBuffer				buffer;
+	VkDeviceSize			offset;
+	VkDeviceAddress			addr;
+};
+
+/*
+* Persistently mapped, host visible buffers the CPU writes per-frame vertex
+* data into directly (device local when the device exposes resizable BAR).
+* There is one set of blocks per TRANSIENT_FRAME_COUNT slot.
+*
+* When a frame's data doesn't fit, another block twice the size is chained
+* on, and the next time the slot comes around the chain is replaced by one
+* block big enough for all of it. Draws go per block, see get_block_*().
+*/
+class TransientRing {
+public:
+	void					init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch, size_t blockSize,
+								VkBufferUsageFlags usage);
+	void					destroy();
+
+	// 'size' bytes, contiguous in one block and aligned to 'alignment'.
+	// pAllocation is optional.
+	void*					alloc(size_t size, size_t alignment,
+								TransientAllocation* pAllocation = nullptr);
+
+	// Moves on to the next slot, must be called once per submitted frame
+	void					next_frame();
+
+	uint32_t				get_block_count() const {
+		return static_cast<uint32_t>(_slots[_slot].size());
+	}
+	VkDeviceAddress			get_block_addr(uint32_t block) const {
+		return _slots[_slot][block].addr;
+	}
+	size_t					get_block_used(uint32_t block) const {
+		return _slots[_slot][block].used;
+	}
+
+	TransientRingStats		get_stats() const;
+
+private:
+	struct Block {
+		AllocatedBuffer		buffer;
+		VkDeviceAddress		addr;
+		size_t				size;
+		size_t				used;
+	};
+
+	uint32_t				add_block(uint32_t slot, size_t size);
+	void					destroy_block(Block* block);
+
+	VkDevice				_device;
+	VmaAllocator			_allocator;
+	DeviceDispatch*			_pDeviceDispatch;
+	VkBufferUsageFlags		_usage;
+
+	std::vector<Block>		_slots[TRANSIENT_FRAME_COUNT];
+	uint32_t				_slot = 0;
+
+	size_t					_highWater = 0;
+	uint32_t				_blockAllocations = 0;
+};
+
+#endif /* VK_RING_H */
@@ -0,0 +1,271 @@
+#include "vk_scene.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ALL_FRAMES_MASK		((1 << FRAME_OVERLAP) - 1)
+
+static glm::mat4
+transform_to_matrix(const Transform* transform) {
+	glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), transform->position);
+	modelMatrix *= glm::mat4_cast(transform->rotation);
+	modelMatrix = glm::scale(modelMatrix, transform->scale);
+	return modelMatrix;
+}
+
+void
+RenderScene::init(VkDevice device, VmaAllocator allocator,
+	DeviceDispatch* pDeviceDispatch, const MaterialRegistry* pMaterials) {
+	_pMaterials = pMaterials;
+	_drawCommands.resize(MAX_RENDER_DRAWS);
+	_drawBuckets.resize(MAX_RENDER_DRAWS);
+	_groupedCommands.resize(MAX_RENDER_DRAWS);
+	_drawData.resize(MAX_RENDER_DRAWS);
+	for (size_t i = 0; i < FRAME_OVERLAP; i++) {
+		_dirtyObjects[i].reserve(MAX_RENDER_OBJECTS);
+	}
+
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = allocator;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+
+	VkBufferDeviceAddressInfo addrInfo = {};
+	addrInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	addrInfo.pNext = nullptr;
+
+	for (size_t i = 0; i < FRAME_OVERLAP; i++) {
+		bufferInfo.pBuffer = &_indirectBuffers[i];
+		bufferInfo.allocSize = MAX_RENDER_DRAWS * sizeof(VkDrawIndexedIndirectCommand);
+		bufferInfo.usage = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+		create_buffer(&bufferInfo);
+
+		bufferInfo.pBuffer = &_drawDataBuffers[i];
+		bufferInfo.allocSize = MAX_RENDER_DRAWS * sizeof(GPUDrawData);
+		bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+		create_buffer(&bufferInfo);
+
+		addrInfo.buffer = _drawDataBuffers[i].buffer;
+		_drawDataAddrs[i] = pDeviceDispatch->vkGetBufferDeviceAddress(device, &addrInfo);
+	}
+}
+
+void
+RenderScene::destroy() {
+	for (size_t i = 0; i < FRAME_OVERLAP; i++) {
+		destroy_buffer(&_indirectBuffers[i]);
+		destroy_buffer(&_drawDataBuffers[i]);
+	}
+}
+
+RenderObjectHandle
+RenderScene::create_object(const Mesh* mesh, VkDeviceAddress vertexBuffer,
+	VkDeviceAddress positionBuffer, VkDeviceSize indexOffset, const Transform* transform) {
+	uint32_t surfaceCount = static_cast<uint32_t>(mesh->surfaces.size());
+	if (_drawCount + surfaceCount > MAX_RENDER_DRAWS) {
+		fprintf(stderr, "[RenderScene] Failed to create object: max draws reached.\n");
+		return INVALID_RENDER_OBJECT;
+	}
+
+	RenderObjectHandle handle;
+	if (_freeCount > 0) {
+		handle = _freeList[--_freeCount];
+	} else if (_objectCount < MAX_RENDER_OBJECTS) {
+		handle = _objectCount++;
+	} else {
+		fprintf(stderr, "[RenderScene] Failed to create object: max objects reached.\n");
+		return INVALID_RENDER_OBJECT;
+	}
+
+	RenderObject* object = &_objects[handle];
+	object->model = transform_to_matrix(transform);
+	object->vertexBuffer = vertexBuffer;
+	object->positionBuffer = positionBuffer;
+	object->indexOffset = indexOffset;
+	object->pMesh = mesh;
+	object->firstDraw = _drawCount;
+	object->drawCount = surfaceCount;
+	object->alive = 1;
+	_drawCount += surfaceCount;
+
+	write_object_draws(object);
+	mark_dirty(handle);
+	_regroupPending = 1;
+
+	return handle;
+}
+
+void
+RenderScene::update_object(RenderObjectHandle handle, const Transform* transform) {
+	if (handle >= _objectCount || !_objects[handle].alive) {
+		fprintf(stderr, "[RenderScene] Attempting to update an invalid object.\n");
+		return;
+	}
+
+	RenderObject* object = &_objects[handle];
+	object->model = transform_to_matrix(transform);
+	for (uint32_t i = 0; i < object->drawCount; i++) {
+		_drawData[object->firstDraw + i].model = object->model;
+	}
+	mark_dirty(handle);
+}
+
+void
+RenderScene::destroy_object(RenderObjectHandle handle) {
+	if (handle >= _objectCount || !_objects[handle].alive) {
+		fprintf(stderr, "[RenderScene] Attempting to destroy an invalid object.\n");
+		return;
+	}
+
+	// The draws stay in place until the next flush compacts the draw range
+	// and groups the commands again without them
+	RenderObject* object = &_objects[handle];
+	object->alive = 0;
+	object->pMesh = nullptr;
+
+	_freeList[_freeCount++] = handle;
+	_compactPending = 1;
+}
+
+void
+RenderScene::flush(uint32_t frameIndex) {
+	if (_compactPending) {
+		compact();
+	}
+	if (_regroupPending) {
+		group_commands();
+	}
+
+	VkDrawIndexedIndirectCommand* gpuCommands =
+		(VkDrawIndexedIndirectCommand*)_indirectBuffers[frameIndex].info.pMappedData;
+	GPUDrawData* gpuData = (GPUDrawData*)_drawDataBuffers[frameIndex].info.pMappedData;
+	uint8_t frameBit = 1 << frameIndex;
+
+	if (_commandRewriteFrames & frameBit) {
+		memcpy(gpuCommands, _groupedCommands.data(),
+			_drawCount * sizeof(VkDrawIndexedIndirectCommand));
+		_commandRewriteFrames &= ~frameBit;
+	}
+
+	if (_fullRewriteFrames & frameBit) {
+		memcpy(gpuData, _drawData.data(), _drawCount * sizeof(GPUDrawData));
+		_fullRewriteFrames &= ~frameBit;
+
+		for (size_t i = 0; i < _dirtyObjects[frameIndex].size(); i++) {
+			_objects[_dirtyObjects[frameIndex][i]].dirtyFrames &= ~frameBit;
+		}
+		_dirtyObjects[frameIndex].clear();
+		return;
+	}
+
+	for (size_t i = 0; i < _dirtyObjects[frameIndex].size(); i++) {
+		RenderObject* object = &_objects[_dirtyObjects[frameIndex][i]];
+		object->dirtyFrames &= ~frameBit;
+		if (!object->alive) {
+			continue;
+		}
+
+		memcpy(gpuData + object->firstDraw, &_drawData[object->firstDraw],
+			object->drawCount * sizeof(GPUDrawData));
+	}
+	_dirtyObjects[frameIndex].clear();
+}
+
+void
+RenderScene::mark_dirty(RenderObjectHandle handle) {
+	RenderObject* object = &_objects[handle];
+	for (uint32_t f = 0; f < FRAME_OVERLAP; f++) {
+		if (!(object->dirtyFrames & (1 << f))) {
+			object->dirtyFrames |= (1 << f);
+			_dirtyObjects[f].push_back(handle);
+		}
+	}
+}
+
+void
+RenderScene::write_object_draws(RenderObject* object) {
+	const Mesh* mesh = object->pMesh;
+	// Every mesh shares the geometry buffer's index range, so the index
+	// buffer is bound once at offset 0 and each draw indexes into it
+	uint32_t baseIndex = static_cast<uint32_t>(object->indexOffset / sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < object->drawCount; i++) {
+		const Surface* surface = &mesh->surfaces[i];
+		uint32_t draw = object->firstDraw + i;
+
+		VkDrawIndexedIndirectCommand* cmd = &_drawCommands[draw];
+		cmd->indexCount = surface->count;
+		cmd->instanceCount = 1;
+		cmd->firstIndex = baseIndex + surface->startIndex;
+		cmd->vertexOffset = 0;
+		cmd->firstInstance = draw;
+		_drawBuckets[draw] = static_cast<uint8_t>(get_bucket(surface->materialID));
+
+		GPUDrawData* data = &_drawData[draw];
+		data->model = object->model;
+		data->vertexBuffer = object->vertexBuffer;
+		data->positionBuffer = object->positionBuffer;
+		data->materialID = surface->materialID;
+		data->padding[0] = data->padding[1] = data->padding[2] = 0;
+	}
+}
+
+// Packs the draws of all live objects to the front of the draw range. This is
+// O(objects) but only runs on frames where something was destroyed.
+void
+RenderScene::compact() {
+	uint32_t cursor = 0;
+	for (uint32_t i = 0; i < _objectCount; i++) {
+		RenderObject* object = &_objects[i];
+		if (!object->alive) {
+			continue;
+		}
+		object->firstDraw = cursor;
+		write_object_draws(object);
+		cursor += object->drawCount;
+	}
+	_drawCount = cursor;
+	_compactPending = 0;
+	_regroupPending = 1;
+	_fullRewriteFrames = ALL_FRAMES_MASK;
+}
+
+uint32_t
+RenderScene::get_bucket(uint32_t material) const {
+	uint32_t bucket = 0;
+	if (_pMaterials->get(material)->flags & MATERIAL_DOUBLE_SIDED_BIT) {
+		bucket |= RENDER_BUCKET_DOUBLE_SIDED_BIT;
+	}
+	if (_pMaterials->get_pass(material) != MATERIAL_PASS_OPAQUE) {
+		bucket |= RENDER_BUCKET_NOT_OPAQUE_BIT;
+	}
+	return bucket;
+}
+
+// Counting sort of the live draws by bucket, stable so draws of an object
+// stay together
+void
+RenderScene::group_commands() {
+	uint32_t counts[RENDER_BUCKET_COUNT] = {};
+	for (uint32_t i = 0; i < _drawCount; i++) {
+		counts[_drawBuckets[i]]++;
+	}
+	uint32_t first = 0;
+	for (uint32_t b = 0; b < RENDER_BUCKET_COUNT; b++) {
+		_ranges[b].first = first;
+		_ranges[b].count = counts[b];
+		first += counts[b];
+	}
+
+	uint32_t cursors[RENDER_BUCKET_COUNT];
+	for (uint32_t b = 0; b < RENDER_BUCKET_COUNT; b++) {
+		cursors[b] = _ranges[b].first;
+	}
+	for (uint32_t i = 0; i < _drawCount; i++) {
+		_groupedCommands[cursors[_drawBuckets[i]]++] = _drawCommands[i];
+	}
+
+	_regroupPending = 0;
+	_commandRewriteFrames = ALL_FRAMES_MASK;
+}
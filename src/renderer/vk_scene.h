@@ -0,0 +1,120 @@
+#ifndef VK_SCENE_H
+#define VK_SCENE_H
+
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_buffers.h"
+#include "vk_materials.h"
+
+#define MAX_RENDER_OBJECTS	4096
+#define MAX_RENDER_DRAWS	16384
+// Groups of draws that need different state, a bucket is made of these
+// bits, see RenderScene::get_bucket()
+#define RENDER_BUCKET_DOUBLE_SIDED_BIT	1
+// Alpha tested or blended, left out of the depth prepass
+#define RENDER_BUCKET_NOT_OPAQUE_BIT	2
+#define RENDER_BUCKET_COUNT				4
+
+// Range of a bucket in the indirect buffer, in draws
+struct RenderDrawRange {
+	uint32_t				first;
+	uint32_t				count;
+};
+
+/*
+* The render scene is the retained counterpart to the DrawContext. Objects
+* are created once and live in per-frame GPU buffers (one indirect command
+* and one GPUDrawData record per surface) until they are destroyed. Only
+* objects whose transform changed get rewritten, so the per-frame CPU cost
+* is proportional to the number of changed objects, not the scene size.
+*
+* The indirect commands are grouped by bucket (opaque or not, single or
+* double sided), each bucket is drawn with one indirect call and the state
+* it needs. Draw data stays at the draw's index, firstInstance points at it,
+* so only creating and destroying objects regroups the commands.
+*/
+class RenderScene {
+public:
+	// pMaterials decides which bucket the surfaces go in
+	void					init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch,
+								const MaterialRegistry* pMaterials);
+	void					destroy();
+
+	RenderObjectHandle		create_object(const Mesh* mesh, VkDeviceAddress vertexBuffer,
+								VkDeviceAddress positionBuffer, VkDeviceSize indexOffset,
+								const Transform* transform);
+	void					update_object(RenderObjectHandle handle,
+								const Transform* transform);
+	void					destroy_object(RenderObjectHandle handle);
+
+	// Writes every pending change for 'frameIndex' into that frame's
+	// buffers. Must be called after the frame's fence has been waited on.
+	void					flush(uint32_t frameIndex);
+
+	uint32_t				get_draw_count() const { return _drawCount; }
+	// Valid after flush(), the same for every frame's indirect buffer
+	const RenderDrawRange&	get_draw_range(uint32_t bucket) const {
+		return _ranges[bucket];
+	}
+	// RENDER_BUCKET_*_BIT of the material
+	uint32_t				get_bucket(uint32_t material) const;
+	VkBuffer				get_indirect_buffer(uint32_t frameIndex) const {
+		return _indirectBuffers[frameIndex].buffer;
+	}
+	VkDeviceAddress			get_draw_data_addr(uint32_t frameIndex) const {
+		return _drawDataAddrs[frameIndex];
+	}
+
+private:
+	struct RenderObject {
+		glm::mat4			model;
+		VkDeviceAddress		vertexBuffer;
+		VkDeviceAddress		positionBuffer;
+		VkDeviceSize		indexOffset;
+		const Mesh*			pMesh;
+		uint32_t			firstDraw;
+		uint32_t			drawCount;
+		// One bit per frame in flight that still has to see this object
+		uint8_t				dirtyFrames;
+		uint8_t				alive;
+	};
+
+	void					mark_dirty(RenderObjectHandle handle);
+	void					write_object_draws(RenderObject* object);
+	void					compact();
+	void					group_commands();
+
+	const MaterialRegistry*	_pMaterials = nullptr;
+
+	RenderObject			_objects[MAX_RENDER_OBJECTS] = {};
+	uint32_t				_freeList[MAX_RENDER_OBJECTS];
+	uint32_t				_freeCount = 0;
+	uint32_t				_objectCount = 0;
+
+	// CPU mirrors of the GPU buffers, copied out in flush(). The commands
+	// are in draw order here and grouped by bucket in _groupedCommands.
+	std::vector<VkDrawIndexedIndirectCommand> _drawCommands;
+	std::vector<uint8_t>	_drawBuckets;
+	std::vector<VkDrawIndexedIndirectCommand> _groupedCommands;
+	std::vector<GPUDrawData> _drawData;
+	uint32_t				_drawCount = 0;
+	RenderDrawRange			_ranges[RENDER_BUCKET_COUNT] = {};
+
+	std::vector<RenderObjectHandle> _dirtyObjects[FRAME_OVERLAP];
+	// Set when draws were moved around (destroy/compact) so the whole
+	// range has to be rewritten for that frame
+	uint8_t					_fullRewriteFrames = 0;
+	uint8_t					_compactPending = 0;
+	// Draws were added or removed, the commands are grouped again and
+	// every frame's indirect buffer rewritten
+	uint8_t					_regroupPending = 0;
+	uint8_t					_commandRewriteFrames = 0;
+
+	AllocatedBuffer			_indirectBuffers[FRAME_OVERLAP];
+	AllocatedBuffer			_drawDataBuffers[FRAME_OVERLAP];
+	VkDeviceAddress			_drawDataAddrs[FRAME_OVERLAP];
+};
+
+#endif /* VK_SCENE_H */
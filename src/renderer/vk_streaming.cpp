@@ -0,0 +1,508 @@
+#include "vk_streaming.h"
+
+#include "vk_images.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void
+TextureStreamer::init(VkDevice device, VmaAllocator allocator,
+	DeviceDispatch* pDeviceDispatch, JobScheduler* pScheduler, size_t budget) {
+	_device = device;
+	_allocator = allocator;
+	_pDeviceDispatch = pDeviceDispatch;
+	_pScheduler = pScheduler;
+	_budget = budget;
+}
+
+void
+TextureStreamer::destroy() {
+	if (_pScheduler != nullptr) {
+		_pScheduler->wait(&_jobCounter);
+	}
+	for (size_t i = 0; i < _completed.size(); i++) {
+		destroy_image(_device, _pDeviceDispatch, _allocator, &_completed[i]->image);
+		destroy_buffer(&_completed[i]->staging);
+		delete _completed[i];
+	}
+	_completed.clear();
+
+	for (size_t i = 0; i < _retired.size(); i++) {
+		if (_retired[i].image.image != VK_NULL_HANDLE) {
+			destroy_image(_device, _pDeviceDispatch, _allocator, &_retired[i].image);
+		}
+		if (_retired[i].buffer.buffer != VK_NULL_HANDLE) {
+			destroy_buffer(&_retired[i].buffer);
+		}
+	}
+	_retired.clear();
+
+	for (size_t i = 0; i < _textures.size(); i++) {
+		destroy_image(_device, _pDeviceDispatch, _allocator, &_textures[i].image);
+	}
+	_textures.clear();
+	_residentBytes = 0;
+	_retiredBytes = 0;
+}
+
+// Bytes levels [firstLevel, levelCount) take in the file, close enough to
+// what the image needs to plan with
+size_t
+TextureStreamer::levels_size(const StreamedTexture* pTexture, uint32_t firstLevel) const {
+	size_t size = 0;
+	for (uint32_t i = firstLevel; i < pTexture->header.levelCount; i++) {
+		size += static_cast<size_t>(pTexture->header.levels[i].size);
+	}
+	return size;
+}
+
+uint32_t
+TextureStreamer::create_level_image(const StreamedTexture* pTexture, uint32_t firstLevel,
+	AllocatedImage* pImage, size_t* pBytes) {
+	const TextureFileHeader* header = &pTexture->header;
+
+	VkImageCreateInfo imgInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO };
+	imgInfo.pNext = nullptr;
+	imgInfo.imageType = VK_IMAGE_TYPE_2D;
+	imgInfo.format = pTexture->format;
+	imgInfo.extent = {
+		std::max(header->width >> firstLevel, 1u), std::max(header->height >> firstLevel, 1u), 1
+	};
+	imgInfo.mipLevels = header->levelCount - firstLevel;
+	imgInfo.arrayLayers = header->layerCount;
+	imgInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imgInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	// TRANSFER_SRC for evictions, which copy the levels that stay
+	imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	imgInfo.flags = pTexture->cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0;
+
+	VmaAllocationCreateInfo allocInfo = {};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	allocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	VmaAllocationInfo allocationInfo;
+	if (vmaCreateImage(_allocator, &imgInfo, &allocInfo, &pImage->image,
+		&pImage->allocation, &allocationInfo) != VK_SUCCESS) {
+		fprintf(stderr, "[Streaming] VMA failed to create an image for %s.\n",
+			pTexture->path.c_str());
+		return 1;
+	}
+	pImage->imageFormat = imgInfo.format;
+	pImage->imageExtent = imgInfo.extent;
+	pImage->mipLevels = imgInfo.mipLevels;
+	*pBytes = static_cast<size_t>(allocationInfo.size);
+
+	VkImageViewCreateInfo viewInfo = { .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO };
+	viewInfo.pNext = nullptr;
+	viewInfo.viewType = pTexture->cube ? VK_IMAGE_VIEW_TYPE_CUBE :
+		(header->layerCount > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D);
+	viewInfo.image = pImage->image;
+	viewInfo.format = imgInfo.format;
+	viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	viewInfo.subresourceRange.baseMipLevel = 0;
+	viewInfo.subresourceRange.levelCount = imgInfo.mipLevels;
+	viewInfo.subresourceRange.baseArrayLayer = 0;
+	viewInfo.subresourceRange.layerCount = header->layerCount;
+
+	_pDeviceDispatch->vkCreateImageView(_device, &viewInfo, nullptr, &pImage->imageView);
+	return 0;
+}
+
+uint32_t
+TextureStreamer::register_texture(const char* path, StreamedTextureHandle* pHandle) {
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr) {
+		return 1;
+	}
+	StreamedTexture texture = {};
+	uint32_t invalid = texture_file_read_header(file, &texture.header);
+	fclose(file);
+	if (invalid) {
+		fprintf(stderr, "[Streaming] %s is not a texture file this version can read.\n", path);
+		return 1;
+	}
+
+	const TextureFileHeader* header = &texture.header;
+	texture.path = path;
+	texture.format = texture_file_vk_format(header->format, header->flags & TEXTURE_FILE_SRGB);
+	texture.cube = (header->flags & TEXTURE_FILE_CUBE) && header->layerCount == 6;
+	texture.tailLevel = header->levelCount - 1;
+	while (texture.tailLevel > 0 &&
+		std::max(header->width >> (texture.tailLevel - 1), header->height >> (texture.tailLevel - 1)) <=
+		STREAM_TAIL_SIZE) {
+		texture.tailLevel--;
+	}
+	texture.residentLevel = header->levelCount;
+	texture.wantedLevel = texture.tailLevel;
+	texture.lastRequestFrame = _frame;
+
+	uint32_t index = static_cast<uint32_t>(_textures.size());
+	_textures.push_back(texture);
+
+	// The tail is a few KB, read it now so the texture can be bound this
+	// frame. Its copy is recorded with the other finished loads.
+	StreamLoad* load = start_load(index, texture.tailLevel, 0);
+	if (load == nullptr || load->failed) {
+		if (load != nullptr) {
+			std::lock_guard<std::mutex> lock(_completedMutex);
+			_completed.erase(std::find(_completed.begin(), _completed.end(), load));
+			destroy_image(_device, _pDeviceDispatch, _allocator, &load->image);
+			destroy_buffer(&load->staging);
+			_residentBytes -= load->bytes;
+			_loadsInFlight--;
+			delete load;
+		}
+		_textures.pop_back();
+		return 1;
+	}
+
+	StreamedTexture* pTexture = &_textures[index];
+	pTexture->image = load->image;
+	pTexture->residentLevel = texture.tailLevel;
+	pTexture->residentBytes = load->bytes;
+
+	fprintf(stderr, "[Streaming] %s: %ux%u, %u levels, tail from level %u\n", path,
+		header->width, header->height, header->levelCount, texture.tailLevel);
+	*pHandle = index;
+	return 0;
+}
+
+void
+TextureStreamer::request(StreamedTextureHandle handle, float pixels) {
+	if (handle == STREAM_INVALID_HANDLE) {
+		return;
+	}
+	StreamedTexture* texture = &_textures[handle];
+
+	// The level whose width is closest to (and at least) the on screen size
+	uint32_t level = texture->tailLevel;
+	if (pixels > 0.f) {
+		float ratio = texture->header.width / pixels;
+		level = ratio > 1.f ? static_cast<uint32_t>(floorf(log2f(ratio))) : 0;
+		level = std::min(level, texture->tailLevel);
+	}
+
+	if (texture->lastRequestFrame != _frame) {
+		texture->wantedLevel = level;
+	} else {
+		texture->wantedLevel = std::min(texture->wantedLevel, level);
+	}
+	texture->lastRequestFrame = _frame;
+}
+
+// Runs on a worker, or inline for the tail
+void
+TextureStreamer::read_levels(void* pData) {
+	StreamLoad* load = static_cast<StreamLoad*>(pData);
+	uint8_t* staging = static_cast<uint8_t*>(load->staging.info.pMappedData);
+
+	FILE* file = fopen(load->path.c_str(), "rb");
+	load->failed = file == nullptr;
+	for (uint32_t i = 0; i < load->regionCount && !load->failed; i++) {
+		const TextureFileLevel* level = &load->levels[load->firstLevel + i];
+		size_t size = static_cast<size_t>(level->size);
+		load->failed = fseek(file, static_cast<long>(level->offset), SEEK_SET) != 0 ||
+			fread(staging + load->regions[i].bufferOffset, 1, size, file) != size;
+	}
+	if (file != nullptr) {
+		fclose(file);
+	}
+
+	std::lock_guard<std::mutex> lock(load->pStreamer->_completedMutex);
+	load->pStreamer->_completed.push_back(load);
+}
+
+TextureStreamer::StreamLoad*
+TextureStreamer::start_load(uint32_t texture, uint32_t firstLevel, uint32_t async) {
+	StreamedTexture* pTexture = &_textures[texture];
+	const TextureFileHeader* header = &pTexture->header;
+
+	StreamLoad* load = new StreamLoad{};
+	load->pStreamer = this;
+	load->texture = texture;
+	load->firstLevel = firstLevel;
+	load->path = pTexture->path;
+	memcpy(load->levels, header->levels, sizeof(load->levels));
+
+	// Block copies want offsets that are a multiple of the block size
+	VkDeviceSize stagingSize = 0;
+	load->regionCount = header->levelCount - firstLevel;
+	for (uint32_t i = 0; i < load->regionCount; i++) {
+		uint32_t level = firstLevel + i;
+		VkBufferImageCopy* region = &load->regions[i];
+		region->bufferOffset = stagingSize;
+		region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region->imageSubresource.mipLevel = i;
+		region->imageSubresource.baseArrayLayer = 0;
+		region->imageSubresource.layerCount = header->layerCount;
+		region->imageExtent = {
+			std::max(header->width >> level, 1u), std::max(header->height >> level, 1u), 1
+		};
+		stagingSize += (header->levels[level].size + 15) & ~VkDeviceSize(15);
+	}
+
+	if (create_level_image(pTexture, firstLevel, &load->image, &load->bytes)) {
+		pTexture->retryFrame = _frame + STREAM_RETRY_FRAMES;
+		delete load;
+		return nullptr;
+	}
+
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = _allocator;
+	bufferInfo.pBuffer = &load->staging;
+	bufferInfo.allocSize = stagingSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	create_buffer(&bufferInfo);
+
+	// The new image counts from now on, the old one stays until it's in
+	_residentBytes += load->bytes;
+	_loadsInFlight++;
+	pTexture->loading = 1;
+
+	if (async && _pScheduler != nullptr) {
+		_pScheduler->submit(read_levels, load, JOB_PRIORITY_LOW, &_jobCounter);
+	} else {
+		read_levels(load);
+	}
+	return load;
+}
+
+void
+TextureStreamer::retire(const AllocatedImage* pImage, const AllocatedBuffer* pBuffer,
+	size_t imageBytes) {
+	Retired retired = {};
+	if (pImage != nullptr) {
+		retired.image = *pImage;
+		retired.bytes = imageBytes;
+		_retiredBytes += imageBytes;
+	}
+	if (pBuffer != nullptr) {
+		retired.buffer = *pBuffer;
+	}
+	retired.frame = _frame;
+	_retired.push_back(retired);
+}
+
+void
+TextureStreamer::replace_image(uint32_t texture, const AllocatedImage* pImage,
+	size_t bytes, uint32_t firstLevel) {
+	StreamedTexture* pTexture = &_textures[texture];
+	if (pTexture->image.image != pImage->image) {
+		// Earlier frames may still be sampling it
+		retire(&pTexture->image, nullptr, pTexture->residentBytes);
+		_residentBytes -= pTexture->residentBytes;
+		_swaps.push_back({ texture, pImage->imageView });
+	}
+	pTexture->image = *pImage;
+	pTexture->residentLevel = firstLevel;
+	pTexture->residentBytes = bytes;
+}
+
+void
+TextureStreamer::finish_load(VkCommandBuffer cmd, StreamLoad* load) {
+	StreamedTexture* texture = &_textures[load->texture];
+	texture->loading = 0;
+	_loadsInFlight--;
+	retire(nullptr, &load->staging, 0);
+
+	if (load->failed) {
+		// Reading it again won't go any better
+		fprintf(stderr, "[Streaming] Failed to read levels %u+ of %s, keeping level %u.\n",
+			load->firstLevel, texture->path.c_str(), texture->residentLevel);
+		texture->failed = 1;
+		retire(&load->image, nullptr, load->bytes);
+		_residentBytes -= load->bytes;
+		return;
+	}
+
+	transition_image(cmd, load->image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _pDeviceDispatch);
+	_pDeviceDispatch->vkCmdCopyBufferToImage(cmd, load->staging.buffer, load->image.image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, load->regionCount, load->regions);
+	transition_image(cmd, load->image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _pDeviceDispatch);
+
+	if (load->firstLevel < texture->residentLevel) {
+		_loadedLevels += texture->residentLevel - load->firstLevel;
+	}
+	replace_image(load->texture, &load->image, load->bytes, load->firstLevel);
+}
+
+// Drops the texture's largest level, the others are copied over on the GPU
+uint32_t
+TextureStreamer::evict_level(VkCommandBuffer cmd, uint32_t texture) {
+	StreamedTexture* pTexture = &_textures[texture];
+	uint32_t firstLevel = pTexture->residentLevel + 1;
+
+	AllocatedImage image;
+	size_t bytes;
+	if (create_level_image(pTexture, firstLevel, &image, &bytes)) {
+		return 0;
+	}
+	_residentBytes += bytes;
+
+	transition_image(cmd, pTexture->image.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, _pDeviceDispatch);
+	transition_image(cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _pDeviceDispatch);
+
+	VkImageCopy2 regions[TEXTURE_FILE_MAX_LEVELS];
+	uint32_t regionCount = pTexture->header.levelCount - firstLevel;
+	for (uint32_t i = 0; i < regionCount; i++) {
+		uint32_t level = firstLevel + i;
+		regions[i] = { .sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2, .pNext = nullptr };
+		regions[i].srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].srcSubresource.mipLevel = i + 1;
+		regions[i].srcSubresource.baseArrayLayer = 0;
+		regions[i].srcSubresource.layerCount = pTexture->header.layerCount;
+		regions[i].dstSubresource = regions[i].srcSubresource;
+		regions[i].dstSubresource.mipLevel = i;
+		regions[i].extent = {
+			std::max(pTexture->header.width >> level, 1u),
+			std::max(pTexture->header.height >> level, 1u), 1
+		};
+	}
+
+	VkCopyImageInfo2 copyInfo = { .sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2, .pNext = nullptr };
+	copyInfo.srcImage = pTexture->image.image;
+	copyInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	copyInfo.dstImage = image.image;
+	copyInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	copyInfo.regionCount = regionCount;
+	copyInfo.pRegions = regions;
+	_pDeviceDispatch->vkCmdCopyImage2(cmd, &copyInfo);
+
+	transition_image(cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _pDeviceDispatch);
+
+	replace_image(texture, &image, bytes, firstLevel);
+	_evictedLevels++;
+	return 1;
+}
+
+// The configured budget, or what the device local heaps have left after
+// everything that isn't a streamed texture if that is less
+size_t
+TextureStreamer::compute_budget() {
+	VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+	vmaGetHeapBudgets(_allocator, budgets);
+	const VkPhysicalDeviceMemoryProperties* pProperties;
+	vmaGetMemoryProperties(_allocator, &pProperties);
+
+	VkDeviceSize heapBudget = 0, heapUsage = 0;
+	for (uint32_t i = 0; i < pProperties->memoryHeapCount; i++) {
+		if (pProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			heapBudget += budgets[i].budget;
+			heapUsage += budgets[i].usage;
+		}
+	}
+
+	size_t ours = _residentBytes + _retiredBytes;
+	size_t others = heapUsage > ours ? static_cast<size_t>(heapUsage) - ours : 0;
+	size_t available = heapBudget > others ? static_cast<size_t>(heapBudget) - others : 0;
+	return std::min(_budget, available);
+}
+
+void
+TextureStreamer::plan(VkCommandBuffer cmd) {
+	for (size_t i = 0; i < _textures.size(); i++) {
+		if (_frame - _textures[i].lastRequestFrame > STREAM_IDLE_FRAMES) {
+			_textures[i].wantedLevel = _textures[i].tailLevel;
+		}
+	}
+
+	// Least recently requested first
+	_order.resize(_textures.size());
+	for (uint32_t i = 0; i < _order.size(); i++) {
+		_order[i] = i;
+	}
+	std::sort(_order.begin(), _order.end(), [&](uint32_t a, uint32_t b) {
+		return _textures[a].lastRequestFrame < _textures[b].lastRequestFrame;
+	});
+
+	size_t budget = compute_budget();
+	_stats.budgetBytes = budget;
+
+	// Over budget, drop one level at a time from the front of the list until
+	// it fits. The tail always stays. Stops once a pass frees nothing, which
+	// is also the case when no smaller image can be allocated.
+	while (_residentBytes > budget) {
+		uint32_t evicted = 0;
+		for (size_t i = 0; i < _order.size() && _residentBytes > budget; i++) {
+			StreamedTexture* texture = &_textures[_order[i]];
+			if (!texture->loading && texture->residentLevel < texture->tailLevel &&
+				evict_level(cmd, _order[i])) {
+				evicted = 1;
+			}
+		}
+		if (!evicted) {
+			break;
+		}
+	}
+
+	// Most recently requested first, as many of the wanted levels as fit
+	for (size_t i = _order.size(); i-- > 0 && _loadsInFlight < STREAM_MAX_LOADS;) {
+		StreamedTexture* texture = &_textures[_order[i]];
+		if (texture->loading || texture->failed || _frame < texture->retryFrame ||
+			texture->wantedLevel >= texture->residentLevel) {
+			continue;
+		}
+		for (uint32_t level = texture->wantedLevel; level < texture->residentLevel; level++) {
+			// The old image stays until the new one is in
+			if (_residentBytes + levels_size(texture, level) <= budget) {
+				start_load(_order[i], level, 1);
+				break;
+			}
+		}
+	}
+}
+
+void
+TextureStreamer::record_uploads(VkCommandBuffer cmd) {
+	_swaps.clear();
+
+	size_t kept = 0;
+	for (size_t i = 0; i < _retired.size(); i++) {
+		Retired* retired = &_retired[i];
+		if (retired->frame + TRANSIENT_FRAME_COUNT > _frame) {
+			_retired[kept++] = *retired;
+			continue;
+		}
+		if (retired->image.image != VK_NULL_HANDLE) {
+			destroy_image(_device, _pDeviceDispatch, _allocator, &retired->image);
+			_retiredBytes -= retired->bytes;
+		}
+		if (retired->buffer.buffer != VK_NULL_HANDLE) {
+			destroy_buffer(&retired->buffer);
+		}
+	}
+	_retired.resize(kept);
+
+	std::vector<StreamLoad*> finished;
+	{
+		std::lock_guard<std::mutex> lock(_completedMutex);
+		finished.swap(_completed);
+	}
+	for (size_t i = 0; i < finished.size(); i++) {
+		finish_load(cmd, finished[i]);
+		delete finished[i];
+	}
+
+	plan(cmd);
+
+	_stats.textureCount = static_cast<uint32_t>(_textures.size());
+	_stats.loadsInFlight = _loadsInFlight;
+	_stats.residentBytes = _residentBytes;
+	_stats.loadedLevels = _loadedLevels;
+	_stats.evictedLevels = _evictedLevels;
+}
+
+void
+TextureStreamer::next_frame() {
+	_frame++;
+}
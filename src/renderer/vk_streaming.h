@@ -0,0 +1,188 @@
+#ifndef VK_STREAMING_H
+#define VK_STREAMING_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_buffers.h"
+#include "../core/job_system.h"
+#include "../core/texture_file.h"
+
+// Levels this size and smaller are the mip tail, loaded at registration and
+// never evicted
+#define STREAM_TAIL_SIZE		64
+#define STREAM_MAX_LOADS		2
+// A texture nobody asked for in this many frames only wants its tail
+#define STREAM_IDLE_FRAMES		120
+// Frames to wait before trying a load again whose image couldn't be created
+#define STREAM_RETRY_FRAMES		60
+#define STREAM_DEFAULT_BUDGET	(256ull * 1024 * 1024)
+
+#define STREAM_INVALID_HANDLE	0xffffffffu
+
+typedef uint32_t StreamedTextureHandle;
+
+// A streamed texture that got a new image, whatever samples it has to move
+// to 'imageView' before it's sampled again
+struct TextureSwap {
+	StreamedTextureHandle	texture;
+	VkImageView				imageView;
+};
+
+struct TextureStreamerStats {
+	uint32_t				textureCount;
+	uint32_t				loadsInFlight;
+	// Images of every streamed texture, including ones still loading
+	size_t					residentBytes;
+	// The configured budget, lowered when the rest of the engine leaves
+	// less than that in the device local heaps
+	size_t					budgetBytes;
+	// Levels streamed in / dropped since init
+	uint32_t				loadedLevels;
+	uint32_t				evictedLevels;
+};
+
+/*
+* Streams the mips of cooked .vtex textures (see texture_cooker). Only the
+* mip tail is read at registration, so a texture can be bound the same frame.
+* Higher levels are read on the job scheduler once the renderer asks for
+* them through request(), with the on screen size of what samples the
+* texture.
+*
+* Residency changes reallocate the image with a different number of levels
+* instead of using sparse binding: a load reads levels [first, levelCount)
+* from the file into a new image, an eviction copies the remaining levels
+* out of the old one on the GPU. Either way the new image is swapped in
+* whole, see get_swaps(). Evictions happen when the resident images go over
+* the budget, least recently requested textures first.
+*/
+class TextureStreamer {
+public:
+	// pScheduler may be nullptr, levels are then read inline
+	void					init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch, JobScheduler* pScheduler,
+								size_t budget);
+	void					destroy();
+
+	// Reads the header and mip tail of 'path'. The image view is valid
+	// right away, the tail is copied in by the next record_uploads().
+	// Returns 0 on success.
+	uint32_t				register_texture(const char* path, StreamedTextureHandle* pHandle);
+
+	// 'pixels' is how many pixels the texture's width spans on screen this
+	// frame, the largest request of a frame wins
+	void					request(StreamedTextureHandle handle, float pixels);
+
+	// Decides what to load and evict, and records the copies of the loads
+	// that finished. Must come before anything samples the textures in 'cmd'.
+	void					record_uploads(VkCommandBuffer cmd);
+
+	// Call once per submitted frame
+	void					next_frame();
+
+	void					set_budget(size_t budget) { _budget = budget; }
+	size_t					get_budget() const { return _budget; }
+	VkImageView				get_image_view(StreamedTextureHandle handle) const {
+		return _textures[handle].image.imageView;
+	}
+	// Textures whose image changed in the last record_uploads()
+	const std::vector<TextureSwap>& get_swaps() const { return _swaps; }
+	const TextureStreamerStats& get_stats() const { return _stats; }
+
+private:
+	struct StreamedTexture {
+		std::string			path;
+		TextureFileHeader	header;
+		VkFormat			format;
+		uint32_t			cube;
+
+		// Holds levels [residentLevel, levelCount) of the file
+		AllocatedImage		image;
+		uint32_t			residentLevel;
+		size_t				residentBytes;
+		// First level of the mip tail
+		uint32_t			tailLevel;
+
+		uint32_t			wantedLevel;
+		uint64_t			lastRequestFrame;
+		uint32_t			loading;
+		// The file couldn't be read, the texture keeps what it has
+		uint32_t			failed;
+		// No loads before this frame, see STREAM_RETRY_FRAMES
+		uint64_t			retryFrame;
+	};
+
+	// Levels being read into a new image, owned by the worker until it is
+	// pushed to _completed
+	struct StreamLoad {
+		TextureStreamer*	pStreamer;
+		uint32_t			texture;
+		uint32_t			firstLevel;
+		// Copies, _textures may grow while the worker reads
+		std::string			path;
+		TextureFileLevel	levels[TEXTURE_FILE_MAX_LEVELS];
+		AllocatedImage		image;
+		size_t				bytes;
+		AllocatedBuffer		staging;
+		VkBufferImageCopy	regions[TEXTURE_FILE_MAX_LEVELS];
+		uint32_t			regionCount;
+		uint32_t			failed;
+	};
+
+	// Freed once the frames that may use it have finished
+	struct Retired {
+		AllocatedImage		image;
+		size_t				bytes;
+		AllocatedBuffer		buffer;
+		uint64_t			frame;
+	};
+
+	static void				read_levels(void* pData);
+
+	size_t					levels_size(const StreamedTexture* pTexture,
+								uint32_t firstLevel) const;
+	uint32_t				create_level_image(const StreamedTexture* pTexture,
+								uint32_t firstLevel, AllocatedImage* pImage, size_t* pBytes);
+	// nullptr when the image can't be created. With async 0 the levels are
+	// read before it returns.
+	StreamLoad*				start_load(uint32_t texture, uint32_t firstLevel, uint32_t async);
+	void					finish_load(VkCommandBuffer cmd, StreamLoad* load);
+	// 0 if the smaller image couldn't be created, nothing was freed then
+	uint32_t				evict_level(VkCommandBuffer cmd, uint32_t texture);
+	// Either may be nullptr
+	void					retire(const AllocatedImage* pImage, const AllocatedBuffer* pBuffer,
+								size_t imageBytes);
+	void					replace_image(uint32_t texture, const AllocatedImage* pImage,
+								size_t bytes, uint32_t firstLevel);
+	size_t					compute_budget();
+	void					plan(VkCommandBuffer cmd);
+
+	VkDevice				_device;
+	VmaAllocator			_allocator;
+	DeviceDispatch*			_pDeviceDispatch;
+	JobScheduler*			_pScheduler;
+
+	std::vector<StreamedTexture> _textures;
+	size_t					_budget = STREAM_DEFAULT_BUDGET;
+	size_t					_residentBytes = 0;
+	// Images replaced but not freed yet
+	size_t					_retiredBytes = 0;
+	uint32_t				_loadsInFlight = 0;
+
+	JobCounter				_jobCounter;
+	std::mutex				_completedMutex;
+	std::vector<StreamLoad*> _completed;
+
+	std::vector<Retired>	_retired;
+	std::vector<TextureSwap> _swaps;
+	std::vector<uint32_t>	_order;
+
+	uint64_t				_frame = 0;
+	uint32_t				_loadedLevels = 0;
+	uint32_t				_evictedLevels = 0;
+	TextureStreamerStats	_stats = {};
+};
+
+#endif /* VK_STREAMING_H */
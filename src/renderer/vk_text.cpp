@@ -2,9 +2,143 @@
 
 #include "vk_images.h"
 
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
+#define SDF_CACHE_MAGIC		0x41464453 // "SDFA"
+#define SDF_CACHE_VERSION	2
+
+// Followed by glyphCount SdfCacheGlyph records, each followed by its pixels
+struct SdfCacheHeader {
+	uint32_t	magic;
+	uint32_t	version;
+	// Hash of the .ttf contents and every parameter the glyphs depend on
+	uint64_t	key;
+	uint32_t	glyphCount;
+	float		baseSize;
+};
+
+struct SdfCacheGlyph {
+	uint32_t	codepoint;
+	int16_t		width;
+	int16_t		height;
+	int16_t		xoff;
+	int16_t		yoff;
+};
+
+static uint64_t
+hash_font(const unsigned char* pData, size_t size, float baseSize) {
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ pData[i]) * 1099511628211ull;
+	}
+	uint32_t params[5] = { SDF_CACHE_VERSION, SDF_PADDING, SDF_ON_EDGE,
+		FIRST_CHAR, LAST_CHAR };
+	uint32_t sizeBits;
+	memcpy(&sizeBits, &baseSize, sizeof(sizeBits));
+	hash = (hash ^ sizeBits) * 1099511628211ull;
+	for (size_t i = 0; i < 5; i++) {
+		hash = (hash ^ params[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+static void
+save_sdf_cache(const char* path, uint64_t key, float baseSize, uint32_t glyphCount,
+	const std::vector<unsigned char>& records) {
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr) {
+		fprintf(stderr, "[VulkanEngine Text] WARN: Could not write font cache %s.\n", path);
+		return;
+	}
+
+	SdfCacheHeader header;
+	header.magic = SDF_CACHE_MAGIC;
+	header.version = SDF_CACHE_VERSION;
+	header.key = key;
+	header.glyphCount = glyphCount;
+	header.baseSize = baseSize;
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(records.data(), 1, records.size(), file);
+	fclose(file);
+}
+
+/*
+* Skyline bottom-left packing. The skyline is the top edge of everything
+* packed so far as a list of horizontal segments, a rect goes wherever its
+* top ends up lowest.
+*/
+static int
+skyline_fit(const std::vector<SkylineNode>& skyline, size_t index, int width,
+	int height) {
+	if (skyline[index].x + width > FONT_PAGE_SIZE) {
+		return -1;
+	}
+	int y = 0;
+	int remaining = width;
+	for (size_t i = index; remaining > 0; i++) {
+		y = skyline[i].y > y ? skyline[i].y : y;
+		if (y + height > FONT_PAGE_SIZE) {
+			return -1;
+		}
+		remaining -= skyline[i].width;
+	}
+	return y;
+}
+
+static uint32_t
+skyline_insert(std::vector<SkylineNode>* pSkyline, int width, int height,
+	int* pX, int* pY) {
+	std::vector<SkylineNode>& skyline = *pSkyline;
+	int bestY = FONT_PAGE_SIZE;
+	size_t bestIndex = skyline.size();
+	for (size_t i = 0; i < skyline.size(); i++) {
+		int y = skyline_fit(skyline, i, width, height);
+		if (y >= 0 && y < bestY) {
+			bestY = y;
+			bestIndex = i;
+		}
+	}
+	if (bestIndex == skyline.size()) {
+		return 0;
+	}
+
+	SkylineNode node = { skyline[bestIndex].x, bestY + height, width };
+	skyline.insert(skyline.begin() + bestIndex, node);
+
+	// Cut the segments the new one covers
+	for (size_t i = bestIndex + 1; i < skyline.size();) {
+		int previousEnd = skyline[i - 1].x + skyline[i - 1].width;
+		if (skyline[i].x >= previousEnd) {
+			break;
+		}
+		int shrink = previousEnd - skyline[i].x;
+		skyline[i].x += shrink;
+		skyline[i].width -= shrink;
+		if (skyline[i].width > 0) {
+			break;
+		}
+		skyline.erase(skyline.begin() + i);
+	}
+	for (size_t i = 0; i + 1 < skyline.size();) {
+		if (skyline[i].y == skyline[i + 1].y) {
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		} else {
+			i++;
+		}
+	}
+
+	*pX = node.x;
+	*pY = bestY;
+	return 1;
+}
+
 uint32_t FontAtlas::create(FontCreateInfo* createInfo) {
 	FILE* fontFile = fopen(createInfo->ttfPath, "rb");
 	if (!fontFile) {
@@ -16,90 +150,702 @@ uint32_t FontAtlas::create(FontCreateInfo* createInfo) {
 	long fileSize = ftell(fontFile);
 	fseek(fontFile, 0, SEEK_SET);
 
-	unsigned char* fontBuffer = (unsigned char*)malloc(fileSize);
-	if (!fontBuffer) {
+	// Kept for the lifetime of the font, glyphs are rasterized from it
+	// whenever a string needs one
+	pFontData = (unsigned char*)malloc(fileSize);
+	if (!pFontData) {
 		ENGINE_ERROR("Failed to allocate font buffer.");
-		free(fontBuffer);
+		fclose(fontFile);
 		return 1;
 	}
 
-	fread(fontBuffer, fileSize, 1, fontFile);
+	fread(pFontData, fileSize, 1, fontFile);
 	fclose(fontFile);
 
-	const int atlasWidth = 512;
-	const int atlasHeight = 512;
-
-	unsigned char* atlas = (unsigned char*)malloc(atlasWidth * atlasHeight);
-	if (atlas == nullptr) {
+	if (!stbtt_InitFont(&fontInfo, pFontData, stbtt_GetFontOffsetForIndex(pFontData, 0))) {
+		ENGINE_ERROR("Failed to read font.");
+		free(pFontData);
+		pFontData = nullptr;
 		return 1;
 	}
-	stbtt_pack_context pc;
-	if (!stbtt_PackBegin(&pc, atlas, atlasWidth, atlasHeight, 0, 1, nullptr)) {
-		ENGINE_ERROR("Failed to initialize font packing.");
+
+	baseSize = (float)createInfo->size;
+	scale = stbtt_ScaleForPixelHeight(&fontInfo, baseSize);
+	cacheKey = hash_font(pFontData, fileSize, baseSize);
+	cachePath = createInfo->cachePath != nullptr ? createInfo->cachePath : "";
+	generation = 0;
+	glyphs.clear();
+
+	ImageCreateInfo imgInfo = {};
+	imgInfo.allocator = createInfo->allocator;
+	imgInfo.device = createInfo->device;
+	imgInfo.pDeviceDispatch = createInfo->pDeviceDispatch;
+	imgInfo.size = VkExtent3D{ FONT_PAGE_SIZE, FONT_PAGE_SIZE, 1 };
+	imgInfo.format = VK_FORMAT_R8_UNORM;
+	imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		FontPage* page = &pages[i];
+		imgInfo.pImg = &page->texture;
+		create_image(&imgInfo);
+		page->skyline.assign(1, SkylineNode{ 0, 0, FONT_PAGE_SIZE });
+		page->lastUsedFrame = 0;
+		page->glyphCount = 0;
+		page->initialized = 0;
+		page->needsClear = 1;
+	}
+	return 0;
+}
+
+void FontAtlas::destroy(VkDevice device, DeviceDispatch* deviceDispatch,
+	VmaAllocator allocator) {
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		destroy_image(device, deviceDispatch, allocator, &pages[i].texture);
+		pages[i].skyline.clear();
+	}
+	glyphs.clear();
+	free(pFontData);
+	pFontData = nullptr;
+}
+
+void
+TextCache::init(VkDevice device, VmaAllocator allocator, DeviceDispatch* pDeviceDispatch,
+	JobScheduler* pScheduler) {
+	_device = device;
+	_allocator = allocator;
+	_pDeviceDispatch = pDeviceDispatch;
+	_pScheduler = pScheduler;
+
+	BufferCreateInfo bufferInfo;
+	bufferInfo.allocator = allocator;
+	bufferInfo.pBuffer = &_glyphTable;
+	bufferInfo.allocSize = MAX_TEXT_GLYPHS * sizeof(GPUGlyph);
+	bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	bufferInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+		VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+	create_buffer(&bufferInfo);
+
+	VkBufferDeviceAddressInfo addrInfo = {};
+	addrInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	addrInfo.pNext = nullptr;
+	addrInfo.buffer = _glyphTable.buffer;
+	_glyphTableAddr = pDeviceDispatch->vkGetBufferDeviceAddress(device, &addrInfo);
+
+	// Handed out from the back, so the table fills from entry 0
+	_freeGlyphs.resize(MAX_TEXT_GLYPHS);
+	for (uint32_t i = 0; i < MAX_TEXT_GLYPHS; i++) {
+		_freeGlyphs[i] = (uint16_t)(MAX_TEXT_GLYPHS - 1 - i);
+	}
+
+	_instances.init(device, allocator, pDeviceDispatch, TEXT_RING_BLOCK_SIZE,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	_uploads.init(device, allocator, pDeviceDispatch, TEXT_UPLOAD_BLOCK_SIZE,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+}
+
+void
+TextCache::destroy() {
+	if (_pScheduler != nullptr) {
+		_pScheduler->wait(&_jobCounter);
+	}
+	for (size_t i = 0; i < _completed.size(); i++) {
+		free_job(_completed[i]);
+	}
+	for (size_t i = 0; i < _waiting.size(); i++) {
+		free_job(_waiting[i]);
+	}
+	_completed.clear();
+	_waiting.clear();
+	_pendingUploads.clear();
+	_cacheWriters.clear();
+
+	_uploads.destroy();
+	_instances.destroy();
+	destroy_buffer(&_glyphTable);
+	_runs.clear();
+}
+
+uint32_t
+TextCache::register_font(FontAtlas* pAtlas) {
+	// The printable ASCII glyphs are what nearly every string uses, the
+	// cache saves rasterizing them on every start
+	uint32_t loaded = 0;
+	FILE* file = pAtlas->cachePath.empty() ? nullptr : fopen(pAtlas->cachePath.c_str(), "rb");
+	if (file != nullptr) {
+		SdfCacheHeader header;
+		if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == SDF_CACHE_MAGIC &&
+			header.version == SDF_CACHE_VERSION && header.key == pAtlas->cacheKey) {
+			for (uint32_t i = 0; i < header.glyphCount; i++) {
+				SdfCacheGlyph record;
+				if (fread(&record, sizeof(record), 1, file) != 1 ||
+					record.width < 0 || record.height < 0) {
+					break;
+				}
+				size_t size = (size_t)record.width * record.height;
+				GlyphJob* job = new GlyphJob{ this, pAtlas, record.codepoint, nullptr,
+					record.width, record.height, record.xoff, record.yoff };
+				if (size > 0) {
+					job->pPixels = (unsigned char*)malloc(size);
+					if (job->pPixels == nullptr || fread(job->pPixels, 1, size, file) != size) {
+						free_job(job);
+						break;
+					}
+				}
+				get_glyph(pAtlas, record.codepoint, job);
+				loaded++;
+			}
+		}
+		fclose(file);
+	}
+
+	// Whatever the cache didn't have goes to the workers
+	uint32_t expected = 0;
+	for (uint32_t c = FIRST_CHAR; c <= LAST_CHAR; c++) {
+		if (get_glyph(pAtlas, c)->state == GLYPH_STATE_PENDING) {
+			expected++;
+		}
+	}
+	if (!pAtlas->cachePath.empty() && loaded < expected) {
+		FontCacheWriter* writer = &_cacheWriters[pAtlas];
+		writer->records.clear();
+		writer->count = 0;
+		writer->expected = expected;
+	}
+	return 0;
+}
+
+void
+TextCache::unregister_font(FontAtlas* pAtlas) {
+	// Jobs only read the font, but they hold a pointer to it
+	if (_pScheduler != nullptr) {
+		_pScheduler->wait(&_jobCounter);
+	}
+	{
+		std::lock_guard<std::mutex> lock(_completedMutex);
+		_waiting.insert(_waiting.end(), _completed.begin(), _completed.end());
+		_completed.clear();
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < _waiting.size(); i++) {
+		if (_waiting[i]->pAtlas == pAtlas) {
+			free_job(_waiting[i]);
+			_pendingGlyphs--;
+		} else {
+			_waiting[kept++] = _waiting[i];
+		}
+	}
+	_waiting.resize(kept);
+
+	for (auto it = pAtlas->glyphs.begin(); it != pAtlas->glyphs.end(); it++) {
+		if (it->second.state == GLYPH_STATE_READY) {
+			_freeGlyphs.push_back(it->second.tableIndex);
+		}
+	}
+	pAtlas->glyphs.clear();
+	for (auto it = _runs.begin(); it != _runs.end();) {
+		if (it->second.pAtlas == pAtlas) {
+			it = _runs.erase(it);
+		} else {
+			it++;
+		}
+	}
+	_cacheWriters.erase(pAtlas);
+}
+
+// Runs on a worker. stb_truetype only reads the font, so any number of
+// glyphs of the same font can be rasterized at once.
+void
+TextCache::rasterize_glyph(void* pData) {
+	GlyphJob* job = (GlyphJob*)pData;
+	const FontAtlas* pAtlas = job->pAtlas;
+	job->pPixels = stbtt_GetCodepointSDF(&pAtlas->fontInfo, pAtlas->scale,
+		job->codepoint, SDF_PADDING, SDF_ON_EDGE, SDF_DIST_SCALE,
+		&job->width, &job->height, &job->xoff, &job->yoff);
+
+	std::lock_guard<std::mutex> lock(job->pCache->_completedMutex);
+	job->pCache->_completed.push_back(job);
+}
+
+// stb_truetype allocates with malloc (STBTT_malloc), same as the cache loader
+void
+TextCache::free_job(GlyphJob* job) {
+	free(job->pPixels);
+	delete job;
+}
+
+// Looks the glyph up, requesting it if this is its first use. pRasterized
+// hands over pixels that are already there (the disk cache).
+FontGlyph*
+TextCache::get_glyph(FontAtlas* pAtlas, uint32_t codepoint, GlyphJob* pRasterized) {
+	auto it = pAtlas->glyphs.find(codepoint);
+	if (it != pAtlas->glyphs.end()) {
+		if (pRasterized != nullptr) {
+			free_job(pRasterized);
+		}
+		return &it->second;
+	}
+
+	FontGlyph* glyph = &pAtlas->glyphs[codepoint];
+	int advance, leftSideBearing;
+	stbtt_GetCodepointHMetrics(&pAtlas->fontInfo, codepoint, &advance, &leftSideBearing);
+	glyph->xadvance = advance * pAtlas->scale;
+	glyph->page = 0;
+	glyph->tableIndex = 0;
+
+	int index = stbtt_FindGlyphIndex(&pAtlas->fontInfo, codepoint);
+	if (stbtt_IsGlyphEmpty(&pAtlas->fontInfo, index)) {
+		glyph->state = GLYPH_STATE_EMPTY;
+		if (pRasterized != nullptr) {
+			free_job(pRasterized);
+		}
+		return glyph;
+	}
+
+	glyph->state = GLYPH_STATE_PENDING;
+	_pendingGlyphs++;
+	if (pRasterized != nullptr) {
+		std::lock_guard<std::mutex> lock(_completedMutex);
+		_completed.push_back(pRasterized);
+		return glyph;
+	}
+
+	GlyphJob* job = new GlyphJob{ this, pAtlas, codepoint, nullptr, 0, 0, 0, 0 };
+	if (_pScheduler != nullptr) {
+		_pScheduler->submit(rasterize_glyph, job, JOB_PRIORITY_LOW, &_jobCounter);
+	} else {
+		rasterize_glyph(job);
+	}
+	return glyph;
+}
+
+// Picks the page no run has drawn from for the longest, as long as no
+// frame still in flight can be sampling it. When the glyph table is what
+// ran out the page holding the most table entries goes instead, a page
+// without any wouldn't free one.
+uint32_t
+TextCache::evict_page(FontAtlas* pAtlas, uint32_t forTableEntries, uint32_t* pPage) {
+	uint32_t oldest = MAX_FONT_PAGES;
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		const FontPage* page = &pAtlas->pages[i];
+		if (_frame - page->lastUsedFrame <= TRANSIENT_FRAME_COUNT) {
+			continue;
+		}
+		if (forTableEntries && page->glyphCount == 0) {
+			continue;
+		}
+		if (oldest == MAX_FONT_PAGES) {
+			oldest = i;
+			continue;
+		}
+		const FontPage* best = &pAtlas->pages[oldest];
+		if (forTableEntries && page->glyphCount != best->glyphCount) {
+			if (page->glyphCount > best->glyphCount) {
+				oldest = i;
+			}
+		} else if (page->lastUsedFrame < best->lastUsedFrame) {
+			oldest = i;
+		}
+	}
+	if (oldest == MAX_FONT_PAGES) {
+		return 0;
+	}
+
+	FontPage* page = &pAtlas->pages[oldest];
+	page->skyline.assign(1, SkylineNode{ 0, 0, FONT_PAGE_SIZE });
+	page->glyphCount = 0;
+	page->needsClear = 1;
+	for (auto it = pAtlas->glyphs.begin(); it != pAtlas->glyphs.end();) {
+		if (it->second.state == GLYPH_STATE_READY && it->second.page == oldest) {
+			_freeGlyphs.push_back(it->second.tableIndex);
+			it = pAtlas->glyphs.erase(it);
+		} else {
+			it++;
+		}
+	}
+	// Runs still pointing into the page get laid out again, which requests
+	// their glyphs anew
+	pAtlas->generation++;
+	_evictedPages++;
+
+	*pPage = oldest;
+	return 1;
+}
+
+uint32_t
+TextCache::pack_glyph(FontAtlas* pAtlas, int width, int height, uint32_t* pPage,
+	int* pX, int* pY) {
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		if (skyline_insert(&pAtlas->pages[i].skyline, width, height, pX, pY)) {
+			*pPage = i;
+			return 1;
+		}
+	}
+	if (!evict_page(pAtlas, 0, pPage)) {
+		return 0;
+	}
+	return skyline_insert(&pAtlas->pages[*pPage].skyline, width, height, pX, pY);
+}
+
+// Glyph quad relative to the pen position in units of the font's base size,
+// so text.vert can scale it to any size, plus its uvs in the page
+void
+TextCache::write_glyph(uint32_t tableIndex, const GlyphJob* job, int x, int y) {
+	float invSize = 1.f / job->pAtlas->baseSize;
+	float invPage = 1.f / FONT_PAGE_SIZE;
+	GPUGlyph* entry = (GPUGlyph*)_glyphTable.info.pMappedData + tableIndex;
+	entry->plane = glm::vec4(job->xoff, job->yoff, job->xoff + job->width,
+		job->yoff + job->height) * invSize;
+	entry->uv = glm::vec4(x, y, x + job->width, y + job->height) * invPage;
+}
+
+void
+TextCache::add_to_font_cache(const GlyphJob* job) {
+	if (job->codepoint < FIRST_CHAR || job->codepoint > LAST_CHAR) {
+		return;
+	}
+	auto it = _cacheWriters.find(job->pAtlas);
+	if (it == _cacheWriters.end()) {
+		return;
+	}
+
+	FontCacheWriter* writer = &it->second;
+	SdfCacheGlyph record;
+	record.codepoint = job->codepoint;
+	record.width = (int16_t)(job->pPixels != nullptr ? job->width : 0);
+	record.height = (int16_t)(job->pPixels != nullptr ? job->height : 0);
+	record.xoff = (int16_t)job->xoff;
+	record.yoff = (int16_t)job->yoff;
+	const unsigned char* bytes = (const unsigned char*)&record;
+	writer->records.insert(writer->records.end(), bytes, bytes + sizeof(record));
+	if (job->pPixels != nullptr) {
+		writer->records.insert(writer->records.end(), job->pPixels,
+			job->pPixels + (size_t)record.width * record.height);
+	}
+
+	if (++writer->count == writer->expected) {
+		const FontAtlas* pAtlas = job->pAtlas;
+		save_sdf_cache(pAtlas->cachePath.c_str(), pAtlas->cacheKey, pAtlas->baseSize,
+			writer->count, writer->records);
+		_cacheWriters.erase(it);
+	}
+}
+
+uint32_t
+TextCache::place_glyph(GlyphJob* job) {
+	FontAtlas* pAtlas = job->pAtlas;
+	auto it = pAtlas->glyphs.find(job->codepoint);
+	if (it == pAtlas->glyphs.end() || it->second.state != GLYPH_STATE_PENDING) {
 		return 1;
 	}
+	FontGlyph* glyph = &it->second;
 
-	stbtt_PackSetOversampling(&pc, 2, 2);
-	if (!stbtt_PackFontRange(&pc, fontBuffer, 0, createInfo->size, ' ', MAX_CHAR,
-		charInfo)) {
-		ENGINE_ERROR("Failed to pack font.");
+	if (job->pPixels == nullptr) {
+		add_to_font_cache(job);
+		glyph->state = GLYPH_STATE_EMPTY;
+		pAtlas->generation++;
 		return 1;
 	}
 
-	stbtt_PackEnd(&pc);
+	// The gutter is uploaded as zeros too, an evicted page still has the
+	// old glyphs in it
+	int width = job->width + FONT_GLYPH_GUTTER;
+	int height = job->height + FONT_GLYPH_GUTTER;
+	TransientAllocation staging;
+	unsigned char* pixels = (unsigned char*)_uploads.alloc((size_t)width * height, 4, &staging);
+	if (pixels == nullptr) {
+		return 0;
+	}
 
-	unsigned char* rgbaAtlas = (unsigned char*)malloc(atlasWidth * atlasHeight * 4);
-	if (rgbaAtlas == nullptr) {
-		return 1;
+	uint32_t pageIndex;
+	int x, y;
+	if (_freeGlyphs.empty()) {
+		// The table may be full of other fonts' glyphs, evicting one of our
+		// pages then frees nothing and the glyph waits for a later frame
+		evict_page(pAtlas, 1, &pageIndex);
+		if (_freeGlyphs.empty()) {
+			return 0;
+		}
+	}
+	if (!pack_glyph(pAtlas, width, height, &pageIndex, &x, &y)) {
+		return 0;
 	}
-	for (size_t i = 0; i < atlasWidth * atlasHeight; i++) {
-		float alpha = atlas[i] / 255.f;
 
-		rgbaAtlas[i * 4] = (unsigned char)(atlas[i] * alpha);
-		rgbaAtlas[i * 4 + 1] = (unsigned char)(atlas[i] * alpha);
-		rgbaAtlas[i * 4 + 2] = (unsigned char)(atlas[i] * alpha);
-		rgbaAtlas[i * 4 + 3] = atlas[i];
+	for (int row = 0; row < job->height; row++) {
+		memcpy(pixels + (size_t)row * width, job->pPixels + (size_t)row * job->width,
+			job->width);
+		memset(pixels + (size_t)row * width + job->width, 0, FONT_GLYPH_GUTTER);
 	}
+	memset(pixels + (size_t)job->height * width, 0, (size_t)FONT_GLYPH_GUTTER * width);
 
-	ImageCreateInfo imgInfo = {};
-	imgInfo.allocator = createInfo->allocator;
-	imgInfo.device = createInfo->device;
-	imgInfo.pDeviceDispatch = createInfo->pDeviceDispatch;
-	imgInfo.pImg = &texture;
-	imgInfo.size = VkExtent3D{ atlasWidth, atlasHeight, 1 };
-	imgInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
-	imgInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
-	create_image_with_data(&imgInfo, rgbaAtlas, createInfo->cmd, createInfo->fence,
-		createInfo->queue);
-
-	free(atlas);
-	free(rgbaAtlas);
-	free(fontBuffer);
-	return 0;
+	FontPage* page = &pAtlas->pages[pageIndex];
+	GlyphUpload upload;
+	upload.pPage = page;
+	upload.buffer = staging.buffer;
+	upload.region = {};
+	upload.region.bufferOffset = staging.offset;
+	upload.region.bufferRowLength = 0;
+	upload.region.bufferImageHeight = 0;
+	upload.region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	upload.region.imageSubresource.mipLevel = 0;
+	upload.region.imageSubresource.baseArrayLayer = 0;
+	upload.region.imageSubresource.layerCount = 1;
+	upload.region.imageOffset = { x, y, 0 };
+	upload.region.imageExtent = { (uint32_t)width, (uint32_t)height, 1 };
+	_pendingUploads.push_back(upload);
+
+	// Nothing in flight references a pending glyph, see layout_run()
+	glyph->tableIndex = _freeGlyphs.back();
+	_freeGlyphs.pop_back();
+	write_glyph(glyph->tableIndex, job, x, y);
+	glyph->state = GLYPH_STATE_READY;
+	glyph->page = (uint8_t)pageIndex;
+	page->glyphCount++;
+	page->lastUsedFrame = _frame;
+	pAtlas->generation++;
+	_current.uploadedGlyphs++;
+
+	add_to_font_cache(job);
+	return 1;
 }
 
-GlyphInfo FontAtlas::get_glyph_info(uint32_t c, float offsetX, float offsetY) {
-	stbtt_aligned_quad q;
-	stbtt_GetPackedQuad(charInfo, texture.imageExtent.width,
-		texture.imageExtent.height, c - FIRST_CHAR, &offsetX, &offsetY,
-		&q, 1);
+void
+TextCache::record_uploads(VkCommandBuffer cmd) {
+	{
+		std::lock_guard<std::mutex> lock(_completedMutex);
+		_waiting.insert(_waiting.end(), _completed.begin(), _completed.end());
+		_completed.clear();
+	}
+	size_t kept = 0;
+	for (size_t i = 0; i < _waiting.size(); i++) {
+		if (place_glyph(_waiting[i])) {
+			free_job(_waiting[i]);
+			_pendingGlyphs--;
+		} else {
+			_waiting[kept++] = _waiting[i];
+		}
+	}
+	_waiting.resize(kept);
+
+	if (_pendingUploads.empty()) {
+		return;
+	}
+
+	// One pair of transitions per page, and one copy per staging block
+	std::sort(_pendingUploads.begin(), _pendingUploads.end(),
+		[](const GlyphUpload& a, const GlyphUpload& b) {
+			if (a.pPage != b.pPage) {
+				return a.pPage < b.pPage;
+			}
+			return a.buffer < b.buffer;
+		});
 
-	GlyphInfo info = {};
-	info.offsetX = offsetX;
-	info.offsetY = offsetY;
-	info.positions[0] = { q.x0, q.y1, 0 };
-	info.positions[1] = { q.x0, q.y0, 0 };
-	info.positions[2] = { q.x1, q.y0, 0 };
-	info.positions[3] = { q.x1, q.y1, 0 };
-	info.uvs[0] = { q.s0, q.t1 };
-	info.uvs[1] = { q.s0, q.t0 };
-	info.uvs[2] = { q.s1, q.t0 };
-	info.uvs[3] = { q.s1, q.t1 };
+	size_t i = 0;
+	while (i < _pendingUploads.size()) {
+		FontPage* page = _pendingUploads[i].pPage;
+		VkImage image = page->texture.image;
+		transition_image(cmd, image, page->initialized ?
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _pDeviceDispatch);
+		if (page->needsClear) {
+			VkClearColorValue clear = {};
+			VkImageSubresourceRange range = {};
+			range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			range.levelCount = 1;
+			range.layerCount = 1;
+			_pDeviceDispatch->vkCmdClearColorImage(cmd, image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear, 1, &range);
+			transition_image(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, _pDeviceDispatch);
+			page->needsClear = 0;
+		}
 
-	return info;
+		while (i < _pendingUploads.size() && _pendingUploads[i].pPage == page) {
+			VkBuffer buffer = _pendingUploads[i].buffer;
+			_regions.clear();
+			while (i < _pendingUploads.size() && _pendingUploads[i].pPage == page &&
+				_pendingUploads[i].buffer == buffer) {
+				_regions.push_back(_pendingUploads[i].region);
+				i++;
+			}
+			_pDeviceDispatch->vkCmdCopyBufferToImage(cmd, buffer, image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(_regions.size()),
+				_regions.data());
+		}
+
+		transition_image(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, _pDeviceDispatch);
+		page->initialized = 1;
+	}
+	_pendingUploads.clear();
 }
 
-void FontAtlas::destroy(VkDevice device, DeviceDispatch* deviceDispatch,
-	VmaAllocator allocator) {
-	destroy_image(device, deviceDispatch, allocator, &texture);
-}
\ No newline at end of file
+static uint64_t
+hash_text_run(const char* text, size_t length, const FontAtlas* pAtlas,
+	glm::vec2 position, uint32_t size, uint32_t color) {
+	// FNV-1a over the string and then the rest of the key
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)text[i]) * 1099511628211ull;
+	}
+	uint64_t key[3] = { (uint64_t)(uintptr_t)pAtlas, 0, ((uint64_t)size << 32) | color };
+	memcpy(&key[1], &position, sizeof(position));
+	for (size_t i = 0; i < 3; i++) {
+		hash = (hash ^ key[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+// Invalid or truncated sequences come out as U+FFFD, one byte at a time
+static uint32_t
+decode_utf8(const unsigned char** pText, const unsigned char* end) {
+	const unsigned char* p = *pText;
+	uint32_t c = *p++;
+	*pText = p;
+	uint32_t length, min;
+	if (c < 0x80) {
+		return c;
+	} else if ((c & 0xe0) == 0xc0) {
+		c &= 0x1f;
+		length = 1;
+		min = 0x80;
+	} else if ((c & 0xf0) == 0xe0) {
+		c &= 0x0f;
+		length = 2;
+		min = 0x800;
+	} else if ((c & 0xf8) == 0xf0) {
+		c &= 0x07;
+		length = 3;
+		min = 0x10000;
+	} else {
+		return 0xfffd;
+	}
+
+	if ((size_t)(end - p) < length) {
+		return 0xfffd;
+	}
+	for (uint32_t i = 0; i < length; i++) {
+		if ((p[i] & 0xc0) != 0x80) {
+			return 0xfffd;
+		}
+		c = (c << 6) | (p[i] & 0x3f);
+	}
+	if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+		return 0xfffd;
+	}
+	*pText = p + length;
+	return c;
+}
+
+void
+TextCache::layout_run(TextRun* run) {
+	FontAtlas* pAtlas = run->pAtlas;
+	run->glyphs.clear();
+	run->pageMask = 0;
+	uint32_t sizeBits = run->size << (GLYPH_INDEX_BITS + GLYPH_TEXTURE_BITS);
+	float scale = run->size / pAtlas->baseSize;
+	float penX = run->position.x;
+	uint32_t previous = 0;
+
+	const unsigned char* p = (const unsigned char*)run->text.data();
+	const unsigned char* end = p + run->text.size();
+	while (p < end) {
+		uint32_t codepoint = decode_utf8(&p, end);
+		if (codepoint < FIRST_CHAR) {
+			continue;
+		}
+		if (previous != 0) {
+			penX += stbtt_GetCodepointKernAdvance(&pAtlas->fontInfo, previous, codepoint) *
+				pAtlas->scale * scale;
+		}
+		previous = codepoint;
+
+		const FontGlyph* glyph = get_glyph(pAtlas, codepoint);
+		// Glyphs still being rasterized are left out, the run is laid out
+		// again once they are in a page (the font's generation changes)
+		if (glyph->state == GLYPH_STATE_READY) {
+			const FontPage* page = &pAtlas->pages[glyph->page];
+			GPUGlyphInstance instance;
+			instance.position = { penX, run->position.y };
+			instance.glyph = sizeBits | (page->descriptorIndex << GLYPH_INDEX_BITS) |
+				glyph->tableIndex;
+			instance.color = run->color;
+			run->glyphs.push_back(instance);
+			run->pageMask |= 1u << glyph->page;
+		}
+		penX += glyph->xadvance * scale;
+	}
+	run->generation = pAtlas->generation;
+}
+
+void
+TextCache::add_text(const char* text, glm::vec2 position, float size,
+	FontAtlas* pAtlas, uint32_t color) {
+	// Sizes are whole pixels, see GPUGlyphInstance
+	uint32_t pixelSize = (uint32_t)(size + 0.5f);
+	pixelSize = pixelSize < 1 ? 1 : pixelSize;
+	pixelSize = pixelSize > MAX_TEXT_SIZE ? MAX_TEXT_SIZE : pixelSize;
+
+	size_t length = strlen(text);
+	uint64_t hash = hash_text_run(text, length, pAtlas, position, pixelSize, color);
+
+	TextRun* run = &_runs[hash];
+	if (run->pAtlas == pAtlas && run->generation == pAtlas->generation &&
+		run->position == position && run->size == pixelSize &&
+		run->color == color && run->text.size() == length &&
+		memcmp(run->text.data(), text, length) == 0) {
+		_current.hits++;
+	} else {
+		// New run, a hash collision which just replaces the old one, or
+		// glyphs arrived / were evicted since it was laid out
+		run->text.assign(text, length);
+		run->pAtlas = pAtlas;
+		run->position = position;
+		run->size = pixelSize;
+		run->color = color;
+		layout_run(run);
+		_current.misses++;
+	}
+	run->lastFrame = _frame;
+
+	// Keeps the pages this frame samples from being evicted while in flight
+	for (uint32_t i = 0; i < MAX_FONT_PAGES; i++) {
+		if (run->pageMask & (1u << i)) {
+			pAtlas->pages[i].lastUsedFrame = _frame;
+		}
+	}
+
+	if (run->glyphs.empty()) {
+		return;
+	}
+	size_t bytes = run->glyphs.size() * sizeof(GPUGlyphInstance);
+	void* data = _instances.alloc(bytes, sizeof(GPUGlyphInstance));
+	if (data == nullptr) {
+		_current.droppedGlyphs += static_cast<uint32_t>(run->glyphs.size());
+		return;
+	}
+	memcpy(data, run->glyphs.data(), bytes);
+	_current.glyphCount += static_cast<uint32_t>(run->glyphs.size());
+}
+
+void
+TextCache::next_frame() {
+	_frame++;
+	// Sweeping every frame is a waste, old runs only cost memory
+	if (_frame % TEXT_RUN_MAX_AGE == 0) {
+		for (auto it = _runs.begin(); it != _runs.end();) {
+			if (_frame - it->second.lastFrame > TEXT_RUN_MAX_AGE) {
+				it = _runs.erase(it);
+			} else {
+				it++;
+			}
+		}
+	}
+
+	_current.runCount = static_cast<uint32_t>(_runs.size());
+	_current.pendingGlyphs = _pendingGlyphs;
+	_current.evictedPages = _evictedPages;
+	_stats = _current;
+	_current = {};
+	_instances.next_frame();
+	_uploads.next_frame();
+}
@@ -1,13 +1,46 @@
 #ifndef VK_TEXT_H
 #define VK_TEXT_H
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../core/job_system.h"
 #include "vk_types.h"
+#include "vk_ring.h"
 
 #include <stb_truetype.h>
 
+// Printable ASCII, rasterized when a font is created and kept in its disk
+// cache. Everything else is rasterized the first time it is drawn.
 #define FIRST_CHAR	' '
 #define LAST_CHAR	'~'
-#define MAX_CHAR	97 // ('~' - ' ')
+
+// Distance fields. Glyphs are rasterized once at the font's base size with
+// SDF_PADDING pixels of distance around them, text.frag turns that into
+// sharp edges at any size.
+#define SDF_PADDING				6
+#define SDF_ON_EDGE				128
+#define SDF_DIST_SCALE			(SDF_ON_EDGE / (float)SDF_PADDING)
+
+// Each font owns MAX_FONT_PAGES square R8 pages glyphs are skyline packed
+// into. When they are full the least recently drawn page is emptied.
+#define FONT_PAGE_SIZE			1024
+#define MAX_FONT_PAGES			2
+// Empty texels between glyphs, so filtering never reads the neighbour
+#define FONT_GLYPH_GUTTER		1
+
+// Bits of GPUGlyphInstance::glyph, glyph table index | texture | pixel size
+#define GLYPH_INDEX_BITS		12
+#define GLYPH_TEXTURE_BITS		10
+#define GLYPH_SIZE_BITS			10
+#define MAX_TEXT_GLYPHS			(1 << GLYPH_INDEX_BITS)
+#define MAX_TEXT_SIZE			((1 << GLYPH_SIZE_BITS) - 1)
+#define TEXT_RING_BLOCK_SIZE	256 * 1024
+#define TEXT_UPLOAD_BLOCK_SIZE	256 * 1024
+// Runs not drawn for this many frames are dropped from the cache
+#define TEXT_RUN_MAX_AGE		120
 
 #define ENGINE_ERROR(MSG) \
 	fprintf(stderr, "[VulkanEngine Text] ERR: " MSG "\n");
@@ -18,29 +51,213 @@ struct FontCreateInfo {
 	DeviceDispatch* pDeviceDispatch;
 
 	const char*		ttfPath;
+	// Pixel size the distance fields are generated at
 	int				size;
-
-	VkCommandBuffer cmd;
-	VkFence			fence;
-	VkQueue			queue;
+	// The printable ASCII glyphs are stored here and reused while the font
+	// and the parameters match, nullptr always rasterizes them
+	const char*		cachePath = nullptr;
 };
 
-struct GlyphInfo {
-	glm::vec3 positions[4];
-	glm::vec2 uvs[4];
-	float offsetX = 0;
-	float offsetY = 0;
+struct SkylineNode {
+	int					x;
+	int					y;
+	int					width;
 };
 
-struct FontAtlas {
+struct FontPage {
 	AllocatedImage		texture;
 	uint32_t			descriptorIndex;
-	stbtt_packedchar	charInfo[MAX_CHAR];
+	std::vector<SkylineNode> skyline;
+	// Last frame a run using this page was drawn, see TextCache::add_text()
+	uint64_t			lastUsedFrame = 0;
+	uint32_t			glyphCount = 0;
+	// Still VK_IMAGE_LAYOUT_UNDEFINED / has to be zeroed before the next
+	// upload (new or evicted), both handled by TextCache::record_uploads()
+	uint32_t			initialized = 0;
+	uint32_t			needsClear = 1;
+};
+
+enum GlyphState : uint8_t {
+	// Being rasterized, left out of runs until it is in a page
+	GLYPH_STATE_PENDING,
+	GLYPH_STATE_READY,
+	// Nothing to draw (space), only moves the pen
+	GLYPH_STATE_EMPTY
+};
+
+struct FontGlyph {
+	GlyphState			state;
+	// Only valid once the glyph is GLYPH_STATE_READY
+	uint8_t				page;
+	uint16_t			tableIndex;
+	// At the font's base size
+	float				xadvance;
+};
+
+struct FontAtlas {
+	FontPage			pages[MAX_FONT_PAGES];
+	float				baseSize;
+	// stb_truetype's scale for baseSize
+	float				scale;
+	unsigned char*		pFontData = nullptr;
+	stbtt_fontinfo		fontInfo;
+
+	// Every codepoint drawn with this font since its page was last evicted
+	std::unordered_map<uint32_t, FontGlyph> glyphs;
+	// Bumped whenever glyphs become ready or are evicted, cached runs laid
+	// out against an older generation are laid out again
+	uint32_t			generation = 0;
+
+	std::string			cachePath;
+	uint64_t			cacheKey = 0;
 
 	uint32_t			create(FontCreateInfo* createInfo);
-	GlyphInfo			get_glyph_info(uint32_t c, float offsetX, float offsetY);
 	void				destroy(VkDevice device, DeviceDispatch* deviceDispatch,
 							VmaAllocator allocator);
 };
 
+struct TextCacheStats {
+	uint32_t			runCount;
+	// add_text() calls that reused a cached run / had to lay one out
+	uint32_t			hits;
+	uint32_t			misses;
+	uint32_t			glyphCount;
+	uint32_t			droppedGlyphs;
+	// Glyphs uploaded into a page / still being rasterized
+	uint32_t			uploadedGlyphs;
+	uint32_t			pendingGlyphs;
+	// Pages emptied to make room, since init
+	uint32_t			evictedPages;
+};
+
+/*
+* Screen space text. Strings are laid out once into runs of 16 byte glyph
+* instances (see GPUGlyphInstance), cached by string + font + position +
+* size + color. Drawing a cached run is a copy of its instances into a mapped
+* per-frame ring, the quads are expanded in text.vert from the glyph table.
+*
+* Glyphs are rasterized on the job scheduler the first time a string uses
+* them and show up a frame or two later. record_uploads() packs the finished
+* ones into the font's pages and copies them in.
+*/
+class TextCache {
+public:
+	// pScheduler may be nullptr, glyphs are then rasterized inline
+	void					init(VkDevice device, VmaAllocator allocator,
+								DeviceDispatch* pDeviceDispatch, JobScheduler* pScheduler);
+	void					destroy();
+
+	// Starts rasterizing the font's printable ASCII glyphs, or loads them
+	// from its disk cache
+	uint32_t				register_font(FontAtlas* pAtlas);
+	// Waits for the font's glyphs in flight and forgets everything about it
+	void					unregister_font(FontAtlas* pAtlas);
+
+	// UTF-8 'text', 'size' in pixels, any size renders from the same pages
+	void					add_text(const char* text, glm::vec2 position, float size,
+								FontAtlas* pAtlas, uint32_t color);
+
+	// Packs the glyphs finished since the last call and records their copies
+	// into the pages. Must come before any text is drawn in 'cmd'.
+	void					record_uploads(VkCommandBuffer cmd);
+
+	// Call once per submitted frame
+	void					next_frame();
+
+	VkDeviceAddress			get_glyph_table_addr() const { return _glyphTableAddr; }
+	const TransientRing&	get_instances() const { return _instances; }
+	// Numbers for the last completed frame
+	const TextCacheStats&	get_stats() const { return _stats; }
+
+private:
+	struct TextRun {
+		std::string			text;
+		FontAtlas*			pAtlas = nullptr;
+		glm::vec2			position = {};
+		uint32_t			size = 0;
+		uint32_t			color = 0;
+		uint64_t			lastFrame = 0;
+		// pAtlas->generation the run was laid out against
+		uint32_t			generation = 0;
+		// Bit per page the run's glyphs live in
+		uint32_t			pageMask = 0;
+		std::vector<GPUGlyphInstance> glyphs;
+	};
+
+	// One glyph being rasterized, owned by the worker until it is pushed to
+	// _completed
+	struct GlyphJob {
+		TextCache*			pCache;
+		FontAtlas*			pAtlas;
+		uint32_t			codepoint;
+		unsigned char*		pPixels;
+		int					width;
+		int					height;
+		int					xoff;
+		int					yoff;
+	};
+
+	struct GlyphUpload {
+		FontPage*			pPage;
+		VkBuffer			buffer;
+		VkBufferImageCopy	region;
+	};
+
+	// The ASCII glyphs of a font without a valid disk cache, written out
+	// once all of them went through record_uploads()
+	struct FontCacheWriter {
+		// Glyph records as they go on disk
+		std::vector<unsigned char> records;
+		uint32_t			count;
+		uint32_t			expected;
+	};
+
+	static void				rasterize_glyph(void* pData);
+
+	void					layout_run(TextRun* run);
+	FontGlyph*				get_glyph(FontAtlas* pAtlas, uint32_t codepoint,
+								GlyphJob* pRasterized = nullptr);
+	// 0 when there is no room in any page this frame
+	uint32_t				place_glyph(GlyphJob* job);
+	uint32_t				pack_glyph(FontAtlas* pAtlas, int width, int height,
+								uint32_t* pPage, int* pX, int* pY);
+	uint32_t				evict_page(FontAtlas* pAtlas, uint32_t forTableEntries,
+								uint32_t* pPage);
+	void					write_glyph(uint32_t tableIndex, const GlyphJob* job,
+								int x, int y);
+	void					add_to_font_cache(const GlyphJob* job);
+	void					free_job(GlyphJob* job);
+
+	VkDevice				_device;
+	VmaAllocator			_allocator;
+	DeviceDispatch*			_pDeviceDispatch;
+	JobScheduler*			_pScheduler;
+
+	std::unordered_map<uint64_t, TextRun> _runs;
+	TransientRing			_instances;
+
+	AllocatedBuffer			_glyphTable;
+	VkDeviceAddress			_glyphTableAddr;
+	std::vector<uint16_t>	_freeGlyphs;
+
+	JobCounter				_jobCounter;
+	std::mutex				_completedMutex;
+	std::vector<GlyphJob*>	_completed;
+	// Finished glyphs that didn't fit yet, retried every frame
+	std::vector<GlyphJob*>	_waiting;
+	uint32_t				_pendingGlyphs = 0;
+
+	// Staging for the glyph pixels, in flight until the frame's fence
+	TransientRing			_uploads;
+	std::vector<GlyphUpload> _pendingUploads;
+	std::vector<VkBufferImageCopy> _regions;
+
+	std::unordered_map<FontAtlas*, FontCacheWriter> _cacheWriters;
+
+	uint64_t				_frame = 0;
+	uint32_t				_evictedPages = 0;
+	TextCacheStats			_current = {};
+	TextCacheStats			_stats = {};
+};
+
 #endif /* VK_TEXT_H */
\ No newline at end of file
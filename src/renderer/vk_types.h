@@ -13,6 +13,8 @@
 #include <stdint.h>
 #include <string>
 
+#include "../core/linear_arena.h"
+
 /*---------------------------
 |  FLAGS AND CONSTANTS
 ---------------------------*/
@@ -22,6 +24,14 @@
 #define MAX_DIR_LIGHTS		64
 #define MAX_SPOT_LIGHTS		64
 
+// Number of frames the CPU may record ahead of the GPU
+constexpr unsigned int FRAME_OVERLAP = 2;
+
+// Buffers the CPU writes while a frame is being recorded, which is before
+// draw() waits on that frame's fence, need one more copy than there are
+// frames in flight
+constexpr unsigned int TRANSIENT_FRAME_COUNT = FRAME_OVERLAP + 1;
+
 typedef uint32_t			RenderDebugFlags;
 
 enum RenderDebugFlagBits : uint32_t {
@@ -40,6 +50,7 @@ struct AllocatedImage {
 	VmaAllocation allocation;
 	VkExtent3D imageExtent;
 	VkFormat imageFormat;
+	uint32_t mipLevels;
 };
 
 struct ImguiLoaderData {
@@ -51,6 +62,9 @@ struct Surface {
 	uint32_t startIndex;
 	uint32_t count;
 	uint32_t materialID;
+	// Center of the bounds of the vertices the surface indexes, in mesh
+	// space. Filled in by upload_mesh().
+	glm::vec3 boundsCenter;
 };
 
 struct Mesh {
@@ -58,16 +72,8 @@ struct Mesh {
 	std::vector<Surface>	surfaces;
 	VkDeviceSize			indexOffset;
 	VkDeviceSize			vertexOffset;
-};
-
-// Holy padding - fuckin fix this
-struct Material {
-	glm::vec3 ambient;
-	char padding1[4];
-	glm::vec3 diffuse;
-	char padding2[4];
-	glm::vec3 specular;
-	float shininess;
+	// Positions only, see GPUPositionStreamHeader
+	VkDeviceSize			positionOffset;
 };
 
 /*---------------------------
@@ -90,16 +96,15 @@ struct TriangleVertex {
 	char		padding[4];
 };
 
-// This struct is used for text
-struct TextVertex {
+// This struct is used for cached debug geometry, the color is packed RGBA8
+struct DebugVertex {
 	glm::vec3	position;
-	char		padding1[4];
-	glm::vec2	uv;
-	char		padding2[8];
-	glm::vec3	color;
-	uint32_t	fontDescriptorIndex;
+	uint32_t	color;
+	glm::vec3	normal;
+	float		padding;
 };
 
+// This struct is used for text
 // This struct is used for simple line drawing
 struct LineVertex {
 	glm::vec4	color;
@@ -117,6 +122,10 @@ struct Transform {
 	glm::vec3 scale;
 };
 
+// Handle to an object living in the retained render scene
+typedef uint32_t			RenderObjectHandle;
+#define INVALID_RENDER_OBJECT	UINT32_MAX
+
 enum class LightType : uint32_t {
 	Direction,
 	Point,
@@ -143,19 +152,27 @@ struct SurfaceDrawData {
 	VkDeviceAddress indexBufferAddr;
 
 	uint32_t		materialID;
+	// MaterialPass and cull mode of the material
+	uint32_t		pass;
+	VkCullModeFlags	cullMode;
 
 	glm::mat4		transform;
+	// Surface::boundsCenter in world space, what the draws are sorted by
+	glm::vec3		boundsCenter;
 	VkDeviceAddress vertexBufferAddr;
+	VkDeviceAddress positionBufferAddr;
 };
 
-struct TextDrawDataS {
-	std::vector<TextVertex> vertices;
-	std::vector<uint32_t>	indices;
-};
-
-struct WireframeDrawDataS {
-	std::vector<Vertex>		vertices;
-	std::vector<uint32_t>	indices;
+// One indexed wireframe draw. Either a mesh already in the geometry buffer
+// or one written into the wireframe ring this frame, nothing is copied.
+struct WireframeDrawData {
+	VkBuffer				indexBuffer;
+	VkDeviceSize			indexOffset;
+	uint32_t				firstIndex;
+	uint32_t				indexCount;
+	VkDeviceAddress			vertexBufferAddr;
+	glm::mat4				transform;
+	glm::vec4				color;
 };
 
 /*---------------------------
@@ -166,8 +183,56 @@ struct GPUSceneData {
 	glm::mat4		view;
 	glm::mat4		proj;
 	glm::mat4		orthoProj;
+	// Bindless slots, see BindlessRegistry
+	uint32_t		shadowMapTexture;
+	uint32_t		skyboxTexture;
+	uint32_t		linearSampler;
+	uint32_t		trilinearSampler;
+	glm::vec3		viewPos;
+	float			padding;
+};
+
+// Start of a mesh's position stream, the positions of every vertex follow:
+// 3 floats each, or when quantized 3 uint16 and one of padding that map
+// [0, 65535] onto boundsMin + q * boundsScale. Passes that only need
+// positions read 8 or 12 bytes per vertex instead of a whole Vertex.
+// Mirrored by PositionBuffer in the vertex shaders.
+struct GPUPositionStreamHeader {
+	glm::vec3		boundsMin;
+	uint32_t		quantized;
+	glm::vec3		boundsScale;
+	uint32_t		padding;
+};
+
+// Texture slot of a GPUMaterial without that texture
+#define MATERIAL_NO_TEXTURE		0xffffffffu
+
+enum MaterialFlagBits : uint32_t {
+	// Fragments under alphaCutoff are discarded
+	MATERIAL_ALPHA_MASK_BIT = 1 << 0,
+	// Drawn blended after the opaque surfaces
+	MATERIAL_ALPHA_BLEND_BIT = 1 << 1,
+	MATERIAL_DOUBLE_SIDED_BIT = 1 << 2
 };
 
+// glTF metallic-roughness material, the textures are bindless slots sampled
+// with the scene's trilinear sampler. Mirrored by Material in mesh.frag.
+struct GPUMaterial {
+	glm::vec4		baseColorFactor;
+	glm::vec3		emissiveFactor;
+	float			metallicFactor;
+	float			roughnessFactor;
+	float			alphaCutoff;
+	uint32_t		baseColorTexture;
+	// Roughness in G, metalness in B
+	uint32_t		metallicRoughnessTexture;
+	uint32_t		normalTexture;
+	uint32_t		occlusionTexture;
+	uint32_t		emissiveTexture;
+	uint32_t		flags;
+};
+static_assert(sizeof(GPUMaterial) == 64, "GPUMaterial must match the std430 Material");
+
 struct GPUDrawPushConstants {
 	VkDeviceAddress sceneBuffer;
 	VkDeviceAddress vertexBuffer;
@@ -175,19 +240,78 @@ struct GPUDrawPushConstants {
 	VkDeviceAddress lightBuffer;
 	uint32_t		lightCount;
 	uint32_t		materialID;
-	// Hopefully something will fill this padding
-	char			padding[8];
+	// When non-zero the shaders ignore vertexBuffer/positionBuffer/
+	// materialID/model and read them from GPUDrawData[gl_InstanceIndex]
+	VkDeviceAddress	drawDataBuffer;
 	glm::mat4		model;
-	glm::vec3		viewPos;
+	// Where gl_Position comes from, the same stream in every pass
+	VkDeviceAddress	positionBuffer;
 };
 
 struct GPUShadowPushConstants {
 	glm::mat4		model;
 	glm::mat4		lightSpaceMatrix;
-	VkDeviceAddress vertexBuffer;
+	VkDeviceAddress positionBuffer;
+	VkDeviceAddress drawDataBuffer;
 	//VkDeviceAddress lightBuffer; THESE WERE FOR GPU DRIVEN SHADOW MAPPING
 	//uint32_t		lightCount;
 };
 
+// One glyph quad of a text run, expanded to 6 vertices in text.vert
+struct GPUGlyphInstance {
+	// Pen position in screen pixels
+	glm::vec2		position;
+	// Glyph table index, font texture index and pixel size, packed as
+	// described by the GLYPH_*_BITS defines in vk_text.h
+	uint32_t		glyph;
+	// RGBA8
+	uint32_t		color;
+};
+
+// Quad corners relative to the pen position (in units of the font's base
+// size) and atlas uvs, both as (x0, y0, x1, y1)
+struct GPUGlyph {
+	glm::vec4		plane;
+	glm::vec4		uv;
+};
+
+struct GPUTextPushConstants {
+	VkDeviceAddress	sceneBuffer;
+	VkDeviceAddress	instanceBuffer;
+	VkDeviceAddress	glyphBuffer;
+};
+
+struct GPUWireframePushConstants {
+	glm::mat4		model;
+	glm::vec4		color;
+	VkDeviceAddress sceneBuffer;
+	VkDeviceAddress vertexBuffer;
+	// Same as in GPUDrawPushConstants
+	VkDeviceAddress	drawDataBuffer;
+};
+
+// One record per surface of a retained render object. The indirect draw
+// command's firstInstance points at the record.
+struct GPUDrawData {
+	glm::mat4		model;
+	VkDeviceAddress vertexBuffer;
+	VkDeviceAddress positionBuffer;
+	uint32_t		materialID;
+	// std430 rounds the struct up to its mat4 alignment
+	uint32_t		padding[3];
+};
+static_assert(sizeof(GPUDrawData) == 96, "GPUDrawData must match the std430 DrawData");
+
+// One instance of a cached debug mesh
+struct GPUDebugInstance {
+	glm::mat4		model;
+	glm::vec4		color;
+};
+
+struct GPUDebugPushConstants {
+	VkDeviceAddress	sceneBuffer;
+	VkDeviceAddress	vertexBuffer;
+	VkDeviceAddress	instanceBuffer;
+};
 
 #endif /* VK_TYPES_H */
@@ -31,7 +31,7 @@ void play_render(Game* pGame) {
 	};
 	vulkanEngine->add_light(&testLight);
 	pGame->entityManager.system_render_update(vulkanEngine);
-	vulkanEngine->draw_text("Testing text", 64, 64, &vulkanEngine->defaultFont);
+	vulkanEngine->draw_text("Testing text", 64, 64, 32, &vulkanEngine->defaultFont);
 	vulkanEngine->draw();
 }
 
@@ -85,6 +85,55 @@ void edit_render(Game* pGame) {
 
 	if (ImGui::Begin("Physics Debugging")) {
 		ImGui::CheckboxFlags("Body Wireframe", &pGame->physicsContext._debugFlags, PHYSICS_DEBUG_BODY_WIREFRAME_BIT);
+		const DebugGeometryStats& debugStats = vulkanEngine->get_debug_geometry_stats();
+		ImGui::Text("Debug draw: %u meshes, %u instances in %u draws",
+			debugStats.meshCount, debugStats.instanceCount, debugStats.batchCount);
+		if (debugStats.droppedInstances > 0) {
+			ImGui::Text("Dropped: %u instances", debugStats.droppedInstances);
+		}
+
+		const uint32_t tickRates[] = { 30, 60, 120 };
+		const char* tickRateNames[] = { "30 Hz", "60 Hz", "120 Hz" };
+		int tickRate = 0;
+		for (int i = 0; i < 3; i++) {
+			if (tickRates[i] == pGame->physicsContext.get_tick_rate()) tickRate = i;
+		}
+		if (ImGui::Combo("Tick Rate", &tickRate, tickRateNames, 3)) {
+			pGame->physicsContext.set_tick_rate(tickRates[tickRate]);
+		}
+
+		const char* smoothingNames[] = { "None", "Interpolate", "Extrapolate" };
+		int smoothing = pGame->entityManager._physicsSmoothing;
+		if (ImGui::Combo("Smoothing", &smoothing, smoothingNames, 3)) {
+			pGame->entityManager.set_physics_smoothing((PhysicsSmoothing)smoothing);
+		}
+
+		const CharacterPoolStats& characterStats =
+			pGame->physicsContext.get_character_pool()->get_stats();
+		ImGui::Text("Characters: %u in %u batches", characterStats.activeCount,
+			characterStats.batchCount);
+		ImGui::Text("Character update: %.3f ms (slowest batch %.3f ms, %.2f us/character)",
+			characterStats.updateMs, characterStats.slowestBatchMs,
+			characterStats.perCharacterUs);
+	}
+	ImGui::End();
+
+	if (ImGui::Begin("Job System")) {
+		JobThreadStats stats[MAX_JOB_THREADS + 1];
+		uint32_t workerCount = pGame->jobScheduler.get_worker_count();
+		pGame->jobScheduler.sample_stats(stats);
+		for (uint32_t i = 0; i <= workerCount; i++) {
+			if (i < workerCount) {
+				ImGui::Text("Worker %2u: %5.1f%%  %5llu jobs  %5llu stolen", i,
+					stats[i].utilization * 100.f,
+					(unsigned long long)stats[i].jobsExecuted,
+					(unsigned long long)stats[i].jobsStolen);
+			} else {
+				ImGui::Text("External : %5.1f%%  %5llu jobs",
+					stats[i].utilization * 100.f,
+					(unsigned long long)stats[i].jobsExecuted);
+			}
+		}
 	}
 	ImGui::End();
 
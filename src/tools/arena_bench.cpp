@@ -0,0 +1,176 @@
+/*
+* arena_bench - compares recording per-frame draw data into std::vectors
+* (clear() every frame, the old DrawContext path) with ArenaArrays in a
+* LinearArena reset every frame (the current DrawContext path).
+*
+*	arena_bench [--lines N] [--triangles N] [--frames N]
+*
+* The vertex structs match LineVertex/TriangleVertex in layout so the memory
+* traffic is the same as in the renderer, without pulling in glm/Vulkan.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../core/linear_arena.h"
+
+#define FRAMES_IN_FLIGHT	2
+
+struct BenchVertex {
+	float	color[4];
+	float	position[3];
+	char	padding[4];
+};
+
+struct BenchResult {
+	float	firstFrameMs;
+	float	averageMs;
+	float	worstMs;
+};
+
+// Stops the compiler from dropping the writes
+static volatile float gSink;
+
+static void
+fill_line(BenchVertex* v, uint32_t i) {
+	float f = (float)i;
+	v[0] = { { 1.f, 0.f, 0.f, 1.f }, { f, 0.f, 0.f } };
+	v[1] = { { 1.f, 0.f, 0.f, 1.f }, { f, 1.f, 0.f } };
+}
+
+static void
+fill_triangle(BenchVertex* v, uint32_t i) {
+	float f = (float)i;
+	v[0] = { { 0.f, 1.f, 0.f, 1.f }, { f, 0.f, 0.f } };
+	v[1] = { { 0.f, 1.f, 0.f, 1.f }, { f, 1.f, 0.f } };
+	v[2] = { { 0.f, 1.f, 0.f, 1.f }, { f, 0.f, 1.f } };
+}
+
+static void
+summarize(const std::vector<float>& times, BenchResult* pResult) {
+	pResult->firstFrameMs = times[0];
+	pResult->averageMs = 0.f;
+	pResult->worstMs = 0.f;
+	// The first frame is warm-up for both paths, report it separately
+	for (size_t i = 1; i < times.size(); i++) {
+		pResult->averageMs += times[i];
+		pResult->worstMs = times[i] > pResult->worstMs ? times[i] : pResult->worstMs;
+	}
+	pResult->averageMs /= (float)(times.size() - 1);
+}
+
+static void
+bench_vectors(uint32_t lines, uint32_t triangles, uint32_t frames, BenchResult* pResult) {
+	std::vector<BenchVertex> lineData;
+	std::vector<BenchVertex> triangleData;
+	std::vector<float> times(frames);
+
+	for (uint32_t f = 0; f < frames; f++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < lines; i++) {
+			BenchVertex v[2];
+			fill_line(v, i);
+			lineData.push_back(v[0]);
+			lineData.push_back(v[1]);
+		}
+		for (uint32_t i = 0; i < triangles; i++) {
+			BenchVertex v[3];
+			fill_triangle(v, i);
+			triangleData.push_back(v[0]);
+			triangleData.push_back(v[1]);
+			triangleData.push_back(v[2]);
+		}
+		gSink = lineData.back().position[0] + triangleData.back().position[0];
+		lineData.clear();
+		triangleData.clear();
+		auto end = std::chrono::high_resolution_clock::now();
+		times[f] = std::chrono::duration<float, std::milli>(end - start).count();
+	}
+	summarize(times, pResult);
+}
+
+static void
+bench_arena(uint32_t lines, uint32_t triangles, uint32_t frames, BenchResult* pResult,
+	LinearArenaStats* pStats) {
+	LinearArena arenas[FRAMES_IN_FLIGHT];
+	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		// Deliberately small so the growth path is part of the measurement
+		arenas[i].init(64 * 1024);
+	}
+	ArenaArray<BenchVertex> lineData;
+	ArenaArray<BenchVertex> triangleData;
+	std::vector<float> times(frames);
+
+	uint32_t arenaIndex = 0;
+	lineData.set_arena(&arenas[arenaIndex]);
+	triangleData.set_arena(&arenas[arenaIndex]);
+
+	for (uint32_t f = 0; f < frames; f++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t i = 0; i < lines; i++) {
+			fill_line(lineData.push_n(2), i);
+		}
+		for (uint32_t i = 0; i < triangles; i++) {
+			fill_triangle(triangleData.push_n(3), i);
+		}
+		gSink = lineData[lineData.size() - 1].position[0] +
+			triangleData[triangleData.size() - 1].position[0];
+
+		// Same as DrawContext::clear()
+		lineData.clear();
+		triangleData.clear();
+		arenaIndex = (arenaIndex + 1) % FRAMES_IN_FLIGHT;
+		arenas[arenaIndex].reset();
+		lineData.set_arena(&arenas[arenaIndex]);
+		triangleData.set_arena(&arenas[arenaIndex]);
+		auto end = std::chrono::high_resolution_clock::now();
+		times[f] = std::chrono::duration<float, std::milli>(end - start).count();
+	}
+	summarize(times, pResult);
+
+	*pStats = arenas[0].get_stats();
+	for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+		arenas[i].deinit();
+	}
+}
+
+int
+main(int argc, char** argv) {
+	uint32_t lines = 100000;
+	uint32_t triangles = 100000;
+	uint32_t frames = 200;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+			lines = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--triangles") == 0 && i + 1 < argc) {
+			triangles = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+			frames = (uint32_t)atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: arena_bench [--lines N] [--triangles N] [--frames N]\n");
+			return 1;
+		}
+	}
+	if (frames < 2) {
+		frames = 2;
+	}
+
+	BenchResult vectorResult, arenaResult;
+	LinearArenaStats arenaStats;
+	bench_vectors(lines, triangles, frames, &vectorResult);
+	bench_arena(lines, triangles, frames, &arenaResult, &arenaStats);
+
+	printf("%u lines + %u triangles per frame, %u frames\n", lines, triangles, frames);
+	printf("%-8s %12s %12s %12s\n", "", "first (ms)", "avg (ms)", "worst (ms)");
+	printf("%-8s %12.3f %12.3f %12.3f\n", "vector",
+		vectorResult.firstFrameMs, vectorResult.averageMs, vectorResult.worstMs);
+	printf("%-8s %12.3f %12.3f %12.3f\n", "arena",
+		arenaResult.firstFrameMs, arenaResult.averageMs, arenaResult.worstMs);
+	printf("arena: capacity %.1f KB, high-water %.1f KB, %u block allocations\n",
+		arenaStats.capacity / 1024.f, arenaStats.highWater / 1024.f,
+		arenaStats.blockAllocations);
+	return 0;
+}
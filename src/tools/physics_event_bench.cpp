@@ -0,0 +1,247 @@
+/*
+* physics_event_bench - drops a pile of boxes onto a floor and times the
+* physics step with the old listeners (an fprintf per callback from the
+* worker threads) against the current ones (push into a PhysicsEventQueue,
+* drained on the main thread after every step).
+*
+*	physics_event_bench [--bodies N] [--steps N] [--threads N]
+*
+* The logging listeners write to stderr like the old ones did, the results
+* go to stdout, so run it with 2>/dev/null (or 2>file) to keep the terminal
+* out of the measurement.
+*/
+#include <Jolt/Jolt.h>
+#include <Jolt/RegisterTypes.h>
+#include <Jolt/Core/Factory.h>
+#include <Jolt/Core/TempAllocator.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../core/job_system.h"
+#include "../physics/phys_events.h"
+#include "../physics/phys_jobs.h"
+#include "../physics/phys_layers.h"
+
+#define TEMP_ALLOC_SIZE		32 * 1024 * 1024
+#define PILE_WIDTH			20
+
+enum BenchMode : uint32_t {
+	BENCH_MODE_NONE = 0,
+	BENCH_MODE_LOG = 1,
+	BENCH_MODE_QUEUE = 2,
+	BENCH_MODE_COUNT = 3
+};
+
+static const char* BENCH_MODE_NAMES[BENCH_MODE_COUNT] = { "no listeners", "logging", "queue" };
+
+// The listeners as they were before the event queue
+class LoggingContactListener : public ContactListener
+{
+public:
+	virtual ValidateResult OnContactValidate(
+		const Body& inBody1,
+		const Body& inBody2, RVec3Arg inBaseOffset,
+		const CollideShapeResult& inCollisionResult) override
+	{
+		fprintf(stderr, "[Physics] Contact validate callback\n");
+		return ValidateResult::AcceptAllContactsForThisBodyPair;
+	}
+
+	virtual void OnContactAdded(
+		const Body& inBody1,
+		const Body& inBody2,
+		const ContactManifold& inManifold,
+		ContactSettings& ioSettings) override
+	{
+		fprintf(stderr, "[Physics] A contact was added\n");
+	}
+
+	virtual void OnContactPersisted(
+		const Body& inBody1,
+		const Body& inBody2,
+		const ContactManifold& inManifold,
+		ContactSettings& ioSettings) override
+	{
+		fprintf(stderr, "[Physics] A contact was persisted\n");
+	}
+
+	virtual void OnContactRemoved(const SubShapeIDPair& inSubShapePair) override
+	{
+		fprintf(stderr, "[Physics] A contact was removed\n");
+	}
+};
+
+class LoggingBodyActivationListener : public BodyActivationListener
+{
+public:
+	virtual void OnBodyActivated(
+		const BodyID& inBodyID,
+		uint64 inBodyUserData) override
+	{
+		fprintf(stderr, "[Physics] A body got activated\n");
+	}
+
+	virtual void OnBodyDeactivated(
+		const BodyID& inBodyID,
+		uint64 inBodyUserData) override
+	{
+		fprintf(stderr, "[Physics] A body went to sleep\n");
+	}
+};
+
+struct BenchResult {
+	float		totalMs;
+	float		averageMs;
+	float		worstMs;
+	uint64_t	events;
+};
+
+static void
+bench(BenchMode mode, uint32_t bodies, uint32_t steps, JobSystem* pJobSystem,
+	TempAllocator* pTempAllocator, BenchResult* pResult) {
+	BPLayerInterfaceImpl broadPhaseLayerInterface;
+	ObjectVsBroadPhaseLayerFilterImpl objectVsBroadPhaseLayerFilter;
+	ObjectLayerPairFilterImpl objectVsObjectLayerFilter;
+
+	// Sized like a level load, see PhysicsContextInfo
+	PhysicsSystem* physicsSystem = new PhysicsSystem();
+	physicsSystem->Init(bodies + 1, 0, bodies * 8, bodies * 8, broadPhaseLayerInterface,
+		objectVsBroadPhaseLayerFilter, objectVsObjectLayerFilter);
+
+	LoggingContactListener loggingContactListener;
+	LoggingBodyActivationListener loggingActivationListener;
+	PhysicsEventQueue eventQueue;
+	ContactListenerImpl contactListener;
+	BodyActivationListenerImpl activationListener;
+	contactListener.pEventQueue = &eventQueue;
+	activationListener.pEventQueue = &eventQueue;
+
+	if (mode == BENCH_MODE_LOG) {
+		physicsSystem->SetContactListener(&loggingContactListener);
+		physicsSystem->SetBodyActivationListener(&loggingActivationListener);
+	} else if (mode == BENCH_MODE_QUEUE) {
+		physicsSystem->SetContactListener(&contactListener);
+		physicsSystem->SetBodyActivationListener(&activationListener);
+	}
+
+	BodyInterface& bodyInterface = physicsSystem->GetBodyInterface();
+	bodyInterface.CreateAndAddBody(BodyCreationSettings(new BoxShape(Vec3(100.f, 1.f, 100.f)),
+		RVec3(0.f, -1.f, 0.f), Quat::sIdentity(), EMotionType::Static, Layers::STATIC),
+		EActivation::DontActivate);
+
+	// A tight column of boxes so most of them are touching for the whole run
+	Ref<Shape> boxShape = new BoxShape(Vec3(0.5f, 0.5f, 0.5f));
+	BodyIDVector bodyIDs;
+	bodyIDs.reserve(bodies);
+	for (uint32_t i = 0; i < bodies; i++) {
+		uint32_t x = i % PILE_WIDTH;
+		uint32_t z = (i / PILE_WIDTH) % PILE_WIDTH;
+		uint32_t y = i / (PILE_WIDTH * PILE_WIDTH);
+		BodyCreationSettings settings(boxShape,
+			RVec3(x * 1.05f - PILE_WIDTH * 0.5f, 0.5f + y * 1.05f, z * 1.05f - PILE_WIDTH * 0.5f),
+			Quat::sIdentity(), EMotionType::Dynamic, Layers::DYNAMIC);
+		Body* body = bodyInterface.CreateBody(settings);
+		if (body == nullptr) {
+			break;
+		}
+		bodyIDs.push_back(body->GetID());
+	}
+	BroadPhase::AddState state = bodyInterface.AddBodiesPrepare(bodyIDs.data(), (int)bodyIDs.size());
+	bodyInterface.AddBodiesFinalize(bodyIDs.data(), (int)bodyIDs.size(), state, EActivation::Activate);
+	physicsSystem->OptimizeBroadPhase();
+
+	std::vector<PhysicsEvent> events;
+	pResult->totalMs = 0.f;
+	pResult->worstMs = 0.f;
+	pResult->events = 0;
+	for (uint32_t s = 0; s < steps; s++) {
+		auto start = std::chrono::high_resolution_clock::now();
+		physicsSystem->Update(1.f / 60.f, 1, pTempAllocator, pJobSystem);
+		if (mode == BENCH_MODE_QUEUE) {
+			// Same as PhysicsContext::update(), drained after every step
+			events.clear();
+			eventQueue.drain(&events);
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+
+		float ms = std::chrono::duration<float, std::milli>(end - start).count();
+		pResult->totalMs += ms;
+		pResult->worstMs = ms > pResult->worstMs ? ms : pResult->worstMs;
+		pResult->events += events.size();
+	}
+	pResult->averageMs = pResult->totalMs / (float)steps;
+
+	uint32_t dropped = eventQueue.reset_dropped();
+	if (dropped > 0) {
+		printf("[Bench] %s: dropped %u events, buffers are full.\n", BENCH_MODE_NAMES[mode], dropped);
+	}
+
+	bodyInterface.RemoveBodies(bodyIDs.data(), (int)bodyIDs.size());
+	bodyInterface.DestroyBodies(bodyIDs.data(), (int)bodyIDs.size());
+	delete physicsSystem;
+}
+
+int
+main(int argc, char* argv[]) {
+	uint32_t bodies = 5000;
+	uint32_t steps = 300;
+	uint32_t threads = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--bodies") == 0 && i + 1 < argc) {
+			bodies = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc) {
+			steps = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = (uint32_t)atoi(argv[++i]);
+		} else {
+			fprintf(stderr, "usage: physics_event_bench [--bodies N] [--steps N] [--threads N]\n");
+			return 2;
+		}
+	}
+	if (bodies == 0 || steps == 0) {
+		fprintf(stderr, "[Bench] Need at least one body and one step.\n");
+		return 2;
+	}
+
+	RegisterDefaultAllocator();
+	Factory::sInstance = new Factory();
+	RegisterTypes();
+
+	JobScheduler scheduler;
+	JobSchedulerInfo jobInfo = {};
+	jobInfo.threadCount = threads;
+	scheduler.init(&jobInfo);
+
+	TempAllocatorImpl* tempAllocator = new TempAllocatorImpl(TEMP_ALLOC_SIZE);
+	JoltJobSystem* jobSystem = new JoltJobSystem(&scheduler, cMaxPhysicsJobs, cMaxPhysicsBarriers);
+
+	printf("[Bench] %u boxes, %u steps at 60 Hz\n", bodies, steps);
+	for (uint32_t mode = 0; mode < BENCH_MODE_COUNT; mode++) {
+		BenchResult result;
+		bench((BenchMode)mode, bodies, steps, jobSystem, tempAllocator, &result);
+		printf("[Bench] %-12s total %9.2f ms, avg %7.3f ms, worst %7.3f ms",
+			BENCH_MODE_NAMES[mode], result.totalMs, result.averageMs, result.worstMs);
+		if (mode == BENCH_MODE_QUEUE) {
+			printf(", %llu events", (unsigned long long)result.events);
+		}
+		printf("\n");
+	}
+
+	delete jobSystem;
+	delete tempAllocator;
+	scheduler.deinit();
+
+	UnregisterTypes();
+	delete Factory::sInstance;
+	Factory::sInstance = nullptr;
+	return 0;
+}
@@ -0,0 +1,394 @@
+/*
+* physics_replay - re-runs a recording made with PhysicsContextInfo::pRecordPath
+* through a bare PhysicsSystem, without the renderer or the ECS.
+*
+*	physics_replay <recording> [--threads N] [--repeat N]
+*
+* Prints per-step timings and compares the state hash after every step with
+* the recorded one. Exits with 1 if the replay diverged. A log cut short by a
+* crash replays up to the last complete record.
+*/
+#include <Jolt/Jolt.h>
+#include <Jolt/RegisterTypes.h>
+#include <Jolt/Core/Factory.h>
+#include <Jolt/Core/TempAllocator.h>
+#include <Jolt/Physics/PhysicsSettings.h>
+#include <Jolt/Physics/PhysicsSystem.h>
+#include <Jolt/Physics/Collision/Shape/BoxShape.h>
+#include <Jolt/Physics/Body/BodyCreationSettings.h>
+#include <Jolt/Physics/Character/Character.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "../core/job_system.h"
+#include "../physics/phys_jobs.h"
+#include "../physics/phys_layers.h"
+#include "../physics/phys_record.h"
+
+#define TEMP_ALLOC_SIZE		10 * 1024 * 1024
+
+struct ReplayResult {
+	std::vector<float>	stepTimes;
+	uint32_t			mismatches;
+	uint32_t			firstMismatch;
+	// Set when the log ends partway through a record, which is what a
+	// crash mid-write leaves behind. Steps before it are still valid.
+	uint32_t			truncated;
+	uint32_t			truncatedRecord;
+};
+
+static uint32_t
+read_record(FILE* file, void* pData, size_t size) {
+	return size == 0 || fread(pData, size, 1, file) == 1;
+}
+
+static uint32_t
+replay(FILE* file, const PhysicsRecordHeader* pHeader, JobScheduler* pScheduler,
+	JobSystem* pJobSystem, TempAllocator* pTempAllocator, ReplayResult* pResult) {
+	BPLayerInterfaceImpl broadPhaseLayerInterface;
+	ObjectVsBroadPhaseLayerFilterImpl objectVsBroadPhaseLayerFilter;
+	ObjectLayerPairFilterImpl objectVsObjectLayerFilter;
+
+	PhysicsSystem* physicsSystem = new PhysicsSystem();
+	physicsSystem->Init(pHeader->maxBodies, pHeader->numBodyMutexes, pHeader->maxBodyPairs,
+		pHeader->maxContactConstraints, broadPhaseLayerInterface,
+		objectVsBroadPhaseLayerFilter, objectVsObjectLayerFilter);
+	BodyInterface& bodyInterface = physicsSystem->GetBodyInterface();
+
+	CharacterPool* characterPool = new CharacterPool();
+	characterPool->init(physicsSystem, pScheduler, &objectVsBroadPhaseLayerFilter,
+		&objectVsObjectLayerFilter);
+	std::unordered_map<uint32_t, CharacterHandle> characterHandles;
+
+	std::map<std::tuple<float, float, float>, Ref<Shape>> boxShapes;
+	std::unordered_map<uint32_t, BodyID> bodyIDs;
+	std::vector<BodyID> pendingBodies;
+	// addNow of the last recorded box, see PhysicsRecordAddBox
+	uint32_t pendingAddNow = 0;
+	std::vector<Character*> characters;
+
+	pResult->stepTimes.clear();
+	pResult->mismatches = 0;
+	pResult->firstMismatch = UINT32_MAX;
+	pResult->truncated = 0;
+	pResult->truncatedRecord = 0;
+
+	uint32_t ok = 1;
+	uint32_t recordIndex = 0;
+	PhysicsRecordType type;
+	for (; ok && fread(&type, sizeof(type), 1, file) == 1; recordIndex++) {
+		switch (type) {
+		case PHYSICS_RECORD_ADD_BOX: {
+			PhysicsRecordAddBox r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+
+			auto key = std::make_tuple(r.extent[0], r.extent[1], r.extent[2]);
+			Ref<Shape>& shape = boxShapes[key];
+			if (shape == nullptr) {
+				shape = new BoxShape(Vec3(r.extent[0], r.extent[1], r.extent[2]));
+			}
+
+			BodyCreationSettings settings(shape,
+				RVec3(r.position[0], r.position[1], r.position[2]),
+				Quat(r.rotation[0], r.rotation[1], r.rotation[2], r.rotation[3]),
+				(EMotionType)r.motionType, (ObjectLayer)r.layer);
+			settings.mIsSensor = r.isSensor;
+
+			Body* body = bodyInterface.CreateBody(settings);
+			if (body == nullptr) {
+				fprintf(stderr, "[Replay] Ran out of bodies.\n");
+				ok = 0;
+				break;
+			}
+			if (body->GetID().GetIndexAndSequenceNumber() != r.bodyID) {
+				fprintf(stderr, "[Replay] Body id %u was recorded as %u, creation order differs.\n",
+					body->GetID().GetIndexAndSequenceNumber(), r.bodyID);
+			}
+			bodyIDs[r.bodyID] = body->GetID();
+			pendingBodies.push_back(body->GetID());
+			pendingAddNow = r.addNow;
+			break;
+		}
+		case PHYSICS_RECORD_COMMIT_BODIES: {
+			PhysicsRecordCommitBodies r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			EActivation activation = r.activate ? EActivation::Activate : EActivation::DontActivate;
+
+			// Bodies added on their own went through CreateAndAddBody,
+			// batches through the prepare/finalize path, the broadphase ends
+			// up different otherwise. A batch can hold a single body so the
+			// recorded flag decides, not the count.
+			if (pendingAddNow) {
+				for (size_t i = 0; i < pendingBodies.size(); i++) {
+					bodyInterface.AddBody(pendingBodies[i], activation);
+				}
+			} else if (!pendingBodies.empty()) {
+				BroadPhase::AddState state = bodyInterface.AddBodiesPrepare(
+					pendingBodies.data(), (int)pendingBodies.size());
+				bodyInterface.AddBodiesFinalize(pendingBodies.data(),
+					(int)pendingBodies.size(), state, activation);
+			}
+			pendingBodies.clear();
+			pendingAddNow = 0;
+			break;
+		}
+		case PHYSICS_RECORD_REMOVE_BODY: {
+			PhysicsRecordRemoveBody r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			auto it = bodyIDs.find(r.bodyID);
+			if (it != bodyIDs.end()) {
+				bodyInterface.RemoveBody(it->second);
+				bodyInterface.DestroyBody(it->second);
+				bodyIDs.erase(it);
+			}
+			break;
+		}
+		case PHYSICS_RECORD_ADD_CHARACTER: {
+			PhysicsRecordAddCharacter r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			Ref<CharacterSettings> settings = create_character_settings(r.radius, r.height);
+			Character* c = new Character(settings,
+				RVec3(r.position[0], r.position[1], r.position[2]), Quat::sIdentity(),
+				0, physicsSystem);
+			c->AddToPhysicsSystem();
+			characters.push_back(c);
+			break;
+		}
+		case PHYSICS_RECORD_CHARACTER_STATE: {
+			PhysicsRecordCharacterState r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			if (r.characterIndex >= characters.size()) {
+				fprintf(stderr, "[Replay] State for unknown character %u.\n", r.characterIndex);
+				ok = 0;
+				break;
+			}
+			Character* c = characters[r.characterIndex];
+			c->SetRotation(Quat(r.rotation[0], r.rotation[1], r.rotation[2], r.rotation[3]));
+			c->SetLinearVelocity(Vec3(r.velocity[0], r.velocity[1], r.velocity[2]));
+			break;
+		}
+		case PHYSICS_RECORD_ADD_VIRTUAL_CHARACTER: {
+			PhysicsRecordAddVirtualCharacter r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			characterHandles[r.handle] = characterPool->create(
+				RVec3(r.position[0], r.position[1], r.position[2]), r.radius, r.height);
+			break;
+		}
+		case PHYSICS_RECORD_REMOVE_VIRTUAL_CHARACTER: {
+			PhysicsRecordRemoveVirtualCharacter r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			auto it = characterHandles.find(r.handle);
+			if (it != characterHandles.end()) {
+				characterPool->destroy(it->second);
+				characterHandles.erase(it);
+			}
+			break;
+		}
+		case PHYSICS_RECORD_VIRTUAL_CHARACTER_INPUT: {
+			PhysicsRecordVirtualCharacterInput r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+			auto it = characterHandles.find(r.handle);
+			if (it == characterHandles.end()) {
+				fprintf(stderr, "[Replay] Input for unknown virtual character %u.\n", r.handle);
+				ok = 0;
+				break;
+			}
+			characterPool->set_input(it->second,
+				Vec3(r.desiredVelocity[0], r.desiredVelocity[1], r.desiredVelocity[2]),
+				Quat(r.rotation[0], r.rotation[1], r.rotation[2], r.rotation[3]));
+			break;
+		}
+		case PHYSICS_RECORD_OPTIMIZE_BROADPHASE:
+			physicsSystem->OptimizeBroadPhase();
+			break;
+		case PHYSICS_RECORD_STEP: {
+			PhysicsRecordStep r;
+			if (!(ok = read_record(file, &r, sizeof(r)))) {
+				break;
+			}
+
+			auto start = std::chrono::high_resolution_clock::now();
+			characterPool->update(r.dt);
+			physicsSystem->Update(r.dt, pHeader->collisionSteps, pTempAllocator, pJobSystem);
+			for (size_t i = 0; i < characters.size(); i++) {
+				characters[i]->PostSimulation(0.05f);
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			pResult->stepTimes.push_back(
+				std::chrono::duration<float, std::milli>(end - start).count());
+
+			if (hash_physics_state(physicsSystem, characterPool) != r.stateHash) {
+				if (pResult->mismatches == 0) {
+					pResult->firstMismatch = r.stepIndex;
+				}
+				pResult->mismatches++;
+			}
+			break;
+		}
+		default:
+			fprintf(stderr, "[Replay] Unknown record type %u.\n", type);
+			ok = 0;
+			break;
+		}
+	}
+
+	// A short read is the only failure that leaves us at the end of the
+	// file, everything else stops on a record that was read in full
+	if (!ok && feof(file)) {
+		pResult->truncated = 1;
+		// The loop has already stepped past the record that failed
+		pResult->truncatedRecord = recordIndex - 1;
+		ok = 1;
+	}
+
+	for (size_t i = 0; i < characters.size(); i++) {
+		characters[i]->RemoveFromPhysicsSystem();
+		delete characters[i];
+	}
+	characterPool->deinit();
+	delete characterPool;
+	delete physicsSystem;
+	return ok;
+}
+
+static void
+print_timings(std::vector<float> stepTimes) {
+	if (stepTimes.empty()) {
+		fprintf(stderr, "[Replay] No steps recorded.\n");
+		return;
+	}
+
+	float total = 0.f;
+	for (size_t i = 0; i < stepTimes.size(); i++) {
+		total += stepTimes[i];
+	}
+
+	// Worst steps first, these are the spikes we are after
+	std::vector<size_t> order(stepTimes.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return stepTimes[a] > stepTimes[b];
+	});
+	size_t worst = order.size() < 5 ? order.size() : 5;
+	for (size_t i = 0; i < worst; i++) {
+		fprintf(stderr, "[Replay]   step %6zu: %8.3f ms\n", order[i], stepTimes[order[i]]);
+	}
+
+	std::sort(stepTimes.begin(), stepTimes.end());
+	size_t n = stepTimes.size();
+	fprintf(stderr, "[Replay] %zu steps, total %.2f ms, min %.3f, avg %.3f, "
+		"median %.3f, p99 %.3f, max %.3f ms\n",
+		n, total, stepTimes[0], total / n, stepTimes[n / 2],
+		stepTimes[(n * 99) / 100 < n ? (n * 99) / 100 : n - 1], stepTimes[n - 1]);
+}
+
+int
+main(int argc, char* argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: physics_replay <recording> [--threads N] [--repeat N]\n");
+		return 2;
+	}
+
+	const char* path = argv[1];
+	uint32_t threads = 0;
+	uint32_t repeat = 1;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			threads = (uint32_t)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+			repeat = (uint32_t)atoi(argv[++i]);
+		}
+	}
+
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr) {
+		fprintf(stderr, "[Replay] Failed to open %s.\n", path);
+		return 2;
+	}
+
+	PhysicsRecordHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 ||
+		header.magic != PHYSICS_RECORD_MAGIC ||
+		header.version != PHYSICS_RECORD_VERSION) {
+		fprintf(stderr, "[Replay] %s is not a physics recording (or an old version).\n", path);
+		fclose(file);
+		return 2;
+	}
+	long recordStart = ftell(file);
+
+	RegisterDefaultAllocator();
+	Factory::sInstance = new Factory();
+	RegisterTypes();
+
+	JobScheduler scheduler;
+	JobSchedulerInfo jobInfo = {};
+	jobInfo.threadCount = threads;
+	scheduler.init(&jobInfo);
+
+	TempAllocatorImpl* tempAllocator = new TempAllocatorImpl(TEMP_ALLOC_SIZE);
+	JoltJobSystem* jobSystem = new JoltJobSystem(&scheduler, cMaxPhysicsJobs, cMaxPhysicsBarriers);
+
+	int exitCode = 0;
+	for (uint32_t run = 0; run < repeat; run++) {
+		fseek(file, recordStart, SEEK_SET);
+
+		ReplayResult result;
+		if (!replay(file, &header, &scheduler, jobSystem, tempAllocator, &result)) {
+			fprintf(stderr, "[Replay] Recording is corrupt.\n");
+			exitCode = 2;
+			break;
+		}
+
+		fprintf(stderr, "[Replay] Run %u:\n", run);
+		if (result.truncated) {
+			fprintf(stderr, "[Replay] Log truncated at record %u, replayed %zu steps before it.\n",
+				result.truncatedRecord, result.stepTimes.size());
+		}
+		print_timings(result.stepTimes);
+		if (result.mismatches > 0) {
+			fprintf(stderr, "[Replay] DIVERGED: %u of %zu steps mismatched, first at step %u.\n",
+				result.mismatches, result.stepTimes.size(), result.firstMismatch);
+			exitCode = 1;
+		} else {
+			fprintf(stderr, "[Replay] Deterministic, all state hashes match.\n");
+		}
+	}
+
+	delete jobSystem;
+	delete tempAllocator;
+	scheduler.deinit();
+
+	UnregisterTypes();
+	delete Factory::sInstance;
+	Factory::sInstance = nullptr;
+
+	fclose(file);
+	return exitCode;
+}
@@ -0,0 +1,292 @@
+/*
+* texture_cooker - converts PNGs (anything stb_image reads) into .vtex files
+* (core/texture_file.h): block compressed, with the whole mip chain built
+* offline so the renderer only has to copy the file into a staging buffer.
+*
+*	texture_cooker [--format bc1|bc3|bc4|bc5|bc7|rgba8] [--linear] [--cube]
+*		[--no-mips] [--verify] -o out.vtex in.png [in.png ...]
+*
+* --cube takes six faces in +X, -X, +Y, -Y, +Z, -Z order (right, left, top,
+* bottom, front, back). Color data is treated as sRGB unless --linear is
+* given, BC4/BC5 are always linear. --verify decodes level 0 again and
+* prints the PSNR of the channels the format keeps.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "../core/job_system.h"
+#include "../core/texture_compress.h"
+#include "../core/texture_file.h"
+
+// Block rows per job, a 1024 wide BC7 level is ~4 KB of output per row
+#define COOKER_ROWS_PER_JOB	4
+
+struct CookerOptions {
+	TextureFileFormat		format = TEXTURE_FORMAT_BC7;
+	uint32_t				linear = 0;
+	uint32_t				cube = 0;
+	uint32_t				mips = 1;
+	uint32_t				verify = 0;
+	const char*				pOutput = nullptr;
+	std::vector<const char*> inputs;
+};
+
+struct CompressJob {
+	TextureFileFormat		format;
+	const uint8_t*			pRgba;
+	uint32_t				width;
+	uint32_t				height;
+	uint8_t*				pOut;
+};
+
+static const char* FORMAT_NAMES[TEXTURE_FORMAT_COUNT] = {
+	"rgba8", "bc1", "bc3", "bc4", "bc5", "bc7"
+};
+
+static float gSrgbToLinear[256];
+
+static uint8_t
+linear_to_srgb(float value) {
+	value = value < 0.f ? 0.f : (value > 1.f ? 1.f : value);
+	float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+	return (uint8_t)(srgb * 255.f + 0.5f);
+}
+
+// 2x2 box filter. Odd sizes clamp, so the last row/column is weighted
+// twice, which is good enough for the rare non power of two texture.
+static void
+downsample(const uint8_t* pSrc, uint32_t width, uint32_t height, uint32_t srgb,
+	uint8_t* pDst) {
+	uint32_t dstWidth = width > 1 ? width / 2 : 1;
+	uint32_t dstHeight = height > 1 ? height / 2 : 1;
+	for (uint32_t y = 0; y < dstHeight; y++) {
+		for (uint32_t x = 0; x < dstWidth; x++) {
+			uint32_t x0 = x * 2, x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+			uint32_t y0 = y * 2, y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+			const uint8_t* texels[4] = {
+				&pSrc[((size_t)y0 * width + x0) * 4], &pSrc[((size_t)y0 * width + x1) * 4],
+				&pSrc[((size_t)y1 * width + x0) * 4], &pSrc[((size_t)y1 * width + x1) * 4]
+			};
+			uint8_t* out = &pDst[((size_t)y * dstWidth + x) * 4];
+			for (uint32_t c = 0; c < 4; c++) {
+				// Alpha is always linear
+				if (srgb && c < 3) {
+					float sum = 0.f;
+					for (uint32_t t = 0; t < 4; t++) {
+						sum += gSrgbToLinear[texels[t][c]];
+					}
+					out[c] = linear_to_srgb(sum * 0.25f);
+				} else {
+					uint32_t sum = 0;
+					for (uint32_t t = 0; t < 4; t++) {
+						sum += texels[t][c];
+					}
+					out[c] = (uint8_t)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+static void
+compress_rows(uint32_t begin, uint32_t end, void* pData) {
+	CompressJob* job = static_cast<CompressJob*>(pData);
+	texture_compress_rows(job->format, job->pRgba, job->width, job->height, begin,
+		end - begin, job->pOut);
+}
+
+static double
+channel_psnr(TextureFileFormat format, const uint8_t* pSource, const uint8_t* pDecoded,
+	size_t texelCount) {
+	uint32_t channels = 4;
+	if (format == TEXTURE_FORMAT_BC1) {
+		channels = 3;
+	} else if (format == TEXTURE_FORMAT_BC4) {
+		channels = 1;
+	} else if (format == TEXTURE_FORMAT_BC5) {
+		channels = 2;
+	}
+
+	double error = 0.0;
+	for (size_t i = 0; i < texelCount; i++) {
+		for (uint32_t c = 0; c < channels; c++) {
+			double diff = (double)pSource[i * 4 + c] - pDecoded[i * 4 + c];
+			error += diff * diff;
+		}
+	}
+	double mse = error / ((double)texelCount * channels);
+	return mse == 0.0 ? INFINITY : 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+static uint32_t
+parse_args(int argc, char** argv, CookerOptions* pOptions) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+			const char* name = argv[++i];
+			uint32_t found = 0;
+			for (uint32_t f = 0; f < TEXTURE_FORMAT_COUNT; f++) {
+				if (strcmp(name, FORMAT_NAMES[f]) == 0) {
+					pOptions->format = (TextureFileFormat)f;
+					found = 1;
+				}
+			}
+			if (!found) {
+				fprintf(stderr, "[Cooker] Unknown format '%s'.\n", name);
+				return 1;
+			}
+		} else if (strcmp(argv[i], "--linear") == 0) {
+			pOptions->linear = 1;
+		} else if (strcmp(argv[i], "--cube") == 0) {
+			pOptions->cube = 1;
+		} else if (strcmp(argv[i], "--no-mips") == 0) {
+			pOptions->mips = 0;
+		} else if (strcmp(argv[i], "--verify") == 0) {
+			pOptions->verify = 1;
+		} else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			pOptions->pOutput = argv[++i];
+		} else if (argv[i][0] == '-') {
+			return 1;
+		} else {
+			pOptions->inputs.push_back(argv[i]);
+		}
+	}
+
+	uint32_t expected = pOptions->cube ? 6 : 1;
+	if (pOptions->pOutput == nullptr || pOptions->inputs.size() != expected) {
+		return 1;
+	}
+	if (pOptions->format == TEXTURE_FORMAT_BC4 || pOptions->format == TEXTURE_FORMAT_BC5) {
+		pOptions->linear = 1;
+	}
+	return 0;
+}
+
+int
+main(int argc, char** argv) {
+	CookerOptions options;
+	if (parse_args(argc, argv, &options)) {
+		fprintf(stderr, "usage: texture_cooker [--format bc1|bc3|bc4|bc5|bc7|rgba8] "
+			"[--linear] [--cube] [--no-mips] [--verify] -o out.vtex in.png [...]\n");
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		float value = i / 255.f;
+		gSrgbToLinear[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	uint32_t layerCount = (uint32_t)options.inputs.size();
+	std::vector<uint8_t*> layers(layerCount);
+	int width = 0, height = 0;
+	for (uint32_t i = 0; i < layerCount; i++) {
+		int layerWidth, layerHeight, channels;
+		layers[i] = stbi_load(options.inputs[i], &layerWidth, &layerHeight, &channels,
+			STBI_rgb_alpha);
+		if (layers[i] == nullptr) {
+			fprintf(stderr, "[Cooker] Failed to load %s: %s\n", options.inputs[i],
+				stbi_failure_reason());
+			return 1;
+		}
+		if (i > 0 && (layerWidth != width || layerHeight != height)) {
+			fprintf(stderr, "[Cooker] %s is %dx%d, expected %dx%d like the other faces.\n",
+				options.inputs[i], layerWidth, layerHeight, width, height);
+			return 1;
+		}
+		width = layerWidth;
+		height = layerHeight;
+	}
+
+	TextureFileHeader header = {};
+	header.format = options.format;
+	header.flags = (options.linear ? 0u : (uint32_t)TEXTURE_FILE_SRGB) |
+		(options.cube ? (uint32_t)TEXTURE_FILE_CUBE : 0u);
+	header.width = (uint32_t)width;
+	header.height = (uint32_t)height;
+	header.layerCount = layerCount;
+	header.levelCount = 1;
+	if (options.mips) {
+		header.levelCount = (uint32_t)floor(log2(width > height ? width : height)) + 1;
+		if (header.levelCount > TEXTURE_FILE_MAX_LEVELS) {
+			header.levelCount = TEXTURE_FILE_MAX_LEVELS;
+		}
+	}
+
+	JobScheduler scheduler;
+	JobSchedulerInfo schedulerInfo = {};
+	scheduler.init(&schedulerInfo);
+
+	std::vector<std::vector<uint8_t>> levels(header.levelCount);
+	std::vector<uint8_t> current, next;
+	size_t uncompressedSize = 0;
+	for (uint32_t layer = 0; layer < layerCount; layer++) {
+		uint32_t levelWidth = header.width, levelHeight = header.height;
+		current.assign(layers[layer], layers[layer] + (size_t)levelWidth * levelHeight * 4);
+		for (uint32_t level = 0; level < header.levelCount; level++) {
+			size_t levelSize = texture_level_size(options.format, levelWidth, levelHeight);
+			levels[level].resize(levelSize * layerCount);
+			uncompressedSize += (size_t)levelWidth * levelHeight * 4;
+
+			CompressJob job = { options.format, current.data(), levelWidth, levelHeight,
+				levels[level].data() + levelSize * layer };
+			scheduler.parallel_for((levelHeight + 3) / 4, COOKER_ROWS_PER_JOB, compress_rows,
+				&job, JOB_PRIORITY_NORMAL);
+
+			if (level + 1 < header.levelCount) {
+				next.resize((size_t)(levelWidth > 1 ? levelWidth / 2 : 1) *
+					(levelHeight > 1 ? levelHeight / 2 : 1) * 4);
+				downsample(current.data(), levelWidth, levelHeight, !options.linear, next.data());
+				current.swap(next);
+				levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+				levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+			}
+		}
+	}
+
+	scheduler.deinit();
+
+	std::vector<const uint8_t*> levelData(header.levelCount);
+	for (uint32_t i = 0; i < header.levelCount; i++) {
+		levelData[i] = levels[i].data();
+	}
+	if (texture_file_write(options.pOutput, &header, levelData.data())) {
+		fprintf(stderr, "[Cooker] Failed to write %s\n", options.pOutput);
+		return 1;
+	}
+
+	float elapsedMs = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+	uint64_t fileSize = header.levels[header.levelCount - 1].offset +
+		header.levels[header.levelCount - 1].size;
+	printf("%s: %ux%u, %u layer(s), %u level(s), %s%s\n", options.pOutput, header.width,
+		header.height, layerCount, header.levelCount, FORMAT_NAMES[options.format],
+		options.linear ? "" : " (sRGB)");
+	printf("%.1f KB (%.1f KB as RGBA8, %.2fx smaller) in %.1f ms\n", fileSize / 1024.0,
+		uncompressedSize / 1024.0, (double)uncompressedSize / fileSize, elapsedMs);
+
+	if (options.verify) {
+		size_t texelCount = (size_t)header.width * header.height;
+		size_t levelSize = texture_level_size(options.format, header.width, header.height);
+		std::vector<uint8_t> decoded(texelCount * 4);
+		for (uint32_t layer = 0; layer < layerCount; layer++) {
+			texture_decompress(options.format, levels[0].data() + levelSize * layer,
+				header.width, header.height, decoded.data());
+			printf("layer %u: PSNR %.2f dB\n", layer,
+				channel_psnr(options.format, layers[layer], decoded.data(), texelCount));
+		}
+	}
+
+	for (uint32_t i = 0; i < layerCount; i++) {
+		stbi_image_free(layers[i]);
+	}
+	return 0;
+}